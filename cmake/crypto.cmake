@@ -33,6 +33,7 @@ target_include_directories(evercrypt.host PRIVATE ${EVERCRYPT_INC})
 
 set(CCFCRYPTO_SRC
   ${CCF_DIR}/src/crypto/hash.cpp
+  ${CCF_DIR}/src/crypto/sha256batch.cpp
   ${CCF_DIR}/src/crypto/symmkey.cpp
 )
 
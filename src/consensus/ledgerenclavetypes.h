@@ -10,12 +10,14 @@ namespace consensus
   /// Consensus-related ringbuffer messages
   enum : ringbuffer::Message
   {
-    /// Request individual log entries. Enclave -> Host
-    DEFINE_RINGBUFFER_MSG_TYPE(ledger_get),
+    /// Request a range of log entries. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_get_range),
 
     ///@{
-    /// Respond to log_get. Host -> Enclave
-    DEFINE_RINGBUFFER_MSG_TYPE(ledger_entry),
+    /// Respond to ledger_get_range, with one or more chunks of consecutive
+    /// framed entries, followed by ledger_no_entry if the range extends past
+    /// the end of the ledger. Host -> Enclave
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_entries),
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_no_entry),
     ///@}
 
@@ -24,14 +26,53 @@ namespace consensus
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_append),
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_truncate),
     ///@}
+
+    /// Entries up to this index have been synced to disk, or written if the
+    /// host does not sync the ledger. Host -> Enclave
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_durable),
+
+    /// The local log is empty and starts after this index, at which the
+    /// node's state was restored from a snapshot. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_init),
+
+    ///@{
+    /// Write a snapshot at an index, as one or more chunks followed by
+    /// snapshot_commit once all chunks have been written. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(snapshot_put_chunk),
+    DEFINE_RINGBUFFER_MSG_TYPE(snapshot_commit),
+    ///@}
+
+    /// Request the latest snapshot. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(snapshot_get),
+
+    ///@{
+    /// Respond to snapshot_get, with the chunks of the latest snapshot in
+    /// order, followed by snapshot_end. If there is no snapshot, only
+    /// snapshot_end is sent, with index 0. Host -> Enclave
+    DEFINE_RINGBUFFER_MSG_TYPE(snapshot_chunk),
+    DEFINE_RINGBUFFER_MSG_TYPE(snapshot_end),
+    ///@}
   };
 }
 
-DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::ledger_get, consensus::Index);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
-  consensus::ledger_entry, std::vector<uint8_t>);
-DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::ledger_no_entry);
+  consensus::ledger_get_range, consensus::Index, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_entries, consensus::Index, std::vector<uint8_t>);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_no_entry, consensus::Index);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   consensus::ledger_append, std::vector<uint8_t>);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   consensus::ledger_truncate, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_durable, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::ledger_init, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::snapshot_put_chunk, consensus::Index, std::vector<uint8_t>);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::snapshot_commit, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::snapshot_get);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::snapshot_chunk, consensus::Index, std::vector<uint8_t>);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::snapshot_end, consensus::Index);
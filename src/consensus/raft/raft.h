@@ -13,6 +13,7 @@
 #include <deque>
 #include <list>
 #include <random>
+#include <set>
 #include <unordered_map>
 #include <vector>
 
@@ -45,6 +46,190 @@ namespace raft
     }
   };
 
+  // Sizes of the uncommitted entries in the log, by which append entries are
+  // batched. The sizes of other entries are estimated from the average size of
+  // all entries added since the sizes were last reset.
+  class EntrySizes
+  {
+    // Assumed size of entries when no entry size is known
+    static constexpr size_t default_entry_size = 1024;
+
+    // Index at which the sizes were last reset
+    Index origin_idx = 1;
+    // Index of the first entry whose size is known
+    Index first_idx = 1;
+    // Total size of the entries from origin_idx to first_idx - 1
+    size_t base = 0;
+    // Total size of the entries from origin_idx to each known entry
+    std::deque<size_t> ends;
+
+    Index next_idx() const
+    {
+      return first_idx + ends.size();
+    }
+
+    size_t end_of(Index idx) const
+    {
+      return idx < first_idx ? base : ends.at(idx - first_idx);
+    }
+
+  public:
+    void reset(Index idx)
+    {
+      origin_idx = idx;
+      first_idx = idx;
+      base = 0;
+      ends.clear();
+    }
+
+    void append(Index idx, size_t size)
+    {
+      if (idx != next_idx())
+        reset(idx);
+
+      ends.push_back((ends.empty() ? base : ends.back()) + size);
+    }
+
+    void truncate(Index idx)
+    {
+      // Forget the sizes of the entries after idx
+      if (idx < first_idx)
+      {
+        reset(idx + 1);
+        return;
+      }
+
+      while (next_idx() > idx + 1)
+        ends.pop_back();
+    }
+
+    void compact(Index idx)
+    {
+      // Forget the sizes of the entries up to idx
+      while (!ends.empty() && first_idx <= idx)
+      {
+        base = ends.front();
+        ends.pop_front();
+        first_idx++;
+      }
+    }
+
+    size_t average() const
+    {
+      auto count = next_idx() - origin_idx;
+      if (count == 0)
+        return default_entry_size;
+
+      return std::max<size_t>((ends.empty() ? base : ends.back()) / count, 1);
+    }
+
+    // Total size of the entries from start_idx to end_idx
+    size_t size(Index start_idx, Index end_idx) const
+    {
+      if (end_idx < start_idx)
+        return 0;
+
+      if (start_idx < first_idx || end_idx >= next_idx())
+        return (end_idx - start_idx + 1) * average();
+
+      return end_of(end_idx) - end_of(start_idx - 1);
+    }
+
+    // The last index of a batch of entries from start_idx to at most
+    // max_idx, whose total size is at most size_limit. A batch holds at least
+    // one entry.
+    Index batch_end(Index start_idx, Index max_idx, size_t size_limit) const
+    {
+      if (start_idx < first_idx || start_idx >= next_idx())
+      {
+        // Batches of entries of unknown size stop at the first known entry
+        Index count = std::max<size_t>(size_limit / average(), 1);
+        Index end_idx = start_idx + count - 1;
+        if (start_idx < first_idx)
+          end_idx = std::min(end_idx, first_idx - 1);
+        return std::min(end_idx, max_idx);
+      }
+
+      auto limit = end_of(start_idx - 1) + size_limit;
+      auto it = std::upper_bound(
+        ends.begin() + (start_idx - first_idx), ends.end(), limit);
+      Index end_idx = first_idx + (it - ends.begin()) - 1;
+      return std::min(std::max(end_idx, start_idx), max_idx);
+    }
+  };
+
+  // Match indices of the nodes of a configuration, from which the highest
+  // index replicated on a majority of them is known at any time. The indices
+  // are split between the majority of highest indices and the others, so that
+  // a node's index is updated in logarithmic time.
+  class MatchQuorum
+  {
+    std::unordered_map<NodeId, Index> match;
+    std::multiset<Index> majority;
+    std::multiset<Index> minority;
+
+    std::multiset<Index>& side(Index idx)
+    {
+      if (!majority.empty() && idx < *majority.begin())
+        return minority;
+      return majority;
+    }
+
+    void transfer(
+      std::multiset<Index>& from,
+      std::multiset<Index>& to,
+      std::multiset<Index>::iterator it)
+    {
+      // Indices are moved between sides without being reallocated
+      to.insert(from.extract(it));
+    }
+
+    void rebalance()
+    {
+      auto majority_size = match.size() - (match.size() - 1) / 2;
+
+      while (majority.size() > majority_size)
+        transfer(majority, minority, majority.begin());
+
+      while (majority.size() < majority_size)
+        transfer(minority, majority, std::prev(minority.end()));
+    }
+
+  public:
+    MatchQuorum(const std::unordered_map<NodeId, Index>& match_) :
+      match(match_)
+    {
+      for (auto& m : match)
+        side(m.second).insert(m.second);
+
+      rebalance();
+    }
+
+    void update(NodeId node_id, Index idx)
+    {
+      // Nodes that are not part of the configuration are ignored
+      auto it = match.find(node_id);
+      if (it == match.end() || it->second == idx)
+        return;
+
+      auto& from = side(it->second);
+      auto n = from.extract(from.find(it->second));
+      n.value() = idx;
+      it->second = idx;
+      side(idx).insert(std::move(n));
+      rebalance();
+    }
+
+    // The highest index replicated on a majority of the nodes
+    Index confirmed() const
+    {
+      if (majority.empty())
+        return std::numeric_limits<Index>::max();
+
+      return *majority.begin();
+    }
+  };
+
   template <class LedgerProxy, class ChannelProxy>
   class Raft
   {
@@ -62,12 +247,24 @@ namespace raft
       Index match_idx;
       // the highest index sent to the node
       Index sent_idx;
+      // the last index of each append entries sent to the node and not yet
+      // acknowledged
+      std::deque<Index> inflight = {};
+      // the index from which entries were last resent to the node, after it
+      // failed to append them
+      Index resent_idx = 0;
+      // time since the node last acknowledged entries
+      std::chrono::milliseconds since_ack = std::chrono::milliseconds(0);
+      // whether the node is far enough behind to be sent larger batches
+      bool catching_up = false;
     };
 
     struct Configuration
     {
       Index idx;
       std::unordered_set<NodeId> nodes;
+      // Match indices of the nodes, local node included
+      MatchQuorum quorum;
     };
 
     SpinLock lock;
@@ -97,15 +294,25 @@ namespace raft
     std::list<Configuration> configurations;
     std::unordered_map<NodeId, NodeState> nodes;
 
-    size_t entry_size_not_limited = 0;
-    size_t entry_count = 0;
-    Index entries_batch_size = 1;
-    static constexpr int batch_window_size = 100;
-    int batch_window_sum = 0;
+    // Append entries are batched by size, and each follower has at most
+    // max_inflight_append_entries batches sent to it and not yet acknowledged.
+    // Followers that are further behind than that are caught up with batches
+    // catch_up_factor times larger.
+    static constexpr size_t catch_up_factor = 16;
+    size_t append_entries_size_limit;
+    size_t max_inflight_append_entries;
+    EntrySizes entry_sizes;
+    // Size of the entries replicated since append entries were last sent
+    size_t unsent_size = 0;
 
     // Indices that are eligible for global commit, from a Node's perspective
     std::deque<Index> committable_indices;
 
+    // Entries recorded to the ledger by a follower but not yet applied to the
+    // store. They are applied when the leader's commit index reaches them, or
+    // on the next tick.
+    std::deque<std::pair<Index, std::vector<uint8_t>>> unapplied_entries;
+
     // When this is set, only public domain is deserialised when receving append
     // entries
     bool public_only = false;
@@ -120,7 +327,6 @@ namespace raft
     std::default_random_engine rand;
 
   public:
-    static constexpr size_t append_entries_size_limit = 20000;
     std::unique_ptr<LedgerProxy> ledger;
     std::shared_ptr<ChannelProxy> channels;
 
@@ -132,7 +338,10 @@ namespace raft
       NodeId id,
       std::chrono::milliseconds request_timeout_,
       std::chrono::milliseconds election_timeout_,
-      bool public_only_ = false) :
+      bool public_only_ = false,
+      size_t append_entries_size_limit_ = default_append_entries_size_limit,
+      size_t max_inflight_append_entries_ =
+        default_max_inflight_append_entries) :
       store(std::move(store)),
 
       current_term(0),
@@ -148,6 +357,8 @@ namespace raft
 
       request_timeout(request_timeout_),
       election_timeout(election_timeout_),
+      append_entries_size_limit(append_entries_size_limit_),
+      max_inflight_append_entries(max_inflight_append_entries_),
       public_only(public_only_),
 
       ledger(std::move(ledger_)),
@@ -255,6 +466,19 @@ namespace raft
       become_leader();
     }
 
+    void init_from_snapshot(Index index, Term term)
+    {
+      // This should only be called before the node has received any entry,
+      // once its store has been restored from a snapshot at index. Entries
+      // are then only accepted after index.
+      std::lock_guard<SpinLock> guard(lock);
+      current_term = term;
+      last_idx = index;
+      commit_idx = index;
+      term_history.update(index, term);
+      LOG_INFO_FMT("Starting from snapshot at {} in term {}", index, term);
+    }
+
     Index get_last_idx()
     {
       return last_idx;
@@ -281,7 +505,20 @@ namespace raft
     void add_configuration(Index idx, std::unordered_set<NodeId> conf)
     {
       // This should only be called when the spin lock is held.
-      configurations.push_back({idx, move(conf)});
+      std::unordered_map<NodeId, Index> match;
+      for (auto node_id : conf)
+      {
+        if (node_id == local_id)
+          match[node_id] = last_idx;
+        else
+        {
+          auto node = nodes.find(node_id);
+          match[node_id] = node == nodes.end() ? 0 : node->second.match_idx;
+        }
+      }
+
+      MatchQuorum quorum(match);
+      configurations.push_back({idx, std::move(conf), std::move(quorum)});
       create_and_remove_node_state();
     }
 
@@ -331,19 +568,17 @@ namespace raft
 
         last_idx = index;
         auto s = replicate_to_ledger(data);
-        entry_size_not_limited += s;
-        entry_count++;
+        entry_sizes.append(index, s);
+        unsent_size += s;
 
         term_history.update(index, current_term);
-        if (entry_size_not_limited >= append_entries_size_limit)
+        if (unsent_size >= append_entries_size_limit)
         {
-          update_batch_size();
-          entry_count = 0;
-          entry_size_not_limited = 0;
-          for (const auto& it : nodes)
+          unsent_size = 0;
+          for (auto& it : nodes)
           {
             LOG_DEBUG_FMT("Sending updates to follower {}", it.first);
-            send_append_entries(it.first, it.second.sent_idx + 1);
+            send_pending_append_entries(it.first, it.second);
           }
         }
       }
@@ -398,18 +633,40 @@ namespace raft
         if (timeout_elapsed >= request_timeout)
         {
           using namespace std::chrono_literals;
+          const auto since_last = timeout_elapsed;
           timeout_elapsed = 0ms;
+          unsent_size = 0;
 
-          update_batch_size();
-          // Send newly available entries to all nodes.
-          for (const auto& it : nodes)
+          // Send newly available entries to all nodes, or a heartbeat to
+          // those that cannot be sent more entries yet.
+          for (auto& it : nodes)
           {
-            send_append_entries(it.first, it.second.sent_idx + 1);
+            auto& node = it.second;
+            node.since_ack += since_last;
+            if (!node.inflight.empty() && node.since_ack >= election_timeout)
+            {
+              // The node has not acknowledged entries for so long that they
+              // are assumed to be lost. Resend them.
+              LOG_INFO_FMT(
+                "No acknowledgement from {} since {}, resending",
+                it.first,
+                node.match_idx);
+              send_append_entries(it.first, node.match_idx + 1);
+            }
+            else if (!send_pending_append_entries(it.first, node))
+            {
+              // An empty append entries after the last index sent, which the
+              // node acknowledges once it has received all entries before it
+              send_append_entries_range(
+                it.first, node.sent_idx + 1, node.sent_idx);
+            }
           }
         }
       }
       else
       {
+        apply_entries(last_idx);
+
         if (timeout_elapsed >= election_timeout)
         {
           // Start an election.
@@ -419,22 +676,6 @@ namespace raft
     }
 
   private:
-    inline void update_batch_size()
-    {
-      auto avg_entry_size = (entry_count == 0) ?
-        append_entries_size_limit :
-        entry_size_not_limited / entry_count;
-
-      auto batch_size = (avg_entry_size == 0) ?
-        append_entries_size_limit / 2 :
-        append_entries_size_limit / avg_entry_size;
-
-      auto batch_avg = batch_window_sum / batch_window_size;
-      // balance out total batch size across batch window
-      batch_window_sum += (batch_size - batch_avg);
-      entries_batch_size = std::max((batch_window_sum / batch_window_size), 1);
-    }
-
     Term get_term_internal(Index idx)
     {
       if (idx > last_idx)
@@ -445,20 +686,50 @@ namespace raft
 
     void send_append_entries(NodeId to, Index start_idx)
     {
-      Index end_idx = (last_idx == 0) ?
-        0 :
-        std::min(start_idx + entries_batch_size, last_idx);
+      // Forget what was sent to the node, and send it entries from start_idx
+      auto& node = nodes.at(to);
+      node.inflight.clear();
+      node.sent_idx = start_idx - 1;
+      node.since_ack = std::chrono::milliseconds(0);
 
-      for (Index i = end_idx; i < last_idx; i += entries_batch_size)
-      {
-        send_append_entries_range(to, start_idx, i);
-        start_idx = std::min(i + 1, last_idx);
-      }
+      if (!send_pending_append_entries(to, node))
+        send_append_entries_range(to, start_idx, start_idx - 1);
+    }
 
-      if (last_idx == 0 || end_idx <= last_idx)
+    bool send_pending_append_entries(NodeId to, NodeState& node)
+    {
+      // Send the node batches of the entries it has not been sent yet, until
+      // it has max_inflight_append_entries batches in flight. Returns true if
+      // any entries were sent.
+      bool sent = false;
+      while (node.sent_idx < last_idx &&
+             node.inflight.size() < max_inflight_append_entries)
       {
-        send_append_entries_range(to, start_idx, last_idx);
+        const auto start_idx = node.sent_idx + 1;
+        const auto catching_up =
+          entry_sizes.size(start_idx, last_idx) >
+          max_inflight_append_entries * append_entries_size_limit;
+        if (catching_up != node.catching_up)
+        {
+          LOG_INFO_FMT(
+            "{} catching up {} from {} to {}",
+            catching_up ? "Start" : "Stop",
+            to,
+            start_idx,
+            last_idx);
+          node.catching_up = catching_up;
+        }
+
+        const auto end_idx = entry_sizes.batch_end(
+          start_idx,
+          last_idx,
+          catching_up ? append_entries_size_limit * catch_up_factor :
+                        append_entries_size_limit);
+        send_append_entries_range(to, start_idx, end_idx);
+        node.inflight.push_back(end_idx);
+        sent = true;
       }
+      return sent;
     }
 
     void send_append_entries_range(NodeId to, Index start_idx, Index end_idx)
@@ -490,8 +761,13 @@ namespace raft
       node.sent_idx = end_idx;
 
       // The host will append log entries to this message when it is
-      // sent to the destination node.
-      channels->send_authenticated(ccf::NodeMsgType::consensus_msg, to, ae);
+      // sent to the destination node. Messages without entries, such as
+      // heartbeats, may be coalesced with others sent to the same node.
+      if (end_idx < start_idx)
+        channels->send_authenticated_coalesced(
+          ccf::NodeMsgType::consensus_msg, to, ae);
+      else
+        channels->send_authenticated(ccf::NodeMsgType::consensus_msg, to, ae);
     }
 
     void recv_append_entries(const uint8_t* data, size_t size)
@@ -645,13 +921,52 @@ namespace raft
 
           last_idx = r.prev_idx;
           ledger->truncate(r.prev_idx);
+          entry_sizes.truncate(r.prev_idx);
+          while (!unapplied_entries.empty() &&
+                 unapplied_entries.back().first > r.prev_idx)
+            unapplied_entries.pop_back();
           send_append_entries_response(r.from_node, false);
           return;
         }
 
+        entry_sizes.append(i, ret.first.size());
+        unapplied_entries.emplace_back(i, std::move(ret.first));
+
+        // While only the public domain is deserialised, applying an entry may
+        // suspend replication after it, so entries are applied as they are
+        // received.
+        if (public_only)
+          apply_entries(i);
+      }
+
+      // Update the current leader because we accepted entries.
+      if (leader_id != r.from_node)
+      {
+        leader_id = r.from_node;
+        LOG_DEBUG_FMT("Node {} thinks leader is {}", local_id, leader_id);
+      }
+
+      // Entries are acknowledged once they are recorded to the ledger, and
+      // only need to be applied to the store before they are committed.
+      send_append_entries_response(r.from_node, true);
+      apply_entries(r.leader_commit_idx);
+      commit_if_possible(r.leader_commit_idx);
+
+      term_history.update(commit_idx + 1, r.term_of_idx);
+    }
+
+    void apply_entries(Index idx)
+    {
+      // Apply the entries recorded to the ledger, up to idx, to the store
+      while (!unapplied_entries.empty() &&
+             unapplied_entries.front().first <= idx)
+      {
+        auto [i, entry] = std::move(unapplied_entries.front());
+        unapplied_entries.pop_front();
+
         Term sig_term = 0;
         auto deserialise_success =
-          store->deserialise(ret.first, public_only, &sig_term);
+          store->deserialise(entry, public_only, &sig_term);
 
         switch (deserialise_success)
         {
@@ -671,18 +986,6 @@ namespace raft
             break;
         }
       }
-
-      // Update the current leader because we accepted entries.
-      if (leader_id != r.from_node)
-      {
-        leader_id = r.from_node;
-        LOG_DEBUG_FMT("Node {} thinks leader is {}", local_id, leader_id);
-      }
-
-      send_append_entries_response(r.from_node, true);
-      commit_if_possible(r.leader_commit_idx);
-
-      term_history.update(commit_idx + 1, r.term_of_idx);
     }
 
     void send_append_entries_response(NodeId to, bool answer)
@@ -697,7 +1000,7 @@ namespace raft
       AppendEntriesResponse response = {
         raft_append_entries_response, local_id, current_term, last_idx, answer};
 
-      channels->send_authenticated(
+      channels->send_authenticated_coalesced(
         ccf::NodeMsgType::consensus_msg, to, response);
     }
 
@@ -754,16 +1057,30 @@ namespace raft
       }
 
       // Update next and match for the responding node.
-      node->second.match_idx = std::min(r.last_log_idx, last_idx);
+      auto& ns = node->second;
+      const auto prev_match_idx = ns.match_idx;
+      update_match_idx(r.from_node, ns, std::min(r.last_log_idx, last_idx));
 
       if (!r.success)
       {
+        if (!ns.inflight.empty() && ns.match_idx + 1 == ns.resent_idx)
+        {
+          // Entries are already being resent from that index. This responds
+          // to an append entries sent before them.
+          LOG_DEBUG_FMT(
+            "Recv append entries response to {} from {}: failed, resending",
+            local_id,
+            r.from_node);
+          return;
+        }
+
         // Failed due to log inconsistency. Reset sent_idx and try again.
         LOG_DEBUG_FMT(
           "Recv append entries response to {} from {}: failed",
           local_id,
           r.from_node);
-        send_append_entries(r.from_node, node->second.match_idx + 1);
+        ns.resent_idx = ns.match_idx + 1;
+        send_append_entries(r.from_node, ns.resent_idx);
         return;
       }
 
@@ -772,7 +1089,22 @@ namespace raft
         local_id,
         r.from_node,
         r.last_log_idx);
+
+      // Acknowledged batches make room for more.
+      if (ns.match_idx > prev_match_idx)
+        ns.since_ack = std::chrono::milliseconds(0);
+
+      while (!ns.inflight.empty() && ns.inflight.front() <= ns.match_idx)
+        ns.inflight.pop_front();
+
+      ns.sent_idx = std::max(ns.sent_idx, ns.match_idx);
+
       update_commit();
+
+      // Committing may have removed the node from the configuration.
+      node = nodes.find(r.from_node);
+      if (node != nodes.end())
+        send_pending_append_entries(r.from_node, node->second);
     }
 
     void send_request_vote(NodeId to)
@@ -987,7 +1319,7 @@ namespace raft
 
       for (auto it = nodes.begin(); it != nodes.end(); ++it)
       {
-        it->second.match_idx = 0;
+        update_match_idx(it->first, it->second, 0);
         it->second.sent_idx = next - 1;
 
         // Send an empty append_entries to all nodes.
@@ -1021,6 +1353,14 @@ namespace raft
         become_leader();
     }
 
+    void update_match_idx(NodeId node_id, NodeState& node, Index idx)
+    {
+      node.match_idx = idx;
+
+      for (auto& c : configurations)
+        c.quorum.update(node_id, idx);
+    }
+
     void update_commit()
     {
       // If there exists some idx in the current term such that
@@ -1032,19 +1372,8 @@ namespace raft
       {
         // The majority must be checked separately for each active
         // configuration.
-        std::vector<Index> match;
-        match.reserve(c.nodes.size() + 1);
-
-        for (auto node : c.nodes)
-        {
-          if (node == local_id)
-            match.push_back(last_idx);
-          else
-            match.push_back(nodes.at(node).match_idx);
-        }
-
-        sort(match.begin(), match.end());
-        auto confirmed = match.at((match.size() - 1) / 2);
+        c.quorum.update(local_id, last_idx);
+        auto confirmed = c.quorum.confirmed();
 
         if (confirmed < new_commit_idx)
           new_commit_idx = confirmed;
@@ -1101,6 +1430,7 @@ namespace raft
 
       LOG_DEBUG_FMT("Compacting...");
       store->compact(idx);
+      entry_sizes.compact(idx);
       LOG_DEBUG_FMT("Commit on {}: {}", local_id, idx);
 
       // Examine all configurations that are followed by a globally committed
@@ -1132,7 +1462,11 @@ namespace raft
     {
       store->rollback(idx);
       ledger->truncate(idx);
+      entry_sizes.truncate(idx);
       last_idx = idx;
+
+      while (!unapplied_entries.empty() && unapplied_entries.back().first > idx)
+        unapplied_entries.pop_back();
       LOG_DEBUG_FMT("Rolled back at {}", idx);
 
       while (!committable_indices.empty() && (committable_indices.back() > idx))
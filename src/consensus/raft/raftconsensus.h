@@ -49,6 +49,11 @@ namespace raft
       raft->force_become_leader(seqno, view, terms, commit_seqno);
     }
 
+    void init_from_snapshot(SeqNo seqno, View view) override
+    {
+      raft->init_from_snapshot(seqno, view);
+    }
+
     bool replicate(const kv::BatchVector& entries) override
     {
       return raft->replicate(entries);
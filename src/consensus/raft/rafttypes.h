@@ -18,11 +18,28 @@ namespace raft
 
   static constexpr NodeId NoNode = std::numeric_limits<NodeId>::max();
 
+  static constexpr size_t default_append_entries_size_limit = 20000;
+  static constexpr size_t default_max_inflight_append_entries = 4;
+
   struct Config
   {
     size_t request_timeout;
     size_t election_timeout;
-    MSGPACK_DEFINE(request_timeout, election_timeout);
+    // Maximum size, in bytes, of the entries sent in one append entries
+    size_t append_entries_size_limit = default_append_entries_size_limit;
+    // Maximum number of append entries sent to a follower and not yet
+    // acknowledged by it
+    size_t max_inflight_append_entries = default_max_inflight_append_entries;
+    // Whether heartbeats and append entries responses sent to the same node
+    // within a tick are authenticated and sent together, at the end of the
+    // tick
+    bool coalesce_messages = false;
+    MSGPACK_DEFINE(
+      request_timeout,
+      election_timeout,
+      append_entries_size_limit,
+      max_inflight_append_entries,
+      coalesce_messages);
   };
 
   template <typename S>
@@ -67,6 +67,19 @@ int main(int argc, char** argv)
           stoi(items[2]),
           vector<uint8_t>(items[3].begin(), items[3].end()));
         break;
+      case shash("replicate_many"):
+        assert(items.size() == 4);
+        driver->replicate_many(
+          stoi(items[1]), stoul(items[2]), stoul(items[3]));
+        break;
+      case shash("throughput"):
+        assert(items.size() == 3);
+        driver->throughput(stoul(items[1]), stoul(items[2]));
+        break;
+      case shash("catch_up"):
+        assert(items.size() == 2);
+        driver->catch_up(stoi(items[1]));
+        break;
       case shash("disconnect"):
         assert(items.size() == 3);
         driver->disconnect(stoi(items[1]), stoi(items[2]));
@@ -6,6 +6,7 @@
 #include "ds/logger.h"
 
 #include <chrono>
+#include <iostream>
 #include <set>
 #include <sstream>
 #include <string>
@@ -32,6 +33,68 @@ private:
   std::unordered_map<raft::NodeId, NodeDriver> _nodes;
   std::set<std::pair<raft::NodeId, raft::NodeId>> _connections;
 
+  static constexpr ms request_timeout = ms(10);
+
+  // Measured scenarios give up after this many rounds
+  static constexpr size_t max_rounds = 100000;
+
+  // Silences the messages logged by the driver and the stubs while measured
+  // scenarios run
+  class Silence
+  {
+    std::streambuf* buf;
+
+  public:
+    Silence() : buf(std::cout.rdbuf(nullptr)) {}
+
+    ~Silence()
+    {
+      std::cout.rdbuf(buf);
+      std::cout.clear();
+    }
+  };
+
+  struct Progress
+  {
+    size_t rounds = 0;
+    size_t append_entries = 0;
+  };
+
+  using Clock = std::chrono::high_resolution_clock;
+
+  static double ms_since(Clock::time_point start)
+  {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+  }
+
+  std::shared_ptr<TRaft> leader_raft()
+  {
+    for (auto& node : _nodes)
+    {
+      if (node.second.raft->is_leader())
+        return node.second.raft;
+    }
+    throw std::logic_error("No leader");
+  }
+
+  // In each round, the leader's request timeout elapses, and the messages
+  // sent by all nodes are dispatched once, until done() holds
+  template <typename Done>
+  Progress run_rounds(std::shared_ptr<TRaft> leader, Done done)
+  {
+    Progress p;
+    while (!done() && p.rounds++ < max_rounds)
+    {
+      leader->periodic(request_timeout);
+      for (auto& node : _nodes)
+        p.append_entries +=
+          node.second.raft->channels->sent_append_entries.size();
+      dispatch_all_once();
+    }
+    return p;
+  }
+
 public:
   RaftDriver(size_t number_of_nodes)
   {
@@ -47,7 +110,7 @@ public:
         std::make_unique<raft::LedgerStubProxy>(node_id),
         std::make_shared<raft::ChannelStubProxy>(),
         node_id,
-        ms(10),
+        request_timeout,
         ms(i * 100));
 
       _nodes.emplace(node_id, NodeDriver{kv, raft});
@@ -224,6 +287,68 @@ public:
     _nodes.at(node_id).raft->replicate(kv::BatchVector{{idx, data, true}});
   }
 
+  void replicate_many(raft::NodeId node_id, size_t count, size_t size)
+  {
+    std::cout << "  KV" << node_id << "->>Node" << node_id
+              << ": replicate " << count << " entries of size " << size
+              << std::endl;
+    Silence s;
+    auto raft = _nodes.at(node_id).raft;
+    const std::vector<uint8_t> data(size, 0);
+    for (size_t i = 0; i < count; ++i)
+      raft->replicate(kv::BatchVector{{raft->get_last_idx() + 1, data, true}});
+  }
+
+  void throughput(size_t count, size_t size)
+  {
+    // Replicates count entries of size bytes on the leader, and runs rounds
+    // until they are committed
+    auto leader = leader_raft();
+    Progress p;
+    double elapsed;
+    {
+      Silence s;
+      auto start = Clock::now();
+      const std::vector<uint8_t> data(size, 0);
+      for (size_t i = 0; i < count; ++i)
+        leader->replicate(
+          kv::BatchVector{{leader->get_last_idx() + 1, data, true}});
+      auto target = leader->get_last_idx();
+      p = run_rounds(
+        leader, [&]() { return leader->get_commit_idx() >= target; });
+      elapsed = ms_since(start);
+    }
+
+    std::cout << "  Note right of Node" << leader->id() << ": committed "
+              << count << " entries of size " << size << " in " << p.rounds
+              << " rounds, " << p.append_entries << " append entries, "
+              << elapsed << " ms (" << (count * 1000 / elapsed)
+              << " entries/s)" << std::endl;
+  }
+
+  void catch_up(raft::NodeId node_id)
+  {
+    // Runs rounds until the node has all the entries of the leader
+    auto leader = leader_raft();
+    auto raft = _nodes.at(node_id).raft;
+    auto target = leader->get_last_idx();
+    auto start_idx = raft->get_last_idx();
+    Progress p;
+    double elapsed;
+    {
+      Silence s;
+      auto start = Clock::now();
+      p = run_rounds(
+        leader, [&]() { return raft->get_last_idx() >= target; });
+      elapsed = ms_since(start);
+    }
+
+    std::cout << "  Note right of Node" << node_id << ": caught up from "
+              << start_idx << " to " << raft->get_last_idx() << " in "
+              << p.rounds << " rounds, " << p.append_entries
+              << " append entries, " << elapsed << " ms" << std::endl;
+  }
+
   void disconnect(raft::NodeId left, raft::NodeId right)
   {
     bool noop = true;
@@ -111,6 +111,13 @@ namespace raft
       sent_append_entries_response.push_back(std::make_pair(to, data));
     }
 
+    template <class T>
+    void send_authenticated_coalesced(
+      const ccf::NodeMsgType& msg_type, NodeId to, const T& data)
+    {
+      send_authenticated(msg_type, to, data);
+    }
+
     size_t sent_msg_count() const
     {
       return sent_request_vote.size() + sent_request_vote_response.size() +
@@ -130,6 +137,9 @@ namespace raft
     raft::NodeId _id;
 
   public:
+    // Number of entries applied to the store
+    size_t deserialise_count = 0;
+
     LoggingStubStore(raft::NodeId id) : _id(id) {}
 
     virtual void compact(Index i)
@@ -153,6 +163,7 @@ namespace raft
       bool public_only = false,
       Term* term = nullptr)
     {
+      deserialise_count++;
       return kv::DeserialiseSuccess::PASS;
     }
   };
@@ -167,6 +178,7 @@ namespace raft
       bool public_only = false,
       Term* term = nullptr) override
     {
+      deserialise_count++;
       return kv::DeserialiseSuccess::PASS_SIGNATURE;
     }
   };
@@ -606,6 +606,90 @@ TEST_CASE("Recv append entries logic" * doctest::test_suite("multiple"))
   }
 }
 
+TEST_CASE(
+  "Followers acknowledge entries before applying them" *
+  doctest::test_suite("multiple"))
+{
+  auto kv_store0 = std::make_shared<StoreSig>(0);
+  auto kv_store1 = std::make_shared<StoreSig>(1);
+
+  raft::NodeId node_id0(0);
+  raft::NodeId node_id1(1);
+
+  ms request_timeout(10);
+
+  TRaft r0(
+    std::make_unique<Adaptor>(kv_store0),
+    std::make_unique<raft::LedgerStubProxy>(node_id0),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id0,
+    request_timeout,
+    ms(20));
+  TRaft r1(
+    std::make_unique<Adaptor>(kv_store1),
+    std::make_unique<raft::LedgerStubProxy>(node_id1),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id1,
+    request_timeout,
+    ms(100));
+
+  std::unordered_set<raft::NodeId> config0 = {node_id0, node_id1};
+  r0.add_configuration(0, config0);
+  r1.add_configuration(0, config0);
+
+  map<raft::NodeId, TRaft*> nodes;
+  nodes[node_id0] = &r0;
+  nodes[node_id1] = &r1;
+
+  r0.periodic(std::chrono::milliseconds(200));
+  REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_request_vote));
+  REQUIRE(1 == dispatch_all(nodes, r1.channels->sent_request_vote_response));
+  REQUIRE(r0.is_leader());
+  REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  REQUIRE(1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+
+  INFO("Node 1 acknowledges an entry without applying it");
+  {
+    std::vector<uint8_t> entry = {1, 1, 1};
+    REQUIRE(r0.replicate(kv::BatchVector{{1, entry, true}}));
+    r0.periodic(request_timeout);
+    REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+    REQUIRE(r1.ledger->ledger.size() == 1);
+    REQUIRE(kv_store1->deserialise_count == 0);
+    REQUIRE(
+      1 ==
+      dispatch_all_and_check(
+        nodes,
+        r1.channels->sent_append_entries_response,
+        [](const auto& msg) {
+          REQUIRE(msg.last_log_idx == 1);
+          REQUIRE(msg.success);
+        }));
+    REQUIRE(r0.get_commit_idx() == 1);
+    REQUIRE(r1.get_commit_idx() == 0);
+  }
+
+  INFO("Node 1 applies the entry once Node 0 tells it that it is committed");
+  {
+    r0.periodic(request_timeout);
+    REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+    REQUIRE(kv_store1->deserialise_count == 1);
+    REQUIRE(r1.get_commit_idx() == 1);
+  }
+
+  INFO("Node 1 applies uncommitted entries on its next tick");
+  {
+    std::vector<uint8_t> entry = {2, 2, 2};
+    REQUIRE(r0.replicate(kv::BatchVector{{2, entry, true}}));
+    r0.periodic(request_timeout);
+    REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+    REQUIRE(kv_store1->deserialise_count == 1);
+    r1.periodic(ms(1));
+    REQUIRE(kv_store1->deserialise_count == 2);
+    REQUIRE(r1.get_commit_idx() == 1);
+  }
+}
+
 TEST_CASE("Exceed append entries limit")
 {
   auto kv_store0 = std::make_shared<Store>(0);
@@ -668,7 +752,7 @@ TEST_CASE("Exceed append entries limit")
   // large entries of size (append_entries_size_limit / 2), so 2nd and 4th entry
   // will exceed append entries limit size which means that 2nd and 4th entries
   // will trigger send_append_entries()
-  std::vector<uint8_t> data((r0.append_entries_size_limit / 2), 1);
+  std::vector<uint8_t> data((raft::default_append_entries_size_limit / 2), 1);
   // I want to get ~500 messages sent over 1mill entries
   auto individual_entries = 1000000;
   auto num_small_entries_sent = 500;
@@ -691,15 +775,30 @@ TEST_CASE("Exceed append entries limit")
     msg_response = !msg_response;
   }
 
-  int data_size = (num_small_entries_sent * r0.append_entries_size_limit) /
+  int data_size =
+    (num_small_entries_sent * raft::default_append_entries_size_limit) /
     (individual_entries - num_big_entries);
   std::vector<uint8_t> smaller_data(data_size, 1);
   for (size_t i = num_big_entries + 1; i <= individual_entries; ++i)
   {
     REQUIRE(r0.replicate(kv::BatchVector{{i, smaller_data, true}}));
     dispatch_all(nodes, r0.channels->sent_append_entries);
+    dispatch_all(nodes, r1.channels->sent_append_entries_response);
   }
 
+  INFO("Node 0 sends Node 1 the rest of the entries once it is idle");
+  r0.periodic(request_timeout);
+  REQUIRE(
+    1 ==
+    dispatch_all_and_check(
+      nodes,
+      r0.channels->sent_append_entries,
+      [&individual_entries](const auto& msg) {
+        REQUIRE(msg.idx == individual_entries);
+      }));
+  REQUIRE(r1.ledger->ledger.size() == individual_entries);
+  dispatch_all(nodes, r1.channels->sent_append_entries_response);
+
   INFO("Node 2 joins the ensemble");
 
   std::unordered_set<raft::NodeId> config1 = {node_id0, node_id1, node_id2};
@@ -732,15 +831,18 @@ TEST_CASE("Exceed append entries limit")
   r2.channels->sent_append_entries_response.pop_front();
   r0.recv_message(reinterpret_cast<uint8_t*>(&aer), sizeof(aer));
 
-  REQUIRE(
-    (r0.channels->sent_append_entries.size() > num_small_entries_sent &&
-     r0.channels->sent_append_entries.size() <=
-       num_small_entries_sent + num_big_entries));
-  auto sent_entries = dispatch_all(nodes, r0.channels->sent_append_entries);
-  REQUIRE(
-    (sent_entries > num_small_entries_sent &&
-     sent_entries <= num_small_entries_sent + num_big_entries));
+  INFO("Node 0 streams large batches to Node 2, a window at a time");
+  size_t sent_entries = 0;
+  while (r0.channels->sent_append_entries.size() > 0)
+  {
+    REQUIRE(
+      r0.channels->sent_append_entries.size() <=
+      raft::default_max_inflight_append_entries);
+    sent_entries += dispatch_all(nodes, r0.channels->sent_append_entries);
+    dispatch_all(nodes, r2.channels->sent_append_entries_response);
+  }
   REQUIRE(r2.ledger->ledger.size() == individual_entries);
+  REQUIRE(sent_entries < num_small_entries_sent / 4);
 }
 
 // Reproduces issue described here: https://github.com/microsoft/CCF/issues/521
@@ -969,4 +1071,39 @@ TEST_CASE(
     CHECK(r2.get_commit_idx() == 2);
     CHECK(r2.get_last_idx() == 3);
   }
-}
\ No newline at end of file
+}
+TEST_CASE("Match quorum" * doctest::test_suite("commit"))
+{
+  std::mt19937 rng(0);
+
+  for (size_t n = 1; n <= 15; ++n)
+  {
+    std::unordered_map<raft::NodeId, raft::Index> match;
+    for (raft::NodeId i = 0; i < n; ++i)
+      match[i] = 0;
+
+    raft::MatchQuorum quorum(match);
+    REQUIRE(quorum.confirmed() == 0);
+
+    INFO("The confirmed index is the highest replicated on a majority");
+    for (size_t i = 0; i < 1000; ++i)
+    {
+      raft::NodeId node_id = rng() % n;
+      raft::Index idx = rng() % 20;
+      match[node_id] = idx;
+      quorum.update(node_id, idx);
+
+      std::vector<raft::Index> sorted;
+      for (auto& m : match)
+        sorted.push_back(m.second);
+      std::sort(sorted.begin(), sorted.end());
+
+      REQUIRE(quorum.confirmed() == sorted.at((n - 1) / 2));
+    }
+
+    INFO("Nodes outside the configuration are ignored");
+    auto confirmed = quorum.confirmed();
+    quorum.update(n, 100);
+    REQUIRE(quorum.confirmed() == confirmed);
+  }
+}
@@ -0,0 +1,80 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT
+#include "consensus/raft/raft.h"
+#include "logging_stub.h"
+
+#include <chrono>
+#include <picobench/picobench.hpp>
+
+using ms = std::chrono::milliseconds;
+using TRaft = raft::Raft<raft::LedgerStubProxy, raft::ChannelStubProxy>;
+using Store = raft::LoggingStubStore;
+using Adaptor = raft::Adaptor<Store, kv::DeserialiseSuccess>;
+
+// Cost of handling the append entries responses of the followers on a leader,
+// each of which may advance the commit index
+template <size_t N>
+static void append_entries_response(picobench::state& s)
+{
+  raft::NodeId leader_id = 0;
+  TRaft r0(
+    std::make_unique<Adaptor>(std::make_shared<Store>(leader_id)),
+    std::make_unique<raft::LedgerStubProxy>(leader_id),
+    std::make_shared<raft::ChannelStubProxy>(),
+    leader_id,
+    ms(10),
+    ms(100));
+
+  std::unordered_set<raft::NodeId> config;
+  for (raft::NodeId i = 0; i < N; ++i)
+    config.insert(i);
+  r0.add_configuration(0, config);
+  r0.force_become_leader();
+
+  std::vector<uint8_t> entry(64, 0);
+  kv::BatchVector entries;
+  for (size_t i = 1; i <= s.iterations(); ++i)
+    entries.emplace_back(i, entry, true);
+  r0.replicate(entries);
+
+  // Followers acknowledge entries in turn
+  std::vector<raft::AppendEntriesResponse> responses;
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    raft::AppendEntriesResponse r = {raft::raft_append_entries_response,
+                                     (raft::NodeId)(1 + i % (N - 1)),
+                                     r0.get_term(),
+                                     i + 1,
+                                     true};
+    responses.push_back(r);
+  }
+  r0.channels->sent_append_entries.clear();
+
+  s.start_timer();
+  for (auto& r : responses)
+    r0.recv_message(reinterpret_cast<uint8_t*>(&r), sizeof(r));
+  s.stop_timer();
+
+  // All but the entries acknowledged by a minority of followers are committed
+  if (r0.get_commit_idx() + N < s.iterations())
+    throw std::logic_error("Entries were not committed");
+}
+
+const std::vector<int> response_count = {1000, 10000};
+
+PICOBENCH_SUITE("append_entries_response");
+PICOBENCH(append_entries_response<3>).iterations(response_count).baseline();
+PICOBENCH(append_entries_response<5>).iterations(response_count);
+PICOBENCH(append_entries_response<7>).iterations(response_count);
+PICOBENCH(append_entries_response<11>).iterations(response_count);
+PICOBENCH(append_entries_response<15>).iterations(response_count);
+
+int main(int argc, char* argv[])
+{
+  logger::config::level() = logger::FATAL;
+
+  picobench::runner runner;
+  runner.parse_cmd_line(argc, argv);
+  return runner.run();
+}
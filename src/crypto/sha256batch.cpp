@@ -0,0 +1,319 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#include "hash.h"
+
+#include <cstring>
+
+extern "C"
+{
+#include <evercrypt/EverCrypt_AutoConfig2.h>
+#include <evercrypt/EverCrypt_Hash.h>
+}
+
+#if defined(__x86_64__)
+#  include <immintrin.h>
+#endif
+
+// Hashes many buffers at once, interleaving their blocks in the lanes of a
+// vectorised compression kernel. On CPUs with the SHA extensions, EverCrypt's
+// implementation, which uses them, is at least as fast as compressing blocks
+// of several buffers together, so buffers are then hashed one at a time.
+//
+// evercrypt_sha256 hashes the bytes of a buffer following its last whole
+// block as if they were at the start of the buffer: the message that is
+// hashed is the whole blocks of the buffer, followed by as many bytes from
+// the start of the buffer as there are trailing bytes. This is the same as
+// SHA-256 for buffers smaller than a block, or made of whole blocks, and it
+// is what is reproduced here, so that both functions give the same hashes.
+
+namespace
+{
+  constexpr size_t block_size = 64;
+
+  const uint32_t k256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+  const uint32_t h256[8] = {0x6a09e667,
+                            0xbb67ae85,
+                            0x3c6ef372,
+                            0xa54ff53a,
+                            0x510e527f,
+                            0x9b05688c,
+                            0x1f83d9ab,
+                            0x5be0cd19};
+
+  // A buffer being hashed in a lane: its whole blocks, read in place, then
+  // the last one or two blocks, with the padding
+  struct Job
+  {
+    const uint8_t* data;
+    size_t blocks;
+    uint8_t tail[2 * block_size];
+    size_t tail_blocks;
+    size_t next;
+    uint32_t state[8];
+    crypto::Sha256Hash* out;
+
+    void start(CBuffer buffer, crypto::Sha256Hash* out_)
+    {
+      data = buffer.p;
+      blocks = buffer.n / block_size;
+      next = 0;
+      out = out_;
+      std::memcpy(state, h256, sizeof(state));
+
+      size_t rest = buffer.n % block_size;
+      tail_blocks = rest + 9 <= block_size ? 1 : 2;
+      std::memset(tail, 0, sizeof(tail));
+      if (rest != 0)
+        std::memcpy(tail, buffer.p, rest);
+      tail[rest] = 0x80;
+      uint64_t bits = buffer.n * 8;
+      for (size_t i = 0; i < 8; ++i)
+        tail[tail_blocks * block_size - 1 - i] = bits >> (i * 8);
+    }
+
+    const uint8_t* block() const
+    {
+      return next < blocks ? data + next * block_size :
+                             tail + (next - blocks) * block_size;
+    }
+
+    // Returns true once the last block has been compressed
+    bool advance()
+    {
+      if (++next < blocks + tail_blocks)
+        return false;
+
+      for (size_t i = 0; i < 8; ++i)
+      {
+        out->h[4 * i] = state[i] >> 24;
+        out->h[4 * i + 1] = state[i] >> 16;
+        out->h[4 * i + 2] = state[i] >> 8;
+        out->h[4 * i + 3] = state[i];
+      }
+      return true;
+    }
+  };
+
+  // Runs the buffers through a kernel that compresses one block in each of
+  // Lanes states at a time. Idle lanes compress a scratch block.
+  template <size_t Lanes, class Compress>
+  void hash_lanes(
+    const CBuffer* buffers,
+    size_t n,
+    crypto::Sha256Hash* hs,
+    Compress compress)
+  {
+    Job jobs[Lanes];
+    bool busy[Lanes] = {};
+    size_t started = 0;
+
+    uint32_t idle_state[8];
+    const uint8_t idle_block[block_size] = {};
+
+    while (true)
+    {
+      size_t active = 0;
+      uint32_t* states[Lanes];
+      const uint8_t* blocks[Lanes];
+      for (size_t l = 0; l < Lanes; ++l)
+      {
+        if (!busy[l] && started < n)
+        {
+          jobs[l].start(buffers[started], &hs[started]);
+          busy[l] = true;
+          started++;
+        }
+
+        if (busy[l])
+        {
+          active++;
+          states[l] = jobs[l].state;
+          blocks[l] = jobs[l].block();
+        }
+        else
+        {
+          states[l] = idle_state;
+          blocks[l] = idle_block;
+        }
+      }
+
+      if (active == 0)
+        return;
+
+      compress(states, blocks);
+
+      for (size_t l = 0; l < Lanes; ++l)
+      {
+        if (busy[l] && jobs[l].advance())
+          busy[l] = false;
+      }
+    }
+  }
+
+#if defined(__x86_64__)
+  // Transposes 8 rows of 8 words, so that word i of row j becomes word j of
+  // row i
+  __attribute__((target("avx2"))) inline void transpose8(__m256i r[8])
+  {
+    __m256i t[8], u[8];
+    for (size_t i = 0; i < 4; ++i)
+    {
+      t[2 * i] = _mm256_unpacklo_epi32(r[2 * i], r[2 * i + 1]);
+      t[2 * i + 1] = _mm256_unpackhi_epi32(r[2 * i], r[2 * i + 1]);
+    }
+    for (size_t i = 0; i < 2; ++i)
+    {
+      u[4 * i] = _mm256_unpacklo_epi64(t[4 * i], t[4 * i + 2]);
+      u[4 * i + 1] = _mm256_unpackhi_epi64(t[4 * i], t[4 * i + 2]);
+      u[4 * i + 2] = _mm256_unpacklo_epi64(t[4 * i + 1], t[4 * i + 3]);
+      u[4 * i + 3] = _mm256_unpackhi_epi64(t[4 * i + 1], t[4 * i + 3]);
+    }
+    for (size_t i = 0; i < 4; ++i)
+    {
+      r[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+      r[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+    }
+  }
+
+  template <int n>
+  __attribute__((target("avx2"))) inline __m256i rotr(__m256i x)
+  {
+    return _mm256_or_si256(
+      _mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+  }
+
+  // Eight lanes with AVX2, one in each 32-bit element of the vectors
+  __attribute__((target("avx2"))) void compress_avx2_x8(
+    uint32_t* const states[8], const uint8_t* const blocks[8])
+  {
+    const __m256i bswap = _mm256_set_epi64x(
+      0x0c0d0e0f08090a0bULL,
+      0x0405060700010203ULL,
+      0x0c0d0e0f08090a0bULL,
+      0x0405060700010203ULL);
+
+    __m256i s[8], w[16];
+    for (size_t l = 0; l < 8; ++l)
+      s[l] = _mm256_loadu_si256((const __m256i*)states[l]);
+    transpose8(s);
+
+    for (size_t half = 0; half < 2; ++half)
+    {
+      for (size_t l = 0; l < 8; ++l)
+        w[8 * half + l] =
+          _mm256_loadu_si256((const __m256i*)(blocks[l] + 32 * half));
+      transpose8(&w[8 * half]);
+      for (size_t i = 0; i < 8; ++i)
+        w[8 * half + i] = _mm256_shuffle_epi8(w[8 * half + i], bswap);
+    }
+
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5],
+            g = s[6], h = s[7];
+
+    for (size_t t = 0; t < 64; ++t)
+    {
+      if (t >= 16)
+      {
+        const __m256i w15 = w[(t - 15) % 16];
+        const __m256i w2 = w[(t - 2) % 16];
+        const __m256i sigma0 = _mm256_xor_si256(
+          _mm256_xor_si256(rotr<7>(w15), rotr<18>(w15)),
+          _mm256_srli_epi32(w15, 3));
+        const __m256i sigma1 = _mm256_xor_si256(
+          _mm256_xor_si256(rotr<17>(w2), rotr<19>(w2)),
+          _mm256_srli_epi32(w2, 10));
+        w[t % 16] = _mm256_add_epi32(
+          _mm256_add_epi32(w[t % 16], sigma0),
+          _mm256_add_epi32(w[(t - 7) % 16], sigma1));
+      }
+
+      const __m256i big_sigma1 = _mm256_xor_si256(
+        _mm256_xor_si256(rotr<6>(e), rotr<11>(e)), rotr<25>(e));
+      const __m256i ch =
+        _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+      const __m256i t1 = _mm256_add_epi32(
+        _mm256_add_epi32(_mm256_add_epi32(h, big_sigma1), ch),
+        _mm256_add_epi32(_mm256_set1_epi32(k256[t]), w[t % 16]));
+
+      const __m256i big_sigma0 = _mm256_xor_si256(
+        _mm256_xor_si256(rotr<2>(a), rotr<13>(a)), rotr<22>(a));
+      const __m256i maj = _mm256_xor_si256(
+        _mm256_and_si256(a, b),
+        _mm256_and_si256(c, _mm256_xor_si256(a, b)));
+      const __m256i t2 = _mm256_add_epi32(big_sigma0, maj);
+
+      h = g;
+      g = f;
+      f = e;
+      e = _mm256_add_epi32(d, t1);
+      d = c;
+      c = b;
+      b = a;
+      a = _mm256_add_epi32(t1, t2);
+    }
+
+    s[0] = _mm256_add_epi32(s[0], a);
+    s[1] = _mm256_add_epi32(s[1], b);
+    s[2] = _mm256_add_epi32(s[2], c);
+    s[3] = _mm256_add_epi32(s[3], d);
+    s[4] = _mm256_add_epi32(s[4], e);
+    s[5] = _mm256_add_epi32(s[5], f);
+    s[6] = _mm256_add_epi32(s[6], g);
+    s[7] = _mm256_add_epi32(s[7], h);
+    transpose8(s);
+    for (size_t l = 0; l < 8; ++l)
+      _mm256_storeu_si256((__m256i*)states[l], s[l]);
+  }
+#endif
+
+  // One buffer at a time, without allocating a hash state for each
+  void evercrypt_sha256_each(
+    const CBuffer* buffers, size_t n, crypto::Sha256Hash* hs)
+  {
+    uint32_t buf[8];
+    EverCrypt_Hash_state_s state;
+    state.tag = EverCrypt_Hash_SHA2_256_s;
+    state.case_SHA2_256_s = buf;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+      auto data = const_cast<uint8_t*>(buffers[i].p);
+      EverCrypt_Hash_init(&state);
+      EverCrypt_Hash_update_multi(&state, data, buffers[i].n);
+      EverCrypt_Hash_update_last(&state, data, buffers[i].n);
+      EverCrypt_Hash_finish(&state, hs[i].h);
+    }
+  }
+}
+
+void crypto::Sha256Hash::evercrypt_sha256_batch(
+  const CBuffer* buffers, size_t n, Sha256Hash* hs)
+{
+#if defined(__x86_64__)
+  // Compressing 8 lanes with AVX2 takes about as long as compressing 2
+  // blocks one at a time
+  constexpr size_t min_avx2_batch = 3;
+
+  if (
+    n >= min_avx2_batch && !EverCrypt_AutoConfig2_has_shaext() &&
+    EverCrypt_AutoConfig2_has_avx2())
+  {
+    hash_lanes<8>(buffers, n, hs, compress_avx2_x8);
+    return;
+  }
+#endif
+
+  evercrypt_sha256_each(buffers, n, hs);
+}
@@ -102,6 +102,18 @@ namespace crypto
     }
   };
 
+  // An entry of a batch given to KeyAesGcm::encrypt_batch or decrypt_batch.
+  // The output buffer is provided by the caller, and is as large as the input.
+  // The tag is written on encryption, and checked on decryption.
+  struct GcmBatchEntry
+  {
+    CBuffer iv;
+    CBuffer aad;
+    CBuffer input;
+    uint8_t* output;
+    uint8_t* tag;
+  };
+
   class KeyAesGcm
   {
   private:
@@ -126,5 +138,11 @@ namespace crypto
       CBuffer cipher,
       CBuffer aad,
       uint8_t* plain) const;
+
+    void encrypt_batch(const GcmBatchEntry* entries, size_t n) const;
+
+    /// Returns false if any of the entries could not be decrypted, in which
+    /// case the content of the output buffers is unspecified.
+    bool decrypt_batch(const GcmBatchEntry* entries, size_t n) const;
   };
 }
@@ -7,6 +7,11 @@
 #include <doctest/doctest.h>
 #include <vector>
 
+extern "C"
+{
+#include <evercrypt/EverCrypt_AutoConfig2.h>
+}
+
 using namespace crypto;
 using namespace std;
 
@@ -70,4 +75,143 @@ TEST_CASE("EverCrypt SHA256 no-collision check")
   crypto::Sha256Hash::evercrypt_sha256({data1}, h1.h);
   crypto::Sha256Hash::evercrypt_sha256({data2}, h2.h);
   REQUIRE(h1 != h2);
-}
\ No newline at end of file
+}
+static void check_sha256_batch()
+{
+  // Sizes around one and two blocks, with their padding
+  std::vector<std::vector<uint8_t>> data;
+  for (size_t size : {0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 1000})
+  {
+    std::vector<uint8_t> d(size);
+    for (size_t i = 0; i < size; i++)
+      d[i] = i + size;
+    data.push_back(d);
+  }
+
+  std::vector<CBuffer> buffers(data.begin(), data.end());
+  for (size_t n = 0; n <= buffers.size(); n++)
+  {
+    std::vector<crypto::Sha256Hash> hs(n);
+    crypto::Sha256Hash::evercrypt_sha256_batch(buffers.data(), n, hs.data());
+    for (size_t i = 0; i < n; i++)
+    {
+      crypto::Sha256Hash h;
+      crypto::Sha256Hash::evercrypt_sha256({buffers[i]}, h.h);
+      REQUIRE(hs[i] == h);
+    }
+  }
+}
+
+TEST_CASE("EverCrypt SHA256 batch consistency test")
+{
+  ::EverCrypt_AutoConfig2_init();
+  check_sha256_batch();
+
+  INFO("Without SHA extensions");
+  ::EverCrypt_AutoConfig2_disable_shaext();
+  check_sha256_batch();
+
+  INFO("Without SHA extensions or AVX2");
+  ::EverCrypt_AutoConfig2_disable_avx2();
+  check_sha256_batch();
+
+  ::EverCrypt_AutoConfig2_init();
+}
+
+TEST_CASE("AES-GCM consistency with and without AES-NI")
+{
+  for (size_t key_size : {16, 32})
+  {
+    std::vector<uint8_t> raw_key(key_size);
+    for (size_t i = 0; i < key_size; i++)
+      raw_key[i] = i * 7 + 1;
+
+    ::EverCrypt_AutoConfig2_init();
+    KeyAesGcm k(raw_key);
+    ::EverCrypt_AutoConfig2_disable_aesni();
+    KeyAesGcm k_mbedtls(raw_key);
+    ::EverCrypt_AutoConfig2_init();
+
+    GcmHeader<> h;
+    h.setIvSeq(42);
+    h.setIvId(7);
+
+    // Sizes around one block, read at an offset that is not aligned
+    for (size_t size : {0, 1, 15, 16, 17, 100, 256, 4096})
+    {
+      for (size_t aad_size : {0, 5, 16, 33})
+      {
+        std::vector<uint8_t> plain(size + 1), aad(aad_size + 1);
+        for (size_t i = 0; i < plain.size(); i++)
+          plain[i] = i;
+        for (size_t i = 0; i < aad.size(); i++)
+          aad[i] = i ^ 0x5a;
+        CBuffer p{plain.data() + 1, size};
+        CBuffer a{aad.data() + 1, aad_size};
+
+        std::vector<uint8_t> cipher(size), cipher_mbedtls(size);
+        uint8_t tag[GCM_SIZE_TAG], tag_mbedtls[GCM_SIZE_TAG];
+        k.encrypt(h.getIv(), p, a, cipher.data(), tag);
+        k_mbedtls.encrypt(h.getIv(), p, a, cipher_mbedtls.data(), tag_mbedtls);
+        REQUIRE(cipher == cipher_mbedtls);
+        REQUIRE(memcmp(tag, tag_mbedtls, GCM_SIZE_TAG) == 0);
+
+        std::vector<uint8_t> decrypted(size);
+        REQUIRE(k.decrypt(h.getIv(), tag, cipher, a, decrypted.data()));
+        REQUIRE(std::equal(decrypted.begin(), decrypted.end(), p.p));
+
+        INFO("No plaintext is given back when the tag is invalid");
+        tag[0] ^= 1;
+        const std::vector<uint8_t> zeroes(size, 0);
+        for (auto key : {&k, &k_mbedtls})
+        {
+          std::vector<uint8_t> unauthenticated(size, 0xff);
+          REQUIRE_FALSE(key->decrypt(
+            h.getIv(), tag, cipher, a, unauthenticated.data()));
+          REQUIRE(unauthenticated == zeroes);
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("AES-GCM batch")
+{
+  KeyAesGcm k(getRawKey());
+
+  constexpr size_t n = 10;
+  std::vector<GcmHeader<>> headers(n);
+  std::vector<std::vector<uint8_t>> plains, ciphers, decrypted;
+  std::vector<GcmBatchEntry> batch;
+  for (size_t i = 0; i < n; i++)
+  {
+    headers[i].setIvSeq(i);
+    plains.emplace_back(i * 100, static_cast<uint8_t>(i));
+    ciphers.emplace_back(plains[i].size());
+    decrypted.emplace_back(plains[i].size());
+    batch.push_back({headers[i].getIv(),
+                     nullb,
+                     plains[i],
+                     ciphers[i].data(),
+                     headers[i].tag});
+  }
+  k.encrypt_batch(batch.data(), n);
+
+  for (size_t i = 0; i < n; i++)
+  {
+    REQUIRE(k.decrypt(
+      headers[i].getIv(),
+      headers[i].tag,
+      ciphers[i],
+      nullb,
+      decrypted[i].data()));
+
+    batch[i].input = ciphers[i];
+    batch[i].output = decrypted[i].data();
+  }
+  REQUIRE(k.decrypt_batch(batch.data(), n));
+  REQUIRE(decrypted == plains);
+
+  headers[n / 2].tag[0] ^= 1;
+  REQUIRE_FALSE(k.decrypt_batch(batch.data(), n));
+}
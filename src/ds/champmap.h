@@ -2,9 +2,15 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "sizeclasspool.h"
+
+#include <algorithm>
 #include <array>
-#include <memory>
+#include <atomic>
+#include <functional>
+#include <new>
 #include <optional>
+#include <stdexcept>
 #include <vector>
 
 namespace champ
@@ -69,16 +75,107 @@ namespace champ
     }
   };
 
+  // Nodes are reference counted intrusively, and allocated from a
+  // SizeClassPool, so that each node is a single allocation. Reference counts
+  // are atomic, since a map may be released by any of the threads it is
+  // shared with.
+  struct NodeBase
+  {
+    enum class Kind : uint8_t
+    {
+      Entry,
+      SubNodes,
+      Collisions
+    };
+
+    mutable std::atomic<uint32_t> refs;
+    const Kind kind;
+
+    NodeBase(Kind kind_) : refs(0), kind(kind_) {}
+
+    // Copies of a node are not referenced yet
+    NodeBase(const NodeBase& that) : refs(0), kind(that.kind) {}
+  };
+
   template <class K, class V, class H>
-  struct SubNodes;
+  class NodePtr
+  {
+  private:
+    NodeBase* p = nullptr;
+
+  public:
+    NodePtr() = default;
+
+    // Takes the first reference to a new node
+    explicit NodePtr(NodeBase* p_) : p(p_)
+    {
+      p->refs.store(1, std::memory_order_relaxed);
+    }
+
+    NodePtr(const NodePtr& that) : p(that.p)
+    {
+      if (p != nullptr)
+        p->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    NodePtr(NodePtr&& that) noexcept : p(that.p)
+    {
+      that.p = nullptr;
+    }
+
+    ~NodePtr()
+    {
+      reset();
+    }
+
+    NodePtr& operator=(NodePtr that) noexcept
+    {
+      std::swap(p, that.p);
+      return *this;
+    }
+
+    void reset();
+
+    template <class T>
+    T* as() const
+    {
+      return static_cast<T*>(p);
+    }
+
+    explicit operator bool() const
+    {
+      return p != nullptr;
+    }
+
+    // True if this is the only reference to the node, which may then be
+    // updated in place
+    bool unique() const
+    {
+      return p->refs.load(std::memory_order_acquire) == 1;
+    }
+  };
+
+  template <class T, class... Args>
+  T* make_node(Args&&... args)
+  {
+    return new (SizeClassPool::allocate(sizeof(T)))
+      T(std::forward<Args>(args)...);
+  }
+
+  template <class T>
+  void destroy_node(T* node)
+  {
+    node->~T();
+    SizeClassPool::deallocate(node, sizeof(T));
+  }
 
   template <class K, class V>
-  struct Entry
+  struct Entry : public NodeBase
   {
     K key;
     V value;
 
-    Entry(K k, V v) : key(k), value(v) {}
+    Entry(const K& k, const V& v) : NodeBase(Kind::Entry), key(k), value(v) {}
 
     const V* getp(const K& k) const
     {
@@ -90,12 +187,13 @@ namespace champ
   };
 
   template <class K, class V, class H>
-  using Node = std::shared_ptr<void>;
-
-  template <class K, class V, class H>
-  struct Collisions
+  struct Collisions : public NodeBase
   {
-    std::array<std::vector<std::shared_ptr<Entry<K, V>>>, collision_bins> bins;
+    using Ptr = NodePtr<K, V, H>;
+
+    std::array<std::vector<Ptr>, collision_bins> bins;
+
+    Collisions() : NodeBase(Kind::Collisions) {}
 
     const V* getp(Hash hash, const K& k) const
     {
@@ -103,8 +201,9 @@ namespace champ
       const auto& bin = bins[idx];
       for (const auto& node : bin)
       {
-        if (k == node->key)
-          return &node->value;
+        const auto entry = node.template as<Entry<K, V>>();
+        if (k == entry->key)
+          return &entry->value;
       }
       return nullptr;
     }
@@ -113,59 +212,242 @@ namespace champ
     {
       const auto idx = mask(hash, collision_depth);
       auto& bin = bins[idx];
-      for (size_t i = 0; i < bin.size(); ++i)
+      Ptr entry(make_node<Entry<K, V>>(k, v));
+      for (auto& node : bin)
       {
-        const auto& entry = bin[i];
-        if (k == entry->key)
+        if (k == node.template as<Entry<K, V>>()->key)
         {
-          bin[i] = std::make_shared<Entry<K, V>>(k, v);
+          node = std::move(entry);
           return false;
         }
       }
-      bin.push_back(std::make_shared<Entry<K, V>>(k, v));
+      bin.push_back(std::move(entry));
       return true;
     }
 
+    bool remove_mut(Hash hash, const K& k)
+    {
+      const auto idx = mask(hash, collision_depth);
+      auto& bin = bins[idx];
+      for (size_t i = 0; i < bin.size(); ++i)
+      {
+        if (k == bin[i].template as<Entry<K, V>>()->key)
+        {
+          bin.erase(bin.begin() + i);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    size_t size() const
+    {
+      size_t n = 0;
+      for (const auto& bin : bins)
+        n += bin.size();
+      return n;
+    }
+
+    const Ptr& first() const
+    {
+      for (const auto& bin : bins)
+      {
+        if (!bin.empty())
+          return bin.front();
+      }
+      throw std::logic_error("No entry in collision node");
+    }
+
     template <class F>
     bool foreach(F&& f) const
     {
       for (const auto& bin : bins)
       {
-        for (const auto& entry : bin)
+        for (const auto& node : bin)
+        {
+          const auto entry = node.template as<Entry<K, V>>();
           if (!f(entry->key, entry->value))
             return false;
+        }
       }
       return true;
     }
   };
 
   template <class K, class V, class H>
-  struct SubNodes
+  struct SubNodes : public NodeBase
   {
-    std::vector<Node<K, V, H>> nodes;
+    using Ptr = NodePtr<K, V, H>;
+
+    // The node is followed in memory by its children: its entries, in the
+    // order of data_map, and then its sub-nodes, in the order of node_map.
     Bitmap node_map;
     Bitmap data_map;
 
-    SubNodes() {}
-
-    SubNodes(std::vector<Node<K, V, H>> ns) : nodes(ns) {}
-
-    SubNodes(std::vector<Node<K, V, H>> ns, Bitmap nm, Bitmap dm) :
-      nodes(ns),
+  private:
+    SubNodes(Bitmap nm, Bitmap dm) :
+      NodeBase(Kind::SubNodes),
       node_map(nm),
       data_map(dm)
     {}
 
-    SmallIndex compressed_idx(SmallIndex idx) const
+    static size_t alloc_size(SmallIndex n)
+    {
+      return sizeof(SubNodes) + n * sizeof(Ptr);
+    }
+
+    // Returns an unreferenced node, whose children are not constructed yet
+    static SubNodes* allocate(Bitmap nm, Bitmap dm)
+    {
+      static_assert(sizeof(SubNodes) % alignof(Ptr) == 0);
+      const SmallIndex n = nm.pop() + dm.pop();
+      return new (SizeClassPool::allocate(alloc_size(n))) SubNodes(nm, dm);
+    }
+
+    static SmallIndex below(Bitmap bits, SmallIndex idx)
+    {
+      return (bits & Bitmap(~((uint32_t)-1 << idx))).pop();
+    }
+
+    // Returns a copy of this node, with bitmaps nm and dm, and child inserted
+    // at c_idx. The other children are moved from this node if steal is true.
+    SubNodes* with_inserted(
+      Bitmap nm, Bitmap dm, SmallIndex c_idx, Ptr&& child, bool steal)
+    {
+      auto node = make(nm, dm);
+      auto src = nodes();
+      auto dst = node->nodes();
+      const auto n = node->count();
+      for (SmallIndex i = 0, j = 0; j < n; ++j)
+      {
+        if (j == c_idx)
+          dst[j] = std::move(child);
+        else if (steal)
+          dst[j] = std::move(src[i++]);
+        else
+          dst[j] = src[i++];
+      }
+      return node;
+    }
+
+    // Returns a copy of this node, with bitmaps nm and dm, without the child
+    // at c_idx. The other children are moved from this node if steal is true.
+    SubNodes* with_removed(Bitmap nm, Bitmap dm, SmallIndex c_idx, bool steal)
+    {
+      auto node = make(nm, dm);
+      auto src = nodes();
+      auto dst = node->nodes();
+      const auto n = count();
+      for (SmallIndex i = 0, j = 0; i < n; ++i)
+      {
+        if (i == c_idx)
+          continue;
+        else if (steal)
+          dst[j++] = std::move(src[i]);
+        else
+          dst[j++] = src[i];
+      }
+      return node;
+    }
+
+    // Replaces the entry at idx with the sub-node child, or the sub-node at
+    // idx with the entry child, keeping the children in order. This node must
+    // not be shared.
+    void replace_moved(SmallIndex idx, Ptr&& child)
+    {
+      const auto old_c_idx = compressed_idx(idx);
+      if (data_map.check(idx))
+      {
+        data_map = data_map.clear(idx);
+        node_map = node_map.set(idx);
+      }
+      else
+      {
+        node_map = node_map.clear(idx);
+        data_map = data_map.set(idx);
+      }
+      const auto c_idx = compressed_idx(idx);
+
+      auto ns = nodes();
+      if (old_c_idx < c_idx)
+        std::rotate(ns + old_c_idx, ns + old_c_idx + 1, ns + c_idx + 1);
+      else if (c_idx < old_c_idx)
+        std::rotate(ns + c_idx, ns + old_c_idx, ns + old_c_idx + 1);
+      ns[c_idx] = std::move(child);
+    }
+
+    // Returns the node held by slot, which is first copied if it is shared
+    static SubNodes* own(Ptr& slot)
     {
-      if (!node_map.check(idx) && !data_map.check(idx))
-        return (SmallIndex)-1;
+      if (!slot.unique())
+        slot = Ptr(slot.template as<SubNodes>()->copy());
+      return slot.template as<SubNodes>();
+    }
+
+    static Collisions<K, V, H>* own_collisions(Ptr& slot)
+    {
+      if (!slot.unique())
+        slot = Ptr(make_node<Collisions<K, V, H>>(
+          *slot.template as<Collisions<K, V, H>>()));
+      return slot.template as<Collisions<K, V, H>>();
+    }
 
-      const auto mask = Bitmap(~((uint32_t)-1 << idx));
+  public:
+    // Children are not part of the object, and are copied by copy()
+    SubNodes(const SubNodes&) = delete;
+
+    // Returns an unreferenced node, whose children are empty
+    static SubNodes* make(Bitmap nm, Bitmap dm)
+    {
+      auto node = allocate(nm, dm);
+      const auto n = node->count();
+      for (SmallIndex i = 0; i < n; ++i)
+        new (&node->nodes()[i]) Ptr();
+      return node;
+    }
+
+    static void destroy(SubNodes* node)
+    {
+      const auto n = node->count();
+      for (SmallIndex i = 0; i < n; ++i)
+        node->nodes()[i].~Ptr();
+      node->~SubNodes();
+      SizeClassPool::deallocate(node, alloc_size(n));
+    }
+
+    SubNodes* copy() const
+    {
+      const auto n = count();
+      auto node = allocate(node_map, data_map);
+      for (SmallIndex i = 0; i < n; ++i)
+        new (&node->nodes()[i]) Ptr(nodes()[i]);
+      return node;
+    }
+
+    SmallIndex count() const
+    {
+      return node_map.pop() + data_map.pop();
+    }
+
+    Ptr* nodes()
+    {
+      return reinterpret_cast<Ptr*>(this + 1);
+    }
+
+    const Ptr* nodes() const
+    {
+      return reinterpret_cast<const Ptr*>(this + 1);
+    }
+
+    SmallIndex compressed_idx(SmallIndex idx) const
+    {
       if (data_map.check(idx))
-        return (data_map & mask).pop();
+        return below(data_map, idx);
 
-      return data_map.pop() + (node_map & mask).pop();
+      if (node_map.check(idx))
+        return data_map.pop() + below(node_map, idx);
+
+      return (SmallIndex)-1;
     }
 
     const V* getp(SmallIndex depth, Hash hash, const K& k) const
@@ -176,148 +458,192 @@ namespace champ
       if (c_idx == (SmallIndex)-1)
         return nullptr;
 
+      const auto& node = nodes()[c_idx];
       if (data_map.check(idx))
-        return node_as<Entry<K, V>>(c_idx)->getp(k);
+        return node.template as<Entry<K, V>>()->getp(k);
 
       if (depth == (collision_depth - 1))
-        return node_as<Collisions<K, V, H>>(c_idx)->getp(hash, k);
+        return node.template as<Collisions<K, V, H>>()->getp(hash, k);
 
-      return node_as<SubNodes<K, V, H>>(c_idx)->getp(depth + 1, hash, k);
+      return node.template as<SubNodes>()->getp(depth + 1, hash, k);
     }
 
-    bool put_mut(SmallIndex depth, Hash hash, const K& k, const V& v)
+    // Puts k and v in the trie held by slot, and returns true if k was not
+    // present. Nodes that are not shared with other tries are updated in
+    // place, and the others are copied.
+    static bool put(
+      Ptr& slot, SmallIndex depth, Hash hash, const K& k, const V& v)
     {
+      auto node = slot.template as<SubNodes>();
       const auto idx = mask(hash, depth);
-      auto c_idx = compressed_idx(idx);
+      const auto c_idx = node->compressed_idx(idx);
 
       if (c_idx == (SmallIndex)-1)
       {
-        data_map = data_map.set(idx);
-        c_idx = compressed_idx(idx);
-        nodes.insert(
-          nodes.begin() + c_idx, std::make_shared<Entry<K, V>>(k, v));
+        auto n = node->with_inserted(
+          node->node_map,
+          node->data_map.set(idx),
+          below(node->data_map, idx),
+          Ptr(make_node<Entry<K, V>>(k, v)),
+          slot.unique());
+        slot = Ptr(n);
         return true;
       }
 
-      if (node_map.check(idx))
+      node = own(slot);
+      auto& child = node->nodes()[c_idx];
+
+      if (node->node_map.check(idx))
       {
-        bool insert;
         if (depth < (collision_depth - 1))
-        {
-          auto sn = *node_as<SubNodes<K, V, H>>(c_idx);
-          insert = sn.put_mut(depth + 1, hash, k, v);
-          nodes[c_idx] = std::make_shared<SubNodes<K, V, H>>(std::move(sn));
-        }
+          return put(child, depth + 1, hash, k, v);
         else
-        {
-          auto sn = *node_as<Collisions<K, V, H>>(c_idx);
-          insert = sn.put_mut(hash, k, v);
-          nodes[c_idx] = std::make_shared<Collisions<K, V, H>>(std::move(sn));
-        }
-        return insert;
+          return own_collisions(child)->put_mut(hash, k, v);
       }
 
-      const auto& entry0 = node_as<Entry<K, V>>(c_idx);
-      if (k == entry0->key)
+      auto entry0 = child;
+      const auto& key0 = entry0.template as<Entry<K, V>>()->key;
+      if (k == key0)
       {
-        nodes[c_idx] = std::make_shared<Entry<K, V>>(k, v);
+        child = Ptr(make_node<Entry<K, V>>(k, v));
         return false;
       }
 
+      // The existing entry and the new one are moved to a new sub-node
+      const auto hash0 = H()(key0);
+      Ptr sub_node;
       if (depth < (collision_depth - 1))
       {
-        const auto hash0 = H()(entry0->key);
-        const auto idx0 = mask(hash0, depth + 1);
-        auto sub_node =
-          SubNodes<K, V, H>({entry0}, Bitmap(0), Bitmap(0).set(idx0));
-        sub_node.put_mut(depth + 1, hash, k, v);
-
-        nodes.erase(nodes.begin() + c_idx);
-        data_map = data_map.clear(idx);
-        node_map = node_map.set(idx);
-        c_idx = compressed_idx(idx);
-        nodes.insert(
-          nodes.begin() + c_idx,
-          std::make_shared<SubNodes<K, V, H>>(std::move(sub_node)));
+        sub_node = Ptr(make(Bitmap(0), Bitmap(0).set(mask(hash0, depth + 1))));
+        sub_node.template as<SubNodes>()->nodes()[0] = std::move(entry0);
+        put(sub_node, depth + 1, hash, k, v);
       }
       else
       {
-        auto sub_node = Collisions<K, V, H>();
-        const auto hash0 = H()(entry0->key);
-        const auto idx0 = mask(hash0, collision_depth);
-        sub_node.bins[idx0].push_back(entry0);
-        const auto idx1 = mask(hash, collision_depth);
-        sub_node.bins[idx1].push_back(std::make_shared<Entry<K, V>>(k, v));
-
-        nodes.erase(nodes.begin() + c_idx);
-        data_map = data_map.clear(idx);
-        node_map = node_map.set(idx);
-        c_idx = compressed_idx(idx);
-        nodes.insert(
-          nodes.begin() + c_idx,
-          std::make_shared<Collisions<K, V, H>>(std::move(sub_node)));
+        auto c = make_node<Collisions<K, V, H>>();
+        c->bins[mask(hash0, collision_depth)].push_back(std::move(entry0));
+        c->bins[mask(hash, collision_depth)].push_back(
+          Ptr(make_node<Entry<K, V>>(k, v)));
+        sub_node = Ptr(c);
       }
+      node->replace_moved(idx, std::move(sub_node));
       return true;
     }
 
-    std::pair<std::shared_ptr<SubNodes<K, V, H>>, bool> put(
-      SmallIndex depth, Hash hash, const K& k, const V& v) const
+    // Removes k, which must be present, from the trie held by slot. Nodes
+    // that are not shared with other tries are updated in place, and the
+    // others are copied. If a single entry is left in a sub-node, that entry
+    // is moved up to its parent, so that the trie stays as shallow as it
+    // would be had k never been added.
+    static void remove(Ptr& slot, SmallIndex depth, Hash hash, const K& k)
     {
-      auto node = *this;
-      auto r = node.put_mut(depth, hash, k, v);
-      return std::make_pair(
-        std::make_shared<SubNodes<K, V, H>>(std::move(node)), r);
+      auto node = slot.template as<SubNodes>();
+      const auto idx = mask(hash, depth);
+
+      if (node->data_map.check(idx))
+      {
+        auto n = node->with_removed(
+          node->node_map,
+          node->data_map.clear(idx),
+          node->compressed_idx(idx),
+          slot.unique());
+        slot = Ptr(n);
+        return;
+      }
+
+      node = own(slot);
+      auto& child = node->nodes()[node->compressed_idx(idx)];
+
+      Ptr last;
+      if (depth < (collision_depth - 1))
+      {
+        remove(child, depth + 1, hash, k);
+        auto sn = child.template as<SubNodes>();
+        if (sn->node_map.pop() == 0 && sn->data_map.pop() == 1)
+          last = sn->nodes()[0];
+      }
+      else
+      {
+        auto c = own_collisions(child);
+        c->remove_mut(hash, k);
+        if (c->size() == 1)
+          last = c->first();
+      }
+
+      if (last)
+        node->replace_moved(idx, std::move(last));
     }
 
     template <class F>
     bool foreach(SmallIndex depth, F&& f) const
     {
       const auto entries = data_map.pop();
+      const auto n = count();
       for (SmallIndex i = 0; i < entries; ++i)
       {
-        const auto& entry = node_as<Entry<K, V>>(i);
+        const auto entry = nodes()[i].template as<Entry<K, V>>();
         if (!f(entry->key, entry->value))
           return false;
       }
-      for (size_t i = entries; i < nodes.size(); ++i)
+      for (SmallIndex i = entries; i < n; ++i)
       {
         if (depth == (collision_depth - 1))
         {
-          if (!node_as<Collisions<K, V, H>>(i)->foreach(std::forward<F>(f)))
+          if (!nodes()[i].template as<Collisions<K, V, H>>()->foreach(
+                std::forward<F>(f)))
             return false;
         }
         else
         {
-          if (!node_as<SubNodes<K, V, H>>(i)->foreach(
+          if (!nodes()[i].template as<SubNodes>()->foreach(
                 depth + 1, std::forward<F>(f)))
             return false;
         }
       }
       return true;
     }
+  };
 
-  private:
-    template <class A>
-    const std::shared_ptr<A>& node_as(SmallIndex c_idx) const
+  template <class K, class V, class H>
+  void NodePtr<K, V, H>::reset()
+  {
+    // The last reference is released without an atomic update, since no
+    // other reference can be taken concurrently
+    if (
+      p != nullptr &&
+      (p->refs.load(std::memory_order_acquire) == 1 ||
+       p->refs.fetch_sub(1, std::memory_order_acq_rel) == 1))
     {
-      return reinterpret_cast<const std::shared_ptr<A>&>(nodes[c_idx]);
+      switch (p->kind)
+      {
+        case NodeBase::Kind::Entry:
+          destroy_node(static_cast<Entry<K, V>*>(p));
+          break;
+        case NodeBase::Kind::SubNodes:
+          SubNodes<K, V, H>::destroy(static_cast<SubNodes<K, V, H>*>(p));
+          break;
+        case NodeBase::Kind::Collisions:
+          destroy_node(static_cast<Collisions<K, V, H>*>(p));
+          break;
+      }
     }
-  };
+    p = nullptr;
+  }
 
   template <class K, class V, class H = std::hash<K>>
   class Map
   {
   private:
-    std::shared_ptr<SubNodes<K, V, H>> root;
+    using Ptr = NodePtr<K, V, H>;
+    using Root = SubNodes<K, V, H>;
+
+    Ptr root;
     size_t _size = 0;
 
-    Map(std::shared_ptr<SubNodes<K, V, H>> root_, size_t size_) :
-      root(root_),
-      _size(size_)
-    {}
+    Map(Ptr root_, size_t size_) : root(std::move(root_)), _size(size_) {}
 
   public:
-    Map() : root(std::make_shared<SubNodes<K, V, H>>()) {}
+    Map() : root(Root::make(Bitmap(0), Bitmap(0))) {}
 
     size_t size() const
     {
@@ -331,7 +657,7 @@ namespace champ
 
     std::optional<V> get(const K& key) const
     {
-      auto v = root->getp(0, H()(key), key);
+      auto v = getp(key);
 
       if (v)
         return *v;
@@ -341,23 +667,80 @@ namespace champ
 
     const V* getp(const K& key) const
     {
-      return root->getp(0, H()(key), key);
+      return root.template as<Root>()->getp(0, H()(key), key);
     }
 
     const Map<K, V, H> put(const K& key, const V& value) const
     {
-      auto r = root->put(0, H()(key), key, value);
-      auto size_ = _size;
-      if (r.second)
-        size_++;
+      Ptr r(root.template as<Root>()->copy());
+      const auto inserted = Root::put(r, 0, H()(key), key, value);
+      return Map(std::move(r), inserted ? _size + 1 : _size);
+    }
+
+    const Map<K, V, H> remove(const K& key) const
+    {
+      if (getp(key) == nullptr)
+        return *this;
 
-      return Map(std::move(r.first), size_);
+      Ptr r(root.template as<Root>()->copy());
+      Root::remove(r, 0, H()(key), key);
+      return Map(std::move(r), _size - 1);
     }
 
     template <class F>
     bool foreach(F&& f) const
     {
-      return root->foreach(0, std::forward<F>(f));
+      return root.template as<Root>()->foreach(0, std::forward<F>(f));
+    }
+
+    /// A mutable copy of a map, to apply many updates at once. Nodes are
+    /// copied the first time they are updated, and updated in place after
+    /// that, while the transient map is their only owner. Nodes shared with
+    /// persistent maps, including those returned by persistent(), are never
+    /// updated in place.
+    class Transient
+    {
+    private:
+      Ptr root;
+      size_t _size;
+
+    public:
+      Transient(const Map<K, V, H>& map) : root(map.root), _size(map._size) {}
+
+      size_t size() const
+      {
+        return _size;
+      }
+
+      const V* getp(const K& key) const
+      {
+        return root.template as<Root>()->getp(0, H()(key), key);
+      }
+
+      void put(const K& key, const V& value)
+      {
+        if (Root::put(root, 0, H()(key), key, value))
+          _size++;
+      }
+
+      void remove(const K& key)
+      {
+        if (getp(key) == nullptr)
+          return;
+
+        Root::remove(root, 0, H()(key), key);
+        _size--;
+      }
+
+      const Map<K, V, H> persistent() const
+      {
+        return Map(root, _size);
+      }
+    };
+
+    Transient transient() const
+    {
+      return Transient(*this);
     }
   };
 }
@@ -0,0 +1,129 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <utility>
+
+// A map bounded by its number of entries and by the total size of its values,
+// which evicts the least recently used entries once either bound is exceeded.
+// The size of each value is given when it is inserted. Entries are found
+// through an ordered map, so that keys only need to be comparable.
+template <class K, class V>
+class LRUCache
+{
+private:
+  struct Entry
+  {
+    K key;
+    V value;
+    size_t size;
+  };
+
+  // Most recently used first
+  std::list<Entry> entries;
+  std::map<K, typename std::list<Entry>::iterator> index;
+
+  size_t max_entries;
+  size_t max_bytes;
+  size_t bytes = 0;
+
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t evictions = 0;
+
+  void erase(typename std::list<Entry>::iterator it)
+  {
+    bytes -= it->size;
+    index.erase(it->key);
+    entries.erase(it);
+  }
+
+public:
+  LRUCache(size_t max_entries_, size_t max_bytes_) :
+    max_entries(max_entries_),
+    max_bytes(max_bytes_)
+  {}
+
+  /// Replaces any entry for key. A value larger than max_bytes is not kept.
+  void insert(const K& key, V&& value, size_t size)
+  {
+    erase(key);
+
+    entries.push_front({key, std::move(value), size});
+    index.emplace(key, entries.begin());
+    bytes += size;
+
+    while (!entries.empty() &&
+           (entries.size() > max_entries || bytes > max_bytes))
+    {
+      erase(std::prev(entries.end()));
+      evictions++;
+    }
+  }
+
+  /// Returns nullptr if key is not cached. The pointer is valid until the
+  /// cache is next modified.
+  V* find(const K& key)
+  {
+    auto search = index.find(key);
+    if (search == index.end())
+    {
+      misses++;
+      return nullptr;
+    }
+
+    hits++;
+    entries.splice(entries.begin(), entries, search->second);
+    return &search->second->value;
+  }
+
+  bool contains(const K& key) const
+  {
+    return index.find(key) != index.end();
+  }
+
+  bool erase(const K& key)
+  {
+    auto search = index.find(key);
+    if (search == index.end())
+      return false;
+
+    erase(search->second);
+    return true;
+  }
+
+  void clear()
+  {
+    entries.clear();
+    index.clear();
+    bytes = 0;
+  }
+
+  size_t size() const
+  {
+    return entries.size();
+  }
+
+  size_t get_bytes() const
+  {
+    return bytes;
+  }
+
+  size_t get_hits() const
+  {
+    return hits;
+  }
+
+  size_t get_misses() const
+  {
+    return misses;
+  }
+
+  size_t get_evictions() const
+  {
+    return evictions;
+  }
+};
@@ -87,15 +87,93 @@ public:
     return RBMap(B, t.left(), t.rootKey(), t.rootValue(), t.right());
   }
 
-  template <class F>
-  void foreach(F&& f) const
+  /// Same interface as champ::Map::Transient. RBMap nodes are never updated in
+  /// place, so this applies each update to a new persistent map.
+  class Transient
   {
-    if (!empty())
+  private:
+    RBMap map;
+
+  public:
+    Transient(const RBMap& map) : map(map) {}
+
+    const V* getp(const K& key) const
+    {
+      return map.getp(key);
+    }
+
+    void put(const K& key, const V& value)
     {
-      left().foreach(std::forward<F>(f));
-      f(rootKey(), rootValue());
-      right().foreach(std::forward<F>(f));
+      map = map.put(key, value);
     }
+
+    RBMap persistent() const
+    {
+      return map;
+    }
+  };
+
+  Transient transient() const
+  {
+    return Transient(*this);
+  }
+
+  /// Calls f on each entry in increasing key order, until f returns false.
+  /// Returns false if the iteration was stopped.
+  template <class F>
+  bool foreach(F&& f) const
+  {
+    return range({}, {}, f);
+  }
+
+  /// Calls f on each entry with from <= key < to, in increasing key order,
+  /// until f returns false. An empty bound does not limit the range.
+  /// Returns false if the iteration was stopped.
+  template <class F>
+  bool range(
+    const std::optional<K>& from, const std::optional<K>& to, F&& f) const
+  {
+    if (empty())
+      return true;
+
+    auto& y = rootKey();
+    const bool after_from = !from.has_value() || !(y < from.value());
+    const bool before_to = !to.has_value() || y < to.value();
+
+    if (after_from && !left().range(from, to, f))
+      return false;
+
+    if (after_from && before_to && !f(y, rootValue()))
+      return false;
+
+    if (before_to && !right().range(from, to, f))
+      return false;
+
+    return true;
+  }
+
+  /// Same as range(), in decreasing key order
+  template <class F>
+  bool reverse_range(
+    const std::optional<K>& from, const std::optional<K>& to, F&& f) const
+  {
+    if (empty())
+      return true;
+
+    auto& y = rootKey();
+    const bool after_from = !from.has_value() || !(y < from.value());
+    const bool before_to = !to.has_value() || y < to.value();
+
+    if (before_to && !right().reverse_range(from, to, f))
+      return false;
+
+    if (after_from && before_to && !f(y, rootValue()))
+      return false;
+
+    if (after_from && !left().reverse_range(from, to, f))
+      return false;
+
+    return true;
   }
 
 private:
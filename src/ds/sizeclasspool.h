@@ -0,0 +1,139 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <new>
+
+// Allocator for many small objects of a few sizes, such as the nodes of
+// persistent maps. Sizes are rounded up to a multiple of granularity, and
+// freed blocks are kept on a free list per size class, to be reused without
+// calling the system allocator. Free lists are per thread, so that no
+// synchronisation is needed: a block freed by another thread than the one
+// that allocated it is reused by the thread that freed it. Larger blocks are
+// not pooled.
+class SizeClassPool
+{
+public:
+  static constexpr size_t granularity = 16;
+  static constexpr size_t max_size = 512;
+  static constexpr size_t size_classes = max_size / granularity;
+  // Freed blocks beyond this are returned to the system allocator
+  static constexpr size_t max_free_blocks = 4096;
+
+private:
+  struct FreeBlock
+  {
+    FreeBlock* next;
+  };
+
+  struct FreeList
+  {
+    FreeBlock* head;
+    size_t count;
+  };
+
+  enum class State
+  {
+    Uninitialised,
+    Active,
+    Released
+  };
+
+  // Trivially destructible, so that blocks freed while the thread exits,
+  // after its free lists have been released, can still check the state
+  struct ThreadLists
+  {
+    std::array<FreeList, size_classes> lists;
+    State state;
+  };
+
+  static inline thread_local ThreadLists thread_lists = {};
+
+  // Releases the free lists of a thread when it exits
+  struct Cleanup
+  {
+    ~Cleanup()
+    {
+      for (auto& list : thread_lists.lists)
+      {
+        while (list.head != nullptr)
+        {
+          auto block = list.head;
+          list.head = block->next;
+          ::operator delete(block);
+        }
+        list.count = 0;
+      }
+      thread_lists.state = State::Released;
+    }
+  };
+
+  static FreeList* get_list(size_t size)
+  {
+    if (size > max_size)
+      return nullptr;
+
+    auto& tl = thread_lists;
+    if (tl.state == State::Uninitialised)
+    {
+      static thread_local Cleanup cleanup;
+      tl.state = State::Active;
+    }
+    else if (tl.state == State::Released)
+    {
+      return nullptr;
+    }
+
+    return &tl.lists[size_class(size)];
+  }
+
+  static constexpr size_t size_class(size_t size)
+  {
+    return size == 0 ? 0 : (size - 1) / granularity;
+  }
+
+public:
+  static constexpr size_t block_size(size_t size)
+  {
+    return size > max_size ? size : (size_class(size) + 1) * granularity;
+  }
+
+  static void* allocate(size_t size)
+  {
+    auto list = get_list(size);
+    if (list == nullptr || list->head == nullptr)
+      return ::operator new(block_size(size));
+
+    auto block = list->head;
+    list->head = block->next;
+    list->count--;
+    return block;
+  }
+
+  /// size must be the size that the block was allocated with
+  static void deallocate(void* p, size_t size)
+  {
+    auto list = get_list(size);
+    if (list == nullptr || list->count >= max_free_blocks)
+    {
+      ::operator delete(p);
+      return;
+    }
+
+    auto block = static_cast<FreeBlock*>(p);
+    block->next = list->head;
+    list->head = block;
+    list->count++;
+  }
+
+  /// Total size of the free blocks kept by the calling thread
+  static size_t free_bytes()
+  {
+    size_t n = 0;
+    for (size_t i = 0; i < size_classes; ++i)
+      n += thread_lists.lists[i].count * (i + 1) * granularity;
+    return n;
+  }
+};
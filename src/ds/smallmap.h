@@ -0,0 +1,262 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+// An unordered map that holds up to N entries inline, without allocating, and
+// is searched linearly. Once it grows beyond N entries, its entries are moved
+// to a std::unordered_map. Erasing entries does not move them back inline.
+template <class K, class V, class H = std::hash<K>, size_t N = 4>
+class SmallMap
+{
+public:
+  using key_type = K;
+  using mapped_type = V;
+  using value_type = std::pair<const K, V>;
+
+private:
+  using Spilled = std::unordered_map<K, V, H>;
+
+  std::array<std::optional<value_type>, N> entries;
+  size_t count = 0;
+  std::optional<Spilled> spilled;
+
+  template <bool is_const>
+  class Iter
+  {
+  private:
+    friend class SmallMap;
+
+    using Map = std::conditional_t<is_const, const SmallMap, SmallMap>;
+    using SpilledIt = std::conditional_t<
+      is_const,
+      typename Spilled::const_iterator,
+      typename Spilled::iterator>;
+
+    Map* map;
+    size_t idx;
+    SpilledIt it;
+
+    Iter(Map* map, size_t idx, SpilledIt it = {}) :
+      map(map),
+      idx(idx),
+      it(it)
+    {}
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = SmallMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<is_const, const value_type*, value_type*>;
+    using reference =
+      std::conditional_t<is_const, const value_type&, value_type&>;
+
+    Iter() : map(nullptr), idx(0) {}
+
+    // Iterators convert to const iterators
+    template <bool c = is_const, std::enable_if_t<c, int> = 0>
+    Iter(const Iter<false>& other) :
+      map(other.map),
+      idx(other.idx),
+      it(other.it)
+    {}
+
+    reference operator*() const
+    {
+      return map->spilled.has_value() ? *it : *map->entries[idx];
+    }
+
+    pointer operator->() const
+    {
+      return &**this;
+    }
+
+    Iter& operator++()
+    {
+      if (map->spilled.has_value())
+        ++it;
+      else
+        ++idx;
+      return *this;
+    }
+
+    Iter operator++(int)
+    {
+      auto prev = *this;
+      ++*this;
+      return prev;
+    }
+
+    bool operator==(const Iter& other) const
+    {
+      if (map != other.map)
+        return false;
+
+      return map->spilled.has_value() ? it == other.it : idx == other.idx;
+    }
+
+    bool operator!=(const Iter& other) const
+    {
+      return !(*this == other);
+    }
+  };
+
+  size_t find_inline(const K& key) const
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      if (entries[i]->first == key)
+        return i;
+    }
+    return count;
+  }
+
+  void spill()
+  {
+    spilled.emplace();
+    spilled->reserve(N + 1);
+    for (size_t i = 0; i < count; ++i)
+    {
+      spilled->insert(std::move(*entries[i]));
+      entries[i].reset();
+    }
+    count = 0;
+  }
+
+public:
+  using iterator = Iter<false>;
+  using const_iterator = Iter<true>;
+
+  size_t size() const
+  {
+    return spilled.has_value() ? spilled->size() : count;
+  }
+
+  bool empty() const
+  {
+    return size() == 0;
+  }
+
+  iterator begin()
+  {
+    if (spilled.has_value())
+      return {this, 0, spilled->begin()};
+    return {this, 0};
+  }
+
+  iterator end()
+  {
+    if (spilled.has_value())
+      return {this, 0, spilled->end()};
+    return {this, count};
+  }
+
+  const_iterator begin() const
+  {
+    if (spilled.has_value())
+      return {this, 0, spilled->cbegin()};
+    return {this, 0};
+  }
+
+  const_iterator end() const
+  {
+    if (spilled.has_value())
+      return {this, 0, spilled->cend()};
+    return {this, count};
+  }
+
+  const_iterator cbegin() const
+  {
+    return begin();
+  }
+
+  const_iterator cend() const
+  {
+    return end();
+  }
+
+  iterator find(const K& key)
+  {
+    if (spilled.has_value())
+      return {this, 0, spilled->find(key)};
+    return {this, find_inline(key)};
+  }
+
+  const_iterator find(const K& key) const
+  {
+    if (spilled.has_value())
+      return {this, 0, spilled->find(key)};
+    return {this, find_inline(key)};
+  }
+
+  std::pair<iterator, bool> insert(value_type&& entry)
+  {
+    if (!spilled.has_value())
+    {
+      auto i = find_inline(entry.first);
+      if (i < count)
+        return {{this, i}, false};
+
+      if (count < N)
+      {
+        entries[count].emplace(std::move(entry));
+        return {{this, count++}, true};
+      }
+
+      spill();
+    }
+
+    auto [it, inserted] = spilled->insert(std::move(entry));
+    return {{this, 0, it}, inserted};
+  }
+
+  std::pair<iterator, bool> insert(const value_type& entry)
+  {
+    return insert(value_type(entry));
+  }
+
+  template <class... Args>
+  std::pair<iterator, bool> emplace(Args&&... args)
+  {
+    return insert(value_type(std::forward<Args>(args)...));
+  }
+
+  V& operator[](const K& key)
+  {
+    auto it = find(key);
+    if (it == end())
+      it = insert({key, V()}).first;
+    return it->second;
+  }
+
+  size_t erase(const K& key)
+  {
+    if (spilled.has_value())
+      return spilled->erase(key);
+
+    auto i = find_inline(key);
+    if (i == count)
+      return 0;
+
+    // Keep inline entries contiguous by moving the last one into the gap
+    if (i != count - 1)
+      entries[i].emplace(std::move(*entries[count - 1]));
+    entries[--count].reset();
+    return 1;
+  }
+
+  void clear()
+  {
+    for (size_t i = 0; i < count; ++i)
+      entries[i].reset();
+    count = 0;
+    spilled.reset();
+  }
+};
@@ -0,0 +1,65 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#include "../lrucache.h"
+
+#include <doctest/doctest.h>
+#include <string>
+
+TEST_CASE(
+  "Least recently used entries are evicted first" * doctest::test_suite("lru"))
+{
+  LRUCache<size_t, std::string> cache(3, 1000);
+  for (size_t i = 0; i < 3; ++i)
+    cache.insert(i, std::to_string(i), 1);
+  REQUIRE(cache.size() == 3);
+
+  // 0 becomes the most recently used entry, so 1 is evicted next
+  REQUIRE(cache.find(0) != nullptr);
+  cache.insert(3, "3", 1);
+  REQUIRE(cache.size() == 3);
+  REQUIRE(cache.contains(0));
+  REQUIRE_FALSE(cache.contains(1));
+  REQUIRE(cache.contains(2));
+  REQUIRE(cache.contains(3));
+  REQUIRE(cache.get_evictions() == 1);
+
+  REQUIRE(*cache.find(3) == "3");
+  REQUIRE(cache.find(1) == nullptr);
+  REQUIRE(cache.get_hits() == 2);
+  REQUIRE(cache.get_misses() == 1);
+}
+
+TEST_CASE("Entries are evicted beyond max bytes" * doctest::test_suite("lru"))
+{
+  LRUCache<size_t, std::string> cache(100, 10);
+  cache.insert(0, "aaaa", 4);
+  cache.insert(1, "bbbb", 4);
+  REQUIRE(cache.get_bytes() == 8);
+
+  cache.insert(2, "cccc", 4);
+  REQUIRE(cache.size() == 2);
+  REQUIRE(cache.get_bytes() == 8);
+  REQUIRE_FALSE(cache.contains(0));
+
+  INFO("Replacing an entry updates its size");
+  {
+    cache.insert(1, "b", 1);
+    REQUIRE(cache.size() == 2);
+    REQUIRE(cache.get_bytes() == 5);
+  }
+
+  INFO("A value larger than the cache is not kept");
+  {
+    cache.insert(3, std::string(11, 'd'), 11);
+    REQUIRE(cache.size() == 0);
+    REQUIRE(cache.get_bytes() == 0);
+  }
+
+  INFO("Erased entries release their size");
+  {
+    cache.insert(4, "eee", 3);
+    REQUIRE(cache.erase(4));
+    REQUIRE_FALSE(cache.erase(4));
+    REQUIRE(cache.get_bytes() == 0);
+  }
+}
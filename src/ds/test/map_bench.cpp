@@ -1,10 +1,13 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the Apache 2.0 License.
-#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#define PICOBENCH_IMPLEMENT
 #include "../champmap.h"
 #include "../rbmap.h"
 
+#include <cstdlib>
+#include <iostream>
 #include <picobench/picobench.hpp>
+#include <thread>
 
 using namespace std;
 
@@ -38,6 +41,51 @@ static const M gen_map(size_t size)
   return map;
 }
 
+// Bytes currently allocated, to measure the memory used by maps. Benchmarks
+// run on a single thread.
+static size_t allocated = 0;
+
+void* operator new(size_t size)
+{
+  auto p = static_cast<size_t*>(std::malloc(size + sizeof(max_align_t)));
+  if (p == nullptr)
+    throw std::bad_alloc();
+  *p = size;
+  allocated += size;
+  return reinterpret_cast<char*>(p) + sizeof(max_align_t);
+}
+
+void operator delete(void* p) noexcept
+{
+  if (p == nullptr)
+    return;
+  auto s =
+    reinterpret_cast<size_t*>(static_cast<char*>(p) - sizeof(max_align_t));
+  allocated -= *s;
+  std::free(s);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  operator delete(p);
+}
+
+// Blocks kept by the pool for reuse are not counted as used by maps
+static size_t used()
+{
+  return allocated - SizeClassPool::free_bytes();
+}
+
+template <class M, class Value>
+static size_t bytes_per_entry(size_t size, const Value& v)
+{
+  const auto before = used();
+  M map;
+  for (uint64_t i = 0; i < size; ++i)
+    map = map.put(i, v);
+  return (used() - before) / size;
+}
+
 template <class A>
 inline void do_not_optimize(A const& value)
 {
@@ -142,3 +190,27 @@ auto bench_rb_map_foreach = benchmark_foreach<RBMap<K, V>>;
 PICOBENCH(bench_rb_map_foreach).iterations(for_sizes).samples(10).baseline();
 auto bench_champ_map_foreach = benchmark_foreach<champ::Map<K, V>>;
 PICOBENCH(bench_champ_map_foreach).iterations(for_sizes).samples(10);
+
+int main(int argc, char* argv[])
+{
+  // Maps are shared between threads in the enclave, so their reference counts
+  // must be updated atomically. The standard library only does so once the
+  // process has started a thread.
+  std::thread([]() {}).join();
+
+  const auto v = gen_val(val_size);
+  std::cout << "Bytes per entry (key only, key and " << val_size
+            << " values):" << std::endl;
+  for (auto size : sizes)
+  {
+    std::cout << "  " << size << " entries: RBMap "
+              << bytes_per_entry<RBMap<K, K>>(size, K()) << ", "
+              << bytes_per_entry<RBMap<K, V>>(size, v) << ", champ::Map "
+              << bytes_per_entry<champ::Map<K, K>>(size, K()) << ", "
+              << bytes_per_entry<champ::Map<K, V>>(size, v) << std::endl;
+  }
+
+  picobench::runner runner;
+  runner.parse_cmd_line(argc, argv);
+  return runner.run();
+}
@@ -3,9 +3,13 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "../champmap.h"
 #include "../rbmap.h"
+#include "../smallmap.h"
 
+#include <algorithm>
 #include <doctest/doctest.h>
+#include <map>
 #include <random>
+#include <unordered_map>
 
 using namespace std;
 
@@ -136,3 +140,250 @@ TEST_CASE("persistent map operations")
     champ = champ_new;
   }
 }
+
+template <class Hash>
+void check_removals()
+{
+  champ::Map<K, V, Hash> champ;
+  std::map<K, V> reference;
+
+  random_device rand_dev;
+  mt19937 gen(rand_dev());
+  uniform_int_distribution<K> gen_key(0, 300);
+  uniform_int_distribution<> gen_op(0, 2);
+
+  for (V v = 0; v < 2000; ++v)
+  {
+    auto k = gen_key(gen);
+    auto prev = champ;
+    auto prev_size = champ.size();
+
+    if (gen_op(gen) == 0)
+    {
+      champ = champ.put(k, v);
+      reference[k] = v;
+    }
+    else
+    {
+      champ = champ.remove(k);
+      REQUIRE(
+        champ.size() == prev_size - (reference.erase(k) == 1 ? 1 : 0));
+      REQUIRE_FALSE(champ.getp(k));
+    }
+
+    REQUIRE(prev.size() == prev_size);
+    REQUIRE(champ.size() == reference.size());
+
+    size_t n = 0;
+    champ.foreach([&](const auto& k, const auto& v) {
+      n++;
+      auto search = reference.find(k);
+      REQUIRE(search != reference.end());
+      REQUIRE(search->second == v);
+      return true;
+    });
+    REQUIRE(n == reference.size());
+  }
+
+  INFO("removing all keys leaves an empty map");
+  {
+    for (const auto& [k, v] : reference)
+      champ = champ.remove(k);
+    REQUIRE(champ.size() == 0);
+    REQUIRE(champ.foreach([](const auto&, const auto&) { return false; }));
+  }
+}
+
+TEST_CASE("persistent map removal")
+{
+  check_removals<std::hash<K>>();
+  check_removals<CollisionHash<K>>();
+}
+
+template <class Hash>
+void check_transient()
+{
+  champ::Map<K, V, Hash> champ;
+  std::map<K, V> reference;
+
+  random_device rand_dev;
+  mt19937 gen(rand_dev());
+  uniform_int_distribution<K> gen_key(0, 300);
+  uniform_int_distribution<> gen_op(0, 2);
+
+  auto check = [](const auto& m, const std::map<K, V>& expected) {
+    REQUIRE(m.size() == expected.size());
+    size_t n = 0;
+    m.foreach([&](const auto& k, const auto& v) {
+      n++;
+      auto search = expected.find(k);
+      REQUIRE(search != expected.end());
+      REQUIRE(search->second == v);
+      return true;
+    });
+    REQUIRE(n == expected.size());
+  };
+
+  for (size_t batch = 0; batch < 20; ++batch)
+  {
+    auto prev = reference;
+    auto t = champ.transient();
+    std::vector<std::pair<decltype(champ), std::map<K, V>>> frozen;
+
+    for (V v = 0; v < 100; ++v)
+    {
+      auto k = gen_key(gen);
+      if (gen_op(gen) == 0)
+      {
+        t.remove(k);
+        reference.erase(k);
+        REQUIRE(t.getp(k) == nullptr);
+      }
+      else
+      {
+        t.put(k, v);
+        reference[k] = v;
+        REQUIRE(*t.getp(k) == v);
+      }
+      REQUIRE(t.size() == reference.size());
+
+      if (v % 25 == 0)
+        frozen.emplace_back(t.persistent(), reference);
+    }
+
+    INFO("updates to a transient map do not change persistent maps");
+    {
+      check(champ, prev);
+      for (const auto& [m, expected] : frozen)
+        check(m, expected);
+    }
+
+    champ = t.persistent();
+    check(champ, reference);
+  }
+}
+
+TEST_CASE("transient map operations")
+{
+  check_transient<std::hash<K>>();
+  check_transient<CollisionHash<K>>();
+}
+
+TEST_CASE("ordered range queries")
+{
+  RBMap<K, V> rb;
+  std::map<K, V> reference;
+
+  random_device rand_dev;
+  mt19937 gen(rand_dev());
+  uniform_int_distribution<K> gen_key(0, 1000);
+
+  for (V v = 0; v < 500; ++v)
+  {
+    auto k = gen_key(gen);
+    rb = rb.put(k, v);
+    reference[k] = v;
+  }
+
+  for (size_t i = 0; i < 100; ++i)
+  {
+    auto a = gen_key(gen);
+    auto b = gen_key(gen);
+    auto from = min(a, b);
+    auto to = max(a, b);
+
+    vector<pair<K, V>> expected(
+      reference.lower_bound(from), reference.lower_bound(to));
+    vector<pair<K, V>> forward;
+    REQUIRE(rb.range(from, to, [&](const K& k, const V& v) {
+      forward.emplace_back(k, v);
+      return true;
+    }));
+    REQUIRE(forward == expected);
+
+    vector<pair<K, V>> backward;
+    REQUIRE(rb.reverse_range(from, to, [&](const K& k, const V& v) {
+      backward.emplace_back(k, v);
+      return true;
+    }));
+    reverse(expected.begin(), expected.end());
+    REQUIRE(backward == expected);
+  }
+
+  INFO("iteration stops early");
+  {
+    vector<K> top;
+    REQUIRE_FALSE(rb.reverse_range({}, {}, [&](const K& k, const V&) {
+      top.push_back(k);
+      return top.size() < 3;
+    }));
+    REQUIRE(top.size() == 3);
+    REQUIRE(top[0] == reference.rbegin()->first);
+  }
+}
+
+TEST_CASE("small map operations")
+{
+  SmallMap<K, V, H, 4> small;
+  unordered_map<K, V> reference;
+
+  auto check = [&]() {
+    REQUIRE(small.size() == reference.size());
+    REQUIRE(small.empty() == reference.empty());
+
+    size_t n = 0;
+    for (const auto& [k, v] : small)
+    {
+      n++;
+      auto search = reference.find(k);
+      REQUIRE(search != reference.end());
+      REQUIRE(search->second == v);
+    }
+    REQUIRE(n == reference.size());
+  };
+
+  INFO("entries are kept inline, then spilled");
+  {
+    for (K k = 0; k < 8; ++k)
+    {
+      REQUIRE(small.insert({k, k}).second);
+      REQUIRE_FALSE(small.insert({k, k + 1}).second);
+      reference.insert({k, k});
+      check();
+    }
+  }
+
+  INFO("entries can be updated and erased");
+  {
+    small[3] = 42;
+    reference[3] = 42;
+    REQUIRE(small.erase(5) == 1);
+    REQUIRE(small.erase(5) == 0);
+    reference.erase(5);
+    check();
+
+    REQUIRE(small.find(5) == small.end());
+    REQUIRE(small.find(3)->second == 42);
+  }
+
+  INFO("inline entries stay contiguous when erased");
+  {
+    small.clear();
+    reference.clear();
+    check();
+
+    for (K k = 0; k < 4; ++k)
+    {
+      small.emplace(k, k);
+      reference.emplace(k, k);
+    }
+    small.erase(1);
+    reference.erase(1);
+    check();
+
+    small[10] = 10;
+    reference[10] = 10;
+    check();
+    REQUIRE(small.find(3)->second == 3);
+  }
+}
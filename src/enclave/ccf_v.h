@@ -69,6 +69,8 @@ extern "C"
 
   using run_func_t = bool (*)();
 
+  using run_worker_func_t = bool (*)();
+
   using tick_func_t = bool (*)(size_t, size_t);
 
   /*ocall function table*/
@@ -137,6 +139,15 @@ extern "C"
     return *_retval ? OE_OK : OE_FAILURE;
   }
 
+  inline oe_result_t enclave_run_worker(oe_enclave_t* enclave, bool* _retval)
+  {
+    static run_worker_func_t run_worker_func =
+      get_enclave_exported_function<run_worker_func_t>("enclave_run_worker");
+
+    *_retval = run_worker_func();
+    return *_retval ? OE_OK : OE_FAILURE;
+  }
+
   inline oe_result_t oe_create_ccf_enclave(
     const char* path,
     oe_enclave_type_t type,
@@ -17,6 +17,7 @@
 #include "rpcclient.h"
 #include "rpcmap.h"
 #include "rpcsessions.h"
+#include "workerpool.h"
 
 namespace enclave
 {
@@ -31,6 +32,7 @@ namespace enclave
     ccf::Notifier notifier;
     ccf::Timers timers;
     std::shared_ptr<RPCMap> rpc_map;
+    std::shared_ptr<WorkerPool> workers;
     std::shared_ptr<RPCSessions> rpcsessions;
     ccf::NodeState node;
     std::shared_ptr<ccf::Forwarder<ccf::NodeToNode>> cmd_forwarder;
@@ -43,6 +45,7 @@ namespace enclave
     Enclave(
       EnclaveConfig* enclave_config,
       const CCFConfig::SignatureIntervals& signature_intervals,
+      const CCFConfig::ForwardingBatch& forwarding_batch,
       const ConsensusType& consensus_type_,
       const raft::Config& raft_config) :
       circuit(enclave_config->circuit),
@@ -52,10 +55,19 @@ namespace enclave
       n2n_channels(std::make_shared<ccf::NodeToNode>(writer_factory)),
       notifier(writer_factory),
       rpc_map(std::make_shared<RPCMap>()),
-      rpcsessions(std::make_shared<RPCSessions>(writer_factory, rpc_map)),
+      workers(
+        enclave_config->worker_threads > 0 ?
+          std::make_shared<WorkerPool>(enclave_config->worker_threads) :
+          nullptr),
+      rpcsessions(
+        std::make_shared<RPCSessions>(writer_factory, rpc_map, workers)),
       node(writer_factory, network, rpcsessions, notifier, timers),
       cmd_forwarder(std::make_shared<ccf::Forwarder<ccf::NodeToNode>>(
-        rpcsessions, n2n_channels, rpc_map)),
+        rpcsessions,
+        n2n_channels,
+        rpc_map,
+        forwarding_batch.max_delay_ms,
+        forwarding_batch.max_size)),
       consensus_type(consensus_type_)
     {
       logger::config::msg() = AdminMessage::log_msg;
@@ -153,6 +165,8 @@ namespace enclave
               std::chrono::milliseconds elapsed_ms(ms_count);
               logger::config::tick(elapsed_ms);
               node.tick(elapsed_ms);
+              n2n_channels->flush();
+              cmd_forwarder->tick(elapsed_ms);
               timers.tick(elapsed_ms);
               // When recovering, no signature should be emitted while the
               // ledger is being read
@@ -186,24 +200,46 @@ namespace enclave
 
         DISPATCHER_SET_MESSAGE_HANDLER(
           bp,
-          consensus::ledger_entry,
+          consensus::ledger_entries,
           [this](const uint8_t* data, size_t size) {
-            auto [body] =
-              ringbuffer::read_message<consensus::ledger_entry>(data, size);
-            if (node.is_reading_public_ledger())
-              node.recover_public_ledger_entry(body);
-            else if (node.is_reading_private_ledger())
-              node.recover_private_ledger_entry(body);
-            else
-              LOG_FAIL_FMT("Cannot recover ledger entry: Unexpected state");
+            // Read the framed entries in place, rather than copying them out
+            auto from = serialized::read<consensus::Index>(data, size);
+            node.recover_ledger_entries(from, data, size);
           });
 
         DISPATCHER_SET_MESSAGE_HANDLER(
           bp,
           consensus::ledger_no_entry,
           [this](const uint8_t* data, size_t size) {
-            ringbuffer::read_message<consensus::ledger_no_entry>(data, size);
-            node.recover_ledger_end();
+            auto [idx] =
+              ringbuffer::read_message<consensus::ledger_no_entry>(data, size);
+            node.recover_ledger_end(idx);
+          });
+
+        DISPATCHER_SET_MESSAGE_HANDLER(
+          bp,
+          consensus::ledger_durable,
+          [this](const uint8_t* data, size_t size) {
+            auto [idx] =
+              ringbuffer::read_message<consensus::ledger_durable>(data, size);
+            node.set_ledger_durable_idx(idx);
+          });
+
+        DISPATCHER_SET_MESSAGE_HANDLER(
+          bp,
+          consensus::snapshot_chunk,
+          [this](const uint8_t* data, size_t size) {
+            auto idx = serialized::read<consensus::Index>(data, size);
+            node.recv_snapshot_chunk(idx, data, size);
+          });
+
+        DISPATCHER_SET_MESSAGE_HANDLER(
+          bp,
+          consensus::snapshot_end,
+          [this](const uint8_t* data, size_t size) {
+            auto [idx] =
+              ringbuffer::read_message<consensus::snapshot_end>(data, size);
+            node.recv_snapshot_end(idx);
           });
 
         rpcsessions->register_message_handlers(bp.get_dispatcher());
@@ -217,6 +253,33 @@ namespace enclave
           node.start_ledger_recovery();
         }
         bp.run(circuit->read_from_outside());
+
+        if (workers)
+          workers->stop();
+        return true;
+      }
+#ifndef VIRTUAL_ENCLAVE
+      catch (const std::exception& e)
+      {
+        auto w = writer_factory.create_writer_to_outside();
+        RINGBUFFER_WRITE_MESSAGE(
+          AdminMessage::fatal_error_msg, w, std::string(e.what()));
+        return false;
+      }
+#endif
+    }
+
+    // Runs client sessions on the calling thread, until the enclave is stopped
+    bool run_worker()
+    {
+      if (!workers)
+        return false;
+
+#ifndef VIRTUAL_ENCLAVE
+      try
+#endif
+      {
+        workers->run();
         return true;
       }
 #ifndef VIRTUAL_ENCLAVE
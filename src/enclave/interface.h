@@ -22,6 +22,10 @@ struct EnclaveConfig
   ringbuffer::Circuit* circuit = nullptr;
   oversized::WriterConfig writer_config = {};
 
+  // Number of host threads that enter the enclave to run client sessions, in
+  // addition to the thread running the enclave
+  size_t worker_threads = 0;
+
 #ifdef DEBUG_CONFIG
   struct DebugConfig
   {
@@ -45,6 +49,17 @@ struct CCFConfig
   };
   SignatureIntervals signature_intervals = {};
 
+  // Forwarded commands and responses are batched per node for at most
+  // max_delay_ms, and up to max_size bytes. If max_delay_ms is 0, they are
+  // not batched.
+  struct ForwardingBatch
+  {
+    size_t max_delay_ms;
+    size_t max_size;
+    MSGPACK_DEFINE(max_delay_ms, max_size);
+  };
+  ForwardingBatch forwarding_batch = {};
+
   struct Genesis
   {
     std::vector<std::vector<uint8_t>> member_certs;
@@ -62,13 +77,19 @@ struct CCFConfig
   };
   Joining joining = {};
 
+  // Minimum number of globally committed transactions between snapshots. If
+  // 0, no snapshot is taken.
+  size_t snapshot_interval = 0;
+
   MSGPACK_DEFINE(
     raft_config,
     node_info_network,
     domain,
     signature_intervals,
+    forwarding_batch,
     genesis,
-    joining);
+    joining,
+    snapshot_interval);
 };
 
 /// General administrative messages
@@ -53,7 +53,11 @@ extern "C"
 #endif
 
     e = new enclave::Enclave(
-      ec, cc.signature_intervals, consensus_type, cc.raft_config);
+      ec,
+      cc.signature_intervals,
+      cc.forwarding_batch,
+      consensus_type,
+      cc.raft_config);
 
     return e->create_new_node(
       start_type,
@@ -76,4 +80,12 @@ extern "C"
     else
       return false;
   }
+
+  bool enclave_run_worker()
+  {
+    if (e != nullptr)
+      return e->run_worker();
+    else
+      return false;
+  }
 }
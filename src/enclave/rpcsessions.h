@@ -14,6 +14,7 @@
 #include "tls/client.h"
 #include "tls/context.h"
 #include "tls/server.h"
+#include "workerpool.h"
 
 #include <limits>
 #include <unordered_map>
@@ -34,6 +35,10 @@ namespace enclave
     std::shared_ptr<RPCMap> rpc_map;
     std::shared_ptr<tls::Cert> cert;
 
+    // If set, client sessions are run on the enclave's worker threads, rather
+    // than on the thread reading from the host
+    std::shared_ptr<WorkerPool> workers;
+
     SpinLock lock;
     std::unordered_map<size_t, std::shared_ptr<Endpoint>> sessions;
 
@@ -44,12 +49,21 @@ namespace enclave
 
     ringbuffer::AbstractWriterFactory& writer_factory;
 
+    // Sessions created with create_client() are always run on the thread
+    // reading from the host, along with consensus
+    bool runs_on_workers(size_t id) const
+    {
+      return workers != nullptr && id <= std::numeric_limits<size_t>::max() / 2;
+    }
+
   public:
     RPCSessions(
       ringbuffer::AbstractWriterFactory& writer_factory,
-      std::shared_ptr<RPCMap> rpc_map_) :
+      std::shared_ptr<RPCMap> rpc_map_,
+      std::shared_ptr<WorkerPool> workers_ = nullptr) :
       writer_factory(writer_factory),
-      rpc_map(rpc_map_)
+      rpc_map(rpc_map_),
+      workers(workers_)
     {}
 
     void set_cert(CBuffer cert_, const tls::Pem& pk)
@@ -93,6 +107,14 @@ namespace enclave
 
       LOG_DEBUG_FMT("Replying to session {}", id);
 
+      if (runs_on_workers(id))
+      {
+        workers->add_task(id, [session = search->second, data]() {
+          session->send(data);
+        });
+        return true;
+      }
+
       search->second->send(data);
       return true;
     }
@@ -140,6 +162,18 @@ namespace enclave
               "tls_inbound for unknown session: " + std::to_string(id));
           }
 
+          if (runs_on_workers(id))
+          {
+            workers->add_task(
+              id,
+              [session = search->second,
+               data = std::vector<uint8_t>(
+                 body.data, body.data + body.size)]() {
+                session->recv(data.data(), data.size());
+              });
+            return;
+          }
+
           search->second->recv(body.data, body.size);
         });
 
@@ -0,0 +1,98 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../workerpool.h"
+
+#include <atomic>
+#include <doctest/doctest.h>
+#include <thread>
+#include <vector>
+
+TEST_CASE("Tasks of a session run in order")
+{
+  constexpr size_t worker_count = 4;
+  constexpr size_t session_count = 8;
+  constexpr size_t task_count = 1000;
+
+  enclave::WorkerPool pool(worker_count);
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < worker_count; ++i)
+    workers.emplace_back([&pool]() { pool.run(); });
+
+  // Sessions are only ever run by one worker at a time, so their counters
+  // need not be atomic
+  std::vector<size_t> next(session_count, 0);
+  std::atomic<size_t> out_of_order(0);
+  std::atomic<size_t> done(0);
+
+  for (size_t i = 0; i < task_count; ++i)
+  {
+    for (size_t s = 0; s < session_count; ++s)
+    {
+      pool.add_task(s, [&, s, i]() {
+        if (next[s]++ != i)
+          ++out_of_order;
+        ++done;
+      });
+    }
+  }
+
+  while (done.load() < session_count * task_count)
+    std::this_thread::yield();
+
+  pool.stop();
+  for (auto& w : workers)
+    w.join();
+
+  REQUIRE(out_of_order.load() == 0);
+  for (size_t s = 0; s < session_count; ++s)
+    REQUIRE(next[s] == task_count);
+}
+
+TEST_CASE("Sessions run in parallel")
+{
+  enclave::WorkerPool pool(2);
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < 2; ++i)
+    workers.emplace_back([&pool]() { pool.run(); });
+
+  // The task of session 0 only completes once session 1 has run, which needs
+  // a second worker
+  std::atomic<bool> first_running(false);
+  std::atomic<bool> second_done(false);
+
+  pool.add_task(0, [&]() {
+    first_running = true;
+    while (!second_done.load())
+      std::this_thread::yield();
+  });
+
+  while (!first_running.load())
+    std::this_thread::yield();
+
+  pool.add_task(1, [&]() { second_done = true; });
+
+  while (!second_done.load())
+    std::this_thread::yield();
+
+  pool.stop();
+  for (auto& w : workers)
+    w.join();
+}
+
+TEST_CASE("Failing tasks do not stop workers")
+{
+  enclave::WorkerPool pool(1);
+  std::thread worker([&pool]() { pool.run(); });
+
+  std::atomic<bool> done(false);
+  pool.add_task(0, []() { throw std::logic_error("Task failed"); });
+  pool.add_task(0, []() { throw 42; });
+  pool.add_task(0, [&]() { done = true; });
+
+  while (!done.load())
+    std::this_thread::yield();
+
+  pool.stop();
+  worker.join();
+}
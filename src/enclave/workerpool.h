@@ -0,0 +1,131 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/logger.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+namespace enclave
+{
+  /// Runs tasks on the enclave's worker threads. Threads cannot be created
+  /// inside the enclave, so each worker is a host thread that has entered the
+  /// enclave and calls run() until the pool is stopped.
+  ///
+  /// Tasks are queued per session. Tasks of the same session run one at a
+  /// time, in order, while tasks of different sessions run in parallel.
+  class WorkerPool
+  {
+  public:
+    using Task = std::function<void()>;
+
+  private:
+    struct SessionQueue
+    {
+      std::deque<Task> tasks;
+      // True while the session is waiting to be run, or running, so that only
+      // one worker runs its tasks
+      bool scheduled = false;
+    };
+
+    const size_t worker_count;
+
+    std::mutex lock;
+    std::condition_variable work_cv;
+    std::unordered_map<size_t, SessionQueue> queues;
+    std::deque<size_t> ready;
+    bool stopping = false;
+
+    void run_task(size_t session_id, Task& task)
+    {
+      try
+      {
+        task();
+      }
+      catch (const std::exception& e)
+      {
+        LOG_FAIL_FMT("Task of session {} failed: {}", session_id, e.what());
+      }
+      catch (...)
+      {
+        LOG_FAIL_FMT("Task of session {} failed", session_id);
+      }
+    }
+
+  public:
+    WorkerPool(size_t worker_count) : worker_count(worker_count) {}
+
+    WorkerPool(const WorkerPool& that) = delete;
+
+    /// If 0, tasks should instead be run on the enclave thread
+    size_t get_worker_count() const
+    {
+      return worker_count;
+    }
+
+    void add_task(size_t session_id, Task task)
+    {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        auto& q = queues[session_id];
+        q.tasks.push_back(std::move(task));
+
+        if (q.scheduled)
+          return;
+
+        q.scheduled = true;
+        ready.push_back(session_id);
+      }
+      work_cv.notify_one();
+    }
+
+    /// Runs tasks on the calling thread until the pool is stopped
+    void run()
+    {
+      std::unique_lock<std::mutex> guard(lock);
+
+      while (true)
+      {
+        work_cv.wait(guard, [this]() { return stopping || !ready.empty(); });
+
+        if (stopping)
+          return;
+
+        auto session_id = ready.front();
+        ready.pop_front();
+
+        // Run the session's tasks until its queue is empty, so that it stays
+        // on this worker while it is busy
+        auto search = queues.find(session_id);
+        while (!search->second.tasks.empty())
+        {
+          auto task = std::move(search->second.tasks.front());
+          search->second.tasks.pop_front();
+
+          guard.unlock();
+          run_task(session_id, task);
+          guard.lock();
+
+          // Sessions added meanwhile may have invalidated the iterator
+          search = queues.find(session_id);
+        }
+
+        queues.erase(search);
+      }
+    }
+
+    /// Stops all workers. Queued tasks are discarded.
+    void stop()
+    {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+      }
+      work_cv.notify_all();
+    }
+  };
+}
@@ -139,6 +139,22 @@ namespace host
       return ret;
     }
 
+    // Run client sessions inside the enclave - should be called from a thread
+    // other than the one calling run()
+    bool run_worker()
+    {
+      bool ret;
+      auto err = enclave_run_worker(e, &ret);
+
+      if (err != OE_OK)
+      {
+        LOG_FATAL_FMT(
+          "Failed to call in enclave_run_worker: {}", oe_result_str(err));
+      }
+
+      return ret;
+    }
+
     /**
      * Checks that a quote is valid, the signing authority is trusted, and the
      * quote is over some expected data.
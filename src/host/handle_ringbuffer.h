@@ -26,6 +26,9 @@ namespace asynchost
     ringbuffer::Reader& r;
     ringbuffer::NonBlockingWriterFactory& nbwf;
 
+    // Called once all outbound messages have been processed
+    std::function<void()> after_drain;
+
     // Sealed secrets file path
     std::string sealed_secrets_file;
 
@@ -33,10 +36,12 @@ namespace asynchost
     HandleRingbufferImpl(
       messaging::BufferProcessor& bp,
       ringbuffer::Reader& r,
-      ringbuffer::NonBlockingWriterFactory& nbwf) :
+      ringbuffer::NonBlockingWriterFactory& nbwf,
+      std::function<void()> after_drain = nullptr) :
       bp(bp),
       r(r),
-      nbwf(nbwf)
+      nbwf(nbwf),
+      after_drain(after_drain)
     {
       // Register message handler for log message from enclave
       DISPATCHER_SET_MESSAGE_HANDLER(
@@ -113,6 +118,10 @@ namespace asynchost
         continue;
       }
 
+      // ...complete any work batched while processing those messages...
+      if (after_drain)
+        after_drain();
+
       // ...flush any pending inbound messages...
       nbwf.flush_all_inbound();
     }
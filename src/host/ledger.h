@@ -6,138 +6,701 @@
 #include "ds/logger.h"
 #include "ds/messaging.h"
 
+#include <algorithm>
+#include <cctype>
 #include <cstdint>
 #include <cstdio>
 #include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <memory>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <vector>
 
 namespace asynchost
 {
-  class Ledger
+  /// A contiguous run of framed ledger bytes. When the bytes live in a sealed
+  /// segment, data points directly into that segment's read-only mapping and
+  /// owner keeps the mapping alive. Otherwise, owner holds a copy.
+  struct LedgerSlice
+  {
+    std::shared_ptr<const void> owner;
+    const uint8_t* data;
+    size_t size;
+  };
+
+  class LedgerFile
   {
   private:
     static constexpr size_t frame_header_size = sizeof(uint32_t);
 
-    // This uses C stdio instead of fstream because an fstream
-    // cannot be truncated.
-    FILE* file;
+    struct Mapping
+    {
+      void* base;
+      size_t size;
+
+      Mapping(void* base, size_t size) : base(base), size(size) {}
+
+      ~Mapping()
+      {
+        munmap(base, size);
+      }
+    };
+
+    const std::string path;
+    const size_t start_idx;
+
+    // Only open while the segment is writable
+    int fd = -1;
+
+    // Only set once the segment has been sealed.
+    std::shared_ptr<Mapping> mapping = nullptr;
+
+    // Offsets of each frame, relative to the start of this segment
     std::vector<size_t> positions;
-    size_t total_len;
-    ringbuffer::WriterPtr to_enclave;
+    size_t total_len = 0;
 
-  public:
-    Ledger(
-      const std::string& filename,
-      ringbuffer::AbstractWriterFactory& writer_factory) :
-      file(NULL),
-      to_enclave(writer_factory.create_writer_to_inside())
+    // Framed entries which have been appended since the last flush. They are
+    // written to the file together, at offset flushed_len.
+    std::vector<uint8_t> pending;
+    size_t flushed_len = 0;
+
+    std::string index_path() const
     {
-      file = fopen(filename.c_str(), "r+b");
+      return path + ".idx";
+    }
 
-      if (!file)
-        file = fopen(filename.c_str(), "w+b");
+    static void throw_errno(const std::string& what)
+    {
+      std::stringstream ss;
+      ss << what << ": " << strerror(errno);
+      throw std::logic_error(ss.str());
+    }
 
-      if (!file)
-        throw std::logic_error("Unable to open or create ledger file");
+    static void read_exact(int fd, void* data, size_t size, size_t offset)
+    {
+      auto p = (uint8_t*)data;
+
+      while (size > 0)
+      {
+        auto n = pread(fd, p, size, offset);
+        if (n <= 0)
+          throw std::logic_error("Failed to read from file");
+
+        p += n;
+        size -= n;
+        offset += n;
+      }
+    }
+
+    static void write_exact(
+      int fd, const void* data, size_t size, size_t offset)
+    {
+      auto p = (const uint8_t*)data;
+
+      while (size > 0)
+      {
+        auto n = pwrite(fd, p, size, offset);
+        if (n < 0)
+          throw std::logic_error("Failed to write to file");
+
+        p += n;
+        size -= n;
+        offset += n;
+      }
+    }
+
+    bool load_index()
+    {
+      FILE* idx = fopen(index_path().c_str(), "rb");
+      if (!idx)
+        return false;
+
+      uint64_t header[2];
+      bool ok = fread(header, sizeof(header), 1, idx) == 1;
+
+      struct stat st;
+      ok = ok && stat(path.c_str(), &st) == 0 &&
+        (uint64_t)st.st_size == header[0] && header[1] > 0;
 
-      fseeko(file, 0, SEEK_END);
-      auto len = ftello(file);
-      if (len == 1)
+      std::vector<uint64_t> offsets;
+      if (ok)
       {
-        std::stringstream ss;
-        ss << "Failed to tell file size: " << strerror(errno);
-        throw std::logic_error(ss.str());
+        offsets.resize(header[1]);
+        ok = fread(offsets.data(), sizeof(uint64_t), offsets.size(), idx) ==
+          offsets.size();
       }
-      fseeko(file, 0, SEEK_SET);
+      fclose(idx);
+
+      if (!ok)
+      {
+        LOG_FAIL_FMT("Ignoring invalid ledger index {}", index_path());
+        return false;
+      }
+
+      positions.assign(offsets.begin(), offsets.end());
+      total_len = header[0];
+      flushed_len = total_len;
+      return true;
+    }
+
+    void scan()
+    {
+      struct stat st;
+      if (fstat(fd, &st) != 0)
+        throw_errno("Failed to tell file size");
+
+      size_t len = st.st_size;
       size_t pos = 0;
       uint32_t size = 0;
 
-      while (len >= frame_header_size)
+      while (len - pos >= frame_header_size)
       {
-        if (fread(&size, frame_header_size, 1, file) != 1)
-          throw std::logic_error("Failed to read from file");
+        read_exact(fd, &size, frame_header_size, pos);
 
-        len -= frame_header_size;
-
-        if (len < size)
+        if (len - pos - frame_header_size < size)
           throw std::logic_error("Malformed ledger file");
 
-        fseeko(file, size, SEEK_CUR);
-        len -= size;
-
         positions.push_back(pos);
         pos += (size + frame_header_size);
       }
 
+      if (pos != len)
+        throw std::logic_error("Malformed ledger file");
+
       total_len = pos;
+      flushed_len = pos;
+    }
 
-      if (len != 0)
-        throw std::logic_error("Malformed ledger file");
+    void map()
+    {
+      int map_fd = ::open(path.c_str(), O_RDONLY);
+      if (map_fd == -1)
+        throw_errno("Failed to open ledger segment " + path);
+
+      auto base = mmap(nullptr, total_len, PROT_READ, MAP_SHARED, map_fd, 0);
+      ::close(map_fd);
+
+      if (base == MAP_FAILED)
+        throw_errno("Failed to map ledger segment " + path);
+
+      mapping = std::make_shared<Mapping>(base, total_len);
     }
 
-    Ledger(const Ledger& that) = delete;
+    void open_for_write()
+    {
+      fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+
+      if (fd == -1)
+        throw std::logic_error("Unable to open or create ledger file");
+    }
 
-    ~Ledger()
+    void unseal(size_t len)
     {
-      if (file)
+      // Readers may still hold the old mapping, so the sealed file is never
+      // truncated in place. Instead, the retained prefix is copied to a fresh
+      // file which replaces it.
+      auto tmp_path = path + ".tmp";
+      int tmp = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (tmp == -1)
+        throw std::logic_error("Unable to create ledger file " + tmp_path);
+
+      write_exact(tmp, mapping->base, len, 0);
+      ::close(tmp);
+      unlink(index_path().c_str());
+
+      if (rename(tmp_path.c_str(), path.c_str()) != 0)
+        throw_errno("Failed to replace ledger segment " + path);
+
+      mapping = nullptr;
+      flushed_len = len;
+      open_for_write();
+    }
+
+  public:
+    LedgerFile(const std::string& path, size_t start_idx) :
+      path(path),
+      start_idx(start_idx)
+    {
+      if (load_index())
       {
-        fflush(file);
-        fclose(file);
+        map();
+        return;
       }
+
+      open_for_write();
+      scan();
     }
 
-    size_t get_last_idx()
+    LedgerFile(const LedgerFile& that) = delete;
+
+    ~LedgerFile()
+    {
+      if (fd != -1)
+      {
+        if (!pending.empty())
+        {
+          if (pwrite(fd, pending.data(), pending.size(), flushed_len) < 0)
+            LOG_FAIL_FMT("Failed to flush ledger segment {}", path);
+        }
+        ::close(fd);
+      }
+    }
+
+    size_t get_start_idx() const
+    {
+      return start_idx;
+    }
+
+    size_t get_last_idx() const
+    {
+      return start_idx + positions.size() - 1;
+    }
+
+    size_t get_count() const
     {
       return positions.size();
     }
 
-    const std::vector<uint8_t> read_entry(size_t idx)
+    size_t get_total_len() const
     {
-      if ((idx == 0) || (idx > positions.size()))
-        return {};
+      return total_len;
+    }
+
+    bool is_sealed() const
+    {
+      return mapping != nullptr;
+    }
 
-      auto len = entry_size(idx);
-      std::vector<uint8_t> entry(len);
-      fseeko(file, positions.at(idx - 1) + frame_header_size, SEEK_SET);
+    size_t framed_entries_size(size_t from, size_t to) const
+    {
+      auto to_pos =
+        (to == get_last_idx()) ? total_len : positions.at(to - start_idx + 1);
+      return to_pos - positions.at(from - start_idx);
+    }
 
-      if (fread(entry.data(), len, 1, file) != 1)
-        throw std::logic_error("Failed to read from file");
+    /// Last index in [from, to] such that the framed entries [from, idx] fit
+    /// in max_size bytes, or from if that entry alone is larger
+    size_t last_idx_within(size_t from, size_t to, size_t max_size) const
+    {
+      if (framed_entries_size(from, to) <= max_size)
+        return to;
+
+      // Each entry ends where the next one starts
+      auto limit = positions.at(from - start_idx) + max_size;
+      auto it = std::upper_bound(
+        positions.begin() + (from - start_idx) + 1,
+        positions.begin() + (to - start_idx) + 1,
+        limit);
+
+      auto fits = it - positions.begin() - 1;
+      return std::max(from, start_idx + fits - 1);
+    }
 
-      return entry;
+    /// Hint that the framed entries [from, to] will soon be read, so that the
+    /// kernel starts reading them in the background
+    void read_ahead(size_t from, size_t to)
+    {
+      auto pos = positions.at(from - start_idx);
+      auto size = framed_entries_size(from, to);
+
+      if (mapping)
+      {
+        static const size_t page_size = sysconf(_SC_PAGESIZE);
+        auto aligned_pos = pos - (pos % page_size);
+        madvise(
+          (uint8_t*)mapping->base + aligned_pos,
+          size + (pos - aligned_pos),
+          MADV_WILLNEED);
+      }
+      else
+      {
+        posix_fadvise(fd, pos, size, POSIX_FADV_WILLNEED);
+      }
     }
 
-    const std::vector<uint8_t> read_framed_entries(size_t from, size_t to)
+    LedgerSlice read_framed_entries(size_t from, size_t to)
     {
-      auto framed_size = framed_entries_size(from, to);
+      auto pos = positions.at(from - start_idx);
+      auto size = framed_entries_size(from, to);
 
-      std::vector<uint8_t> framed_entries(framed_size);
-      if (framed_size == 0)
-        return framed_entries;
+      if (mapping)
+      {
+        return {mapping, (const uint8_t*)mapping->base + pos, size};
+      }
 
-      fseeko(file, positions.at(from - 1), SEEK_SET);
+      // Entries which have not been flushed yet are read from pending
+      auto copy = std::make_shared<std::vector<uint8_t>>(size);
+      auto end = pos + size;
 
-      if (fread(framed_entries.data(), framed_size, 1, file) != 1)
-        throw std::logic_error("Failed to read from file");
+      if (pos < flushed_len)
+        read_exact(fd, copy->data(), std::min(end, flushed_len) - pos, pos);
 
-      return framed_entries;
+      if (end > flushed_len)
+      {
+        auto from_pos = std::max(pos, flushed_len);
+        memcpy(
+          copy->data() + (from_pos - pos),
+          pending.data() + (from_pos - flushed_len),
+          end - from_pos);
+      }
+
+      return {copy, copy->data(), size};
     }
 
-    size_t framed_entries_size(size_t from, size_t to)
+    void write_entry(const uint8_t* data, size_t size)
+    {
+      if (mapping)
+        throw std::logic_error("Cannot write to sealed ledger segment");
+
+      positions.push_back(total_len);
+      total_len += (size + frame_header_size);
+
+      uint32_t frame = (uint32_t)size;
+      auto frame_data = (const uint8_t*)&frame;
+
+      pending.insert(pending.end(), frame_data, frame_data + frame_header_size);
+      pending.insert(pending.end(), data, data + size);
+    }
+
+    /// Write all pending entries to the file, returning the number of bytes
+    /// written
+    size_t flush()
     {
-      if ((from == 0) || (to < from) || (to > positions.size()))
+      if (pending.empty())
         return 0;
 
-      if (to == positions.size())
+      auto size = pending.size();
+      write_exact(fd, pending.data(), size, flushed_len);
+
+      flushed_len = total_len;
+      pending.clear();
+      return size;
+    }
+
+    void sync()
+    {
+      if (fd != -1 && fdatasync(fd) != 0)
+        throw_errno("Failed to sync file");
+    }
+
+    void truncate(size_t last_idx)
+    {
+      // Keep entries up to and including last_idx
+      auto count = last_idx + 1 - start_idx;
+      if (count >= positions.size())
+        return;
+
+      total_len = positions.at(count);
+      positions.resize(count);
+
+      if (mapping)
       {
-        return total_len - positions.at(from - 1);
+        unseal(total_len);
+        return;
       }
-      else
+
+      if (total_len >= flushed_len)
+      {
+        pending.resize(total_len - flushed_len);
+        return;
+      }
+
+      pending.clear();
+
+      if (ftruncate(fd, total_len))
+        throw std::logic_error("Failed to truncate file");
+
+      flushed_len = total_len;
+    }
+
+    /// Make the segment read-only, persist its offset index and map it
+    void seal()
+    {
+      if (mapping || positions.empty())
+        return;
+
+      flush();
+
+      if (fsync(fd) != 0)
+        throw_errno("Failed to sync file");
+
+      ::close(fd);
+      fd = -1;
+
+      FILE* idx = fopen(index_path().c_str(), "wb");
+      if (!idx)
+        throw std::logic_error("Unable to create ledger index");
+
+      uint64_t header[2] = {total_len, positions.size()};
+      std::vector<uint64_t> offsets(positions.begin(), positions.end());
+
+      if (
+        fwrite(header, sizeof(header), 1, idx) != 1 ||
+        fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), idx) !=
+          offsets.size())
+        throw std::logic_error("Failed to write ledger index");
+
+      fclose(idx);
+      map();
+
+      LOG_DEBUG_FMT(
+        "Ledger sealed segment {}: [{}, {}]",
+        path,
+        start_idx,
+        get_last_idx());
+    }
+
+    void remove()
+    {
+      if (fd != -1)
+      {
+        ::close(fd);
+        fd = -1;
+      }
+
+      // Outstanding slices keep their (now unlinked) mapping alive
+      unlink(index_path().c_str());
+      unlink(path.c_str());
+    }
+  };
+
+  class Ledger
+  {
+  private:
+    static constexpr size_t frame_header_size = sizeof(uint32_t);
+
+    // Maximum size of each chunk of entries sent to the enclave in response
+    // to a range request (unless a single entry is larger)
+    static constexpr size_t max_read_chunk_size = 1 << 20;
+
+    const std::string filename;
+
+    // If 0, the ledger is a single file which is never sealed. Otherwise,
+    // segments are sealed and mapped as soon as they reach this many bytes.
+    const size_t segment_size;
+
+    std::vector<std::unique_ptr<LedgerFile>> segments;
+    ringbuffer::WriterPtr to_enclave;
+
+    // Index of the first entry. This is 1, unless the node's state was
+    // restored from a snapshot and the ledger starts just after it.
+    size_t first_idx = 1;
+
+    std::string segment_path(size_t start_idx) const
+    {
+      if (segment_size == 0)
+        return filename;
+
+      return filename + "." + std::to_string(start_idx);
+    }
+
+    std::vector<size_t> find_segments() const
+    {
+      std::vector<size_t> starts;
+
+      if (segment_size == 0)
+      {
+        starts.push_back(1);
+        return starts;
+      }
+
+      glob_t g;
+      auto pattern = filename + ".*";
+      if (glob(pattern.c_str(), 0, nullptr, &g) == 0)
+      {
+        for (size_t i = 0; i < g.gl_pathc; i++)
+        {
+          std::string suffix(g.gl_pathv[i] + filename.size() + 1);
+          if (
+            !suffix.empty() &&
+            std::all_of(suffix.begin(), suffix.end(), ::isdigit))
+            starts.push_back(std::stoull(suffix));
+        }
+      }
+      globfree(&g);
+
+      std::sort(starts.begin(), starts.end());
+      return starts;
+    }
+
+    LedgerFile& segment_for(size_t idx) const
+    {
+      auto it = std::upper_bound(
+        segments.begin(),
+        segments.end(),
+        idx,
+        [](size_t i, const std::unique_ptr<LedgerFile>& s) {
+          return i < s->get_start_idx();
+        });
+
+      return **(--it);
+    }
+
+  public:
+    Ledger(
+      const std::string& filename,
+      ringbuffer::AbstractWriterFactory& writer_factory,
+      size_t segment_size = 0) :
+      filename(filename),
+      segment_size(segment_size),
+      to_enclave(writer_factory.create_writer_to_inside())
+    {
+      auto starts = find_segments();
+      if (!starts.empty())
+        first_idx = starts.front();
+
+      size_t next_idx = first_idx;
+
+      for (auto start : starts)
+      {
+        if (start != next_idx)
+          throw std::logic_error("Malformed ledger: missing segment");
+
+        auto segment =
+          std::make_unique<LedgerFile>(segment_path(start), start);
+        next_idx = segment->get_last_idx() + 1;
+
+        // All but the most recent segment should already be sealed, but may
+        // not be if the host stopped while sealing.
+        if (segment_size != 0 && !segments.empty())
+          segments.back()->seal();
+
+        segments.push_back(std::move(segment));
+      }
+    }
+
+    Ledger(const Ledger& that) = delete;
+
+    size_t get_last_idx()
+    {
+      if (segments.empty())
+        return first_idx - 1;
+
+      return segments.back()->get_last_idx();
+    }
+
+    size_t get_first_idx() const
+    {
+      return first_idx;
+    }
+
+    /// Start an empty ledger after idx, at which the node's state was restored
+    /// from a snapshot. A single ledger file always starts at index 1, so this
+    /// requires a segmented ledger.
+    bool init(size_t idx)
+    {
+      if (get_last_idx() == idx)
+        return true;
+
+      if (segment_size == 0 || !segments.empty())
+      {
+        LOG_FAIL_FMT(
+          "Cannot start ledger after {}: {}",
+          idx,
+          segments.empty() ? "ledger is not segmented" : "ledger is not empty");
+        return false;
+      }
+
+      LOG_INFO_FMT("Ledger starts after snapshot at {}", idx);
+      first_idx = idx + 1;
+      return true;
+    }
+
+    /// Framed entries [from, to], as one slice per segment they span
+    std::vector<LedgerSlice> read_framed_entries_slices(size_t from, size_t to)
+    {
+      std::vector<LedgerSlice> slices;
+      if ((from < first_idx) || (to < from) || (to > get_last_idx()))
+        return slices;
+
+      while (from <= to)
+      {
+        auto& segment = segment_for(from);
+        auto last = std::min(to, segment.get_last_idx());
+        slices.push_back(segment.read_framed_entries(from, last));
+        from = last + 1;
+      }
+
+      return slices;
+    }
+
+    /// Framed entries [from, to], split into chunks of consecutive entries,
+    /// along with the index of the first entry in each chunk
+    std::vector<std::pair<size_t, LedgerSlice>> read_framed_entries_chunks(
+      size_t from, size_t to, size_t max_chunk_size)
+    {
+      std::vector<std::pair<size_t, LedgerSlice>> chunks;
+      if ((from < first_idx) || (to < from) || (to > get_last_idx()))
+        return chunks;
+
+      while (from <= to)
+      {
+        auto& segment = segment_for(from);
+        auto last = segment.last_idx_within(
+          from, std::min(to, segment.get_last_idx()), max_chunk_size);
+        chunks.emplace_back(from, segment.read_framed_entries(from, last));
+        from = last + 1;
+      }
+
+      return chunks;
+    }
+
+    void read_ahead(size_t from, size_t to)
+    {
+      to = std::min(to, get_last_idx());
+
+      while (from >= first_idx && from <= to)
+      {
+        auto& segment = segment_for(from);
+        auto last = std::min(to, segment.get_last_idx());
+        segment.read_ahead(from, last);
+        from = last + 1;
+      }
+    }
+
+    const std::vector<uint8_t> read_entry(size_t idx)
+    {
+      if ((idx < first_idx) || (idx > get_last_idx()))
+        return {};
+
+      auto slice = segment_for(idx).read_framed_entries(idx, idx);
+      return std::vector<uint8_t>(
+        slice.data + frame_header_size, slice.data + slice.size);
+    }
+
+    const std::vector<uint8_t> read_framed_entries(size_t from, size_t to)
+    {
+      std::vector<uint8_t> framed_entries;
+      framed_entries.reserve(framed_entries_size(from, to));
+
+      for (auto& slice : read_framed_entries_slices(from, to))
+        framed_entries.insert(
+          framed_entries.end(), slice.data, slice.data + slice.size);
+
+      return framed_entries;
+    }
+
+    size_t framed_entries_size(size_t from, size_t to)
+    {
+      if ((from < first_idx) || (to < from) || (to > get_last_idx()))
+        return 0;
+
+      size_t size = 0;
+
+      while (from <= to)
       {
-        return positions.at(to) - positions.at(from - 1);
+        auto& segment = segment_for(from);
+        auto last = std::min(to, segment.get_last_idx());
+        size += segment.framed_entries_size(from, last);
+        from = last + 1;
       }
+
+      return size;
     }
 
     size_t entry_size(size_t idx)
@@ -149,55 +712,64 @@ namespace asynchost
 
     void write_entry(const uint8_t* data, size_t size)
     {
-      fseeko(file, total_len, SEEK_SET);
-      positions.push_back(total_len);
+      if (segments.empty() || segments.back()->is_sealed())
+      {
+        auto start = get_last_idx() + 1;
+        segments.push_back(
+          std::make_unique<LedgerFile>(segment_path(start), start));
+      }
 
-      LOG_DEBUG_FMT("Ledger write {}: {} bytes", positions.size(), size);
+      auto& segment = *segments.back();
+      segment.write_entry(data, size);
 
-      total_len += (size + frame_header_size);
+      LOG_DEBUG_FMT("Ledger write {}: {} bytes", get_last_idx(), size);
 
-      uint32_t frame = (uint32_t)size;
+      if (segment_size != 0 && segment.get_total_len() >= segment_size)
+        segment.seal();
+    }
+
+    /// Write out all entries appended since the last flush. Returns the number
+    /// of bytes written.
+    size_t flush()
+    {
+      if (segments.empty())
+        return 0;
 
-      if (fwrite(&frame, frame_header_size, 1, file) != 1)
-        throw std::logic_error("Failed to write to file");
+      return segments.back()->flush();
+    }
 
-      if (fwrite(data, size, 1, file) != 1)
-        throw std::logic_error("Failed to write to file");
+    /// Sync flushed entries to disk. Sealed segments are synced when sealed.
+    void sync()
+    {
+      if (!segments.empty())
+        segments.back()->sync();
     }
 
     void truncate(size_t last_idx)
     {
-      LOG_DEBUG_FMT("Ledger truncate: {}/{}", last_idx, positions.size());
+      LOG_DEBUG_FMT("Ledger truncate: {}/{}", last_idx, get_last_idx());
 
-      // positions[last_idx - 1] is the position of the specified
-      // final index. Truncate the ledger at position[last_idx].
-      if (last_idx >= positions.size())
+      if (last_idx >= get_last_idx())
         return;
 
-      total_len = positions.at(last_idx);
-      positions.resize(last_idx);
-
-      if (fflush(file) != 0)
+      // Segments starting after last_idx are removed entirely, except in
+      // single-file mode where the one file is kept and emptied.
+      while (
+        segment_size != 0 && !segments.empty() &&
+        segments.back()->get_start_idx() > last_idx)
       {
-        std::stringstream ss;
-        ss << "Failed to flush file: " << strerror(errno);
-        throw std::logic_error(ss.str());
+        segments.back()->remove();
+        segments.pop_back();
       }
 
-      if (ftruncate(fileno(file), total_len))
-        throw std::logic_error("Failed to truncate file");
-
-      fseeko(file, total_len, SEEK_SET);
+      if (!segments.empty())
+        segments.back()->truncate(last_idx);
     }
 
+    // Appends are handled by the LedgerWriter, which batches them
     void register_message_handlers(
       messaging::Dispatcher<ringbuffer::Message>& disp)
     {
-      DISPATCHER_SET_MESSAGE_HANDLER(
-        disp,
-        consensus::ledger_append,
-        [this](const uint8_t* data, size_t size) { write_entry(data, size); });
-
       DISPATCHER_SET_MESSAGE_HANDLER(
         disp,
         consensus::ledger_truncate,
@@ -207,23 +779,45 @@ namespace asynchost
         });
 
       DISPATCHER_SET_MESSAGE_HANDLER(
-        disp, consensus::ledger_get, [&](const uint8_t* data, size_t size) {
-          // The enclave has asked for a ledger entry.
+        disp,
+        consensus::ledger_init,
+        [this](const uint8_t* data, size_t size) {
           auto [idx] =
-            ringbuffer::read_message<consensus::ledger_get>(data, size);
+            ringbuffer::read_message<consensus::ledger_init>(data, size);
+          init(idx);
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_get_range,
+        [&](const uint8_t* data, size_t size) {
+          // The enclave has asked for a range of ledger entries.
+          auto [from, to] =
+            ringbuffer::read_message<consensus::ledger_get_range>(data, size);
 
-          auto& entry = read_entry(idx);
+          auto last = std::min<size_t>(to, get_last_idx());
+
+          for (auto& [chunk_from, chunk] :
+               read_framed_entries_chunks(from, last, max_read_chunk_size))
+          {
+            RINGBUFFER_WRITE_MESSAGE(
+              consensus::ledger_entries,
+              to_enclave,
+              chunk_from,
+              serializer::ByteRange{chunk.data, chunk.size});
+          }
 
-          if (entry.size() > 0)
+          if (to > last)
           {
             RINGBUFFER_WRITE_MESSAGE(
-              consensus::ledger_entry, to_enclave, entry);
+              consensus::ledger_no_entry, to_enclave, last + 1);
           }
           else
           {
-            RINGBUFFER_WRITE_MESSAGE(consensus::ledger_no_entry, to_enclave);
+            // The enclave is likely to ask for the next range next
+            read_ahead(to + 1, to + (to - from) + 1);
           }
         });
     }
   };
-}
\ No newline at end of file
+}
@@ -0,0 +1,50 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ledgerwriter.h"
+#include "timer.h"
+
+namespace asynchost
+{
+  /// Periodically logs the batch sizes and sync latencies of a LedgerWriter
+  /// over the last period
+  class LedgerStatsImpl
+  {
+  private:
+    const LedgerWriter& writer;
+    LedgerWriter::Counters last;
+
+  public:
+    LedgerStatsImpl(const LedgerWriter& writer) : writer(writer) {}
+
+    void on_timer()
+    {
+      const auto& c = writer.get_counters();
+
+      auto batches = c.batches - last.batches;
+      if (batches == 0)
+        return;
+
+      auto entries = c.entries - last.entries;
+      auto syncs = c.syncs - last.syncs;
+      auto sync_time = c.total_sync_time - last.total_sync_time;
+
+      LOG_INFO_FMT(
+        "Ledger: {} entries ({} bytes) in {} batches, {:.1f} entries per batch "
+        "(max {}), {} syncs, {}us per sync (max {}us)",
+        entries,
+        c.bytes - last.bytes,
+        batches,
+        (double)entries / batches,
+        c.max_batch_entries,
+        syncs,
+        syncs == 0 ? 0 : sync_time.count() / syncs,
+        c.max_sync_time.count());
+
+      last = c;
+    }
+  };
+
+  using LedgerStats = proxy_ptr<Timer<LedgerStatsImpl>>;
+}
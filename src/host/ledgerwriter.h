@@ -0,0 +1,162 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ledger.h"
+
+#include <chrono>
+
+namespace asynchost
+{
+  enum class LedgerSyncPolicy
+  {
+    /// Entries are written once per batch, but never explicitly synced. They
+    /// are reported as durable once written.
+    none,
+    /// Every batch is synced (fdatasync) once written
+    batch,
+    /// Written batches are synced at most once per sync interval
+    interval
+  };
+
+  /// Group-commits ledger appends: all consensus::ledger_append messages read
+  /// from the ringbuffer in one drain are staged in the ledger, then written
+  /// out together by flush(), which applies the sync policy and reports the
+  /// last durable index to the enclave.
+  class LedgerWriter
+  {
+  public:
+    struct Counters
+    {
+      size_t batches = 0;
+      size_t entries = 0;
+      size_t bytes = 0;
+      size_t max_batch_entries = 0;
+      size_t syncs = 0;
+      std::chrono::microseconds total_sync_time{0};
+      std::chrono::microseconds max_sync_time{0};
+    };
+
+  private:
+    Ledger& ledger;
+    const LedgerSyncPolicy sync_policy;
+    const std::chrono::milliseconds sync_interval;
+    ringbuffer::WriterPtr to_enclave;
+
+    size_t batch_entries = 0;
+    bool unsynced = false;
+    consensus::Index durable_idx = 0;
+    std::chrono::steady_clock::time_point last_sync;
+    Counters counters;
+
+  public:
+    LedgerWriter(
+      Ledger& ledger,
+      ringbuffer::AbstractWriterFactory& writer_factory,
+      LedgerSyncPolicy sync_policy = LedgerSyncPolicy::none,
+      std::chrono::milliseconds sync_interval = std::chrono::milliseconds(0)) :
+      ledger(ledger),
+      sync_policy(sync_policy),
+      sync_interval(sync_interval),
+      to_enclave(writer_factory.create_writer_to_inside()),
+      last_sync(std::chrono::steady_clock::now())
+    {}
+
+    void append(const uint8_t* data, size_t size)
+    {
+      ledger.write_entry(data, size);
+      batch_entries++;
+    }
+
+    /// Called once all pending ringbuffer messages have been processed
+    void flush()
+    {
+      if (batch_entries > 0)
+      {
+        auto bytes = ledger.flush();
+
+        counters.batches++;
+        counters.entries += batch_entries;
+        counters.bytes += bytes;
+        counters.max_batch_entries =
+          std::max(counters.max_batch_entries, batch_entries);
+
+        LOG_TRACE_FMT(
+          "Ledger batch: {} entries, {} bytes", batch_entries, bytes);
+
+        batch_entries = 0;
+        unsynced = true;
+      }
+
+      if (!unsynced)
+        return;
+
+      switch (sync_policy)
+      {
+        case LedgerSyncPolicy::none:
+        {
+          unsynced = false;
+          report_durable();
+          break;
+        }
+
+        case LedgerSyncPolicy::batch:
+        {
+          sync();
+          break;
+        }
+
+        case LedgerSyncPolicy::interval:
+        {
+          if (std::chrono::steady_clock::now() - last_sync >= sync_interval)
+            sync();
+          break;
+        }
+      }
+    }
+
+    const Counters& get_counters() const
+    {
+      return counters;
+    }
+
+    void register_message_handlers(
+      messaging::Dispatcher<ringbuffer::Message>& disp)
+    {
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_append,
+        [this](const uint8_t* data, size_t size) { append(data, size); });
+    }
+
+  private:
+    void sync()
+    {
+      auto start = std::chrono::steady_clock::now();
+      ledger.sync();
+      last_sync = std::chrono::steady_clock::now();
+      unsynced = false;
+
+      auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        last_sync - start);
+      counters.syncs++;
+      counters.total_sync_time += elapsed;
+      counters.max_sync_time = std::max(counters.max_sync_time, elapsed);
+      LOG_TRACE_FMT("Ledger synced in {}us", elapsed.count());
+
+      report_durable();
+    }
+
+    void report_durable()
+    {
+      auto last_idx = ledger.get_last_idx();
+      if (last_idx != durable_idx)
+      {
+        durable_idx = last_idx;
+        LOG_TRACE_FMT("Ledger durable up to {}", durable_idx);
+        RINGBUFFER_WRITE_MESSAGE(
+          consensus::ledger_durable, to_enclave, durable_idx);
+      }
+    }
+  };
+}
@@ -7,10 +7,13 @@
 #include "ds/oversized.h"
 #include "enclave.h"
 #include "handle_ringbuffer.h"
+#include "ledgerstats.h"
+#include "ledgerwriter.h"
 #include "nodeconnections.h"
 #include "notifyconnections.h"
 #include "rpcconnections.h"
 #include "sigterm.h"
+#include "snapshots.h"
 #include "ticker.h"
 
 #include <CLI11/CLI11.hpp>
@@ -20,6 +23,7 @@
 #include <locale>
 #include <string>
 #include <thread>
+#include <vector>
 
 using namespace std::string_literals;
 using namespace std::chrono_literals;
@@ -81,6 +85,38 @@ int main(int argc, char** argv)
   std::string ledger_file("ccf.ledger");
   app.add_option("--ledger-file", ledger_file, "Ledger file", true);
 
+  size_t ledger_segment_size = 0;
+  app.add_option(
+    "--ledger-segment-size",
+    ledger_segment_size,
+    "Size in bytes after which the ledger is split into a new segment file. "
+    "Complete segments are indexed and memory-mapped read-only. If 0, the "
+    "ledger is kept in a single file",
+    true);
+
+  std::string ledger_sync("none");
+  app.add_set(
+    "--ledger-sync",
+    ledger_sync,
+    {"none", "batch", "interval"},
+    "When to sync ledger writes to disk: never explicitly, after every batch "
+    "of appended entries, or at most every --ledger-sync-interval-ms",
+    true);
+
+  size_t ledger_sync_interval = 10;
+  app.add_option(
+    "--ledger-sync-interval-ms",
+    ledger_sync_interval,
+    "Minimum milliseconds between ledger syncs, with --ledger-sync interval",
+    true);
+
+  size_t ledger_stats_interval = 60000;
+  app.add_option(
+    "--ledger-stats-interval-ms",
+    ledger_stats_interval,
+    "Milliseconds between logs of the ledger batch sizes and sync latencies",
+    true);
+
   std::string host_log_level("info");
   app.add_set(
     "-l,--host-log-level",
@@ -119,6 +155,42 @@ int main(int argc, char** argv)
     "Maximum milliseconds between signatures",
     true);
 
+  size_t forwarding_batch_max_delay_ms = 0;
+  app.add_option(
+    "--forwarding-batch-max-delay-ms",
+    forwarding_batch_max_delay_ms,
+    "Maximum milliseconds for which forwarded commands and responses are "
+    "batched before being encrypted and sent to another node. If 0, they are "
+    "sent as soon as they are forwarded.",
+    true);
+
+  size_t forwarding_batch_max_size = 1 << 16;
+  app.add_option(
+    "--forwarding-batch-max-size",
+    forwarding_batch_max_size,
+    "Size (bytes) above which a batch of forwarded commands and responses is "
+    "sent, without waiting for --forwarding-batch-max-delay-ms",
+    true);
+
+  size_t snapshot_interval = 0;
+  app.add_option(
+    "--snapshot-interval",
+    snapshot_interval,
+    "Minimum number of globally committed transactions between snapshots of "
+    "the store, taken by the primary next to the ledger. If 0, no snapshot is "
+    "taken",
+    true);
+
+  size_t worker_threads = 0;
+  app.add_option(
+    "--worker-threads",
+    worker_threads,
+    "Number of additional threads executing client requests inside the "
+    "enclave. If 0, requests are executed on the thread running consensus. "
+    "Each thread uses one of the enclave's TCS, so this must be lower than its "
+    "NumTCS",
+    true);
+
   size_t circuit_size_shift = 22;
   app.add_option(
     "--circuit-size-shift",
@@ -151,6 +223,33 @@ int main(int argc, char** argv)
     "set to a significantly lower value than --raft-election-timeout-ms.",
     true);
 
+  size_t raft_append_entries_size_limit =
+    raft::default_append_entries_size_limit;
+  app.add_option(
+    "--raft-append-entries-size-limit",
+    raft_append_entries_size_limit,
+    "Maximum size, in bytes, of the entries the Raft leader sends to a "
+    "follower in one message. Followers that are far behind are sent larger "
+    "messages to catch up.",
+    true);
+
+  size_t raft_max_inflight_append_entries =
+    raft::default_max_inflight_append_entries;
+  app.add_option(
+    "--raft-max-inflight-append-entries",
+    raft_max_inflight_append_entries,
+    "Maximum number of messages of entries the Raft leader sends to a "
+    "follower before the follower acknowledges them.",
+    true);
+
+  bool raft_coalesce_messages = false;
+  app.add_flag(
+    "--raft-coalesce-messages",
+    raft_coalesce_messages,
+    "Coalesce the Raft heartbeats and responses sent to the same node within "
+    "a tick, so that they are authenticated once. This saves work when "
+    "messages are frequent, but delays them until the end of the tick.");
+
   size_t max_msg_size = 24;
   app.add_option(
     "--max-msg-size",
@@ -306,10 +405,6 @@ int main(int argc, char** argv)
     logger::config::set_start(s);
   });
 
-  // handle outbound messages from the enclave
-  asynchost::HandleRingbuffer handle_ringbuffer(
-    bp, circuit.read_from_inside(), non_blocking_factory);
-
   // graceful shutdown on sigterm
   asynchost::Sigterm sigterm(writer_factory);
 
@@ -325,13 +420,21 @@ int main(int argc, char** argv)
   EnclaveConfig enclave_config;
   enclave_config.circuit = &circuit;
   enclave_config.writer_config = writer_config;
+  enclave_config.worker_threads = worker_threads;
 #ifdef DEBUG_CONFIG
   enclave_config.debug_config = {memory_reserve_startup};
 #endif
 
   CCFConfig ccf_config;
-  ccf_config.raft_config = {raft_timeout, raft_election_timeout};
+  ccf_config.raft_config = {raft_timeout,
+                            raft_election_timeout,
+                            raft_append_entries_size_limit,
+                            raft_max_inflight_append_entries,
+                            raft_coalesce_messages};
   ccf_config.signature_intervals = {sig_max_tx, sig_max_ms};
+  ccf_config.forwarding_batch = {forwarding_batch_max_delay_ms,
+                                 forwarding_batch_max_size};
+  ccf_config.snapshot_interval = snapshot_interval;
   ccf_config.node_info_network = {rpc_address.hostname,
                                   public_rpc_address.hostname,
                                   node_address.hostname,
@@ -390,9 +493,38 @@ int main(int argc, char** argv)
   LOG_INFO_FMT("Created new node");
 
   // ledger
-  asynchost::Ledger ledger(ledger_file, writer_factory);
+  asynchost::Ledger ledger(ledger_file, writer_factory, ledger_segment_size);
   ledger.register_message_handlers(bp.get_dispatcher());
 
+  auto ledger_sync_policy = asynchost::LedgerSyncPolicy::none;
+  if (ledger_sync == "batch")
+    ledger_sync_policy = asynchost::LedgerSyncPolicy::batch;
+  else if (ledger_sync == "interval")
+    ledger_sync_policy = asynchost::LedgerSyncPolicy::interval;
+
+  asynchost::LedgerWriter ledger_writer(
+    ledger,
+    writer_factory,
+    ledger_sync_policy,
+    std::chrono::milliseconds(ledger_sync_interval));
+  ledger_writer.register_message_handlers(bp.get_dispatcher());
+  asynchost::LedgerStats ledger_stats(ledger_stats_interval, ledger_writer);
+
+  // snapshots, kept next to the ledger. A joining node can only start from a
+  // snapshot if its ledger is segmented, so that it can start after it.
+  asynchost::Snapshots snapshots(
+    ledger_file,
+    writer_factory,
+    start_type != StartType::Join || ledger_segment_size != 0);
+  snapshots.register_message_handlers(bp.get_dispatcher());
+
+  // handle outbound messages from the enclave, writing out all ledger entries
+  // appended by each batch of messages together
+  asynchost::HandleRingbuffer handle_ringbuffer(
+    bp, circuit.read_from_inside(), non_blocking_factory, [&ledger_writer]() {
+      ledger_writer.flush();
+    });
+
   asynchost::NodeConnections node(
     ledger, writer_factory, node_address.hostname, node_address.port);
   node.register_message_handlers(bp.get_dispatcher());
@@ -443,8 +575,18 @@ int main(int argc, char** argv)
 #endif
   });
 
+  // Start threads which will ECall and execute client requests inside the
+  // enclave, until it is stopped
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < worker_threads; ++i)
+  {
+    workers.emplace_back([&]() { enclave.run_worker(); });
+  }
+
   uv_run(uv_default_loop(), UV_RUN_DEFAULT);
   enclave_thread.join();
+  for (auto& t : workers)
+    t.join();
 
   return 0;
 }
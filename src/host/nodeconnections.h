@@ -228,9 +228,14 @@ namespace asynchost
 
             // Find the total frame size, and write it along with the header.
             auto count = ae.idx - ae.prev_idx;
-            uint32_t frame = (uint32_t)(
-              size_to_send +
-              ledger.framed_entries_size(ae.prev_idx + 1, ae.idx));
+            auto slices =
+              ledger.read_framed_entries_slices(ae.prev_idx + 1, ae.idx);
+
+            size_t entries_size = 0;
+            for (auto& slice : slices)
+              entries_size += slice.size;
+
+            uint32_t frame = (uint32_t)(size_to_send + entries_size);
 
             LOG_DEBUG_FMT(
               "raft send AE to {} [{}]: {}, {}",
@@ -239,14 +244,17 @@ namespace asynchost
               ae.idx,
               ae.prev_idx);
 
-            // TODO(#performance): writev
-            node.value()->write(sizeof(uint32_t), (uint8_t*)&frame);
-            node.value()->write(size_to_send, data_to_send);
+            // The ledger entries are written straight from the ledger, in the
+            // same write as the header
+            std::vector<PinnedBuffer> buffers;
+            buffers.reserve(slices.size() + 1);
+            buffers.push_back(framed_copy(frame, data_to_send, size_to_send));
+
+            for (auto& slice : slices)
+              buffers.push_back(
+                {std::move(slice.owner), slice.data, slice.size});
 
-            auto framed_entries =
-              ledger.read_framed_entries(ae.prev_idx + 1, ae.idx);
-            frame = (uint32_t)framed_entries.size();
-            node.value()->write(frame, framed_entries.data());
+            node.value()->write(std::move(buffers));
           }
           else
           {
@@ -255,13 +263,22 @@ namespace asynchost
 
             LOG_DEBUG_FMT("node send to {} [{}]", to, frame);
 
-            node.value()->write(sizeof(uint32_t), (uint8_t*)&frame);
-            node.value()->write(size_to_send, data_to_send);
+            node.value()->write(
+              {framed_copy(frame, data_to_send, size_to_send)});
           }
         });
     }
 
   private:
+    static PinnedBuffer framed_copy(
+      uint32_t frame, const uint8_t* data, size_t size)
+    {
+      auto copy = std::make_shared<std::vector<uint8_t>>(sizeof(frame) + size);
+      memcpy(copy->data(), &frame, sizeof(frame));
+      memcpy(copy->data() + sizeof(frame), data, size);
+      return {copy, copy->data(), copy->size()};
+    }
+
     bool add_node(
       ccf::NodeId node, const std::string& host, const std::string& service)
     {
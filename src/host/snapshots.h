@@ -0,0 +1,220 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "consensus/ledgerenclavetypes.h"
+#include "ds/logger.h"
+#include "ds/messaging.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <glob.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace asynchost
+{
+  /// Snapshots of the enclave's store, kept next to the ledger as
+  /// <ledger file>.snapshot.<index>. Each file holds the framed chunks of one
+  /// snapshot. Chunks are written to a temporary file, which is only renamed
+  /// once the enclave has committed the snapshot, so that incomplete snapshots
+  /// are never loaded.
+  class Snapshots
+  {
+  private:
+    static constexpr size_t frame_header_size = sizeof(uint32_t);
+
+    const std::string prefix;
+
+    // If false, no snapshot is loaded by the enclave. This is the case for
+    // a joining node whose ledger cannot start after a snapshot.
+    const bool loadable;
+
+    ringbuffer::WriterPtr to_enclave;
+
+    // Snapshot being written, if any
+    consensus::Index pending_idx = 0;
+    FILE* pending_file = nullptr;
+
+    std::string snapshot_path(consensus::Index idx) const
+    {
+      return prefix + std::to_string(idx);
+    }
+
+    std::string pending_path(consensus::Index idx) const
+    {
+      return snapshot_path(idx) + ".tmp";
+    }
+
+    void discard_pending()
+    {
+      if (pending_file == nullptr)
+        return;
+
+      fclose(pending_file);
+      pending_file = nullptr;
+      ::remove(pending_path(pending_idx).c_str());
+      pending_idx = 0;
+    }
+
+  public:
+    Snapshots(
+      const std::string& ledger_filename,
+      ringbuffer::AbstractWriterFactory& writer_factory,
+      bool loadable = true) :
+      prefix(ledger_filename + ".snapshot."),
+      loadable(loadable),
+      to_enclave(writer_factory.create_writer_to_inside())
+    {}
+
+    Snapshots(const Snapshots& that) = delete;
+
+    ~Snapshots()
+    {
+      discard_pending();
+    }
+
+    /// Index of the latest complete snapshot, or 0 if there is none
+    consensus::Index get_latest_idx() const
+    {
+      consensus::Index latest = 0;
+
+      glob_t g;
+      auto pattern = prefix + "*";
+      if (glob(pattern.c_str(), 0, nullptr, &g) == 0)
+      {
+        for (size_t i = 0; i < g.gl_pathc; i++)
+        {
+          std::string suffix(g.gl_pathv[i] + prefix.size());
+          if (
+            !suffix.empty() &&
+            std::all_of(suffix.begin(), suffix.end(), ::isdigit))
+            latest = std::max<consensus::Index>(latest, std::stoull(suffix));
+        }
+      }
+      globfree(&g);
+
+      return latest;
+    }
+
+    void write_chunk(consensus::Index idx, const uint8_t* data, size_t size)
+    {
+      // Chunks of a new snapshot replace an unfinished one
+      if (idx != pending_idx)
+      {
+        discard_pending();
+
+        pending_file = fopen(pending_path(idx).c_str(), "wb");
+        if (pending_file == nullptr)
+        {
+          LOG_FAIL_FMT("Unable to open snapshot file for {}", idx);
+          return;
+        }
+        pending_idx = idx;
+      }
+
+      uint32_t frame = (uint32_t)size;
+      if (
+        fwrite(&frame, frame_header_size, 1, pending_file) != 1 ||
+        (size > 0 && fwrite(data, size, 1, pending_file) != 1))
+      {
+        LOG_FAIL_FMT("Failed to write snapshot chunk for {}", idx);
+        discard_pending();
+      }
+    }
+
+    bool commit(consensus::Index idx)
+    {
+      if (pending_file == nullptr || idx != pending_idx)
+      {
+        LOG_FAIL_FMT("Cannot commit incomplete snapshot {}", idx);
+        return false;
+      }
+
+      auto ok = fflush(pending_file) == 0 && fsync(fileno(pending_file)) == 0;
+      fclose(pending_file);
+      pending_file = nullptr;
+
+      if (
+        !ok ||
+        rename(pending_path(idx).c_str(), snapshot_path(idx).c_str()) != 0)
+      {
+        LOG_FAIL_FMT("Failed to commit snapshot {}", idx);
+        ::remove(pending_path(idx).c_str());
+        pending_idx = 0;
+        return false;
+      }
+
+      LOG_INFO_FMT("Committed snapshot {}", idx);
+      pending_idx = 0;
+      return true;
+    }
+
+    /// Chunks of a complete snapshot, in order. Empty if the snapshot cannot
+    /// be read.
+    std::vector<std::vector<uint8_t>> read_chunks(consensus::Index idx) const
+    {
+      std::vector<std::vector<uint8_t>> chunks;
+
+      FILE* f = fopen(snapshot_path(idx).c_str(), "rb");
+      if (f == nullptr)
+        return chunks;
+
+      uint32_t frame;
+      while (fread(&frame, frame_header_size, 1, f) == 1)
+      {
+        std::vector<uint8_t> chunk(frame);
+        if (frame > 0 && fread(chunk.data(), frame, 1, f) != 1)
+        {
+          LOG_FAIL_FMT("Snapshot {} is truncated", idx);
+          chunks.clear();
+          break;
+        }
+        chunks.push_back(std::move(chunk));
+      }
+
+      fclose(f);
+      return chunks;
+    }
+
+    void register_message_handlers(
+      messaging::Dispatcher<ringbuffer::Message>& disp)
+    {
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::snapshot_put_chunk,
+        [this](const uint8_t* data, size_t size) {
+          auto idx = serialized::read<consensus::Index>(data, size);
+          write_chunk(idx, data, size);
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::snapshot_commit,
+        [this](const uint8_t* data, size_t size) {
+          auto [idx] =
+            ringbuffer::read_message<consensus::snapshot_commit>(data, size);
+          commit(idx);
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp, consensus::snapshot_get, [this](const uint8_t*, size_t) {
+          consensus::Index idx = loadable ? get_latest_idx() : 0;
+          auto chunks = read_chunks(idx);
+          if (chunks.empty())
+            idx = 0;
+
+          for (auto& chunk : chunks)
+          {
+            RINGBUFFER_WRITE_MESSAGE(
+              consensus::snapshot_chunk, to_enclave, idx, chunk);
+          }
+
+          RINGBUFFER_WRITE_MESSAGE(consensus::snapshot_end, to_enclave, idx);
+        });
+    }
+  };
+}
@@ -11,6 +11,15 @@ namespace asynchost
   class TCPImpl;
   using TCP = proxy_ptr<TCPImpl>;
 
+  /// A buffer which is written without being copied. owner is kept alive
+  /// until the write has completed.
+  struct PinnedBuffer
+  {
+    std::shared_ptr<const void> owner;
+    const uint8_t* data;
+    size_t size;
+  };
+
   class TCPBehaviour
   {
   public:
@@ -48,27 +57,28 @@ namespace asynchost
       RECONNECTING
     };
 
-    struct PendingWrite
+    struct WriteRequest
     {
-      uv_write_t* req;
-      size_t len;
+      uv_write_t req;
 
-      PendingWrite(uv_write_t* req, size_t len) : req(req), len(len) {}
+      // Bytes copied from the caller, if any
+      std::vector<uint8_t> copy;
 
-      PendingWrite(PendingWrite&& that) : req(that.req), len(that.len)
-      {
-        that.req = nullptr;
-      }
+      // Owners of buffers written without copying. These are only released
+      // once the write has completed.
+      std::vector<std::shared_ptr<const void>> owners;
+
+      std::vector<uv_buf_t> bufs;
 
-      ~PendingWrite()
+      WriteRequest()
       {
-        free_write(req);
+        req.data = this;
       }
     };
 
     Status status;
     std::unique_ptr<TCPBehaviour> behaviour;
-    std::vector<PendingWrite> pending_writes;
+    std::vector<std::unique_ptr<WriteRequest>> pending_writes;
 
     std::string host;
     std::string service;
@@ -142,12 +152,35 @@ namespace asynchost
 
     bool write(size_t len, const uint8_t* data)
     {
-      auto req = new uv_write_t;
-      char* copy = new char[len];
+      auto w = std::make_unique<WriteRequest>();
+      w->copy.resize(len);
       if (data)
-        memcpy(copy, data, len);
-      req->data = copy;
+        memcpy(w->copy.data(), data, len);
+
+      w->bufs.push_back(uv_buf_init((char*)w->copy.data(), len));
+      return write(std::move(w));
+    }
+
+    /// Write all buffers, in order, with a single uv_write and without
+    /// copying them
+    bool write(std::vector<PinnedBuffer>&& buffers)
+    {
+      auto w = std::make_unique<WriteRequest>();
+      w->owners.reserve(buffers.size());
+      w->bufs.reserve(buffers.size());
+
+      for (auto& b : buffers)
+      {
+        w->bufs.push_back(uv_buf_init((char*)b.data, b.size));
+        w->owners.push_back(std::move(b.owner));
+      }
+
+      return write(std::move(w));
+    }
 
+  private:
+    bool write(std::unique_ptr<WriteRequest> w)
+    {
       switch (status)
       {
         case CONNECTING_RESOLVING:
@@ -155,16 +188,17 @@ namespace asynchost
         case RESOLVING_FAILED:
         case CONNECTING_FAILED:
         {
-          pending_writes.emplace_back(req, len);
+          pending_writes.push_back(std::move(w));
           break;
         }
 
         case CONNECTED:
-          return send_write(req, len);
+          return send_write(std::move(w));
 
         case DISCONNECTED:
         {
-          LOG_DEBUG_FMT("Disconnected: Ignoring write of size {}", len);
+          LOG_DEBUG_FMT(
+            "Disconnected: Ignoring write of {} buffers", w->bufs.size());
           break;
         }
 
@@ -178,7 +212,6 @@ namespace asynchost
       return true;
     }
 
-  private:
     bool init()
     {
       assert_status(FRESH, FRESH);
@@ -200,25 +233,26 @@ namespace asynchost
       return true;
     }
 
-    bool send_write(uv_write_t* req, size_t len)
+    bool send_write(std::unique_ptr<WriteRequest> w)
     {
-      char* copy = (char*)req->data;
-
-      uv_buf_t buf;
-      buf.base = copy;
-      buf.len = len;
-
       int rc;
 
-      if ((rc = uv_write(req, (uv_stream_t*)&uv_handle, &buf, 1, on_write)) < 0)
+      if (
+        (rc = uv_write(
+           &w->req,
+           (uv_stream_t*)&uv_handle,
+           w->bufs.data(),
+           w->bufs.size(),
+           on_write)) < 0)
       {
-        free_write(req);
         LOG_FAIL_FMT("uv_write failed: {}", uv_strerror(rc));
         assert_status(CONNECTED, DISCONNECTED);
         behaviour->on_disconnect();
         return false;
       }
 
+      // Ownership passes to libuv until on_write
+      w.release();
       return true;
     }
 
@@ -428,12 +462,9 @@ namespace asynchost
           return;
 
         for (auto& w : pending_writes)
-        {
-          send_write(w.req, w.len);
-          w.req = nullptr;
-        }
+          send_write(std::move(w));
 
-        std::vector<PendingWrite>().swap(pending_writes);
+        std::vector<std::unique_ptr<WriteRequest>>().swap(pending_writes);
         behaviour->on_connect();
       }
     }
@@ -509,17 +540,7 @@ namespace asynchost
     static void on_write(uv_write_t* req, int rc)
     {
       (void)rc;
-      free_write(req);
-    }
-
-    static void free_write(uv_write_t* req)
-    {
-      if (req == nullptr)
-        return;
-
-      char* copy = (char*)req->data;
-      delete[] copy;
-      delete req;
+      delete static_cast<WriteRequest*>(req->data);
     }
 
     static void on_reconnect(uv_handle_t* handle)
@@ -2,10 +2,50 @@
 // Licensed under the Apache 2.0 License.
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "../ledger.h"
+#include "../ledgerwriter.h"
+#include "../snapshots.h"
 
 #include <doctest/doctest.h>
+#include <glob.h>
 #include <string>
 
+static void remove_segments(const std::string& filename)
+{
+  glob_t g;
+  auto pattern = filename + ".*";
+  if (glob(pattern.c_str(), 0, nullptr, &g) == 0)
+  {
+    for (size_t i = 0; i < g.gl_pathc; i++)
+      unlink(g.gl_pathv[i]);
+  }
+  globfree(&g);
+}
+
+// Removes a test ledger file, its segments, their indices and snapshots when
+// the test starts and when it ends, so that no files are left behind
+class TestLedgerFiles
+{
+private:
+  std::string filename;
+
+  void remove_files()
+  {
+    unlink(filename.c_str());
+    remove_segments(filename);
+  }
+
+public:
+  TestLedgerFiles(const std::string& filename_) : filename(filename_)
+  {
+    remove_files();
+  }
+
+  ~TestLedgerFiles()
+  {
+    remove_files();
+  }
+};
+
 TEST_CASE("Read/Write test")
 {
   ringbuffer::Circuit eio(1024);
@@ -13,6 +53,7 @@ TEST_CASE("Read/Write test")
 
   const std::vector<uint8_t> e1 = {1, 2, 3};
   const std::vector<uint8_t> e2 = {5, 5, 6, 7};
+  TestLedgerFiles files("testlog");
   {
     asynchost::Ledger l("testlog", wf);
     l.truncate(0);
@@ -37,6 +78,7 @@ TEST_CASE("Entry sizes")
   const std::vector<uint8_t> e1 = {1, 2, 3};
   const std::vector<uint8_t> e2 = {5, 5, 6, 7};
 
+  TestLedgerFiles files("testlog");
   asynchost::Ledger l("testlog", wf);
   l.truncate(0);
   REQUIRE(l.get_last_idx() == 0);
@@ -58,4 +100,356 @@ TEST_CASE("Entry sizes")
     for (auto c : e)
       std::cout << std::hex << (int)c;
     std::cout << std::endl;*/
-}
\ No newline at end of file
+}
+
+static std::vector<uint8_t> make_entry(size_t i)
+{
+  return std::vector<uint8_t>(10 + i % 7, (uint8_t)i);
+}
+
+TEST_CASE("Segmented ledger")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::string filename = "testlog_segmented";
+  const size_t segment_size = 64;
+  const size_t n = 20;
+  TestLedgerFiles files(filename);
+
+  {
+    asynchost::Ledger l(filename, wf, segment_size);
+    REQUIRE(l.get_last_idx() == 0);
+
+    for (size_t i = 1; i <= n; i++)
+    {
+      auto e = make_entry(i);
+      l.write_entry(e.data(), e.size());
+    }
+
+    REQUIRE(l.get_last_idx() == n);
+
+    INFO("Reads from sealed segments point into a shared mapping");
+    auto slices = l.read_framed_entries_slices(1, n);
+    REQUIRE(slices.size() > 1);
+    auto again = l.read_framed_entries_slices(1, 1);
+    REQUIRE(again.size() == 1);
+    REQUIRE(again[0].data == slices[0].data);
+    REQUIRE(again[0].owner == slices[0].owner);
+
+    size_t total = 0;
+    for (auto& s : slices)
+      total += s.size;
+    REQUIRE(total == l.framed_entries_size(1, n));
+  }
+
+  INFO("Sealed segments have a persisted index");
+  struct stat st;
+  REQUIRE(stat((filename + ".1.idx").c_str(), &st) == 0);
+
+  {
+    asynchost::Ledger l(filename, wf, segment_size);
+    REQUIRE(l.get_last_idx() == n);
+
+    for (size_t i = 1; i <= n; i++)
+      REQUIRE(l.read_entry(i) == make_entry(i));
+
+    auto framed = l.read_framed_entries(1, n);
+    REQUIRE(framed.size() == l.framed_entries_size(1, n));
+
+    INFO("Truncation can reach into a sealed segment");
+    auto slice = l.read_framed_entries_slices(2, 2);
+    l.truncate(2);
+    REQUIRE(l.get_last_idx() == 2);
+    REQUIRE(l.read_entry(3).empty());
+    REQUIRE(slice[0].data[sizeof(uint32_t)] == 2);
+
+    for (size_t i = 3; i <= n; i++)
+    {
+      auto e = make_entry(i + 1);
+      l.write_entry(e.data(), e.size());
+    }
+  }
+
+  asynchost::Ledger l(filename, wf, segment_size);
+  REQUIRE(l.get_last_idx() == n);
+  REQUIRE(l.read_entry(2) == make_entry(2));
+  for (size_t i = 3; i <= n; i++)
+    REQUIRE(l.read_entry(i) == make_entry(i + 1));
+}
+
+TEST_CASE("Group commit")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::string filename = "testlog_group";
+  TestLedgerFiles files(filename);
+
+  asynchost::Ledger l(filename, wf);
+  asynchost::LedgerWriter w(l, wf, asynchost::LedgerSyncPolicy::batch);
+
+  const size_t n = 10;
+  for (size_t i = 1; i <= n; i++)
+  {
+    auto e = make_entry(i);
+    w.append(e.data(), e.size());
+  }
+
+  INFO("Entries are readable before the batch is written");
+  struct stat st;
+  REQUIRE(stat(filename.c_str(), &st) == 0);
+  REQUIRE(st.st_size == 0);
+  for (size_t i = 1; i <= n; i++)
+    REQUIRE(l.read_entry(i) == make_entry(i));
+
+  w.flush();
+  REQUIRE(stat(filename.c_str(), &st) == 0);
+  REQUIRE(st.st_size == l.framed_entries_size(1, n));
+
+  auto& counters = w.get_counters();
+  REQUIRE(counters.batches == 1);
+  REQUIRE(counters.entries == n);
+  REQUIRE(counters.max_batch_entries == n);
+  REQUIRE(counters.syncs == 1);
+
+  INFO("The durable index is reported to the enclave");
+  consensus::Index durable = 0;
+  eio.read_from_outside().read(
+    -1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+      REQUIRE(m == consensus::ledger_durable);
+      durable = serialized::read<consensus::Index>(data, size);
+    });
+  REQUIRE(durable == n);
+
+  INFO("Nothing is synced when nothing was written");
+  w.flush();
+  REQUIRE(counters.syncs == 1);
+
+  INFO("Truncation of unwritten entries");
+  auto e = make_entry(n + 1);
+  w.append(e.data(), e.size());
+  l.truncate(n - 1);
+  w.flush();
+  REQUIRE(l.get_last_idx() == n - 1);
+  REQUIRE(stat(filename.c_str(), &st) == 0);
+  REQUIRE(st.st_size == l.framed_entries_size(1, n - 1));
+}
+
+TEST_CASE("Durable index without syncs")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::string filename = "testlog_nosync";
+  TestLedgerFiles files(filename);
+
+  asynchost::Ledger l(filename, wf);
+  asynchost::LedgerWriter w(l, wf, asynchost::LedgerSyncPolicy::none);
+
+  const size_t n = 5;
+  for (size_t i = 1; i <= n; i++)
+  {
+    auto e = make_entry(i);
+    w.append(e.data(), e.size());
+  }
+  w.flush();
+  REQUIRE(w.get_counters().syncs == 0);
+
+  INFO("Written entries are reported as durable");
+  size_t reports = 0;
+  consensus::Index durable = 0;
+  auto read_reports = [&]() {
+    eio.read_from_outside().read(
+      -1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+        REQUIRE(m == consensus::ledger_durable);
+        durable = serialized::read<consensus::Index>(data, size);
+        reports++;
+      });
+  };
+  read_reports();
+  REQUIRE(reports == 1);
+  REQUIRE(durable == n);
+
+  INFO("The durable index is not reported again when nothing was written");
+  w.flush();
+  read_reports();
+  REQUIRE(reports == 1);
+}
+
+TEST_CASE("Range reads")
+{
+  ringbuffer::Circuit eio(1 << 16);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::string filename = "testlog_range";
+  const size_t n = 50;
+  TestLedgerFiles files(filename);
+
+  asynchost::Ledger l(filename, wf, 128);
+  for (size_t i = 1; i <= n; i++)
+  {
+    auto e = make_entry(i);
+    l.write_entry(e.data(), e.size());
+  }
+
+  INFO("Chunks cover the range, in order, within the size limit");
+  for (size_t max_chunk_size : {1, 20, 64, 1000})
+  {
+    auto chunks = l.read_framed_entries_chunks(3, n - 3, max_chunk_size);
+    size_t next = 3;
+    std::vector<uint8_t> all;
+    for (auto& [from, chunk] : chunks)
+    {
+      REQUIRE(from == next);
+      const uint8_t* data = chunk.data;
+      size_t size = chunk.size;
+      REQUIRE(
+        (size <= max_chunk_size ||
+         size == l.framed_entries_size(from, from)));
+      while (size > 0)
+      {
+        auto entry_size = serialized::read<uint32_t>(data, size);
+        REQUIRE(
+          std::vector<uint8_t>(data, data + entry_size) == make_entry(next++));
+        serialized::skip(data, size, entry_size);
+      }
+    }
+    REQUIRE(next == n - 2);
+  }
+
+  INFO("Range requests are answered with chunks, then the end of the ledger");
+  messaging::Dispatcher<ringbuffer::Message> disp("test");
+  l.register_message_handlers(disp);
+
+  std::vector<uint8_t> request(2 * sizeof(consensus::Index));
+  auto p = request.data();
+  auto s = request.size();
+  serialized::write<consensus::Index>(p, s, 40);
+  serialized::write<consensus::Index>(p, s, 60);
+  disp.dispatch(consensus::ledger_get_range, request.data(), request.size());
+
+  size_t next = 40;
+  consensus::Index end = 0;
+  eio.read_from_outside().read(
+    -1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+      if (m == consensus::ledger_entries)
+      {
+        REQUIRE(end == 0);
+        REQUIRE(serialized::read<consensus::Index>(data, size) == next);
+        while (size > 0)
+        {
+          auto entry_size = serialized::read<uint32_t>(data, size);
+          serialized::skip(data, size, entry_size);
+          next++;
+        }
+      }
+      else
+      {
+        REQUIRE(m == consensus::ledger_no_entry);
+        end = serialized::read<consensus::Index>(data, size);
+      }
+    });
+  REQUIRE(next == n + 1);
+  REQUIRE(end == n + 1);
+}
+
+TEST_CASE("Ledger after snapshot")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::string filename = "testlog_after_snapshot";
+  const size_t segment_size = 64;
+  const size_t snapshot_idx = 100;
+  const size_t n = 10;
+  TestLedgerFiles files(filename);
+
+  {
+    INFO("A single ledger file cannot start after a snapshot");
+    asynchost::Ledger l(filename, wf);
+    REQUIRE(!l.init(snapshot_idx));
+    REQUIRE(l.get_last_idx() == 0);
+  }
+  remove(filename.c_str());
+
+  {
+    asynchost::Ledger l(filename, wf, segment_size);
+    REQUIRE(l.init(snapshot_idx));
+    REQUIRE(l.get_first_idx() == snapshot_idx + 1);
+    REQUIRE(l.get_last_idx() == snapshot_idx);
+
+    for (size_t i = 1; i <= n; i++)
+    {
+      auto e = make_entry(snapshot_idx + i);
+      l.write_entry(e.data(), e.size());
+    }
+    REQUIRE(l.get_last_idx() == snapshot_idx + n);
+
+    INFO("A non-empty ledger cannot be restarted after another snapshot");
+    REQUIRE(!l.init(snapshot_idx + 1));
+  }
+
+  asynchost::Ledger l(filename, wf, segment_size);
+  REQUIRE(l.get_first_idx() == snapshot_idx + 1);
+  REQUIRE(l.get_last_idx() == snapshot_idx + n);
+  REQUIRE(l.read_entry(snapshot_idx).empty());
+  REQUIRE(l.read_framed_entries_slices(1, snapshot_idx + 1).empty());
+  for (size_t i = 1; i <= n; i++)
+    REQUIRE(l.read_entry(snapshot_idx + i) == make_entry(snapshot_idx + i));
+}
+
+TEST_CASE("Snapshot files")
+{
+  ringbuffer::Circuit eio(1 << 16);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::string filename = "testlog_snapshots";
+  TestLedgerFiles files(filename);
+
+  asynchost::Snapshots snapshots(filename, wf);
+  REQUIRE(snapshots.get_latest_idx() == 0);
+
+  const std::vector<std::vector<uint8_t>> chunks = {
+    {1, 2, 3}, {}, make_entry(42)};
+
+  INFO("Snapshots are only visible once committed");
+  for (auto& chunk : chunks)
+    snapshots.write_chunk(10, chunk.data(), chunk.size());
+  REQUIRE(snapshots.get_latest_idx() == 0);
+  REQUIRE(snapshots.commit(10));
+  REQUIRE(snapshots.get_latest_idx() == 10);
+  REQUIRE(snapshots.read_chunks(10) == chunks);
+
+  INFO("An unfinished snapshot is discarded by the next one");
+  snapshots.write_chunk(20, chunks[0].data(), chunks[0].size());
+  snapshots.write_chunk(30, chunks[2].data(), chunks[2].size());
+  REQUIRE(!snapshots.commit(20));
+  REQUIRE(snapshots.commit(30));
+  REQUIRE(snapshots.get_latest_idx() == 30);
+  REQUIRE(snapshots.read_chunks(30).size() == 1);
+
+  INFO("The latest snapshot is sent on request");
+  messaging::Dispatcher<ringbuffer::Message> disp("test");
+  snapshots.register_message_handlers(disp);
+  disp.dispatch(consensus::snapshot_get, nullptr, 0);
+
+  size_t received = 0;
+  consensus::Index end = 0;
+  eio.read_from_outside().read(
+    -1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+      if (m == consensus::snapshot_chunk)
+      {
+        REQUIRE(serialized::read<consensus::Index>(data, size) == 30);
+        REQUIRE(std::vector<uint8_t>(data, data + size) == chunks[2]);
+        received++;
+      }
+      else
+      {
+        REQUIRE(m == consensus::snapshot_end);
+        end = serialized::read<consensus::Index>(data, size);
+      }
+    });
+  REQUIRE(received == 1);
+  REQUIRE(end == 30);
+}
@@ -32,9 +32,23 @@ namespace kv
     class FlatbufferSerialiser
     {
     private:
+      // Space for the table, vector lengths and alignment of a frame
+      static constexpr size_t frame_overhead = 64;
+
       flatbuffers::FlatBufferBuilder builder;
       flatbuffers::Offset<Frame> frame;
 
+      template <typename S>
+      flatbuffers::Offset<flatbuffers::Vector<uint8_t>> create_vector(S* s)
+      {
+        const size_t size = s ? s->get_raw_data_size() : 0;
+        uint8_t* data;
+        auto v = builder.CreateUninitializedVector(size, &data);
+        if (s)
+          s->write_raw_data(data, size);
+        return v;
+      }
+
     public:
       FlatbufferSerialiser(
         const std::vector<uint8_t>& replicated,
@@ -47,6 +61,23 @@ namespace kv
         builder.Finish(frame);
       }
 
+      // Serialises replicated and derived, either of which may be null,
+      // directly into a frame sized for them
+      template <typename S>
+      FlatbufferSerialiser(S* replicated, S* derived) :
+        builder(
+          (replicated ? replicated->get_raw_data_size() : 0) +
+          (derived ? derived->get_raw_data_size() : 0) + frame_overhead)
+      {
+        // Vectors are written one at a time, since each one is only valid
+        // until the next one is created
+        auto fb_replicated = create_vector(replicated);
+        auto fb_derived = create_vector(derived);
+
+        frame = CreateFrame(builder, fb_replicated, fb_derived);
+        builder.Finish(frame);
+      }
+
       std::unique_ptr<flatbuffers::DetachedBuffer> get_detached_buffer()
       {
         return std::make_unique<flatbuffers::DetachedBuffer>(builder.Release());
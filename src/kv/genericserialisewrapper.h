@@ -169,70 +169,70 @@ namespace kv
       serialise_internal(k);
     }
 
-    std::vector<uint8_t> get_raw_data()
+    /// Size of the serialised transaction, as written by write_raw_data
+    size_t get_raw_data_size()
+    {
+      const auto public_size = public_writer.get_raw_buffer().n;
+
+      // If no crypto util is set, all maps have been serialised by the public
+      // writer.
+      if (!crypto_util)
+        return public_size;
+
+      return crypto_util->get_header_length() + sizeof(size_t) + public_size +
+        private_writer.get_raw_buffer().n;
+    }
+
+    /// Writes the serialised transaction to data, of get_raw_data_size()
+    /// bytes, encrypting the private domain directly into it
+    void write_raw_data(uint8_t* data, size_t size)
     {
       // make sure the private buffer is empty when we return
       auto writer_guard_func = [](W* writer) { writer->clear(); };
       std::unique_ptr<decltype(private_writer), decltype(writer_guard_func)>
         writer_guard(&private_writer, writer_guard_func);
 
-      auto serialised_public_domain = public_writer.get_raw_data();
+      const auto raw_data_size = get_raw_data_size();
+      if (size != raw_data_size)
+        throw std::logic_error(fmt::format(
+          "Cannot write {} bytes of serialised transaction to {} bytes",
+          raw_data_size,
+          size));
+
+      auto serialised_public_domain = public_writer.get_raw_buffer();
 
-      // If no crypto util is set, all maps have been serialised by the public
-      // writer.
       if (!crypto_util)
       {
-        return serialised_public_domain;
+        serialized::write(
+          data, size, serialised_public_domain.p, serialised_public_domain.n);
+        return;
       }
 
-      auto serialised_private_domain = private_writer.get_raw_data();
-
-      return serialise_domains(
-        serialised_public_domain, serialised_private_domain);
-    }
-
-    std::vector<uint8_t> serialise_domains(
-      const std::vector<uint8_t>& serialised_public_domain,
-      const std::vector<uint8_t>& serialised_private_domain =
-        std::vector<uint8_t>())
-    {
-      std::vector<uint8_t> serialised_tx;
-      std::vector<uint8_t> serialised_hdr;
-      std::vector<uint8_t> encrypted_private_domain(
-        serialised_private_domain.size());
-
-      crypto_util->encrypt(
-        serialised_private_domain,
-        serialised_public_domain,
-        serialised_hdr,
-        encrypted_private_domain,
-        version);
+      auto serialised_private_domain = private_writer.get_raw_buffer();
 
       // Serialise entire tx
       // Format: gcm hdr (iv + tag) + len of public domain + public domain +
       // encrypted privated domain
-      auto space = serialised_hdr.size() + sizeof(size_t) +
-        serialised_public_domain.size() + encrypted_private_domain.size();
-      serialised_tx.resize(space);
-      auto data_ = serialised_tx.data();
+      auto serialised_hdr = data;
+      data += crypto_util->get_header_length();
+      size -= crypto_util->get_header_length();
 
+      serialized::write(data, size, serialised_public_domain.n);
       serialized::write(
-        data_, space, serialised_hdr.data(), serialised_hdr.size());
-      serialized::write(data_, space, serialised_public_domain.size());
-      serialized::write(
-        data_,
-        space,
-        serialised_public_domain.data(),
-        serialised_public_domain.size());
-      if (encrypted_private_domain.size() > 0)
-      {
-        serialized::write(
-          data_,
-          space,
-          encrypted_private_domain.data(),
-          encrypted_private_domain.size());
-      }
+        data, size, serialised_public_domain.p, serialised_public_domain.n);
+
+      AbstractTxEncryptor::BatchEntry private_domain{serialised_private_domain,
+                                                     serialised_public_domain,
+                                                     serialised_hdr,
+                                                     data,
+                                                     version};
+      crypto_util->encrypt_batch(&private_domain, 1);
+    }
 
+    std::vector<uint8_t> get_raw_data()
+    {
+      std::vector<uint8_t> serialised_tx(get_raw_data_size());
+      write_raw_data(serialised_tx.data(), serialised_tx.size());
       return serialised_tx;
     }
   };
@@ -333,13 +333,17 @@ namespace kv
       serialized::skip(data_, size_, public_domain_length);
       decrypted_buffer.resize(size_);
 
-      if (!crypto_util->decrypt(
-            {data_, data_ + size_},
-            {data_public, data_public + public_domain_length},
-            {data, data + crypto_util->get_header_length()},
-            decrypted_buffer,
-            version))
+      // The private domain is decrypted from the serialised tx in place, and
+      // its header is only read
+      AbstractTxEncryptor::BatchEntry private_domain{
+        {data_, size_},
+        {data_public, public_domain_length},
+        const_cast<uint8_t*>(data),
+        decrypted_buffer.data(),
+        version};
+      if (!crypto_util->decrypt_batch(&private_domain, 1))
       {
+        decrypted_buffer.clear();
         return false;
       }
 
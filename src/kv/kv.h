@@ -4,14 +4,21 @@
 
 #include "ds/champmap.h"
 #include "ds/logger.h"
+#include "ds/rbmap.h"
+#include "ds/smallmap.h"
 #include "ds/spinlock.h"
 #include "kvtypes.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <limits>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <unordered_map>
@@ -57,7 +64,17 @@ namespace kv
   template <class S, class D>
   class Store;
 
-  template <class K, class V, class H, class S, class D>
+  /// State of an ordered map, sorted by key
+  template <class K, class V, class H>
+  using OrderedState = RBMap<K, V>;
+
+  template <
+    class K,
+    class V,
+    class H,
+    class S,
+    class D,
+    template <class, class, class> class M = champ::Map>
   class Map : public AbstractMap<S, D>
   {
   public:
@@ -75,14 +92,21 @@ namespace kv
       VersionV(Version ver, V val) : version(ver), value(val) {}
     };
 
-    using State = champ::Map<K, VersionV, H>;
-    using Read = std::unordered_map<K, Version, H>;
+    using State = M<K, VersionV, H>;
+    // Transactions usually touch few keys, so their read and write sets are
+    // kept inline while small
+    using Read = SmallMap<K, Version, H>;
+    using TxWrite = SmallMap<K, VersionV, H>;
     using Write = std::unordered_map<K, VersionV, H>;
     /// Signature for transaction commit handlers
     using CommitHook = std::function<void(Version, const State&, const Write&)>;
 
+    /// True if the state is sorted by key, so that the map supports range
+    /// queries
+    static constexpr bool ordered = std::is_same_v<State, RBMap<K, VersionV>>;
+
   private:
-    using This = Map<K, V, H, S, D>;
+    using This = Map<K, V, H, S, D, M>;
 
     struct LocalCommit
     {
@@ -92,13 +116,52 @@ namespace kv
     };
     using LocalCommits = std::list<LocalCommit>;
 
+    // The states of the roll, oldest first, as seen by new transactions.
+    // Published lists only ever grow past their head: a new one is published
+    // (RCU-style) with the map locked whenever the roll changes, so that views
+    // are created without taking the map lock. Each state owns the next one,
+    // so that states discarded by compaction are released along with the
+    // last view holding a list that starts from them.
+    struct ReadState
+    {
+      Version version;
+      State state;
+      // Set once, with the map locked, before publishing a list whose head is
+      // the next state. Readers never look past the head of their list.
+      mutable std::shared_ptr<const ReadState> next;
+
+      ~ReadState()
+      {
+        // Release the following states that are not shared iteratively, as
+        // a long run of discarded states would otherwise exhaust the stack
+        auto n = std::move(next);
+        while (n != nullptr && n.use_count() == 1)
+          n = std::move(n->next);
+      }
+    };
+
+    struct Published
+    {
+      // Oldest state of the roll, globally committed
+      std::shared_ptr<const ReadState> front;
+      // Newest state of the roll, owned through front
+      const ReadState* head;
+      size_t rollback_counter;
+    };
+
     Store<S, D>* store;
     std::string name;
     size_t rollback_counter;
     std::unique_ptr<LocalCommits> roll;
+    std::shared_ptr<const Published> published;
+    // Set while the map is locked, and states may be about to be published
+    std::atomic<bool> locked;
     CommitHook local_hook;
     CommitHook global_hook;
     LocalCommits commit_deltas;
+    // Keys removed by committed transactions, oldest first, so that their
+    // tombstones can be purged once the removal is globally committed
+    std::deque<std::pair<Version, K>> removals;
     SpinLock sl;
     const SecurityDomain security_domain;
     const bool replicated;
@@ -114,12 +177,63 @@ namespace kv
       name(name_),
       roll(std::make_unique<LocalCommits>()),
       rollback_counter(0),
+      locked(false),
       security_domain(security_domain_),
       replicated(replicated_),
       local_hook(local_hook_),
       global_hook(global_hook_)
     {
       roll->push_back({0, State(), Write()});
+      publish();
+    }
+
+    // Publishes all states of the roll. The Map expects to be locked.
+    void publish()
+    {
+      auto r = roll->begin();
+      auto front = std::make_shared<const ReadState>(
+        ReadState{r->version, r->state, nullptr});
+      auto head = front.get();
+      for (++r; r != roll->end(); ++r)
+      {
+        head->next = std::make_shared<const ReadState>(
+          ReadState{r->version, r->state, nullptr});
+        head = head->next.get();
+      }
+
+      std::atomic_store(
+        &published,
+        std::make_shared<const Published>(
+          Published{front, head, rollback_counter}));
+    }
+
+    // Publishes the state committed at the back of the roll, after the
+    // previously published states. The Map expects to be locked.
+    void publish_commit()
+    {
+      auto& r = roll->back();
+      auto head = published->head;
+      head->next = std::make_shared<const ReadState>(
+        ReadState{r.version, r.state, nullptr});
+
+      std::atomic_store(
+        &published,
+        std::make_shared<const Published>(
+          Published{published->front, head->next.get(), rollback_counter}));
+    }
+
+    // Publishes the previously published states from the front of the roll,
+    // once compaction has discarded older ones. The Map expects to be locked.
+    void publish_front()
+    {
+      auto front = &published->front;
+      while ((*front)->version < roll->front().version)
+        front = &(*front)->next;
+
+      std::atomic_store(
+        &published,
+        std::make_shared<const Published>(
+          Published{*front, published->head, rollback_counter}));
     }
 
     Map(const Map& that) = delete;
@@ -256,11 +370,25 @@ namespace kv
       friend Tx<S, D>;
 
     private:
+      // Range of keys read by iterating over an ordered map. The lower bound
+      // is inclusive, and the upper bound is exclusive unless to_inclusive is
+      // set. An empty bound does not limit the range.
+      struct RangeRead
+      {
+        std::optional<K> from;
+        std::optional<K> to;
+        bool to_inclusive;
+      };
+
       This& map;
-      State state;
-      State committed;
+      // Published states of the map when this view was created. These are
+      // shared rather than copied, and keep state and committed alive.
+      std::shared_ptr<const Published> published;
+      const State& state;
+      const State& committed;
       Read reads;
-      Write writes;
+      std::vector<RangeRead> range_reads;
+      TxWrite writes;
       Version start_version;
       size_t rollback_counter;
       Version read_version;
@@ -268,13 +396,20 @@ namespace kv
       bool changes;
       bool deserialised;
       bool committed_writes;
-
-      TxView(This& parent, State& s, Version v, size_t r) :
+      // State written by this view's commit. Serialisation happens after the
+      // map is unlocked, so it reads this rather than the back of the roll.
+      State committed_state;
+
+      TxView(
+        This& parent,
+        std::shared_ptr<const Published>&& p,
+        const ReadState& r) :
         map(parent),
-        state(s),
-        committed(parent.roll->front().state),
-        start_version(v),
-        rollback_counter(r),
+        published(std::move(p)),
+        state(r.state),
+        committed(published->front->state),
+        start_version(r.version),
+        rollback_counter(published->rollback_counter),
         read_version(NoVersion),
         commit_version(NoVersion),
         changes(false),
@@ -475,6 +610,64 @@ namespace kv
         return true;
       }
 
+      /** Iterate over entries with keys in [from, to), in increasing key order
+       *
+       * Only available on ordered maps. Unlike foreach(), this only depends
+       * on the entries in the range, up to the last one visited: the
+       * transaction conflicts with transactions writing to that range only.
+       *
+       * @param from Lowest key of the range
+       * @param to Key following the range
+       * @param F functor, taking a key and a value, return value determines
+       * whether the iteration should continue (true) or stop (false)
+       *
+       * @return true if all entries in the range have been visited
+       */
+      template <class F>
+      bool range(const K& from, const K& to, F&& f)
+      {
+        return scan(from, to, false, f);
+      }
+
+      /** Iterate over entries with keys in [from, to), in decreasing key order
+       *
+       * Only available on ordered maps. See range().
+       */
+      template <class F>
+      bool reverse_range(const K& from, const K& to, F&& f)
+      {
+        return scan(from, to, true, f);
+      }
+
+      /** Iterate over all entries, in decreasing key order
+       *
+       * Only available on ordered maps. See range().
+       */
+      template <class F>
+      bool reverse_foreach(F&& f)
+      {
+        return scan({}, {}, true, f);
+      }
+
+      /** Get the entry with the lowest key not less than key
+       *
+       * Only available on ordered maps. The transaction only depends on the
+       * keys from key to the returned entry.
+       *
+       * @param key Key
+       *
+       * @return optional containing the entry, empty if there is none
+       */
+      std::optional<std::pair<K, V>> lower_bound(const K& key)
+      {
+        std::optional<std::pair<K, V>> result;
+        scan(key, {}, false, [&result](const K& k, const V& v) {
+          result.emplace(k, v);
+          return false;
+        });
+        return result;
+      }
+
       Version start_order()
       {
         return start_version;
@@ -494,6 +687,112 @@ namespace kv
       }
 
     private:
+      template <class F>
+      bool scan(
+        const std::optional<K>& from,
+        const std::optional<K>& to,
+        bool reverse,
+        F&& f)
+      {
+        static_assert(ordered, "Range queries require an ordered map");
+
+        if (commit_version != NoVersion)
+          return false;
+
+        auto before = [reverse](const K& a, const K& b) {
+          return reverse ? b < a : a < b;
+        };
+
+        // Writes of this transaction in the range, in iteration order, are
+        // merged with the entries of the state
+        std::vector<typename TxWrite::const_iterator> own;
+        for (auto it = writes.cbegin(); it != writes.cend(); ++it)
+        {
+          auto& k = it->first;
+          if (
+            (!from.has_value() || !(k < from.value())) &&
+            (!to.has_value() || k < to.value()))
+            own.push_back(it);
+        }
+        std::sort(own.begin(), own.end(), [&before](auto a, auto b) {
+          return before(a->first, b->first);
+        });
+        auto next_own = own.begin();
+
+        // Last key visited, if the iteration is stopped
+        std::optional<K> last;
+        auto visit = [&f, &last](const K& k, const VersionV& v) {
+          if (deleted(v.version) || f(k, v.value))
+            return true;
+
+          last = k;
+          return false;
+        };
+
+        auto visit_own_before = [&](const K* k) {
+          while (next_own != own.end() &&
+                 (k == nullptr || before((*next_own)->first, *k)))
+          {
+            auto w = *next_own++;
+            if (!visit(w->first, w->second))
+              return false;
+          }
+          return true;
+        };
+
+        auto visit_state = [&](const K& k, const VersionV& v) {
+          if (!visit_own_before(&k))
+            return false;
+
+          // A key written by this transaction hides the state's entry
+          if (next_own != own.end() && !before(k, (*next_own)->first))
+          {
+            auto w = *next_own++;
+            return visit(w->first, w->second);
+          }
+
+          return visit(k, v);
+        };
+
+        bool completed = reverse ? state.reverse_range(from, to, visit_state) :
+                                   state.range(from, to, visit_state);
+        if (completed)
+          completed = visit_own_before(nullptr);
+
+        // Record a dependency on the keys up to the last one visited
+        if (completed)
+          range_reads.push_back({from, to, false});
+        else if (reverse)
+          range_reads.push_back({last, to, false});
+        else
+          range_reads.push_back({from, last, true});
+
+        return completed;
+      }
+
+      // Returns true if an entry in the range has been written in the current
+      // state since this transaction began
+      bool range_written(const State& current, const RangeRead& r)
+      {
+        bool written = false;
+        current.range(
+          r.from,
+          r.to_inclusive ? std::nullopt : r.to,
+          [this, &r, &written](const K& k, const VersionV& v) {
+            if (r.to_inclusive && r.to.value() < k)
+              return false;
+
+            // Removed entries are kept, with their negated version
+            if (std::abs(v.version) > start_version)
+            {
+              written = true;
+              return false;
+            }
+            return true;
+          });
+        return written;
+      }
+
       virtual bool has_writes()
       {
         return committed_writes || !writes.empty();
@@ -510,12 +809,20 @@ namespace kv
           return true;
 
         // If the parent map has rolled back since this transaction began, this
-        // transaction must fail.
-        if (rollback_counter != map.rollback_counter)
+        // transaction must fail. Deserialised transactions do not depend on
+        // the state they were decoded against, since their writes are applied
+        // to the current state, and they may legitimately be decoded before
+        // the store is rolled back to apply them.
+        if (!deserialised && rollback_counter != map.rollback_counter)
           return false;
 
-        // If we have iterated over the map, check for a global version match.
+        // If the map has not changed since this transaction began, everything
+        // this transaction has read is still current.
         auto& current = map.roll->back();
+        if (!deserialised && current.version == start_version)
+          return true;
+
+        // If we have iterated over the map, check for a global version match.
 
         if ((read_version != NoVersion) && (read_version != current.version))
         {
@@ -550,6 +857,19 @@ namespace kv
           }
         }
 
+        // Check that each range we have read is unchanged.
+        if constexpr (ordered)
+        {
+          for (auto& r : range_reads)
+          {
+            if (range_written(current.state, r))
+            {
+              LOG_DEBUG_FMT("Read depends on a range that has been written");
+              return false;
+            }
+          }
+        }
+
         return true;
       }
 
@@ -567,7 +887,9 @@ namespace kv
 
         if (!writes.empty())
         {
-          auto state = map.roll->back().state;
+          // The writes are applied in place to a transient copy of the state,
+          // so that nodes are only copied once per transaction.
+          auto state = map.roll->back().state.transient();
 
           for (auto it = writes.begin(); it != writes.end(); ++it)
           {
@@ -575,23 +897,29 @@ namespace kv
             {
               // Write the new value with the global version.
               changes = true;
-              state = state.put(it->first, VersionV{v, it->second.value});
+              state.put(it->first, VersionV{v, it->second.value});
             }
             else
             {
               // Write an empty value with the deleted global version only if
               // the key exists.
-              auto search = state.get(it->first);
-              if (search.has_value())
+              if (state.getp(it->first) != nullptr)
               {
                 changes = true;
-                state = state.put(it->first, VersionV{-v, V()});
+                state.put(it->first, VersionV{-v, V()});
+                if constexpr (!ordered)
+                  map.removals.emplace_back(v, it->first);
               }
             }
           }
 
           if (changes)
-            map.roll->push_back({v, state, writes});
+          {
+            committed_state = state.persistent();
+            map.roll->push_back(
+              {v, committed_state, Write(writes.begin(), writes.end())});
+            map.publish_commit();
+          }
         }
       }
 
@@ -619,7 +947,12 @@ namespace kv
 
         if (include_reads)
         {
-          s.serialise_read_version(read_version);
+          // Ranges read are not serialised, and are replaced by a dependency
+          // on the whole map
+          s.serialise_read_version(
+            (read_version == NoVersion && !range_reads.empty()) ?
+              start_version :
+              read_version);
 
           s.serialise_count_header(reads.size());
           for (auto it = reads.begin(); it != reads.end(); ++it)
@@ -631,6 +964,12 @@ namespace kv
           s.serialise_count_header(0);
         }
 
+        // Only removes of keys that existed were applied by commit, and so
+        // only those are serialised
+        auto applied_remove = [this](const K& k) {
+          return committed_state.getp(k) != nullptr;
+        };
+
         uint64_t write_ctr = 0;
         uint64_t remove_ctr = 0;
         for (auto it = writes.begin(); it != writes.end(); ++it)
@@ -639,11 +978,9 @@ namespace kv
           {
             ++write_ctr;
           }
-          else
+          else if (applied_remove(it->first))
           {
-            auto search = map.roll->back().state.get(it->first);
-            if (search.has_value())
-              ++remove_ctr;
+            ++remove_ctr;
           }
         }
         s.serialise_count_header(write_ctr);
@@ -658,7 +995,7 @@ namespace kv
         s.serialise_count_header(remove_ctr);
         for (auto it = writes.begin(); it != writes.end(); ++it)
         {
-          if (is_remove(it->second.version))
+          if (is_remove(it->second.version) && applied_remove(it->first))
           {
             s.serialise_remove(it->first);
           }
@@ -668,6 +1005,7 @@ namespace kv
       virtual bool deserialise(D& d, Version version)
       {
         commit_version = version;
+        deserialised = true;
         uint64_t ctr;
 
         auto rv = d.template deserialise_read_version<Version>();
@@ -711,35 +1049,52 @@ namespace kv
 
     TxView* create_view(Version version) override
     {
-      lock();
-
-      // Find the last entry committed at or before this version.
-      TxView* view = nullptr;
-
-      for (auto it = roll->rbegin(); it != roll->rend(); ++it)
+      // This does not lock the map, since published states do not change.
+      // However, a transaction holding the map lock may have been given this
+      // version to commit, and not have published it yet. In that case, the
+      // map lock is taken to wait for it, unless the published states already
+      // include this version.
+      const bool busy = locked.load();
+      auto p = std::atomic_load(&published);
+      if (busy && p->head->version < version)
       {
-        if (it->version <= version)
-        {
-          view = new TxView(*this, it->state, it->version, rollback_counter);
-          break;
-        }
+        std::lock_guard<SpinLock> guard(sl);
+        p = std::atomic_load(&published);
       }
 
-      if (view == nullptr)
+      // Find the last entry committed at or before this version. Views
+      // usually read the newest state, so the head is checked first.
+      auto r = p->head;
+      if (r->version > version)
       {
-        view = new TxView(
-          *this, roll->front().state, roll->front().version, rollback_counter);
+        r = p->front.get();
+        while (r != p->head && r->next->version <= version)
+          r = r->next.get();
       }
 
-      unlock();
-      return view;
+      return new TxView(*this, std::move(p), *r);
     }
 
     void compact(Version v) override
+    {
+      const bool discarded = compact_roll(v);
+
+      // Purging tombstones rewrites the states of the roll, which must then
+      // all be published again
+      if (purge_removals(v))
+        publish();
+      else if (discarded)
+        publish_front();
+    }
+
+    // Returns true if states have been discarded
+    bool compact_roll(Version v)
     {
       // This discards available rollback state before version v, and populates
       // the commit_deltas to be passed to the global commit hook, if there is
       // one, up to version v. The Map expects to be locked during compaction.
+      bool discarded = false;
+
       while (roll->size() > 1)
       {
         auto r = roll->begin();
@@ -751,7 +1106,7 @@ namespace kv
           if (global_hook)
             commit_deltas.emplace_back(
               LocalCommit{r->version, r->state, move(r->writes)});
-          return;
+          return discarded;
         }
 
         // Discardable, so move to commit_deltas.
@@ -761,9 +1116,10 @@ namespace kv
         // Stop if the next state may be rolled back or is the only state.
         // This ensures there is always a state present.
         if (std::next(r)->version > v)
-          return;
+          return discarded;
 
         roll->pop_front();
+        discarded = true;
       }
 
       // There is only one roll. We may need to call the commit hook.
@@ -772,6 +1128,57 @@ namespace kv
       if (global_hook && !r->writes.empty())
         commit_deltas.emplace_back(
           LocalCommit{r->version, r->state, move(r->writes)});
+
+      return discarded;
+    }
+
+    // Returns true if tombstones have been purged
+    bool purge_removals(Version v)
+    {
+      // This removes the tombstones of keys removed at or before version v
+      // from every state of the roll, unless the key has since been written
+      // again. Transactions that depend on a tombstone may now conflict, while
+      // those that depend on the key being missing do not.
+      // Ordered maps keep their tombstones, which range reads depend on.
+      // The Map expects to be locked during compaction.
+      if constexpr (ordered)
+      {
+        return false;
+      }
+      else
+      {
+        bool purged = false;
+
+        for (auto& r : *roll)
+        {
+          auto state = r.state.transient();
+          bool changed = false;
+
+          for (const auto& [version, key] : removals)
+          {
+            if (version > v || version > r.version)
+              break;
+
+            auto search = state.getp(key);
+            if (search != nullptr && search->version == -version)
+            {
+              state.remove(key);
+              changed = true;
+            }
+          }
+
+          if (changed)
+          {
+            r.state = state.persistent();
+            purged = true;
+          }
+        }
+
+        while (!removals.empty() && removals.front().first <= v)
+          removals.pop_front();
+
+        return purged;
+      }
     }
 
     void post_compact() override
@@ -804,8 +1211,100 @@ namespace kv
         roll->pop_back();
       }
 
+      while (!removals.empty() && removals.back().first > v)
+        removals.pop_back();
+
       if (advance)
+      {
         rollback_counter++;
+        publish();
+      }
+    }
+
+    class Snapshot : public AbstractMapSnapshot<S>
+    {
+    private:
+      const std::string name;
+      const SecurityDomain security_domain;
+      const State state;
+
+    public:
+      Snapshot(
+        const std::string& name,
+        SecurityDomain security_domain,
+        const State& state) :
+        name(name),
+        security_domain(security_domain),
+        state(state)
+      {}
+
+      void serialise(SnapshotSerialiser<S>& s) override
+      {
+        s.start_map(name, security_domain);
+        state.foreach([&s](const K& k, const VersionV& v) {
+          if (!deleted(v.version))
+            s.serialise_entry(k, v.value, v.version);
+          return true;
+        });
+      }
+    };
+
+    std::unique_ptr<AbstractMapSnapshot<S>> snapshot(Version v) override
+    {
+      // This captures the state at version v, which must not have been
+      // compacted away. States are persistent, so this is a cheap copy and
+      // the snapshot can be serialised without holding the map lock.
+      // The Map expects to be locked while the snapshot is taken.
+      for (auto it = roll->rbegin(); it != roll->rend(); ++it)
+      {
+        if (it->version <= v)
+          return std::make_unique<Snapshot>(name, security_domain, it->state);
+      }
+
+      return std::make_unique<Snapshot>(
+        name, security_domain, roll->front().state);
+    }
+
+    void deserialise_snapshot(D& d, Version v) override
+    {
+      // This adds the entries of one snapshot chunk to the map, as a single
+      // compacted state at version v. The Map expects to be locked during
+      // deserialisation.
+      auto state = roll->back().state.transient();
+      Write writes;
+
+      for (auto w = d.template deserialise_write_version<K, V, Version>();
+           w.has_value();
+           w = d.template deserialise_write_version<K, V, Version>())
+      {
+        auto& entry = w.value();
+        if (entry.is_remove)
+          throw std::logic_error(
+            fmt::format("Unexpected removal in snapshot of {}", name));
+
+        state.put(entry.key, VersionV{entry.version, entry.value});
+        writes[entry.key] = {entry.version, entry.value};
+      }
+
+      roll->clear();
+      roll->push_back({v, state.persistent(), std::move(writes)});
+      rollback_counter++;
+      publish();
+    }
+
+    void post_deserialise_snapshot() override
+    {
+      // Snapshots are only taken at globally committed versions, so both the
+      // local and the global hooks see the restored entries.
+      auto& r = roll->back();
+      if (r.writes.empty())
+        return;
+
+      if (local_hook)
+        local_hook(r.version, r.state, r.writes);
+
+      if (global_hook)
+        global_hook(r.version, r.state, r.writes);
     }
 
     void clear() override
@@ -814,16 +1313,20 @@ namespace kv
       // and rollback counter. The Map expects to be locked before clearing it.
       roll->clear();
       roll->push_back({0, State(), Write()});
+      removals.clear();
       rollback_counter = 0;
+      publish();
     }
 
     void lock() override
     {
       sl.lock();
+      locked.store(true);
     }
 
     void unlock() override
     {
+      locked.store(false);
       sl.unlock();
     }
 
@@ -836,6 +1339,9 @@ namespace kv
 
       std::swap(rollback_counter, map->rollback_counter);
       std::swap(roll, map->roll);
+      std::swap(removals, map->removals);
+      publish();
+      map->publish();
     }
   };
 
@@ -1023,13 +1529,9 @@ namespace kv
 
           if (data->size() == 0)
           {
-            auto h = store->get_history();
-            if (h != nullptr)
-            {
-              // This tx does not have a write set, so this is a read only tx
-              // because of this we are returning NoVersion
-              h->add_result(req_id, NoVersion);
-            }
+            // This tx does not have a write set, so this is a read only tx
+            // because of this we are returning NoVersion
+            store->add_read_only_result(req_id);
             return CommitSuccess::OK;
           }
 
@@ -1142,9 +1644,10 @@ namespace kv
         frame::FlatbufferSerialiser fbs({}, {});
         return fbs.get_detached_buffer();
       }
-      // Retrieve encryptor.
+      // Borrow an encryptor, as other transactions may be serialised
+      // concurrently.
       auto map = view_list.begin()->second.map;
-      auto e = map->get_store()->get_encryptor();
+      auto e = map->get_store()->borrow_encryptor();
 
       S replicated_serialiser(e, version);
       S derived_serialiser(e, version);
@@ -1172,12 +1675,10 @@ namespace kv
         }
       }
 
-      // Return serialised Tx.
+      // Return serialised Tx, written directly into its frame
       frame::FlatbufferSerialiser fbs(
-        replicated ? std::move(replicated_serialiser.get_raw_data()) :
-                     std::move(std::vector<uint8_t>(0)),
-        derived ? std::move(derived_serialiser.get_raw_data()) :
-                  std::move(std::vector<uint8_t>(0)));
+        replicated ? &replicated_serialiser : nullptr,
+        derived ? &derived_serialiser : nullptr);
       return std::move(fbs.get_detached_buffer());
     }
 
@@ -1226,12 +1727,59 @@ namespace kv
     }
   };
 
+  /// The state of every map of a store at a compacted version, captured by
+  /// Store::snapshot()
+  template <class S>
+  class StoreSnapshot
+  {
+  private:
+    const Version version;
+    std::vector<std::unique_ptr<AbstractMapSnapshot<S>>> map_snapshots;
+    std::shared_ptr<AbstractTxEncryptor> encryptor;
+
+  public:
+    StoreSnapshot(
+      Version version,
+      std::vector<std::unique_ptr<AbstractMapSnapshot<S>>>&& map_snapshots,
+      std::shared_ptr<AbstractTxEncryptor> encryptor) :
+      version(version),
+      map_snapshots(std::move(map_snapshots)),
+      encryptor(encryptor)
+    {}
+
+    Version get_version() const
+    {
+      return version;
+    }
+
+    /** Serialise the snapshot
+     *
+     * @param max_chunk_entries Maximum number of entries in each chunk
+     * @param handler Called with each chunk, in order. Chunks can be passed
+     * in order to Store::deserialise_snapshot() to restore the state.
+     */
+    void serialise(
+      size_t max_chunk_entries,
+      typename SnapshotSerialiser<S>::ChunkHandler handler)
+    {
+      SnapshotSerialiser<S> s(encryptor, version, max_chunk_entries, handler);
+
+      for (auto& map_snapshot : map_snapshots)
+        map_snapshot->serialise(s);
+
+      s.flush();
+    }
+  };
+
   template <class S, class D>
   class Store : public AbstractStore
   {
   public:
     template <class K, class V, class H = std::hash<K>>
     using Map = Map<K, V, H, S, D>;
+    /// A Map sorted by key, with range queries on its TxView
+    template <class K, class V, class H = std::hash<K>>
+    using OrderedMap = kv::Map<K, V, H, S, D, OrderedState>;
     using Tx = Tx<S, D>;
 
   private:
@@ -1243,6 +1791,18 @@ namespace kv
     std::shared_ptr<Consensus> consensus = nullptr;
     std::shared_ptr<TxHistory> history = nullptr;
     std::shared_ptr<AbstractTxEncryptor> encryptor = nullptr;
+
+    // Encryptors are not reentrant, so transactions serialised concurrently
+    // each borrow a clone of the encryptor. Returned clones are kept for
+    // reuse until the encryptor is replaced.
+    struct EncryptorPool
+    {
+      SpinLock lock;
+      std::vector<std::shared_ptr<AbstractTxEncryptor>> spare;
+    };
+    std::shared_ptr<EncryptorPool> encryptor_pool = nullptr;
+    SpinLock encryptor_lock;
+
     Version version = 0;
     Version compacted = 0;
 
@@ -1322,14 +1882,51 @@ namespace kv
 
     void set_encryptor(std::shared_ptr<AbstractTxEncryptor> encryptor_)
     {
+      std::lock_guard<SpinLock> eguard(encryptor_lock);
       encryptor = encryptor_;
+      encryptor_pool = std::make_shared<EncryptorPool>();
     }
 
     std::shared_ptr<AbstractTxEncryptor> get_encryptor() override
     {
+      std::lock_guard<SpinLock> eguard(encryptor_lock);
       return encryptor;
     }
 
+    std::shared_ptr<AbstractTxEncryptor> borrow_encryptor() override
+    {
+      std::shared_ptr<AbstractTxEncryptor> e;
+      std::shared_ptr<EncryptorPool> pool;
+      {
+        std::lock_guard<SpinLock> eguard(encryptor_lock);
+        if (encryptor == nullptr)
+          return nullptr;
+        e = encryptor;
+        pool = encryptor_pool;
+      }
+
+      std::shared_ptr<AbstractTxEncryptor> clone;
+      {
+        std::lock_guard<SpinLock> pguard(pool->lock);
+        if (!pool->spare.empty())
+        {
+          clone = std::move(pool->spare.back());
+          pool->spare.pop_back();
+        }
+      }
+      if (clone == nullptr)
+        clone = e->clone();
+
+      // The clone goes back to its pool once released. If the encryptor has
+      // been replaced in the meantime, the pool and its clones are dropped.
+      auto raw = clone.get();
+      return std::shared_ptr<AbstractTxEncryptor>(
+        raw, [pool, clone = std::move(clone)](AbstractTxEncryptor*) mutable {
+          std::lock_guard<SpinLock> pguard(pool->lock);
+          pool->spare.push_back(std::move(clone));
+        });
+    }
+
     template <class K, class V, class H = std::hash<K>>
     Map<K, V, H>* get(std::string name)
     {
@@ -1488,136 +2085,161 @@ namespace kv
         h->rollback(v);
     }
 
-    DeserialiseSuccess deserialise(
+    /// A serialised transaction that has been decrypted and decoded by
+    /// decode(), but not yet applied to the store
+    struct DecodedTx
+    {
+      const std::vector<uint8_t>* data = nullptr;
+      Version version = NoVersion;
+      bool valid = false;
+      OrderedViews<S, D> views;
+    };
+
+    /** Decrypt and decode a serialised transaction
+     *
+     * This does not modify the store, and may be called concurrently with
+     * apply() and other calls to decode(), provided each concurrent caller
+     * uses its own encryptor (see `AbstractTxEncryptor::clone()`).
+     *
+     * @param data Serialised transaction, which must outlive the result
+     * @param public_only Only decode public maps, skipping decryption
+     * @param e Encryptor used to decrypt private maps
+     *
+     * @return Decoded transaction, to be passed to apply()
+     */
+    DecodedTx decode(
       const std::vector<uint8_t>& data,
-      bool public_only = false,
-      Term* term = nullptr) override
+      bool public_only,
+      std::shared_ptr<AbstractTxEncryptor> e)
     {
-      // This will return FAILED if the serialised transaction is being
-      // applied out of order.
-      // Processing transactions locally and also deserialising to the
-      // same store will result in a store version mismatch and
-      // deserialisation will then fail.
+      DecodedTx tx;
+      tx.data = &data;
 
       frame::FlatbufferDeserialiser fbd(data.data());
       auto frames = fbd.get_frames();
-      Version v;
-      OrderedViews<S, D> views;
-      bool first_serialiser = true;
-      auto e = get_encryptor();
-
-      // create the first deserialiser
-      D d(
-        e,
-        public_only ? kv::SecurityDomain::PUBLIC :
-                      std::optional<kv::SecurityDomain>());
 
       for (auto& [frame, size] : frames)
       {
-        // find the first buffer that has data to deserialise
-        if (size > 0)
-        {
-          if (!d.init(frame, size))
-          {
-            LOG_FAIL_FMT("Initialisation of deserialise object failed");
-            return DeserialiseSuccess::FAILED;
-          }
+        if (size == 0)
+          continue;
 
-          v = d.template deserialise_version<Version>();
-          // Throw away any local commits that have not propagated via the
-          // consensus.
-          rollback(v - 1);
+        D d(
+          e,
+          public_only ? kv::SecurityDomain::PUBLIC :
+                        std::optional<kv::SecurityDomain>());
 
-          // Make sure this is the next transaction.
-          auto cv = current_version();
-          if (cv != (v - 1))
-          {
-            LOG_FAIL_FMT(
-              "Tried to deserialise {} but current_version is {}", v, cv);
-            return DeserialiseSuccess::FAILED;
-          }
-          // initialized first deserialiser
-          break;
+        if (!d.init(frame, size))
+        {
+          LOG_FAIL_FMT("Initialisation of deserialise object failed");
+          return tx;
         }
-      }
 
-      // Deserialised transactions express read dependencies as versions,
-      // rather than with the actual value read. As a result, they don't
-      // need snapshot isolation on the map state, and so do not need to
-      // lock all the maps before creating the transaction.
-      std::lock_guard<SpinLock> mguard(maps_lock);
+        Version v = d.template deserialise_version<Version>();
+        if (tx.version == NoVersion)
+        {
+          tx.version = v;
+        }
+        else if (v != tx.version)
+        {
+          LOG_FAIL_FMT(
+            "Deserialisers versions do not match {} {}", tx.version, v);
+          return tx;
+        }
 
-      for (auto& [frame, size] : frames)
-      {
-        if (size > 0)
+        for (auto r = d.start_map(); r.has_value(); r = d.start_map())
         {
-          if (first_serialiser)
+          const auto map_name = r.value();
+
+          // Only the lookup needs the maps lock, so that concurrent decoders
+          // do not serialise on it.
+          AbstractMap<S, D>* map = nullptr;
           {
-            first_serialiser = false;
+            std::lock_guard<SpinLock> mguard(maps_lock);
+            auto search = maps.find(map_name);
+            if (search != maps.end())
+              map = search->second.get();
           }
-          else
-          {
-            // create next deserialiser
-            D d(
-              e,
-              public_only ? kv::SecurityDomain::PUBLIC :
-                            std::optional<kv::SecurityDomain>());
 
-            if (!d.init(frame, size))
-            {
-              LOG_FAIL_FMT("Initialisation of deserialise object failed");
-              return DeserialiseSuccess::FAILED;
-            }
+          if (map == nullptr)
+          {
+            LOG_FAIL_FMT("No such map {} at version {}", map_name, v);
+            return tx;
+          }
 
-            Version v_ = d.template deserialise_version<Version>();
-            LOG_DEBUG_FMT("Deserialising {}", v_);
-            if (v != v_)
-            {
-              LOG_FAIL_FMT("Deserialisers versions do not match {} {}", v, v_);
-              return DeserialiseSuccess::FAILED;
-            }
+          if (tx.views.find(map_name) != tx.views.end())
+          {
+            LOG_FAIL_FMT("Multiple writes on {} at version {}", map_name, v);
+            return tx;
           }
 
-          for (auto r = d.start_map(); r.has_value(); r = d.start_map())
+          auto view = map->create_view(v);
+          tx.views[map_name] = {map,
+                                std::unique_ptr<AbstractTxView<S, D>>(view)};
+
+          if (!view->deserialise(d, v))
           {
-            const auto map_name = r.value();
+            LOG_FAIL_FMT(
+              "Could not deserialise Tx for map {} at version {}", map_name, v);
+            return tx;
+          }
+        }
 
-            auto search = maps.find(map_name);
-            if (search == maps.end())
-            {
-              LOG_FAIL_FMT("No such map {} at version {}", map_name, v);
-              return DeserialiseSuccess::FAILED;
-            }
+        if (!d.end())
+        {
+          LOG_FAIL_FMT("Unexpected content in Tx at version {}", v);
+          return tx;
+        }
+      }
 
-            auto view_search = views.find(map_name);
-            if (view_search != views.end())
-            {
-              LOG_FAIL_FMT("Multiple writes on {} at version {}", map_name, v);
-              return DeserialiseSuccess::FAILED;
-            }
+      tx.valid = true;
+      return tx;
+    }
 
-            auto view = search->second->create_view(v);
-            if (!view->deserialise(d, v))
-            {
-              LOG_FAIL_FMT(
-                "Could not deserialise Tx for map {} at version {}",
-                map_name,
-                v);
-              return DeserialiseSuccess::FAILED;
-            }
+    /** Apply a decoded transaction to the store
+     *
+     * Decoded transactions must be applied in version order.
+     *
+     * @param tx Transaction returned by decode()
+     * @param term Set to the term of the signature, if the transaction
+     * contains one
+     *
+     * @return Outcome of the deserialisation
+     */
+    DeserialiseSuccess apply(DecodedTx& tx, Term* term = nullptr)
+    {
+      // This will return FAILED if the serialised transaction is being
+      // applied out of order.
+      // Processing transactions locally and also deserialising to the
+      // same store will result in a store version mismatch and
+      // deserialisation will then fail.
+      auto v = tx.version;
+      if (v == NoVersion)
+        return DeserialiseSuccess::FAILED;
 
-            views[map_name] = {search->second.get(),
-                               std::unique_ptr<AbstractTxView<S, D>>(view)};
-          }
+      // Throw away any local commits that have not propagated via the
+      // consensus.
+      rollback(v - 1);
 
-          if (!d.end())
-          {
-            LOG_FAIL_FMT("Unexpected content in Tx at version {}", v);
-            return DeserialiseSuccess::FAILED;
-          }
-        }
+      // Make sure this is the next transaction.
+      auto cv = current_version();
+      if (cv != (v - 1))
+      {
+        LOG_FAIL_FMT(
+          "Tried to deserialise {} but current_version is {}", v, cv);
+        return DeserialiseSuccess::FAILED;
       }
 
+      if (!tx.valid)
+        return DeserialiseSuccess::FAILED;
+
+      auto& views = tx.views;
+
+      // Deserialised transactions express read dependencies as versions,
+      // rather than with the actual value read. As a result, they don't
+      // need snapshot isolation on the map state, and so do not need to
+      // lock all the maps before creating the transaction.
+      std::lock_guard<SpinLock> mguard(maps_lock);
+
       auto c = Tx::commit(views, [v]() { return v; });
       if (!c.has_value())
       {
@@ -1655,6 +2277,7 @@ namespace kv
           }
           success = DeserialiseSuccess::PASS_SIGNATURE;
         }
+        auto& data = *tx.data;
         auto rep = frame::replicated(data.data());
         h->append(rep.p, rep.n, data.data(), data.size());
       }
@@ -1662,6 +2285,115 @@ namespace kv
       return success;
     }
 
+    DeserialiseSuccess deserialise(
+      const std::vector<uint8_t>& data,
+      bool public_only = false,
+      Term* term = nullptr) override
+    {
+      auto tx = decode(data, public_only, get_encryptor());
+      return apply(tx, term);
+    }
+
+    /** Capture the state of all maps at the last compacted version
+     *
+     * The state of a map is persistent, so this is cheap. Serialising the
+     * returned snapshot does not require any lock on the store.
+     */
+    std::unique_ptr<StoreSnapshot<S>> snapshot()
+    {
+      std::lock_guard<SpinLock> mguard(maps_lock);
+      auto v = commit_version();
+
+      for (auto& map : maps)
+        map.second->lock();
+
+      std::vector<std::unique_ptr<AbstractMapSnapshot<S>>> map_snapshots;
+      for (auto& map : maps)
+        map_snapshots.push_back(map.second->snapshot(v));
+
+      for (auto& map : maps)
+        map.second->unlock();
+
+      return std::make_unique<StoreSnapshot<S>>(
+        v, std::move(map_snapshots), get_encryptor());
+    }
+
+    /** Restore one chunk of a snapshot serialised by StoreSnapshot::serialise()
+     *
+     * The store must be empty, or only contain earlier chunks of the same
+     * snapshot. Once a chunk has been restored, the store is compacted at the
+     * snapshot version and the commit hooks of restored maps have been run.
+     *
+     * @param data Serialised chunk
+     * @param public_only Only restore public maps, skipping decryption
+     *
+     * @return Version of the snapshot, or NoVersion on failure
+     */
+    Version deserialise_snapshot(
+      const std::vector<uint8_t>& data, bool public_only = false)
+    {
+      D d(
+        get_encryptor(),
+        public_only ? kv::SecurityDomain::PUBLIC :
+                      std::optional<kv::SecurityDomain>());
+
+      if (!d.init(data.data(), data.size()))
+      {
+        LOG_FAIL_FMT("Initialisation of snapshot deserialiser failed");
+        return NoVersion;
+      }
+
+      auto v = d.template deserialise_version<Version>();
+      std::vector<AbstractMap<S, D>*> restored;
+
+      {
+        std::lock_guard<SpinLock> mguard(maps_lock);
+
+        auto cv = current_version();
+        if (cv != 0 && cv != v)
+        {
+          LOG_FAIL_FMT(
+            "Tried to restore snapshot at {} but current_version is {}", v, cv);
+          return NoVersion;
+        }
+
+        for (auto r = d.start_map(); r.has_value(); r = d.start_map())
+        {
+          const auto map_name = r.value();
+
+          auto search = maps.find(map_name);
+          if (search == maps.end())
+          {
+            LOG_FAIL_FMT("No such map {} in snapshot at {}", map_name, v);
+            return NoVersion;
+          }
+
+          auto map = search->second.get();
+          map->lock();
+          map->deserialise_snapshot(d, v);
+          map->unlock();
+          restored.push_back(map);
+        }
+
+        if (!d.end())
+        {
+          LOG_FAIL_FMT("Unexpected content in snapshot at {}", v);
+          return NoVersion;
+        }
+
+        std::lock_guard<SpinLock> vguard(version_lock);
+        version = v;
+        compacted = v;
+        last_replicated = v;
+        last_committable = v;
+      }
+
+      for (auto map : restored)
+        map->post_deserialise_snapshot();
+
+      return v;
+    }
+
     bool operator==(const Store<S, D>& that) const
     {
       // Only used for debugging, not thread safe.
@@ -1717,11 +2449,6 @@ namespace kv
         version,
         (globally_committable ? " globally_committable" : ""));
 
-      BatchDetachedBuffer batch;
-      Version previous_last_replicated = 0;
-      Version next_last_replicated = 0;
-      Version previous_rollback_count = 0;
-
       {
         std::lock_guard<SpinLock> vguard(version_lock);
         if (globally_committable && version > last_committable)
@@ -1730,71 +2457,101 @@ namespace kv
         pending_txs.insert(
           {version,
            std::make_pair(std::move(pending_tx), globally_committable)});
+      }
 
-        auto h = get_history();
+      // Transactions are replicated in order. Those committed by other threads
+      // while a batch is being replicated are left pending, and are replicated
+      // by the thread that replicated that batch.
+      while (true)
+      {
+        BatchDetachedBuffer batch;
+        Version previous_last_replicated = 0;
+        Version next_last_replicated = 0;
+        Version previous_rollback_count = 0;
 
-        for (Version offset = 1; true; ++offset)
         {
-          auto search = pending_txs.find(last_replicated + offset);
-          if (search == pending_txs.end())
-            break;
+          std::lock_guard<SpinLock> vguard(version_lock);
+          auto h = get_history();
 
-          auto& [pending_tx_, committable_] = search->second;
-          auto p_tx_ = pending_tx_();
+          for (Version offset = 1; true; ++offset)
+          {
+            auto search = pending_txs.find(last_replicated + offset);
+            if (search == pending_txs.end())
+              break;
 
-          // NB: this cannot happen currently. Regular Tx only make it here if
-          // they did succeed, and signatures cannot conflict because they
-          // execute in order with a read_version that's version - 1, so even
-          // two contiguous signatures are fine
-          if (p_tx_.success != CommitSuccess::OK)
-            LOG_DEBUG_FMT("Failed Tx commit {}", last_replicated + offset);
+            auto& [pending_tx_, committable_] = search->second;
+            auto p_tx_ = pending_tx_();
 
-          if (h)
-          {
-            auto replicated = frame::replicated(p_tx_.buffer->data());
-
-            h->add_result(
-              p_tx_.reqid,
-              version,
-              replicated.p,
-              replicated.n,
-              p_tx_.buffer->data(),
+            // NB: this cannot happen currently. Regular Tx only make it here if
+            // they did succeed, and signatures cannot conflict because they
+            // execute in order with a read_version that's version - 1, so even
+            // two contiguous signatures are fine
+            if (p_tx_.success != CommitSuccess::OK)
+              LOG_DEBUG_FMT("Failed Tx commit {}", last_replicated + offset);
+
+            if (h)
+            {
+              auto replicated = frame::replicated(p_tx_.buffer->data());
+
+              h->add_result(
+                p_tx_.reqid,
+                last_replicated + offset,
+                replicated.p,
+                replicated.n,
+                p_tx_.buffer->data(),
+                p_tx_.buffer->size());
+            }
+
+            LOG_DEBUG_FMT(
+              "Batching {} ({})",
+              last_replicated + offset,
               p_tx_.buffer->size());
+            batch.emplace_back(
+              last_replicated + offset, std::move(p_tx_.buffer), committable_);
+            pending_txs.erase(search);
           }
 
-          LOG_DEBUG_FMT(
-            "Batching {} ({})", last_replicated + offset, p_tx_.buffer->size());
-          batch.emplace_back(
-            last_replicated + offset, std::move(p_tx_.buffer), committable_);
-          pending_txs.erase(search);
-        }
+          // The whole batch is hashed at once, while it still holds the
+          // buffers of its transactions
+          if (h)
+            h->append_pending();
 
-        if (batch.size() == 0)
-          return CommitSuccess::OK;
+          if (batch.size() == 0)
+            return CommitSuccess::OK;
 
-        previous_rollback_count = rollback_count;
-        previous_last_replicated = last_replicated;
-        next_last_replicated = last_replicated + batch.size();
-      }
+          previous_rollback_count = rollback_count;
+          previous_last_replicated = last_replicated;
+          next_last_replicated = last_replicated + batch.size();
+        }
+
+        if (!r->replicate(batch))
+        {
+          std::lock_guard<SpinLock> vguard(version_lock);
+          LOG_DEBUG_FMT("Failed to replicate");
+          return CommitSuccess::NO_REPLICATE;
+        }
 
-      if (r->replicate(batch))
-      {
         std::lock_guard<SpinLock> vguard(version_lock);
         if (
-          last_replicated == previous_last_replicated &&
-          previous_rollback_count == rollback_count)
-          last_replicated = next_last_replicated;
-        return CommitSuccess::OK;
-      }
-      else
-      {
-        std::lock_guard<SpinLock> vguard(version_lock);
-        LOG_DEBUG_FMT("Failed to replicate");
-        return CommitSuccess::NO_REPLICATE;
+          last_replicated != previous_last_replicated ||
+          previous_rollback_count != rollback_count)
+          return CommitSuccess::OK;
+
+        last_replicated = next_last_replicated;
       }
     }
 
-    Version next_version() override
+    void add_read_only_result(const TxHistory::RequestID& req_id) override
+    {
+      // Results are added under the version lock, in order with those of the
+      // transactions being replicated
+      std::lock_guard<SpinLock> vguard(version_lock);
+      auto h = get_history();
+      if (h != nullptr)
+        h->add_result(req_id, NoVersion);
+    }
+
+        Version next_version() override
     {
       std::lock_guard<SpinLock> vguard(version_lock);
 
@@ -7,6 +7,7 @@
 #include "enclave/consensus_type.h"
 #include "flatbufferwrapper.h"
 
+#include <algorithm>
 #include <array>
 #include <chrono>
 #include <functional>
@@ -111,6 +112,17 @@ namespace kv
       std::vector<uint8_t> response;
     };
 
+    // Counters of the requests, results and responses kept by the history.
+    // Hits and misses count the lookups of requests and responses.
+    struct RequestCacheStats
+    {
+      size_t hits = 0;
+      size_t misses = 0;
+      size_t evictions = 0;
+      size_t entries = 0;
+      size_t bytes = 0;
+    };
+
     using ResultCallbackHandler = std::function<bool(ResultCallbackArgs)>;
     using ResponseCallbackHandler = std::function<bool(ResponseCallbackArgs)>;
 
@@ -146,6 +158,10 @@ namespace kv
       const uint8_t* all_data,
       size_t all_data_size) = 0;
     virtual void add_result(RequestID id, kv::Version version) = 0;
+    // Appends the results added since the last call to the history, hashing
+    // them together. Until then, the data passed to add_result must remain
+    // valid.
+    virtual void append_pending() = 0;
     virtual void add_response(
       RequestID id, const std::vector<uint8_t>& response) = 0;
     virtual void register_on_result(ResultCallbackHandler func) = 0;
@@ -154,7 +170,12 @@ namespace kv
     virtual void clear_on_response() = 0;
     virtual crypto::Sha256Hash get_full_state_root() = 0;
     virtual crypto::Sha256Hash get_replicated_state_root() = 0;
+    // Number of Merkle roots computed so far, rather than read from cache
+    virtual size_t get_roots_computed() = 0;
+    virtual RequestCacheStats get_request_cache_stats() = 0;
     virtual std::vector<uint8_t> get_receipt(Version v) = 0;
+    virtual std::vector<std::vector<uint8_t>> get_receipts(
+      Version from, Version to) = 0;
     virtual bool verify_receipt(const std::vector<uint8_t>& receipt) = 0;
   };
 
@@ -218,6 +239,8 @@ namespace kv
       state = Primary;
     }
 
+    virtual void init_from_snapshot(SeqNo seqno, View view) {}
+
     virtual bool replicate(const BatchDetachedBuffer& entries) = 0;
     virtual bool replicate(const BatchVector& entries) = 0;
     virtual View get_view() = 0;
@@ -318,6 +341,29 @@ namespace kv
       std::vector<uint8_t>& plain,
       kv::Version version) = 0;
     virtual size_t get_header_length() = 0;
+
+    /// An entry of a batch given to encrypt_batch or decrypt_batch. The output
+    /// buffer is provided by the caller, and is as large as the input. The
+    /// header, of get_header_length() bytes, is written on encryption and read
+    /// on decryption.
+    struct BatchEntry
+    {
+      CBuffer input;
+      CBuffer additional_data;
+      uint8_t* header;
+      uint8_t* output;
+      kv::Version version;
+    };
+
+    virtual void encrypt_batch(const BatchEntry* entries, size_t n) = 0;
+
+    /// Returns false if any of the entries could not be decrypted, in which
+    /// case the content of the output buffers is unspecified
+    virtual bool decrypt_batch(const BatchEntry* entries, size_t n) = 0;
+
+    /// Create an encryptor with the same keys, that can safely be used
+    /// concurrently with this one
+    virtual std::shared_ptr<AbstractTxEncryptor> clone() = 0;
   };
 
   class AbstractStore
@@ -330,6 +376,9 @@ namespace kv
     virtual std::shared_ptr<Consensus> get_consensus() = 0;
     virtual std::shared_ptr<TxHistory> get_history() = 0;
     virtual std::shared_ptr<AbstractTxEncryptor> get_encryptor() = 0;
+    /// Encryptor for the exclusive use of the caller until it releases it,
+    /// so that transactions can be serialised concurrently
+    virtual std::shared_ptr<AbstractTxEncryptor> borrow_encryptor() = 0;
     virtual DeserialiseSuccess deserialise(
       const std::vector<uint8_t>& data,
       bool public_only = false,
@@ -339,6 +388,9 @@ namespace kv
     // TODO (#api): split out?
     virtual CommitSuccess commit(
       Version v, PendingTx pt, bool globally_committable) = 0;
+    /// Records the result of a transaction without writes in the history,
+    /// which is not replicated and so has no version
+    virtual void add_read_only_result(const TxHistory::RequestID& req_id) = 0;
     virtual size_t commit_gap() = 0;
   };
 
@@ -359,6 +411,88 @@ namespace kv
     virtual bool is_replicated() = 0;
   };
 
+  /// Serialises the state of maps captured by a snapshot into a sequence of
+  /// self-contained chunks. Each chunk is serialised (and its private domain
+  /// encrypted) like a transaction at the snapshot version, and holds at most
+  /// a fixed number of entries, each with the version at which it was written.
+  template <class S>
+  class SnapshotSerialiser
+  {
+  public:
+    using ChunkHandler = std::function<void(std::vector<uint8_t>&& chunk)>;
+
+  private:
+    std::shared_ptr<AbstractTxEncryptor> encryptor;
+    const Version version;
+    const size_t max_chunk_entries;
+    ChunkHandler handler;
+
+    std::unique_ptr<S> chunk;
+    size_t chunk_entries = 0;
+
+    std::string map_name;
+    SecurityDomain map_domain = SecurityDomain::PUBLIC;
+    bool map_started = false;
+
+  public:
+    SnapshotSerialiser(
+      std::shared_ptr<AbstractTxEncryptor> encryptor,
+      Version version,
+      size_t max_chunk_entries,
+      ChunkHandler handler) :
+      encryptor(encryptor),
+      version(version),
+      max_chunk_entries(std::max<size_t>(max_chunk_entries, 1)),
+      handler(handler)
+    {}
+
+    void start_map(const std::string& name, SecurityDomain domain)
+    {
+      map_name = name;
+      map_domain = domain;
+      map_started = false;
+    }
+
+    template <class K, class V>
+    void serialise_entry(const K& k, const V& v, Version write_version)
+    {
+      if (chunk == nullptr)
+        chunk = std::make_unique<S>(encryptor, version);
+
+      // A map spanning several chunks is started again in each of them
+      if (!map_started)
+      {
+        chunk->start_map(map_name, map_domain);
+        map_started = true;
+      }
+
+      chunk->serialise_write_version(k, v, write_version);
+
+      if (++chunk_entries >= max_chunk_entries)
+        flush();
+    }
+
+    /// Emits the current chunk, if it holds any entries
+    void flush()
+    {
+      if (chunk == nullptr)
+        return;
+
+      handler(chunk->get_raw_data());
+      chunk.reset();
+      chunk_entries = 0;
+      map_started = false;
+    }
+  };
+
+  template <class S>
+  class AbstractMapSnapshot
+  {
+  public:
+    virtual ~AbstractMapSnapshot() {}
+    virtual void serialise(SnapshotSerialiser<S>& s) = 0;
+  };
+
   template <class S, class D>
   class AbstractMap
   {
@@ -372,6 +506,9 @@ namespace kv
     virtual void compact(Version v) = 0;
     virtual void post_compact() = 0;
     virtual void rollback(Version v) = 0;
+    virtual std::unique_ptr<AbstractMapSnapshot<S>> snapshot(Version v) = 0;
+    virtual void deserialise_snapshot(D& d, Version v) = 0;
+    virtual void post_deserialise_snapshot() = 0;
     virtual void lock() = 0;
     virtual void unlock() = 0;
     virtual SecurityDomain get_security_domain() = 0;
@@ -50,10 +50,10 @@ namespace kv
       return sb.size() == 0;
     }
 
-    std::vector<uint8_t> get_raw_data()
+    /// Valid until the writer is next modified
+    CBuffer get_raw_buffer()
     {
-      return {reinterpret_cast<uint8_t*>(sb.data()),
-              reinterpret_cast<uint8_t*>(sb.data()) + sb.size()};
+      return {reinterpret_cast<uint8_t*>(sb.data()), sb.size()};
     }
   };
 
@@ -29,17 +29,23 @@ namespace kv
   private:
     nlohmann::json arr;
 
+    // Msgpack encoding of arr, kept until the writer is next modified
+    std::vector<uint8_t> raw_data;
+    bool raw_data_valid = false;
+
   public:
     template <typename T>
     void append(T&& t)
     {
       nlohmann::json obj = t;
       arr.push_back(obj);
+      raw_data_valid = false;
     }
 
     void clear()
     {
       arr.clear();
+      raw_data_valid = false;
     }
 
     bool is_empty()
@@ -47,9 +53,15 @@ namespace kv
       return arr.empty();
     }
 
-    std::vector<uint8_t> get_raw_data()
+    /// Valid until the writer is next modified
+    CBuffer get_raw_buffer()
     {
-      return nlohmann::json::to_msgpack(arr);
+      if (!raw_data_valid)
+      {
+        raw_data = nlohmann::json::to_msgpack(arr);
+        raw_data_valid = true;
+      }
+      return raw_data;
     }
   };
 
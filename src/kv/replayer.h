@@ -0,0 +1,249 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "kv.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kv
+{
+  /// Replays batches of serialised transactions into a Store. Entries are
+  /// decrypted and decoded ahead of time on a pool of worker threads (and on
+  /// the calling thread, while it waits), and applied to the store in order on
+  /// the calling thread. Applying a decoded transaction has the same effect as
+  /// Store::deserialise().
+  template <class S, class D>
+  class Replayer
+  {
+  public:
+    using StoreT = Store<S, D>;
+    using DecodedTx = typename StoreT::DecodedTx;
+
+    /// Called on the replaying thread, in order, with the position of each
+    /// applied entry in the batch and the outcome of its deserialisation.
+    /// Returning false stops the replay of the batch.
+    using ApplyHook = std::function<bool(size_t, DeserialiseSuccess)>;
+
+  private:
+    struct Slot
+    {
+      DecodedTx tx;
+      // Set if decoding threw, rethrown when the entry is applied
+      std::exception_ptr error;
+      bool ready = false;
+    };
+
+    struct Batch
+    {
+      const std::vector<std::vector<uint8_t>>& entries;
+      const bool public_only;
+      std::vector<Slot> slots;
+      std::atomic<size_t> next{0};
+
+      Batch(
+        const std::vector<std::vector<uint8_t>>& entries, bool public_only) :
+        entries(entries),
+        public_only(public_only),
+        slots(entries.size())
+      {}
+    };
+
+    StoreT& store;
+    std::vector<std::thread> workers;
+
+    std::mutex lock;
+    std::condition_variable work_cv;
+    std::condition_variable ready_cv;
+    Batch* batch = nullptr;
+    size_t busy = 0;
+    bool stopping = false;
+
+    // Decodes entry i of the batch. Must be called with the lock held, which
+    // is released while decoding.
+    void decode(
+      Batch& b,
+      size_t i,
+      std::shared_ptr<AbstractTxEncryptor> e,
+      std::unique_lock<std::mutex>& guard)
+    {
+      auto& slot = b.slots[i];
+      guard.unlock();
+
+      DecodedTx tx;
+      std::exception_ptr error;
+      try
+      {
+        tx = store.decode(b.entries[i], b.public_only, e);
+      }
+      catch (...)
+      {
+        error = std::current_exception();
+      }
+
+      guard.lock();
+      slot.tx = std::move(tx);
+      slot.error = error;
+      slot.ready = true;
+      ready_cv.notify_all();
+    }
+
+    // Stops workers from claiming further entries of the batch, and waits for
+    // those in flight, so that the batch can go out of scope
+    void finish(Batch& b)
+    {
+      b.next = b.slots.size();
+      std::unique_lock<std::mutex> guard(lock);
+      batch = nullptr;
+      ready_cv.wait(guard, [this]() { return busy == 0; });
+    }
+
+    void worker(std::shared_ptr<AbstractTxEncryptor> e)
+    {
+      std::unique_lock<std::mutex> guard(lock);
+
+      while (true)
+      {
+        work_cv.wait(guard, [this]() {
+          return stopping ||
+            (batch != nullptr && batch->next < batch->slots.size());
+        });
+
+        if (stopping)
+          return;
+
+        auto b = batch;
+        busy++;
+
+        const auto count = b->slots.size();
+        for (auto i = b->next++; i < count; i = b->next++)
+          decode(*b, i, e, guard);
+
+        busy--;
+        ready_cv.notify_all();
+      }
+    }
+
+  public:
+    /** Create a replayer
+     *
+     * The encryptor of the store must be set before the replayer is created.
+     *
+     * @param store Store to apply transactions to
+     * @param worker_count Number of decoding threads. If 0, entries are
+     * decoded on the replaying thread.
+     */
+    Replayer(StoreT& store, size_t worker_count) : store(store)
+    {
+      auto e = store.get_encryptor();
+
+      for (size_t i = 0; i < worker_count; ++i)
+      {
+        workers.emplace_back(
+          &Replayer::worker, this, e ? e->clone() : nullptr);
+      }
+    }
+
+    Replayer(const Replayer& that) = delete;
+
+    ~Replayer()
+    {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+      }
+      work_cv.notify_all();
+
+      for (auto& w : workers)
+        w.join();
+    }
+
+    StoreT& get_store()
+    {
+      return store;
+    }
+
+    size_t get_worker_count() const
+    {
+      return workers.size();
+    }
+
+    /** Replay a batch of serialised transactions
+     *
+     * When this returns, workers no longer reference the batch.
+     *
+     * @param entries Serialised transactions, in version order
+     * @param public_only Only deserialise public maps
+     * @param hook Called after each entry is applied
+     * @param term Passed to Store::apply() for each entry
+     *
+     * @return Number of entries applied
+     */
+    size_t replay(
+      const std::vector<std::vector<uint8_t>>& entries,
+      bool public_only,
+      ApplyHook hook,
+      Term* term = nullptr)
+    {
+      Batch b(entries, public_only);
+      const auto count = b.slots.size();
+      auto e = store.get_encryptor();
+
+      if (!workers.empty())
+      {
+        {
+          std::lock_guard<std::mutex> guard(lock);
+          batch = &b;
+        }
+        work_cv.notify_all();
+      }
+
+      size_t applied = 0;
+      try
+      {
+        for (; applied < count; ++applied)
+        {
+          auto& slot = b.slots[applied];
+
+          std::unique_lock<std::mutex> guard(lock);
+          while (!slot.ready)
+          {
+            // Help decoding while the next entry to apply is not ready
+            auto i = b.next++;
+            if (i < count)
+              decode(b, i, e, guard);
+            else
+              ready_cv.wait(guard);
+          }
+          guard.unlock();
+
+          if (slot.error)
+            std::rethrow_exception(slot.error);
+
+          auto result = store.apply(slot.tx, term);
+          slot.tx = {};
+
+          if (!hook(applied, result))
+          {
+            ++applied;
+            break;
+          }
+        }
+      }
+      catch (...)
+      {
+        finish(b);
+        throw;
+      }
+
+      finish(b);
+      return applied;
+    }
+  };
+}
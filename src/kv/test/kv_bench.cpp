@@ -4,11 +4,14 @@
 
 #include "enclave/appinterface.h"
 #include "kv/kv.h"
+#include "kv/replayer.h"
 #include "node/encryptor.h"
 #include "stub_consensus.h"
 
 #include <picobench/picobench.hpp>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace ccfapp;
 using namespace ccf;
@@ -59,6 +62,53 @@ static void serialise(picobench::state& s)
   s.stop_timer();
 }
 
+// Serialises a committed transaction, writing 2 * s.iterations() values of S
+// bytes, into its frame
+template <kv::SecurityDomain SD, size_t S>
+static void serialise_committed(picobench::state& s)
+{
+  Store kv_store;
+  auto secrets = create_network_secrets();
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(0x1, secrets);
+  kv_store.set_encryptor(encryptor);
+
+  auto& map0 = kv_store.create<std::string, std::string>("map0", SD);
+  auto& map1 = kv_store.create<std::string, std::string>("map1", SD);
+  Store::Tx tx;
+  auto [tx0, tx1] = tx.get_view(map0, map1);
+
+  const std::string value(S, 'v');
+  for (int i = 0; i < s.iterations(); i++)
+  {
+    auto key = "key" + std::to_string(i);
+    tx0->put(key, value);
+    tx1->put(key, value);
+  }
+
+  auto rc = tx.commit();
+  if (rc != kv::CommitSuccess::OK)
+    throw std::logic_error("Transaction commit failed: " + std::to_string(rc));
+
+  s.start_timer();
+  auto data = tx.serialise();
+  s.stop_timer();
+
+  if (data->size() == 0)
+    throw std::logic_error("Transaction serialisation failed");
+}
+
+template <size_t S>
+static void serialise_committed_public(picobench::state& s)
+{
+  serialise_committed<kv::SecurityDomain::PUBLIC, S>(s);
+}
+
+template <size_t S>
+static void serialise_committed_private(picobench::state& s)
+{
+  serialise_committed<kv::SecurityDomain::PRIVATE, S>(s);
+}
+
 template <kv::SecurityDomain SD>
 static void deserialise(picobench::state& s)
 {
@@ -94,6 +144,170 @@ static void deserialise(picobench::state& s)
   s.stop_timer();
 }
 
+// Serialised transactions, each writing keys_per_tx private keys
+std::vector<std::vector<uint8_t>> make_entries(
+  Store& kv_store2, size_t tx_count, size_t keys_per_tx)
+{
+  auto consensus = std::make_shared<kv::StubConsensus>();
+  Store kv_store(consensus);
+  kv_store.set_encryptor(kv_store2.get_encryptor());
+
+  auto& map0 = kv_store.create<std::string, std::string>("map0");
+  auto& map1 = kv_store.create<std::string, std::string>("map1");
+  kv_store2.clone_schema(kv_store);
+
+  std::vector<std::vector<uint8_t>> entries;
+  for (size_t i = 0; i < tx_count; i++)
+  {
+    Store::Tx tx;
+    auto [tx0, tx1] = tx.get_view(map0, map1);
+    for (size_t j = 0; j < keys_per_tx; j++)
+    {
+      auto key = "key" + std::to_string(i * keys_per_tx + j);
+      tx0->put(key, std::string(64, 'v'));
+      tx1->put(key, std::string(64, 'v'));
+    }
+    tx.commit();
+    entries.push_back(consensus->get_latest_data().first);
+  }
+
+  return entries;
+}
+
+static void replay_serial(picobench::state& s)
+{
+  Store kv_store2;
+  auto secrets = create_network_secrets();
+  kv_store2.set_encryptor(std::make_shared<ccf::TxEncryptor>(0x1, secrets));
+  auto entries = make_entries(kv_store2, s.iterations(), 20);
+
+  s.start_timer();
+  for (auto& entry : entries)
+  {
+    auto rc = kv_store2.deserialise(entry);
+    if (rc != kv::DeserialiseSuccess::PASS)
+      throw std::logic_error(
+        "Transaction deserialisation failed: " + std::to_string(rc));
+  }
+  s.stop_timer();
+}
+
+template <size_t workers>
+static void replay_parallel(picobench::state& s)
+{
+  Store kv_store2;
+  auto secrets = create_network_secrets();
+  kv_store2.set_encryptor(std::make_shared<ccf::TxEncryptor>(0x1, secrets));
+  auto entries = make_entries(kv_store2, s.iterations(), 20);
+  kv::Replayer<StoreSerialiser, StoreDeserialiser> replayer(
+    kv_store2, workers);
+
+  s.start_timer();
+  replayer.replay(entries, false, [](size_t, kv::DeserialiseSuccess rc) {
+    if (rc != kv::DeserialiseSuccess::PASS)
+      throw std::logic_error(
+        "Transaction deserialisation failed: " + std::to_string(rc));
+    return true;
+  });
+  s.stop_timer();
+}
+
+// Runs s.iterations() transactions, each reading or writing a single key of a
+// map, as most RPCs do
+template <bool write>
+static void single_key(picobench::state& s)
+{
+  Store kv_store;
+  auto& map =
+    kv_store.create<size_t, size_t>("map", kv::SecurityDomain::PUBLIC);
+
+  constexpr size_t key_count = 1000;
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    for (size_t k = 0; k < key_count; k++)
+      view->put(k, k);
+    tx.commit();
+  }
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); i++)
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    if constexpr (write)
+      view->put(i % key_count, i);
+    else
+      view->get(i % key_count);
+
+    if (tx.commit() != kv::CommitSuccess::OK)
+      throw std::logic_error("Transaction commit failed");
+  }
+  s.stop_timer();
+}
+
+// Runs s.iterations() transactions, each writing key_count keys of a map
+template <size_t key_count>
+static void bulk_write(picobench::state& s)
+{
+  Store kv_store;
+  auto& map =
+    kv_store.create<size_t, size_t>("map", kv::SecurityDomain::PUBLIC);
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); i++)
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    for (size_t k = 0; k < key_count; k++)
+      view->put((i * key_count + k) % 100000, i);
+
+    if (tx.commit() != kv::CommitSuccess::OK)
+      throw std::logic_error("Transaction commit failed");
+  }
+  s.stop_timer();
+}
+
+// Commits s.iterations() transactions, split across threads. Each transaction
+// reads a shared map, and writes its own key in another shared map, so that
+// commits contend for the same maps without conflicting
+template <size_t threads>
+static void commit_contended(picobench::state& s)
+{
+  Store kv_store;
+  auto& config =
+    kv_store.create<size_t, size_t>("config", kv::SecurityDomain::PUBLIC);
+  auto& data =
+    kv_store.create<size_t, size_t>("data", kv::SecurityDomain::PUBLIC);
+
+  {
+    Store::Tx tx;
+    tx.get_view(config)->put(0, 1);
+    tx.commit();
+  }
+
+  const size_t per_thread = s.iterations() / threads;
+  auto thread_fn = [&](size_t t) {
+    for (size_t i = 0; i < per_thread; i++)
+    {
+      Store::Tx tx;
+      auto [config_view, data_view] = tx.get_view(config, data);
+      auto step = config_view->get(0).value_or(0);
+      data_view->put(t, i * step);
+      if (tx.commit() != kv::CommitSuccess::OK)
+        throw std::logic_error("Transaction commit failed");
+    }
+  };
+
+  s.start_timer();
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; t++)
+    workers.emplace_back(thread_fn, t);
+  for (auto& w : workers)
+    w.join();
+  s.stop_timer();
+}
+
 const std::vector<int> tx_count = {10, 100, 200};
 const uint32_t sample_size = 100;
 
@@ -106,9 +320,65 @@ PICOBENCH(serialise<SD::PUBLIC>)
   .baseline();
 PICOBENCH(serialise<SD::PRIVATE>).iterations(tx_count).samples(sample_size);
 
+PICOBENCH_SUITE("serialise_committed");
+PICOBENCH(serialise_committed_public<8>)
+  .iterations(tx_count)
+  .samples(sample_size)
+  .baseline();
+PICOBENCH(serialise_committed_private<8>)
+  .iterations(tx_count)
+  .samples(sample_size);
+PICOBENCH(serialise_committed_public<1024>)
+  .iterations(tx_count)
+  .samples(sample_size);
+PICOBENCH(serialise_committed_private<1024>)
+  .iterations(tx_count)
+  .samples(sample_size);
+
 PICOBENCH_SUITE("deserialise");
 PICOBENCH(deserialise<SD::PUBLIC>)
   .iterations(tx_count)
   .samples(sample_size)
   .baseline();
 PICOBENCH(deserialise<SD::PRIVATE>).iterations(tx_count).samples(sample_size);
+
+const std::vector<int> replay_tx_count = {100, 1000};
+
+PICOBENCH_SUITE("replay");
+PICOBENCH(replay_serial)
+  .iterations(replay_tx_count)
+  .samples(sample_size)
+  .baseline();
+PICOBENCH(replay_parallel<0>).iterations(replay_tx_count).samples(sample_size);
+PICOBENCH(replay_parallel<1>).iterations(replay_tx_count).samples(sample_size);
+PICOBENCH(replay_parallel<3>).iterations(replay_tx_count).samples(sample_size);
+
+const std::vector<int> single_key_tx_count = {1000, 10000};
+
+PICOBENCH_SUITE("single key");
+PICOBENCH(single_key<false>)
+  .iterations(single_key_tx_count)
+  .samples(sample_size)
+  .baseline();
+PICOBENCH(single_key<true>).iterations(single_key_tx_count).samples(sample_size);
+
+const std::vector<int> bulk_tx_count = {10, 100};
+
+PICOBENCH_SUITE("bulk write");
+PICOBENCH(bulk_write<10>)
+  .iterations(bulk_tx_count)
+  .samples(sample_size)
+  .baseline();
+PICOBENCH(bulk_write<1000>).iterations(bulk_tx_count).samples(sample_size);
+
+const std::vector<int> contended_tx_count = {1600, 16000};
+
+PICOBENCH_SUITE("contention");
+PICOBENCH(commit_contended<1>)
+  .iterations(contended_tx_count)
+  .samples(10)
+  .baseline();
+PICOBENCH(commit_contended<2>).iterations(contended_tx_count).samples(10);
+PICOBENCH(commit_contended<4>).iterations(contended_tx_count).samples(10);
+PICOBENCH(commit_contended<8>).iterations(contended_tx_count).samples(10);
+PICOBENCH(commit_contended<16>).iterations(contended_tx_count).samples(10);
@@ -149,3 +149,73 @@ TEST_CASE("Concurrent kv access" * doctest::test_suite("concurrency"))
     compact_thread.join();
   }
 }
+
+TEST_CASE(
+  "Concurrent reads are consistent" * doctest::test_suite("concurrency"))
+{
+  // Writers increment the same key in two maps in each transaction, while
+  // readers check that they always see both maps at the same version. Views
+  // are created without locking the maps, so this checks that a reader never
+  // sees a commit in one map and not in the other. The store is not compacted
+  // here, since a view whose read version has been compacted away reads the
+  // oldest remaining state of each map instead
+  Store kv_store;
+
+  using MapType = Store::Map<size_t, size_t>;
+  auto& map_a = kv_store.create<MapType>("a", kv::SecurityDomain::PUBLIC);
+  auto& map_b = kv_store.create<MapType>("b", kv::SecurityDomain::PUBLIC);
+
+  constexpr size_t writer_count = 4;
+  constexpr size_t reader_count = 4;
+  constexpr size_t tx_count = 1000;
+
+  std::atomic<size_t> active_writers(writer_count);
+  std::atomic<size_t> mismatches(0);
+  std::atomic<size_t> reads(0);
+  std::vector<std::thread> threads;
+
+  for (size_t i = 0u; i < writer_count; ++i)
+  {
+    threads.emplace_back([&]() {
+      for (size_t j = 0u; j < tx_count; ++j)
+      {
+        while (true)
+        {
+          Store::Tx tx;
+          auto [view_a, view_b] = tx.get_view(map_a, map_b);
+          auto v = view_a->get(0).value_or(0) + 1;
+          view_a->put(0, v);
+          view_b->put(0, v);
+          if (tx.commit() == kv::CommitSuccess::OK)
+            break;
+        }
+      }
+      --active_writers;
+    });
+  }
+
+  for (size_t i = 0u; i < reader_count; ++i)
+  {
+    threads.emplace_back([&]() {
+      while (active_writers.load() > 0)
+      {
+        Store::Tx tx;
+        auto [view_a, view_b] = tx.get_view(map_a, map_b);
+        if (view_a->get(0) != view_b->get(0))
+          ++mismatches;
+        ++reads;
+      }
+    });
+  }
+
+  for (auto& t : threads)
+    t.join();
+
+  REQUIRE(reads.load() > 0);
+  REQUIRE(mismatches.load() == 0);
+
+  Store::Tx tx;
+  auto [view_a, view_b] = tx.get_view(map_a, map_b);
+  REQUIRE(view_a->get(0) == writer_count * tx_count);
+  REQUIRE(view_b->get(0) == writer_count * tx_count);
+}
@@ -0,0 +1,66 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#include "../../ds/logger.h"
+#include "../kv.h"
+#include "../kvserialiser.h"
+
+#include <string>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+using namespace std;
+
+using Store = kv::Store<kv::KvStoreSerialiser, kv::KvStoreDeserialiser>;
+
+static constexpr size_t transactions = 1000000;
+static constexpr size_t live_keys = 1000;
+static constexpr size_t compact_interval = 100;
+
+static constexpr size_t max_expected_rss = 32768;
+
+static size_t get_maxrss()
+{
+  rusage r;
+  auto rc = getrusage(RUSAGE_SELF, &r);
+  if (rc != 0)
+    throw std::logic_error("getrusage failed");
+  return r.ru_maxrss;
+}
+
+// Each transaction writes a new key and removes the one written live_keys
+// transactions before, so that the map never holds more than live_keys
+// entries. Removed keys leave tombstones in the map until their removal is
+// compacted.
+static int put_remove_and_compact()
+{
+  Store kv_store;
+  auto& map = kv_store.create<size_t, std::string>(
+    "map", kv::SecurityDomain::PUBLIC);
+  const std::string value(64, 'x');
+
+  for (size_t i = 0; i < transactions; ++i)
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put(i, value);
+    if (i >= live_keys)
+      view->remove(i - live_keys);
+
+    if (tx.commit() != kv::CommitSuccess::OK)
+      throw std::logic_error("commit failed");
+
+    if (i % compact_interval == 0)
+      kv_store.compact(kv_store.current_version());
+
+    if (i % (transactions / 10) == 0)
+      LOG_INFO_FMT("MAX RSS: {}Kb", get_maxrss());
+  }
+  LOG_INFO_FMT("MAX RSS: {}Kb", get_maxrss());
+
+  return get_maxrss() < max_expected_rss ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+  return put_remove_and_compact();
+}
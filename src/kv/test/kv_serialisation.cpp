@@ -5,6 +5,7 @@
 #include "kv/flatbufferwrapper.h"
 #include "kv/kv.h"
 #include "kv/kvserialiser.h"
+#include "kv/replayer.h"
 #include "node/encryptor.h"
 #include "stub_consensus.h"
 
@@ -362,6 +363,258 @@ TEST_CASE("Integrity" * doctest::test_suite("serialisation"))
   }
 }
 
+TEST_CASE("Parallel replay" * doctest::test_suite("serialisation"))
+{
+  auto consensus = std::make_shared<kv::StubConsensus>();
+  auto secrets = ccf::NetworkSecrets("");
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(1, secrets);
+
+  Store kv_store(consensus);
+  kv_store.set_encryptor(encryptor);
+  auto& public_map =
+    kv_store.create<size_t, std::string>("public", kv::SecurityDomain::PUBLIC);
+  auto& private_map = kv_store.create<size_t, std::string>("private");
+
+  constexpr size_t entry_count = 50;
+  std::vector<std::vector<uint8_t>> entries;
+  for (size_t i = 0; i < entry_count; ++i)
+  {
+    Store::Tx tx;
+    auto [public_view, private_view] = tx.get_view(public_map, private_map);
+    public_view->put(i, "public");
+    private_view->put(i, "private");
+    if (i > 0)
+      private_view->remove(i - 1);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    entries.push_back(consensus->get_latest_data().first);
+  }
+
+  auto make_target = [&]() {
+    auto target = std::make_unique<Store>();
+    target->set_encryptor(encryptor);
+    target->clone_schema(kv_store);
+    return target;
+  };
+
+  const std::vector<size_t> worker_counts = {0, 1, 4};
+
+  SUBCASE("Replayed store matches deserialised store")
+  {
+    auto serial_store = make_target();
+    for (auto& entry : entries)
+      REQUIRE(serial_store->deserialise(entry) == kv::DeserialiseSuccess::PASS);
+
+    for (auto workers : worker_counts)
+    {
+      INFO("Workers: " << workers);
+      auto target = make_target();
+      kv::Replayer<StoreSerialiser, StoreDeserialiser> replayer(
+        *target, workers);
+
+      size_t next = 0;
+      auto applied = replayer.replay(
+        entries, false, [&next](size_t i, kv::DeserialiseSuccess result) {
+          REQUIRE(i == next++);
+          REQUIRE(result == kv::DeserialiseSuccess::PASS);
+          return true;
+        });
+
+      REQUIRE(applied == entry_count);
+      REQUIRE(target->current_version() == entry_count);
+      REQUIRE(*target == *serial_store);
+    }
+  }
+
+  SUBCASE("Replay stops when the hook returns false")
+  {
+    constexpr size_t stop_at = 10;
+
+    for (auto workers : worker_counts)
+    {
+      INFO("Workers: " << workers);
+      auto target = make_target();
+      kv::Replayer<StoreSerialiser, StoreDeserialiser> replayer(
+        *target, workers);
+
+      auto applied = replayer.replay(
+        entries, false, [](size_t i, kv::DeserialiseSuccess result) {
+          return i + 1 < stop_at;
+        });
+
+      REQUIRE(applied == stop_at);
+      REQUIRE(target->current_version() == stop_at);
+
+      // Replay resumes from the next entry
+      std::vector<std::vector<uint8_t>> rest(
+        entries.begin() + stop_at, entries.end());
+      applied = replayer.replay(
+        rest, false, [](size_t i, kv::DeserialiseSuccess result) {
+          return result == kv::DeserialiseSuccess::PASS;
+        });
+
+      REQUIRE(applied == rest.size());
+      REQUIRE(target->current_version() == entry_count);
+    }
+  }
+
+  SUBCASE("Replay stops at a corrupted entry")
+  {
+    constexpr size_t corrupted_idx = 5;
+    auto corrupted = entries;
+    std::vector<uint8_t> value_to_corrupt = {'p', 'u', 'b', 'l', 'i', 'c'};
+    REQUIRE(
+      corrupt_serialised_tx(corrupted[corrupted_idx], value_to_corrupt));
+
+    for (auto workers : worker_counts)
+    {
+      INFO("Workers: " << workers);
+      auto target = make_target();
+      kv::Replayer<StoreSerialiser, StoreDeserialiser> replayer(
+        *target, workers);
+
+      auto applied = replayer.replay(
+        corrupted, false, [](size_t i, kv::DeserialiseSuccess result) {
+          return result != kv::DeserialiseSuccess::FAILED;
+        });
+
+      REQUIRE(applied == corrupted_idx + 1);
+      REQUIRE(target->current_version() == corrupted_idx);
+    }
+  }
+}
+
+TEST_CASE("Snapshot" * doctest::test_suite("serialisation"))
+{
+  auto consensus = std::make_shared<kv::StubConsensus>();
+  auto secrets = ccf::NetworkSecrets("");
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(1, secrets);
+
+  Store kv_store(consensus);
+  kv_store.set_encryptor(encryptor);
+  auto& public_map =
+    kv_store.create<size_t, std::string>("public", kv::SecurityDomain::PUBLIC);
+  auto& private_map = kv_store.create<size_t, std::string>("private");
+
+  constexpr size_t entry_count = 20;
+  constexpr kv::Version snapshot_version = 15;
+  std::vector<std::vector<uint8_t>> entries;
+  for (size_t i = 0; i < entry_count; ++i)
+  {
+    Store::Tx tx;
+    auto [public_view, private_view] = tx.get_view(public_map, private_map);
+    public_view->put(i, "public");
+    private_view->put(i, "private");
+    if (i > 0)
+      private_view->remove(i - 1);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    entries.push_back(consensus->get_latest_data().first);
+  }
+
+  // Entries written after the compacted version are not in the snapshot
+  kv_store.compact(snapshot_version);
+  auto snapshot = kv_store.snapshot();
+  REQUIRE(snapshot->get_version() == snapshot_version);
+
+  constexpr size_t max_chunk_entries = 4;
+  std::vector<std::vector<uint8_t>> chunks;
+  snapshot->serialise(
+    max_chunk_entries,
+    [&chunks](std::vector<uint8_t>&& chunk) { chunks.push_back(chunk); });
+
+  // 15 public entries and 1 private entry
+  REQUIRE(chunks.size() == 4);
+
+  auto make_target = [&]() {
+    auto target = std::make_unique<Store>();
+    target->set_encryptor(encryptor);
+    target->clone_schema(kv_store);
+    return target;
+  };
+
+  SUBCASE("Restored store matches the store at the snapshot version")
+  {
+    auto target = make_target();
+    auto target_public = target->get<size_t, std::string>("public");
+    auto target_private = target->get<size_t, std::string>("private");
+
+    size_t local_hook_entries = 0;
+    size_t global_hook_entries = 0;
+    target_public->set_local_hook(
+      [&](kv::Version v, const auto&, const auto& w) {
+        REQUIRE(v == snapshot_version);
+        local_hook_entries += w.size();
+      });
+    target_public->set_global_hook(
+      [&](kv::Version v, const auto&, const auto& w) {
+        REQUIRE(v == snapshot_version);
+        global_hook_entries += w.size();
+      });
+
+    for (auto& chunk : chunks)
+      REQUIRE(target->deserialise_snapshot(chunk) == snapshot_version);
+
+    REQUIRE(target->current_version() == snapshot_version);
+    REQUIRE(target->commit_version() == snapshot_version);
+    REQUIRE(local_hook_entries == snapshot_version);
+    REQUIRE(global_hook_entries == snapshot_version);
+
+    Store::Tx tx;
+    auto [public_view, private_view] =
+      tx.get_view(*target_public, *target_private);
+    for (size_t i = 0; i < entry_count; ++i)
+    {
+      INFO("Key: " << i);
+      REQUIRE(public_view->get(i).has_value() == (i < snapshot_version));
+      REQUIRE(
+        private_view->get(i).has_value() == (i + 1 == snapshot_version));
+    }
+  }
+
+  SUBCASE("Snapshot and ledger suffix match the full ledger")
+  {
+    auto full = make_target();
+    for (auto& entry : entries)
+      REQUIRE(full->deserialise(entry) == kv::DeserialiseSuccess::PASS);
+
+    auto target = make_target();
+    for (auto& chunk : chunks)
+      REQUIRE(target->deserialise_snapshot(chunk) == snapshot_version);
+
+    for (auto i = snapshot_version; i < entry_count; ++i)
+      REQUIRE(target->deserialise(entries[i]) == kv::DeserialiseSuccess::PASS);
+
+    REQUIRE(target->current_version() == entry_count);
+
+    Store::Tx tx1, tx2;
+    auto full_view = tx1.get_view(*full->get<size_t, std::string>("private"));
+    auto target_view =
+      tx2.get_view(*target->get<size_t, std::string>("private"));
+    for (size_t i = 0; i < entry_count; ++i)
+      REQUIRE(full_view->get(i) == target_view->get(i));
+  }
+
+  SUBCASE("Public only restore")
+  {
+    auto target = make_target();
+    for (auto& chunk : chunks)
+      REQUIRE(target->deserialise_snapshot(chunk, true) == snapshot_version);
+
+    Store::Tx tx;
+    auto [public_view, private_view] = tx.get_view(
+      *target->get<size_t, std::string>("public"),
+      *target->get<size_t, std::string>("private"));
+    REQUIRE(public_view->get(0).has_value());
+    REQUIRE(!private_view->get(snapshot_version - 1).has_value());
+  }
+
+  SUBCASE("Snapshot cannot be restored in a store at another version")
+  {
+    auto target = make_target();
+    REQUIRE(target->deserialise(entries[0]) == kv::DeserialiseSuccess::PASS);
+    REQUIRE(target->deserialise_snapshot(chunks[0]) == kv::NoVersion);
+  }
+}
+
 TEST_CASE("nlohmann (de)serialisation" * doctest::test_suite("serialisation"))
 {
   const auto k0 = "abc";
@@ -203,6 +203,294 @@ TEST_CASE("Rollback and compact")
   }
 }
 
+TEST_CASE("Views across compaction")
+{
+  Store kv_store;
+  auto& map = kv_store.create<std::string, std::string>(
+    "map", kv::SecurityDomain::PUBLIC);
+
+  constexpr auto k = "key";
+
+  auto write = [&](const std::string& value) {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put(k, value);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    return view->end_order();
+  };
+
+  write("value1");
+  auto v2 = write("value2");
+  write("value3");
+
+  Store::Tx tx_before;
+  auto view_before = tx_before.get_view(map);
+
+  INFO("Compaction moves the globally committed state forward");
+  {
+    kv_store.compact(v2);
+    auto v4 = write("value4");
+
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(view->get(k).value() == "value4");
+    REQUIRE(view->get_globally_committed(k).value() == "value2");
+
+    kv_store.compact(v4);
+    Store::Tx tx2;
+    auto view2 = tx2.get_view(map);
+    REQUIRE(view2->get(k).value() == "value4");
+    REQUIRE(view2->get_globally_committed(k).value() == "value4");
+  }
+
+  INFO("Views created before compaction keep reading their states");
+  {
+    REQUIRE(view_before->get(k).value() == "value3");
+    REQUIRE(!view_before->get_globally_committed(k).has_value());
+  }
+}
+
+TEST_CASE("Tombstones are purged on compaction")
+{
+  using State = Store::Map<std::string, std::string>::State;
+  using Write = Store::Map<std::string, std::string>::Write;
+  size_t entries = 0;
+
+  // The state passed to the hook includes the tombstones of removed keys
+  auto local_hook = [&](kv::Version v, const State& s, const Write& w) {
+    entries = s.size();
+  };
+
+  Store kv_store;
+  auto& map = kv_store.create<std::string, std::string>(
+    "map", kv::SecurityDomain::PUBLIC, local_hook);
+
+  auto commit = [&](const std::string& put, const std::string& remove) {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    if (!put.empty())
+      view->put(put, "value");
+    if (!remove.empty())
+      REQUIRE(view->remove(remove));
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    return tx.commit_version();
+  };
+
+  commit("a", "");
+  commit("b", "");
+  auto removed = commit("c", "a");
+  REQUIRE(entries == 3);
+
+  INFO("Tombstones are kept until the removal is compacted");
+  {
+    kv_store.compact(removed - 1);
+    commit("d", "");
+    REQUIRE(entries == 4);
+
+    kv_store.compact(removed);
+    commit("e", "");
+    REQUIRE(entries == 4);
+  }
+
+  INFO("Keys written again after their removal are kept");
+  {
+    commit("", "b");
+    commit("b", "");
+    auto v = commit("f", "");
+    kv_store.compact(v);
+    commit("g", "");
+    REQUIRE(entries == 6);
+
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(view->get("b").has_value());
+    REQUIRE_FALSE(view->get("a").has_value());
+  }
+
+  INFO("Removals that are rolled back are not purged");
+  {
+    auto v = commit("", "g");
+    commit("", "f");
+    kv_store.rollback(v);
+    REQUIRE(kv_store.current_version() == v);
+    commit("h", "");
+    REQUIRE(entries == 7);
+
+    kv_store.compact(kv_store.current_version());
+    commit("i", "");
+    REQUIRE(entries == 7);
+
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(view->get("f").has_value());
+    REQUIRE_FALSE(view->get("g").has_value());
+  }
+}
+
+TEST_CASE("Ordered map range queries")
+{
+  Store kv_store;
+  auto& map = kv_store.create<Store::OrderedMap<int, std::string>>(
+    "map", kv::SecurityDomain::PUBLIC);
+
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    for (int k = 0; k < 10; k += 2)
+      view->put(k, std::to_string(k));
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  auto collect_range = [](auto view, int from, int to, bool reverse) {
+    std::vector<int> keys;
+    auto f = [&keys](const int& k, const std::string& v) {
+      REQUIRE(v == std::to_string(k));
+      keys.push_back(k);
+      return true;
+    };
+    if (reverse)
+      view->reverse_range(from, to, f);
+    else
+      view->range(from, to, f);
+    return keys;
+  };
+
+  INFO("Ranges are visited in key order");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(collect_range(view, 2, 8, false) == std::vector<int>{2, 4, 6});
+    REQUIRE(collect_range(view, 1, 9, true) == std::vector<int>{8, 6, 4, 2});
+    REQUIRE(collect_range(view, 3, 4, false).empty());
+  }
+
+  INFO("Own writes and removals are merged in key order");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put(5, "5");
+    view->put(1, "1");
+    REQUIRE(view->remove(4));
+    REQUIRE(
+      collect_range(view, 0, 10, false) == std::vector<int>{0, 1, 2, 5, 6, 8});
+    REQUIRE(
+      collect_range(view, 0, 10, true) == std::vector<int>{8, 6, 5, 2, 1, 0});
+  }
+
+  INFO("Iteration stops early");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    std::vector<int> top;
+    REQUIRE_FALSE(view->reverse_foreach([&top](const int& k, const auto&) {
+      top.push_back(k);
+      return top.size() < 2;
+    }));
+    REQUIRE(top == std::vector<int>{8, 6});
+  }
+
+  INFO("Lower bound");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    auto lb = view->lower_bound(3);
+    REQUIRE(lb.has_value());
+    REQUIRE(lb->first == 4);
+    REQUIRE(view->lower_bound(4)->first == 4);
+    REQUIRE_FALSE(view->lower_bound(9).has_value());
+  }
+}
+
+TEST_CASE("Ordered map range conflicts")
+{
+  Store kv_store;
+  auto& map = kv_store.create<Store::OrderedMap<int, int>>(
+    "map", kv::SecurityDomain::PUBLIC);
+
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    for (int k = 0; k < 10; k += 2)
+      view->put(k, k);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  // Transactions read a range, and write their result outside of it
+
+  auto sum_range = [](auto view, int from, int to) {
+    int sum = 0;
+    view->range(from, to, [&sum](const int& k, const int& v) {
+      sum += v;
+      return true;
+    });
+    return sum;
+  };
+
+  auto write = [&](int k) {
+    Store::Tx tx;
+    tx.get_view(map)->put(k, k);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  };
+
+  auto remove = [&](int k) {
+    Store::Tx tx;
+    REQUIRE(tx.get_view(map)->remove(k));
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  };
+
+  INFO("Writes outside the range do not conflict");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put(100, sum_range(view, 2, 6));
+    write(6);
+    write(1);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  INFO("Writes inside the range conflict");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put(100, sum_range(view, 2, 6));
+    write(3);
+    REQUIRE(tx.commit() == kv::CommitSuccess::CONFLICT);
+  }
+
+  INFO("Removals inside the range conflict");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put(100, sum_range(view, 2, 6));
+    remove(4);
+    REQUIRE(tx.commit() == kv::CommitSuccess::CONFLICT);
+  }
+
+  INFO("Only keys up to the last one visited are read");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    auto lb = view->lower_bound(5);
+    REQUIRE(lb.has_value());
+    REQUIRE(lb->first == 6);
+    view->put(100, lb->second);
+    write(7);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  INFO("Keys between the bound and the entry found are read");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    auto lb = view->lower_bound(7);
+    REQUIRE(lb.has_value());
+    REQUIRE(lb->first == 7);
+    view->put(100, lb->second);
+    remove(7);
+    REQUIRE(tx.commit() == kv::CommitSuccess::CONFLICT);
+  }
+}
+
 TEST_CASE("Clear entire store")
 {
   Store kv_store;
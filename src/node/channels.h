@@ -4,6 +4,7 @@
 
 #include "crypto/symmkey.h"
 #include "ds/logger.h"
+#include "ds/spinlock.h"
 #include "entities.h"
 #include "tls/keyexchange.h"
 #include "tls/keypair.h"
@@ -11,6 +12,7 @@
 #include <iostream>
 #include <map>
 #include <mbedtls/ecdh.h>
+#include <mutex>
 
 namespace ccf
 {
@@ -23,9 +25,13 @@ namespace ccf
     ESTABLISHED
   };
 
+  // Channels are used by the thread running consensus, and by worker threads
+  // forwarding commands, so all their operations are serialised
   class Channel
   {
   private:
+    SpinLock lock;
+
     // Used for key exchange
     tls::KeyExchangeContext ctx;
     ChannelStatus status;
@@ -39,6 +45,7 @@ namespace ccf
 
     std::optional<std::vector<uint8_t>> get_public()
     {
+      std::lock_guard<SpinLock> guard(lock);
       if (status == ESTABLISHED)
         return {};
 
@@ -47,16 +54,19 @@ namespace ccf
 
     void set_status(ChannelStatus status_)
     {
+      std::lock_guard<SpinLock> guard(lock);
       status = status_;
     }
 
     ChannelStatus get_status()
     {
+      std::lock_guard<SpinLock> guard(lock);
       return status;
     }
 
     bool load_peer_public(const uint8_t* bytes, size_t size)
     {
+      std::lock_guard<SpinLock> guard(lock);
       if (status == ESTABLISHED)
         return false;
 
@@ -66,6 +76,7 @@ namespace ccf
 
     void establish()
     {
+      std::lock_guard<SpinLock> guard(lock);
       auto shared_secret = ctx.compute_shared_secret();
       key = std::make_unique<crypto::KeyAesGcm>(shared_secret);
       ctx.free_ctx();
@@ -74,6 +85,7 @@ namespace ccf
 
     void free_ctx()
     {
+      std::lock_guard<SpinLock> guard(lock);
       if (status != ESTABLISHED)
         return;
 
@@ -82,6 +94,7 @@ namespace ccf
 
     void tag(GcmHdr& header, CBuffer aad)
     {
+      std::lock_guard<SpinLock> guard(lock);
       if (status != ESTABLISHED)
         throw std::logic_error("Channel is not established for tagging");
 
@@ -91,6 +104,7 @@ namespace ccf
 
     bool verify(const GcmHdr& header, CBuffer aad)
     {
+      std::lock_guard<SpinLock> guard(lock);
       if (status != ESTABLISHED)
         throw std::logic_error("Channel is not established for verifying");
 
@@ -99,6 +113,7 @@ namespace ccf
 
     void encrypt(GcmHdr& header, CBuffer aad, CBuffer plain, Buffer cipher)
     {
+      std::lock_guard<SpinLock> guard(lock);
       if (status != ESTABLISHED)
         throw std::logic_error("Channel is not established for encrypting");
 
@@ -109,6 +124,7 @@ namespace ccf
     bool decrypt(
       const GcmHdr& header, CBuffer aad, CBuffer cipher, Buffer plain)
     {
+      std::lock_guard<SpinLock> guard(lock);
       if (status != ESTABLISHED)
         throw std::logic_error("Channel is not established for decrypting");
 
@@ -119,7 +135,13 @@ namespace ccf
   class ChannelManager
   {
   private:
+    // Channels are never removed, so references to them remain valid once
+    // the lock is released
+    SpinLock lock;
     std::unordered_map<NodeId, std::unique_ptr<Channel>> channels;
+
+    // Serialises use of the network key pair, and the loading of peer keys
+    SpinLock key_exchange_lock;
     tls::KeyPairPtr network_kp;
 
   public:
@@ -129,6 +151,7 @@ namespace ccf
 
     Channel& get(NodeId peer_id)
     {
+      std::lock_guard<SpinLock> guard(lock);
       auto search = channels.find(peer_id);
       if (search != channels.end())
       {
@@ -142,6 +165,7 @@ namespace ccf
 
     std::optional<std::vector<uint8_t>> get_signed_public(NodeId peer_id)
     {
+      std::lock_guard<SpinLock> guard(key_exchange_lock);
       const auto own_public_for_peer_ = get(peer_id).get_public();
       if (!own_public_for_peer_.has_value())
         return {};
@@ -168,6 +192,7 @@ namespace ccf
     bool load_peer_signed_public(
       NodeId peer_id, const std::vector<uint8_t>& peer_signed_public)
     {
+      std::lock_guard<SpinLock> guard(key_exchange_lock);
       auto& channel = get(peer_id);
 
       // Verify signature
@@ -8,6 +8,7 @@
 #include "node/networksecrets.h"
 
 #include <atomic>
+#include <mbedtls/platform_util.h>
 
 namespace ccf
 {
@@ -44,23 +45,78 @@ namespace ccf
     {
       return crypto::GcmHeader<crypto::GCM_SIZE_IV>::RAW_DATA_SIZE;
     }
+
+    void encrypt_batch(const BatchEntry* entries, size_t n) override
+    {
+      for (size_t i = 0; i < n; ++i)
+      {
+        memset(entries[i].header, 0, get_header_length());
+        memcpy(entries[i].output, entries[i].input.p, entries[i].input.n);
+      }
+    }
+
+    bool decrypt_batch(const BatchEntry* entries, size_t n) override
+    {
+      for (size_t i = 0; i < n; ++i)
+        memcpy(entries[i].output, entries[i].input.p, entries[i].input.n);
+      return true;
+    }
+
+    std::shared_ptr<kv::AbstractTxEncryptor> clone() override
+    {
+      return std::make_shared<NullTxEncryptor>();
+    }
   };
 
   class TxEncryptor : public kv::AbstractTxEncryptor
   {
   private:
+    // AES-GCM contexts cannot be used concurrently, so the raw keys are kept
+    // for clones to create their own. A single copy is shared by an encryptor
+    // and all its clones, and is wiped once none of them uses it.
+    struct RawKeys
+    {
+      std::vector<std::pair<kv::Version, std::vector<uint8_t>>> keys;
+
+      ~RawKeys()
+      {
+        for (auto& [v, key] : keys)
+          mbedtls_platform_zeroize(key.data(), key.size());
+      }
+    };
+
     NodeId id;
-    std::atomic<SeqNo> seqNo{0};
+    // Shared with clones, so that IVs are never reused across them
+    std::shared_ptr<std::atomic<SeqNo>> seqNo;
 
     // Encryption keys are set when TxEncryptor object is created and are used
     // to determine which key to use for encryption/decryption when
     // committing/deserialising depending on the version
     std::vector<std::pair<kv::Version, crypto::KeyAesGcm>> encryption_keys;
 
+    std::shared_ptr<const RawKeys> raw_keys;
+
+    // Reused across batches
+    std::vector<crypto::GcmBatchEntry> batch;
+
+    TxEncryptor(
+      NodeId id_,
+      std::shared_ptr<std::atomic<SeqNo>> seqNo_,
+      std::shared_ptr<const RawKeys> raw_keys_) :
+      id(id_),
+      seqNo(seqNo_),
+      raw_keys(raw_keys_)
+    {
+      for (auto const& [v, raw_key] : raw_keys->keys)
+      {
+        encryption_keys.emplace_back(v, raw_key);
+      }
+    }
+
     void set_iv(crypto::GcmHeader<crypto::GCM_SIZE_IV>& gcm_hdr)
     {
       gcm_hdr.setIvId(id);
-      gcm_hdr.setIvSeq(seqNo.fetch_add(1));
+      gcm_hdr.setIvSeq(seqNo->fetch_add(1));
     }
 
     const crypto::KeyAesGcm& get_encryption_key(kv::Version version)
@@ -85,15 +141,67 @@ namespace ccf
       return search->second;
     }
 
+    bool crypt_batch(const BatchEntry* entries, size_t n, bool encrypt)
+    {
+      // IVs of a batch are reserved at once
+      const SeqNo first_seqno = encrypt ? seqNo->fetch_add(n) : 0;
+
+      batch.resize(n);
+      for (size_t i = 0; i < n; ++i)
+      {
+        const auto& e = entries[i];
+        uint8_t* tag = e.header;
+        uint8_t* iv = e.header + crypto::GCM_SIZE_TAG;
+
+        if (encrypt)
+        {
+          crypto::GcmHeader<crypto::GCM_SIZE_IV> gcm_hdr;
+          gcm_hdr.setIvId(id);
+          gcm_hdr.setIvSeq(first_seqno + i);
+          memcpy(iv, gcm_hdr.iv, sizeof(gcm_hdr.iv));
+        }
+
+        batch[i] = {{iv, crypto::GCM_SIZE_IV},
+                    e.additional_data,
+                    e.input,
+                    e.output,
+                    tag};
+      }
+
+      // Consecutive entries with the same key are given to it together
+      bool ok = true;
+      size_t begin = 0;
+      while (begin < n)
+      {
+        const auto& key = get_encryption_key(entries[begin].version);
+        size_t end = begin + 1;
+        while (end < n && &get_encryption_key(entries[end].version) == &key)
+          end++;
+
+        if (encrypt)
+          key.encrypt_batch(batch.data() + begin, end - begin);
+        else
+          ok &= key.decrypt_batch(batch.data() + begin, end - begin);
+
+        begin = end;
+      }
+
+      return ok;
+    }
+
   public:
-    TxEncryptor(NodeId id_, NetworkSecrets& ns) : id(id_)
+    TxEncryptor(NodeId id_, NetworkSecrets& ns) :
+      id(id_),
+      seqNo(std::make_shared<std::atomic<SeqNo>>(0))
     {
       // Create map of existing encryption keys
+      auto keys = std::make_shared<RawKeys>();
       for (auto const& ns_ : ns.get_secrets())
       {
-        encryption_keys.emplace_back(
-          std::make_pair(ns_.first, ns_.second->master));
+        encryption_keys.emplace_back(ns_.first, ns_.second->master);
+        keys->keys.emplace_back(ns_.first, ns_.second->master);
       }
+      raw_keys = keys;
     }
 
     /**
@@ -168,5 +276,43 @@ namespace ccf
     {
       return crypto::GcmHeader<crypto::GCM_SIZE_IV>::RAW_DATA_SIZE;
     }
+
+    /**
+     * Encrypt a batch of entries into buffers provided by the caller, with
+     * consecutive IVs.
+     *
+     * @param[in]   entries           Entries to encrypt, each with the version
+     * used to retrieve its encryption key
+     * @param[in]   n                 Number of entries
+     */
+    void encrypt_batch(const BatchEntry* entries, size_t n) override
+    {
+      crypt_batch(entries, n, true);
+    }
+
+    /**
+     * Decrypt a batch of entries into buffers provided by the caller.
+     *
+     * @param[in]   entries           Entries to decrypt, each with the version
+     * used to retrieve its encryption key
+     * @param[in]   n                 Number of entries
+     *
+     * @return Boolean status indicating success of decryption of all entries.
+     */
+    bool decrypt_batch(const BatchEntry* entries, size_t n) override
+    {
+      return crypt_batch(entries, n, false);
+    }
+
+    /**
+     * Create an encryptor with its own AES-GCM contexts for the same keys,
+     * sharing the IV sequence number with this one.
+     *
+     * @return Encryptor that can be used concurrently with this one
+     */
+    std::shared_ptr<kv::AbstractTxEncryptor> clone() override
+    {
+      return std::shared_ptr<TxEncryptor>(new TxEncryptor(id, seqNo, raw_keys));
+    }
   };
 }
\ No newline at end of file
@@ -60,6 +60,7 @@ namespace ccf
     static constexpr auto CODE_IDS = "ccf.code_ids";
     static constexpr auto VOTING_HISTORY = "ccf.voting_history";
     static constexpr auto SERVICE = "ccf.service";
+    static constexpr auto SNAPSHOT_EVIDENCE = "ccf.snapshot_evidence";
   };
 
   using StoreSerialiser = kv::KvStoreSerialiser;
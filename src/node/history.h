@@ -5,6 +5,8 @@
 #include "../consensus/pbft/pbfttypes.h"
 #include "../crypto/hash.h"
 #include "../ds/logger.h"
+#include "../ds/lrucache.h"
+#include "../ds/spinlock.h"
 #include "../kv/kvtypes.h"
 #include "../tls/keypair.h"
 #include "../tls/tls.h"
@@ -12,8 +14,10 @@
 #include "nodes.h"
 #include "signatures.h"
 
+#include <algorithm>
 #include <array>
 #include <deque>
+#include <optional>
 #include <string.h>
 
 extern "C"
@@ -68,6 +72,16 @@ namespace ccf
 
   constexpr size_t MAX_HISTORY_LEN = 1000;
 
+  // Requests, and their results and responses, are kept until the version at
+  // which they were executed is compacted, within these bounds
+  constexpr size_t MAX_CACHED_REQUESTS = 10000;
+  constexpr size_t MAX_CACHED_REQUEST_BYTES = 64 * 1024 * 1024;
+
+  // Entries flushed from the Merkle tree for which receipts can still be
+  // produced, and receipts kept until the tree changes
+  constexpr size_t MAX_FLUSHED_HISTORY_LEN = 1 << 18;
+  constexpr size_t MAX_CACHED_RECEIPTS = 1000;
+
   static std::ostream& operator<<(std::ostream& os, HashOp flag)
   {
     switch (flag)
@@ -97,6 +111,14 @@ namespace ccf
     LOG_DEBUG_FMT("History [{}] {}", flag, h);
   }
 
+  // The root of the tree is only computed if it is going to be logged
+  template <class T>
+  static void log_root(const T& tree, HashOp flag)
+  {
+    if (logger::config::ok(logger::DBG))
+      log_hash(tree.get_root(), flag);
+  }
+
   class NullTxHistory : public kv::TxHistory
   {
     Store& store;
@@ -176,6 +198,7 @@ namespace ccf
       size_t all_data_size) override
     {}
     void add_result(RequestID id, kv::Version version) override {}
+    void append_pending() override {}
     void add_response(
       kv::TxHistory::RequestID id,
       const std::vector<uint8_t>& response) override
@@ -199,11 +222,27 @@ namespace ccf
       return crypto::Sha256Hash();
     }
 
+    size_t get_roots_computed() override
+    {
+      return 0;
+    }
+
+    RequestCacheStats get_request_cache_stats() override
+    {
+      return {};
+    }
+
     std::vector<uint8_t> get_receipt(kv::Version v) override
     {
       return {};
     }
 
+    std::vector<std::vector<uint8_t>> get_receipts(
+      kv::Version from, kv::Version to) override
+    {
+      return {};
+    }
+
     bool verify_receipt(const std::vector<uint8_t>& v) override
     {
       return true;
@@ -284,20 +323,109 @@ namespace ccf
   class MerkleTreeHistory
   {
     merkle_tree* tree;
+    // Computed on demand, and reset whenever an entry is appended or retracted
+    mutable std::optional<crypto::Sha256Hash> root;
+    mutable size_t roots_computed = 0;
+
+    // Hashes flushed from each level of the tree, from which receipts for
+    // flushed entries are produced. Level lv holds the nodes from
+    // offset_of(flushed_begin >> lv) up to the first node kept in the tree.
+    std::vector<std::deque<crypto::Sha256Hash>> flushed_levels;
+    uint32_t flushed_begin = 0;
+
+    // Serialised receipts, valid for the current root
+    LRUCache<uint64_t, std::vector<uint8_t>> receipts;
+
+    static merkle_tree* deserialise_tree(const std::vector<uint8_t>& serialised)
+    {
+      auto t = mt_deserialize(serialised.data(), serialised.size());
+      if (t == nullptr)
+        throw std::logic_error("Could not deserialise Merkle tree");
+
+      // mt_deserialize leaves empty levels without capacity, which mt_insert
+      // cannot grow, so they are given room for one hash
+      for (uint32_t lv = 0; lv < t->hs.sz; ++lv)
+      {
+        auto& level = t->hs.vs[lv];
+        if (level.cap == 0)
+        {
+          level.vs = static_cast<uint8_t**>(malloc(sizeof(uint8_t*)));
+          level.cap = 1;
+        }
+      }
+      return t;
+    }
+
+    void changed()
+    {
+      root.reset();
+      receipts.clear();
+    }
+
+    void reset_flushed()
+    {
+      flushed_levels.clear();
+      flushed_begin = tree->i;
+    }
+
+    // Keeps the hashes that flushing the tree to i discards, and forgets the
+    // oldest ones beyond MAX_FLUSHED_HISTORY_LEN
+    void keep_flushed(uint32_t i)
+    {
+      flushed_levels.resize(tree->hs.sz);
+      for (uint32_t lv = 0; lv < tree->hs.sz; ++lv)
+      {
+        const auto& level = tree->hs.vs[lv];
+        const uint32_t n =
+          std::min(offset_of(i >> lv) - offset_of(tree->i >> lv), level.sz);
+        for (uint32_t k = 0; k < n; ++k)
+        {
+          auto& h = flushed_levels[lv].emplace_back();
+          std::copy(level.vs[k], level.vs[k] + h.SIZE, h.h);
+        }
+      }
+
+      if (i - flushed_begin > MAX_FLUSHED_HISTORY_LEN)
+      {
+        const uint32_t begin = i - MAX_FLUSHED_HISTORY_LEN;
+        for (uint32_t lv = 0; lv < flushed_levels.size(); ++lv)
+        {
+          auto& level = flushed_levels[lv];
+          const size_t n = std::min<size_t>(
+            offset_of(begin >> lv) - offset_of(flushed_begin >> lv),
+            level.size());
+          level.erase(level.begin(), level.begin() + n);
+        }
+        flushed_begin = begin;
+      }
+    }
+
+    // Node n of level lv, either still in the tree or flushed from it
+    const uint8_t* get_node(uint32_t lv, uint32_t n) const
+    {
+      const uint32_t first = offset_of(tree->i >> lv);
+      if (n >= first)
+        return tree->hs.vs[lv].vs[n - first];
+      return flushed_levels[lv][n - offset_of(flushed_begin >> lv)].h;
+    }
 
   public:
     MerkleTreeHistory(MerkleTreeHistory const&) = delete;
 
-    MerkleTreeHistory(const std::vector<uint8_t>& serialised)
+    MerkleTreeHistory(const std::vector<uint8_t>& serialised) :
+      receipts(MAX_CACHED_RECEIPTS, MAX_CACHED_RECEIPTS * 1024)
     {
-      tree = mt_deserialize(serialised.data(), serialised.size());
+      tree = deserialise_tree(serialised);
+      reset_flushed();
     }
 
-    MerkleTreeHistory()
+    MerkleTreeHistory() :
+      receipts(MAX_CACHED_RECEIPTS, MAX_CACHED_RECEIPTS * 1024)
     {
       ::hash ih(init_hash());
       tree = mt_create(ih);
       free_hash(ih);
+      reset_flushed();
     }
 
     ~MerkleTreeHistory()
@@ -311,29 +439,47 @@ namespace ccf
       if (!mt_insert_pre(tree, h))
         throw std::logic_error("Precondition to mt_insert violated");
       mt_insert(tree, h);
+      changed();
     }
 
     crypto::Sha256Hash get_root() const
     {
-      crypto::Sha256Hash res;
-      if (!mt_get_root_pre(tree, res.h))
-        throw std::logic_error("Precondition to mt_get_root violated");
-      mt_get_root(tree, res.h);
-      return res;
+      if (!root.has_value())
+      {
+        crypto::Sha256Hash res;
+        if (!mt_get_root_pre(tree, res.h))
+          throw std::logic_error("Precondition to mt_get_root violated");
+        mt_get_root(tree, res.h);
+        root = res;
+        roots_computed++;
+      }
+      return root.value();
+    }
+
+    // Number of times the root has been computed, rather than read from cache
+    size_t get_roots_computed() const
+    {
+      return roots_computed;
     }
 
     void operator=(const MerkleTreeHistory& rhs)
     {
       mt_free(tree);
-      crypto::Sha256Hash root(rhs.get_root());
-      tree = mt_create(root.h);
+      crypto::Sha256Hash rhs_root(rhs.get_root());
+      tree = mt_create(rhs_root.h);
+      changed();
+      reset_flushed();
     }
 
     void flush(uint64_t index)
     {
+      // A tree restored from a frontier may already be flushed past index
+      if (index <= begin_index())
+        return;
       if (!mt_flush_to_pre(tree, index))
         throw std::logic_error("Precondition to mt_flush_to violated");
       LOG_TRACE_FMT("mt_flush_to index={}", index);
+      keep_flushed(index - tree->offset);
       mt_flush_to(tree, index);
     }
 
@@ -342,6 +488,7 @@ namespace ccf
       if (!mt_retract_to_pre(tree, index))
         throw std::logic_error("Precondition to mt_retract_to violated");
       mt_retract_to(tree, index);
+      changed();
     }
 
     Receipt get_receipt(uint64_t index)
@@ -349,6 +496,91 @@ namespace ccf
       return Receipt(tree, index);
     }
 
+    // Produces the receipts of the entries from from to to, inclusive,
+    // serialised as by Receipt::to_v. The path of an entry is made of the
+    // siblings of its nodes at each level, and consecutive entries share the
+    // siblings of their common ancestors, which are looked up once. Entries
+    // flushed from the tree are served from the flushed levels.
+    std::vector<std::vector<uint8_t>> get_receipts(uint64_t from, uint64_t to)
+    {
+      if (from > to || from < tree->offset + flushed_begin || to > end_index())
+        throw std::logic_error(fmt::format(
+          "Cannot produce receipts for [{}, {}]: tree holds [{}, {}]",
+          from,
+          to,
+          tree->offset + flushed_begin,
+          end_index()));
+
+      // Also computes the right hand side hashes of the tree
+      const auto r = get_root();
+      const uint32_t j = tree->j;
+
+      // Whether the right hand side hash of each level is part of the paths
+      // reaching it, as in mt_get_path
+      std::array<bool, 32> rhs_on_path = {};
+      uint32_t levels = 0;
+      for (bool actd = false; (j >> levels) != 0; ++levels)
+      {
+        rhs_on_path[levels] = actd;
+        actd = actd || ((j >> levels) % 2 == 1);
+      }
+
+      std::array<const uint8_t*, 32> siblings = {};
+      auto get_sibling = [&](uint32_t lv, uint32_t k) -> const uint8_t* {
+        if (k % 2 == 1)
+          return get_node(lv, k - 1);
+        if (k == (j >> lv))
+          return nullptr;
+        if (k + 1 == (j >> lv))
+          return rhs_on_path[lv] ? tree->rhs.vs[lv] : nullptr;
+        return get_node(lv, k + 1);
+      };
+
+      std::vector<std::vector<uint8_t>> out;
+      out.reserve(to - from + 1);
+      for (uint64_t index = from; index <= to; ++index)
+      {
+        const uint32_t k = index - tree->offset;
+
+        // Only the levels at which this entry and the previous one have
+        // different ancestors need new siblings
+        for (uint32_t lv = 0; lv < levels; ++lv)
+        {
+          if (index != from && (k >> lv) == ((k - 1) >> lv))
+            break;
+          siblings[lv] = get_sibling(lv, k >> lv);
+        }
+
+        auto cached = receipts.find(index);
+        if (cached != nullptr)
+        {
+          out.push_back(*cached);
+          continue;
+        }
+
+        size_t path_size = 1;
+        for (uint32_t lv = 0; lv < levels; ++lv)
+          path_size += siblings[lv] != nullptr;
+
+        size_t vs = sizeof(index) + sizeof(j) + r.SIZE + r.SIZE * path_size;
+        std::vector<uint8_t> v(vs);
+        uint8_t* buf = v.data();
+        serialized::write(buf, vs, index);
+        serialized::write(buf, vs, j);
+        serialized::write(buf, vs, r.h, r.SIZE);
+        serialized::write(buf, vs, get_node(0, k), r.SIZE);
+        for (uint32_t lv = 0; lv < levels; ++lv)
+        {
+          if (siblings[lv] != nullptr)
+            serialized::write(buf, vs, siblings[lv], r.SIZE);
+        }
+
+        receipts.insert(index, std::vector<uint8_t>(v), v.size());
+        out.push_back(std::move(v));
+      }
+      return out;
+    }
+
     bool verify(const Receipt& r)
     {
       return r.verify(tree);
@@ -361,6 +593,95 @@ namespace ccf
       mt_serialize(tree, output.data(), output.capacity());
       return output;
     }
+
+    // Serialises the tree as it was at index, leaving this tree unchanged
+    std::vector<uint8_t> serialise(uint64_t index)
+    {
+      MerkleTreeHistory copy(serialise());
+      copy.retract(index);
+      return copy.serialise();
+    }
+
+    uint64_t begin_index() const
+    {
+      return tree->offset + tree->i;
+    }
+
+    uint64_t end_index() const
+    {
+      return tree->offset + tree->j - 1;
+    }
+
+    // Serialises the frontier of the tree as it was at index: the hashes
+    // needed to compute its root and to append to it, at most two per level.
+    // Its size does not depend on the number of entries. It deserialises as a
+    // tree flushed to index, from which receipts for earlier entries cannot
+    // be produced.
+    std::vector<uint8_t> serialise_frontier(uint64_t index)
+    {
+      if (index < begin_index() || index > end_index())
+        throw std::logic_error(fmt::format(
+          "Cannot serialise frontier at {}: tree holds [{}, {}]",
+          index,
+          begin_index(),
+          end_index()));
+
+      // Same layout as mt_serialize, with big-endian integers
+      std::vector<uint8_t> output;
+      auto write_uint = [&output](uint64_t x, size_t bytes) {
+        for (size_t b = bytes; b > 0; --b)
+          output.push_back(static_cast<uint8_t>(x >> ((b - 1) * 8)));
+      };
+      auto write_hash = [&output](const uint8_t* h) {
+        output.insert(output.end(), h, h + crypto::Sha256Hash::SIZE);
+      };
+      const uint8_t zero[crypto::Sha256Hash::SIZE] = {};
+
+      const uint32_t i = index - tree->offset;
+      const uint32_t j = i + 1;
+      write_uint(0, 1);
+      write_uint(crypto::Sha256Hash::SIZE, 4);
+      write_uint(tree->offset, 8);
+      write_uint(i, 4);
+      write_uint(j, 4);
+
+      // Each level of the tree holds the hashes of its nodes from
+      // offset_of(i >> lv) onwards, of which only the ones up to the node
+      // covering index are kept
+      write_uint(tree->hs.sz, 4);
+      for (uint32_t lv = 0; lv < tree->hs.sz; ++lv)
+      {
+        const auto& level = tree->hs.vs[lv];
+        const uint32_t first = offset_of(tree->i >> lv);
+        const uint32_t begin = std::min(offset_of(i >> lv) - first, level.sz);
+        const uint32_t end = std::min((j >> lv) - first, level.sz);
+        write_uint(end - begin, 4);
+        for (uint32_t n = begin; n < end; ++n)
+          write_hash(level.vs[n]);
+      }
+
+      // The right hand side hashes and the root are recomputed on demand
+      write_uint(false, 1);
+      write_uint(tree->rhs.sz, 4);
+      for (uint32_t n = 0; n < tree->rhs.sz; ++n)
+        write_hash(zero);
+      write_hash(zero);
+      return output;
+    }
+
+    std::vector<uint8_t> serialise_frontier()
+    {
+      return serialise_frontier(end_index());
+    }
+
+    void deserialise(const std::vector<uint8_t>& serialised)
+    {
+      auto t = deserialise_tree(serialised);
+      mt_free(tree);
+      tree = t;
+      changed();
+      reset_flushed();
+    }
   };
 
   template <class T>
@@ -377,12 +698,102 @@ namespace ccf
 
     std::shared_ptr<kv::Consensus> consensus;
 
-    std::map<RequestID, std::vector<uint8_t>> requests;
-    std::map<RequestID, std::pair<kv::Version, crypto::Sha256Hash>> results;
-    std::map<RequestID, std::vector<uint8_t>> responses;
+    using Result = std::pair<kv::Version, crypto::Sha256Hash>;
+    LRUCache<RequestID, std::vector<uint8_t>> requests;
+    LRUCache<RequestID, Result> results;
+    LRUCache<RequestID, std::vector<uint8_t>> responses;
+    // Cached requests, in the order in which they were executed
+    std::deque<std::pair<kv::Version, RequestID>> request_versions;
     std::optional<ResultCallbackHandler> on_result;
     std::optional<ResponseCallbackHandler> on_response;
 
+    // Entries of results added since the last call to append_pending(), which
+    // are hashed together before being appended to the trees
+    struct PendingEntry
+    {
+      CBuffer replicated;
+      CBuffer all_data;
+    };
+    std::vector<PendingEntry> pending;
+    std::vector<CBuffer> pending_buffers;
+    std::vector<crypto::Sha256Hash> pending_hashes;
+
+    // Protects the trees, the pending entries and the caches. Results are
+    // added by the thread committing to the store, while worker threads add
+    // requests and produce receipts, and the enclave thread compacts and rolls
+    // back. Methods suffixed with _unsafe expect it to be held. The store
+    // calls the history with its version lock held, so that lock is never
+    // taken while this one is held.
+    SpinLock lock;
+
+    void append_pending_unsafe()
+    {
+      if (pending.empty())
+        return;
+
+      auto with_replicated = is_replicated_tree_enabled();
+      pending_buffers.clear();
+      for (auto& entry : pending)
+      {
+        pending_buffers.push_back(entry.all_data);
+        if (with_replicated)
+          pending_buffers.push_back(entry.replicated);
+      }
+      pending.clear();
+
+      pending_hashes.resize(pending_buffers.size());
+      crypto::Sha256Hash::evercrypt_sha256_batch(
+        pending_buffers.data(), pending_buffers.size(), pending_hashes.data());
+
+      for (size_t i = 0; i < pending_hashes.size(); ++i)
+      {
+        log_hash(pending_hashes[i], APPEND);
+        full_state_tree.append(pending_hashes[i]);
+
+        if (with_replicated)
+        {
+          ++i;
+          log_hash(pending_hashes[i], APPEND);
+          replicated_state_tree.append(pending_hashes[i]);
+        }
+      }
+    }
+
+    crypto::Sha256Hash get_full_state_root_unsafe()
+    {
+      append_pending_unsafe();
+      return full_state_tree.get_root();
+    }
+
+    void add_result_unsafe(RequestID id, kv::Version version)
+    {
+#ifdef PBFT
+      auto root = get_full_state_root_unsafe();
+      LOG_DEBUG << fmt::format(
+                     "HISTORY: add_result {0} {1} {2}", id, version, root)
+                << std::endl;
+      results.insert(id, {version, root}, sizeof(Result));
+      if (on_result.has_value())
+        on_result.value()({id, version, root});
+#else
+      LOG_DEBUG << fmt::format("HISTORY: add_result {0} {1}", id, version)
+                << std::endl;
+#endif
+      track_request_unsafe(id, version);
+    }
+
+    // Remembers the version at which a cached request was executed, so that
+    // it is dropped from the caches once that version is compacted
+    void track_request_unsafe(const RequestID& id, kv::Version version)
+    {
+      if (!requests.contains(id) && !results.contains(id))
+        return;
+
+      request_versions.emplace_back(version, id);
+      if (request_versions.size() > MAX_CACHED_REQUESTS)
+        request_versions.pop_front();
+    }
+
   public:
     HashedTxHistory(
       Store& store_,
@@ -394,7 +805,10 @@ namespace ccf
       id(id_),
       kp(kp_),
       signatures(sig_),
-      nodes(nodes_)
+      nodes(nodes_),
+      requests(MAX_CACHED_REQUESTS, MAX_CACHED_REQUEST_BYTES),
+      results(MAX_CACHED_REQUESTS, MAX_CACHED_REQUESTS * sizeof(Result)),
+      responses(MAX_CACHED_REQUESTS, MAX_CACHED_REQUEST_BYTES)
     {}
 
     bool is_replicated_tree_enabled()
@@ -409,6 +823,7 @@ namespace ccf
 
     void register_on_result(ResultCallbackHandler func) override
     {
+      std::lock_guard<SpinLock> guard(lock);
       if (on_result.has_value())
         throw std::logic_error("on_result has already been set");
       on_result = func;
@@ -416,6 +831,7 @@ namespace ccf
 
     void register_on_response(ResponseCallbackHandler func) override
     {
+      std::lock_guard<SpinLock> guard(lock);
       if (on_response.has_value())
         throw std::logic_error("on_response has already been set");
       on_response = func;
@@ -423,29 +839,60 @@ namespace ccf
 
     void clear_on_result() override
     {
+      std::lock_guard<SpinLock> guard(lock);
       on_result.reset();
     }
 
     void clear_on_response() override
     {
+      std::lock_guard<SpinLock> guard(lock);
       on_response.reset();
     }
 
     void set_node_id(NodeId id_)
     {
+      std::lock_guard<SpinLock> guard(lock);
       id = id_;
     }
 
     crypto::Sha256Hash get_full_state_root() override
     {
-      return full_state_tree.get_root();
+      std::lock_guard<SpinLock> guard(lock);
+      return get_full_state_root_unsafe();
     }
 
     crypto::Sha256Hash get_replicated_state_root() override
     {
+      std::lock_guard<SpinLock> guard(lock);
+      append_pending_unsafe();
       return replicated_state_tree.get_root();
     }
 
+    size_t get_roots_computed() override
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      return full_state_tree.get_roots_computed() +
+        replicated_state_tree.get_roots_computed();
+    }
+
+    // Used to snapshot the history along with the store, at version v. Only
+    // the frontier of the tree is kept, which is enough to resume it.
+    std::vector<uint8_t> get_full_state_tree(kv::Version v)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      append_pending_unsafe();
+      return full_state_tree.serialise_frontier(v);
+    }
+
+    // Used to restore the history from a snapshot, before any entry following
+    // the snapshot is appended. Accepts either a whole tree or its frontier.
+    void set_full_state_tree(const std::vector<uint8_t>& serialised)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      full_state_tree.deserialise(serialised);
+      log_root(full_state_tree, APPEND);
+    }
+
     void append(
       const std::vector<uint8_t>& replicated,
       const std::vector<uint8_t>& all_data) override
@@ -460,6 +907,9 @@ namespace ccf
       const uint8_t* all_data,
       size_t all_data_size) override
     {
+      std::lock_guard<SpinLock> guard(lock);
+      append_pending_unsafe();
+
       crypto::Sha256Hash h({{all_data, all_data_size}});
       log_hash(h, APPEND);
       full_state_tree.append(h);
@@ -494,7 +944,7 @@ namespace ccf
         return false;
       }
       tls::VerifierPtr from_cert = tls::make_verifier(ni.value().cert);
-      crypto::Sha256Hash root = full_state_tree.get_root();
+      crypto::Sha256Hash root = get_full_state_root();
       log_hash(root, VERIFY);
       return from_cert->verify_hash(
         root.h, root.SIZE, sig_value.sig.data(), sig_value.sig.size());
@@ -502,27 +952,41 @@ namespace ccf
 
     void rollback(kv::Version v) override
     {
+      std::lock_guard<SpinLock> guard(lock);
+      append_pending_unsafe();
       full_state_tree.retract(v);
-      log_hash(full_state_tree.get_root(), ROLLBACK);
+      log_root(full_state_tree, ROLLBACK);
 
       if (is_replicated_tree_enabled())
       {
         replicated_state_tree.retract(v);
-        log_hash(replicated_state_tree.get_root(), ROLLBACK);
+        log_root(replicated_state_tree, ROLLBACK);
       }
     }
 
     void compact(kv::Version v) override
     {
+      std::lock_guard<SpinLock> guard(lock);
+      append_pending_unsafe();
+
+      while (!request_versions.empty() && request_versions.front().first <= v)
+      {
+        const auto& id = request_versions.front().second;
+        requests.erase(id);
+        results.erase(id);
+        responses.erase(id);
+        request_versions.pop_front();
+      }
+
       if (v > MAX_HISTORY_LEN)
         full_state_tree.flush(v - MAX_HISTORY_LEN);
-      log_hash(full_state_tree.get_root(), COMPACT);
+      log_root(full_state_tree, COMPACT);
 
       if (is_replicated_tree_enabled())
       {
         if (v > MAX_HISTORY_LEN)
           replicated_state_tree.flush(v - MAX_HISTORY_LEN);
-        log_hash(replicated_state_tree.get_root(), COMPACT);
+        log_root(replicated_state_tree, COMPACT);
       }
     }
 
@@ -546,14 +1010,22 @@ namespace ccf
         [version, view, commit, this]() {
           Store::Tx sig(version);
           auto sig_view = sig.get_view(signatures);
-          crypto::Sha256Hash root = full_state_tree.get_root();
+          NodeId signer;
+          crypto::Sha256Hash root;
+          std::vector<uint8_t> frontier;
+          {
+            std::lock_guard<SpinLock> guard(lock);
+            signer = id;
+            root = get_full_state_root_unsafe();
+            frontier = full_state_tree.serialise_frontier();
+          }
           Signature sig_value(
-            id,
+            signer,
             version,
             view,
             commit,
             kp.sign_hash(root.h, root.SIZE),
-            full_state_tree.serialise());
+            frontier);
           sig_view->put(0, sig_value);
           return sig.commit_reserved();
         },
@@ -569,7 +1041,10 @@ namespace ccf
       const std::vector<uint8_t>& request) override
     {
       LOG_DEBUG << fmt::format("HISTORY: add_request {0}", id) << std::endl;
-      requests[id] = request;
+      {
+        std::lock_guard<SpinLock> guard(lock);
+        requests.insert(id, std::vector<uint8_t>(request), request.size());
+      }
 
       auto consensus = store.get_consensus();
       if (!consensus)
@@ -585,13 +1060,11 @@ namespace ccf
       const std::vector<uint8_t>& replicated,
       const std::vector<uint8_t>& all_data) override
     {
-      add_result(
-        id,
-        version,
-        replicated.data(),
-        replicated.size(),
-        all_data.data(),
-        all_data.size());
+      std::lock_guard<SpinLock> guard(lock);
+      pending.push_back({{replicated.data(), replicated.size()},
+                         {all_data.data(), all_data.size()}});
+      add_result_unsafe(id, version);
+      append_pending_unsafe();
     }
 
     void add_result(
@@ -602,29 +1075,22 @@ namespace ccf
       const uint8_t* all_data,
       size_t all_data_size) override
     {
-      append(replicated, replicated_size, all_data, all_data_size);
-      auto root = get_full_state_root();
-      LOG_DEBUG << fmt::format(
-                     "HISTORY: add_result {0} {1} {2}", id, version, root)
-                << std::endl;
-#ifdef PBFT
-      results[id] = {version, root};
-      if (on_result.has_value())
-        on_result.value()({id, version, root});
-#endif
+      std::lock_guard<SpinLock> guard(lock);
+      pending.push_back(
+        {{replicated, replicated_size}, {all_data, all_data_size}});
+      add_result_unsafe(id, version);
+    }
+
+    void append_pending() override
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      append_pending_unsafe();
     }
 
     void add_result(kv::TxHistory::RequestID id, kv::Version version) override
     {
-      auto root = get_full_state_root();
-      LOG_DEBUG << fmt::format(
-                     "HISTORY: add_result {0} {1} {2}", id, version, root)
-                << std::endl;
-#ifdef PBFT
-      results[id] = {version, root};
-      if (on_result.has_value())
-        on_result.value()({id, version, root});
-#endif
+      std::lock_guard<SpinLock> guard(lock);
+      add_result_unsafe(id, version);
     }
 
     void add_response(
@@ -632,17 +1098,62 @@ namespace ccf
       const std::vector<uint8_t>& response) override
     {
       LOG_DEBUG << fmt::format("HISTORY: add_response {0}", id) << std::endl;
-      responses[id] = response;
+      std::lock_guard<SpinLock> guard(lock);
+      responses.insert(id, std::vector<uint8_t>(response), response.size());
+    }
+
+    std::optional<std::vector<uint8_t>> get_request(RequestID id)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      auto request = requests.find(id);
+      if (request == nullptr)
+        return std::nullopt;
+      return *request;
+    }
+
+    std::optional<std::vector<uint8_t>> get_response(RequestID id)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      auto response = responses.find(id);
+      if (response == nullptr)
+        return std::nullopt;
+      return *response;
+    }
+
+    RequestCacheStats get_request_cache_stats() override
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      RequestCacheStats stats;
+      stats.hits = requests.get_hits() + responses.get_hits();
+      stats.misses = requests.get_misses() + responses.get_misses();
+      stats.evictions = requests.get_evictions() + results.get_evictions() +
+        responses.get_evictions();
+      stats.entries = requests.size() + results.size() + responses.size();
+      stats.bytes =
+        requests.get_bytes() + results.get_bytes() + responses.get_bytes();
+      return stats;
     }
 
     std::vector<uint8_t> get_receipt(kv::Version index) override
     {
-      return full_state_tree.get_receipt(index).to_v();
+      std::lock_guard<SpinLock> guard(lock);
+      append_pending_unsafe();
+      return full_state_tree.get_receipts(index, index)[0];
+    }
+
+    std::vector<std::vector<uint8_t>> get_receipts(
+      kv::Version from, kv::Version to) override
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      append_pending_unsafe();
+      return full_state_tree.get_receipts(from, to);
     }
 
     bool verify_receipt(const std::vector<uint8_t>& v) override
     {
       auto r = Receipt::from_v(v);
+      std::lock_guard<SpinLock> guard(lock);
+      append_pending_unsafe();
       return full_state_tree.verify(r);
     }
   };
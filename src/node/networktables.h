@@ -16,6 +16,7 @@
 #include "secrets.h"
 #include "service.h"
 #include "signatures.h"
+#include "snapshotevidence.h"
 #include "users.h"
 #include "values.h"
 #include "votinghistory.h"
@@ -71,6 +72,7 @@ namespace ccf
     Values& values;
     Secrets& secrets_table;
     Signatures& signatures;
+    SnapshotEvidences& snapshot_evidence;
 
     //
     // Pbft related tables
@@ -117,6 +119,8 @@ namespace ccf
         tables->create<Secrets>(Tables::SECRETS, kv::SecurityDomain::PUBLIC)),
       signatures(tables->create<Signatures>(
         Tables::SIGNATURES, kv::SecurityDomain::PUBLIC)),
+      snapshot_evidence(tables->create<SnapshotEvidences>(
+        Tables::SNAPSHOT_EVIDENCE, kv::SecurityDomain::PUBLIC)),
       pbft_requests(
         tables->create<pbft::PbftRequests>(pbft::Tables::PBFT_REQUESTS))
     {}
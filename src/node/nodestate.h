@@ -12,6 +12,7 @@
 #include "entities.h"
 #include "genesisgen.h"
 #include "history.h"
+#include "kv/replayer.h"
 #include "networkstate.h"
 #include "nodetonode.h"
 #include "notifier.h"
@@ -20,6 +21,7 @@
 #include "rpc/memberfrontend.h"
 #include "rpc/serialization.h"
 #include "seal.h"
+#include "snapshotter.h"
 #include "timer.h"
 #include "tls/client.h"
 #include "tls/entropy.h"
@@ -198,7 +200,56 @@ namespace ccf
     std::vector<kv::Version> term_history;
     kv::Version last_recovered_commit_idx = 1;
 
+    // Ledger entries are requested from the host in ranges of this many
+    // entries, with at most two ranges outstanding at a time
+    static constexpr consensus::Index recovery_batch_entries = 1000;
+    static constexpr std::chrono::milliseconds recovery_progress_period{5000};
+
+    // Ledger entries are decrypted and decoded ahead of being applied on this
+    // many threads. Threads cannot be created inside SGX enclaves, where
+    // entries are decoded on the enclave thread.
+#ifdef VIRTUAL_ENCLAVE
+    static constexpr size_t recovery_replay_workers = 3;
+#else
+    static constexpr size_t recovery_replay_workers = 0;
+#endif
+    std::unique_ptr<kv::Replayer<StoreSerialiser, StoreDeserialiser>> replayer;
+
+    // Last ledger entry read, and last ledger entry requested from the host
     consensus::Index ledger_idx = 0;
+    consensus::Index ledger_requested_idx = 0;
+
+    struct RecoveryProgress
+    {
+      size_t entries = 0;
+      size_t bytes = 0;
+      std::chrono::milliseconds elapsed{0};
+      std::chrono::milliseconds since_report{0};
+    };
+    RecoveryProgress recovery_progress;
+
+    // Last ledger index the host has reported as durable. Snapshots are only
+    // taken up to it.
+    std::atomic<consensus::Index> ledger_durable_idx = 0;
+
+    //
+    // snapshots
+    //
+    std::unique_ptr<Snapshotter> snapshotter;
+    Join::In join_args;
+
+    // Snapshot read from the host when joining or recovering, if any. The
+    // first chunk is the frontier of the Merkle tree of the history at the
+    // snapshot index.
+    consensus::Index snapshot_idx = 0;
+    std::vector<std::vector<uint8_t>> snapshot_chunks;
+    crypto::Sha256Hash snapshot_hash;
+    bool snapshot_verified = false;
+
+    // A node joining from a snapshot is only opened to clients once the
+    // snapshot has been verified
+    bool awaiting_snapshot_evidence = false;
+    bool open_user_frontend_on_join = false;
 
   public:
     NodeState(
@@ -312,6 +363,9 @@ namespace ccf
       create_node_cert(args.config);
       open_node_frontend();
 
+      snapshotter = std::make_unique<Snapshotter>(
+        writer_factory, network, args.config.snapshot_interval);
+
       // Generate quote over node certificate
       // TODO: https://github.com/microsoft/CCF/issues/59
       std::vector<uint8_t> quote{1};
@@ -462,9 +516,10 @@ namespace ccf
             setup_history();
             setup_encryptor();
 
-            open_member_frontend();
-
-            accept_network_tls_connections(args.config);
+#ifndef PBFT
+            if (snapshot_idx != 0)
+              join_from_snapshot_unsafe(public_only);
+#endif
 
             if (public_only)
               sm.advance(State::partOfPublicNetwork);
@@ -473,10 +528,18 @@ namespace ccf
 
             join_timer.reset();
 
-            LOG_INFO_FMT(
-              "Node has now joined the network as node {}: {}",
-              self,
-              (public_only ? "public only" : "all domains"));
+            if (awaiting_snapshot_evidence)
+            {
+              LOG_INFO_FMT(
+                "Node {} is waiting for evidence of snapshot at {} in the "
+                "ledger",
+                self,
+                snapshot_idx);
+            }
+            else
+            {
+              finish_join();
+            }
           }
           else if (resp->node_status == NodeStatus::PENDING)
           {
@@ -524,6 +587,15 @@ namespace ccf
       std::lock_guard<SpinLock> guard(lock);
       sm.expect(State::pending);
 
+      // The join request is only sent once the host has provided the latest
+      // snapshot, if any, which the node starts from once trusted
+      join_args = args;
+      RINGBUFFER_WRITE_MESSAGE(consensus::snapshot_get, to_host);
+    }
+
+    void start_join_unsafe()
+    {
+      auto args = join_args;
       initiate_join(args);
 
       using namespace std::chrono_literals;
@@ -538,6 +610,114 @@ namespace ccf
       join_timer->start();
     }
 
+    void finish_join()
+    {
+      open_member_frontend();
+
+      accept_network_tls_connections(join_args.config);
+
+      if (open_user_frontend_on_join)
+      {
+        open_user_frontend();
+        LOG_INFO_FMT("Now accepting user transactions");
+      }
+
+      LOG_INFO_FMT(
+        "Node has now joined the network as node {}: {}",
+        self,
+        (sm.check(State::partOfPublicNetwork) ? "public only" : "all domains"));
+    }
+
+    void join_from_snapshot_unsafe(bool public_only)
+    {
+      // The snapshot is supplied by the untrusted host, so the node is only
+      // opened to clients once the snapshot matches the evidence recorded in
+      // the ledger by the primary that took it
+      awaiting_snapshot_evidence = true;
+      setup_snapshot_evidence_hook();
+      restore_snapshot(*network.tables, history, public_only);
+
+      Store::Tx tx;
+      GenesisGenerator g(network, tx);
+      auto last_sig = g.get_last_signature();
+      if (!last_sig.has_value())
+        throw std::logic_error(
+          fmt::format("No signature in snapshot at {}", snapshot_idx));
+
+      // Only entries following the snapshot are replicated to this node, and
+      // written to its ledger
+      consensus->init_from_snapshot(snapshot_idx, last_sig->term);
+      RINGBUFFER_WRITE_MESSAGE(consensus::ledger_init, to_host, snapshot_idx);
+
+      // The private state of the snapshot is restored once the node has
+      // recovered the network secrets it was written with
+      if (!public_only)
+        snapshot_chunks.clear();
+    }
+
+    //
+    // funcs in state "pending" or "readingPublicLedger"
+    //
+    void recv_snapshot_chunk(
+      consensus::Index idx, const uint8_t* data, size_t size)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      snapshot_chunks.emplace_back(data, data + size);
+    }
+
+    void recv_snapshot_end(consensus::Index idx)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+
+#ifdef PBFT
+      // Nodes only start from snapshots with Raft
+      idx = 0;
+#endif
+
+      // A snapshot holds the history's tree, followed by at least one chunk
+      // of the store
+      if (idx != 0 && snapshot_chunks.size() < 2)
+      {
+        LOG_FAIL_FMT("Ignoring incomplete snapshot at {}", idx);
+        idx = 0;
+      }
+
+      snapshot_idx = idx;
+      if (idx == 0)
+      {
+        snapshot_chunks.clear();
+      }
+      else
+      {
+        for (auto& chunk : snapshot_chunks)
+          snapshot_hash = Snapshotter::hash_chunk(snapshot_hash, chunk);
+
+        snapshotter->set_last_snapshot_idx(idx);
+        LOG_INFO_FMT(
+          "Starting from snapshot at {}: {} chunks, hash {}",
+          idx,
+          snapshot_chunks.size(),
+          snapshot_hash);
+      }
+
+      if (sm.check(State::pending))
+      {
+        start_join_unsafe();
+      }
+      else if (sm.check(State::readingPublicLedger))
+      {
+        if (snapshot_idx != 0)
+          recover_public_snapshot_unsafe();
+
+        start_reading_ledger(snapshot_idx);
+      }
+      else
+      {
+        throw std::logic_error(
+          fmt::format("Unexpected snapshot at {}", snapshot_idx));
+      }
+    }
+
     //
     // funcs in state "readingPublicLedger"
     //
@@ -546,25 +726,46 @@ namespace ccf
       std::lock_guard<SpinLock> guard(lock);
       sm.expect(State::readingPublicLedger);
       LOG_INFO_FMT("Start public recovery");
-      read_ledger_idx(++ledger_idx);
+
+      // The ledger is read once the host has provided the latest snapshot, if
+      // any, from which recovery starts
+      RINGBUFFER_WRITE_MESSAGE(consensus::snapshot_get, to_host);
     }
 
-    void recover_public_ledger_entry(const std::vector<uint8_t>& ledger_entry)
+    void recover_public_snapshot_unsafe()
     {
-      std::lock_guard<SpinLock> guard(lock);
-      sm.expect(State::readingPublicLedger);
+      setup_snapshot_evidence_hook();
+      restore_snapshot(*network.tables, history, true);
 
-      LOG_DEBUG_FMT(
-        "Deserialising public ledger entry ({})", ledger_entry.size());
+      Store::Tx tx;
+      GenesisGenerator g(network, tx);
+      auto last_sig = g.get_last_signature();
+      if (!last_sig.has_value())
+        throw std::logic_error(
+          fmt::format("No signature in snapshot at {}", snapshot_idx));
+
+      // The index at which each term before the snapshot started is unknown.
+      // These terms are all assumed to start at the first entry, which is
+      // only used to report terms of entries that are no longer available.
+      term_history.assign(last_sig->term + 1, 1);
+      last_recovered_commit_idx = snapshot_idx;
+
+      LOG_INFO_FMT(
+        "Recovered public state from snapshot at {} in term {}",
+        snapshot_idx,
+        last_sig->term);
+    }
+
+    // Returns false once the end of the public ledger has been reached
+    bool recover_public_ledger_entry_unsafe(kv::DeserialiseSuccess result)
+    {
+      sm.expect(State::readingPublicLedger);
 
-      // When reading the public ledger, deserialise in the real store
-      auto result = network.tables->deserialise(ledger_entry, true);
       if (result == kv::DeserialiseSuccess::FAILED)
       {
         LOG_FAIL_FMT("Failed to deserialise entry in public ledger");
         network.tables->rollback(ledger_idx - 1);
-        recover_public_ledger_end_unsafe();
-        return;
+        return false;
       }
 
       // If the ledger entry is a signature, it is safe to compact the store
@@ -590,12 +791,21 @@ namespace ccf
         }
       }
 
-      read_ledger_idx(++ledger_idx);
+      return true;
     }
 
     void recover_public_ledger_end_unsafe()
     {
       sm.expect(State::readingPublicLedger);
+      log_recovery_progress("Finished public recovery");
+
+      if (snapshot_idx != 0 && !snapshot_verified)
+      {
+        throw std::logic_error(fmt::format(
+          "No evidence of snapshot at {} in the ledger. Remove the snapshot to "
+          "recover from the ledger only.",
+          snapshot_idx));
+      }
 
       // When reaching the end of the public ledger, truncate to last signed
       // index and promote network secrets to this index
@@ -678,22 +888,16 @@ namespace ccf
     //
     // funcs in state "readingPrivateLedger"
     //
-    void recover_private_ledger_entry(const std::vector<uint8_t>& ledger_entry)
+    // Returns false once the end of the private ledger has been reached
+    bool recover_private_ledger_entry_unsafe(kv::DeserialiseSuccess result)
     {
-      std::lock_guard<SpinLock> guard(lock);
       sm.expect(State::readingPrivateLedger);
 
-      LOG_INFO_FMT(
-        "Deserialising private ledger entry ({})", ledger_entry.size());
-
-      // When reading the private ledger, deserialise in the recovery store
-      auto result = recovery_store->deserialise(ledger_entry);
       if (result == kv::DeserialiseSuccess::FAILED)
       {
         LOG_FAIL_FMT("Failed to deserialise entry in private ledger");
         recovery_store->rollback(ledger_idx - 1);
-        recover_private_ledger_end_unsafe();
-        return;
+        return false;
       }
 
       if (result == kv::DeserialiseSuccess::PASS_SIGNATURE)
@@ -702,17 +906,16 @@ namespace ccf
       if (recovery_store->current_version() == recovery_v)
       {
         LOG_INFO_FMT("Reached recovery final version at {}", recovery_v);
-        recover_private_ledger_end_unsafe();
-      }
-      else
-      {
-        read_ledger_idx(++ledger_idx);
+        return false;
       }
+
+      return true;
     }
 
     void recover_private_ledger_end_unsafe()
     {
       sm.expect(State::readingPrivateLedger);
+      log_recovery_progress("Finished private recovery");
 
       // When reaching the end of the private ledger, make sure the same
       // ledger has been read and swap in private state
@@ -725,6 +928,7 @@ namespace ccf
 
       network.tables->swap_private_maps(*recovery_store.get());
       recovery_store.reset();
+      snapshot_chunks.clear();
 
       // Raft should deserialise all security domains when network is opened
       consensus->enable_all_domains();
@@ -755,23 +959,104 @@ namespace ccf
     //
     // funcs in state "readingPublicLedger" or "readingPrivateLedger"
     //
-    void recover_ledger_end()
+    bool is_reading_ledger() const
+    {
+      return is_reading_public_ledger() || is_reading_private_ledger();
+    }
+
+    void recover_ledger_entries(
+      consensus::Index from, const uint8_t* data, size_t size)
     {
       std::lock_guard<SpinLock> guard(lock);
 
-      if (is_reading_public_ledger())
+      // Ranges requested before recovery ended (or before it was restarted
+      // for the private ledger) may still be in flight, and are ignored
+      if (!is_reading_ledger() || from != ledger_idx + 1)
       {
-        recover_public_ledger_end_unsafe();
+        LOG_DEBUG_FMT(
+          "Ignoring ledger entries from {} (last read {})", from, ledger_idx);
+        return;
+      }
+
+      std::vector<std::vector<uint8_t>> entries;
+      while (size > 0)
+      {
+        auto entry_size = serialized::read<uint32_t>(data, size);
+        entries.emplace_back(data, data + entry_size);
+        serialized::skip(data, size, entry_size);
       }
-      else if (is_reading_private_ledger())
+
+      // When reading the public ledger, deserialise in the real store. When
+      // reading the private ledger, deserialise in the recovery store.
+      const auto public_only = is_reading_public_ledger();
+      auto& store = public_only ? *network.tables : *recovery_store;
+      if (replayer == nullptr || &replayer->get_store() != &store)
       {
+        replayer =
+          std::make_unique<kv::Replayer<StoreSerialiser, StoreDeserialiser>>(
+            store, recovery_replay_workers);
+      }
+
+      bool more = true;
+      replayer->replay(
+        entries,
+        public_only,
+        [this, &entries, &more, public_only](
+          size_t i, kv::DeserialiseSuccess result) {
+          ++ledger_idx;
+          recovery_progress.entries++;
+          recovery_progress.bytes += entries[i].size();
+
+          LOG_DEBUG_FMT(
+            "Deserialised {} ledger entry {} ({})",
+            public_only ? "public" : "private",
+            ledger_idx,
+            entries[i].size());
+
+          more = public_only ? recover_public_ledger_entry_unsafe(result) :
+                               recover_private_ledger_entry_unsafe(result);
+          return more;
+        });
+
+      if (more)
+      {
+        read_ledger_ahead();
+        return;
+      }
+
+      // The replayer no longer decodes against the store, which may be
+      // discarded once recovery ends
+      replayer.reset();
+
+      if (public_only)
+        recover_public_ledger_end_unsafe();
+      else
         recover_private_ledger_end_unsafe();
+    }
+
+    void recover_ledger_end(consensus::Index idx)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+
+      // The host reports the end of the ledger for each range requested past
+      // it. Only the first report, once all entries before it have been read,
+      // ends recovery.
+      if (!is_reading_ledger() || idx != ledger_idx + 1)
+      {
+        LOG_DEBUG_FMT(
+          "Ignoring end of ledger at {} (last read {})", idx, ledger_idx);
+        return;
+      }
+
+      replayer.reset();
+
+      if (is_reading_public_ledger())
+      {
+        recover_public_ledger_end_unsafe();
       }
       else
       {
-        throw std::logic_error(
-          "Cannot end ledger recovery if not reading public or private "
-          "ledger");
+        recover_private_ledger_end_unsafe();
       }
     }
 
@@ -804,6 +1089,9 @@ namespace ccf
       recovery_store->set_history(recovery_history);
       recovery_store->set_encryptor(recovery_encryptor);
 
+      if (snapshot_idx != 0)
+        restore_snapshot(*recovery_store, recovery_history, false);
+
       // Record real store version and root
       recovery_v = network.tables->current_version();
       auto h = dynamic_cast<MerkleTxHistory*>(history.get());
@@ -897,8 +1185,7 @@ namespace ccf
       setup_private_recovery_store();
 
       // Start reading private security domain of ledger
-      ledger_idx = 0;
-      read_ledger_idx(++ledger_idx);
+      start_reading_ledger(snapshot_idx);
 
       sm.advance(State::readingPrivateLedger);
       return true;
@@ -909,12 +1196,33 @@ namespace ccf
     //
     void tick(std::chrono::milliseconds elapsed)
     {
+      if (is_reading_ledger())
+      {
+        recovery_progress.elapsed += elapsed;
+        recovery_progress.since_report += elapsed;
+        if (recovery_progress.since_report >= recovery_progress_period)
+        {
+          recovery_progress.since_report = std::chrono::milliseconds(0);
+          log_recovery_progress("Recovery progress");
+        }
+        return;
+      }
+
       if (
         !sm.check(State::partOfNetwork) &&
         !sm.check(State::partOfPublicNetwork))
         return;
 
       consensus->periodic(elapsed);
+
+#ifndef PBFT
+      if (sm.check(State::partOfNetwork) && consensus->is_primary())
+      {
+        auto h = dynamic_cast<MerkleTxHistory*>(history.get());
+        if (h)
+          snapshotter->maybe_snapshot(*h, ledger_durable_idx);
+      }
+#endif
     }
 
     void node_msg(const std::vector<uint8_t>& data)
@@ -940,6 +1248,19 @@ namespace ccf
         case consensus_msg:
           consensus->recv_message(p, psize);
           break;
+        case consensus_coalesced_msg:
+          try
+          {
+            n2n_channels->recv_authenticated_coalesced(
+              p, psize, [this](const uint8_t* data, size_t size) {
+                consensus->recv_message(data, size);
+              });
+          }
+          catch (const std::logic_error& err)
+          {
+            LOG_FAIL_FMT("Invalid coalesced consensus message: {}", err.what());
+          }
+          break;
 
         default:
         {}
@@ -977,6 +1298,11 @@ namespace ccf
       return sm.check(State::partOfPublicNetwork);
     }
 
+    void set_ledger_durable_idx(consensus::Index idx)
+    {
+      ledger_durable_idx = idx;
+    }
+
     std::optional<std::vector<uint8_t>> get_quote()
     {
       std::vector<uint8_t> quote{1};
@@ -1172,8 +1498,7 @@ namespace ccf
       consensus->suspend_replication(recovery_v + 1);
 
       // Start reading private security domain of ledger
-      ledger_idx = 0;
-      read_ledger_idx(++ledger_idx);
+      start_reading_ledger(snapshot_idx);
 
       sm.advance(State::readingPrivateLedger);
     }
@@ -1200,6 +1525,15 @@ namespace ccf
         {
           this->consensus->set_f(
             1); // TODO: we should make f come from a KV table
+
+          // A node joining from a snapshot opens its user frontend once
+          // the snapshot has been verified
+          if (awaiting_snapshot_evidence)
+          {
+            open_user_frontend_on_join = true;
+            return;
+          }
+
           open_user_frontend();
           LOG_INFO_FMT("Now accepting user transactions");
         }
@@ -1260,7 +1594,10 @@ namespace ccf
 
     void setup_n2n_channels()
     {
-      n2n_channels->initialize(self, {network.secrets->get_current().priv_key});
+      n2n_channels->initialize(
+        self,
+        {network.secrets->get_current().priv_key},
+        raft_config.coalesce_messages);
     }
 
     void setup_cmd_forwarder()
@@ -1281,7 +1618,9 @@ namespace ccf
         self,
         std::chrono::milliseconds(raft_config.request_timeout),
         std::chrono::milliseconds(raft_config.election_timeout),
-        public_only);
+        public_only,
+        raft_config.append_entries_size_limit,
+        raft_config.max_inflight_append_entries);
 
       consensus = std::make_shared<RaftConsensusType>(std::move(raft));
 
@@ -1385,9 +1724,39 @@ namespace ccf
       }
     }
 
-    void read_ledger_idx(consensus::Index idx)
+    // Reads the ledger from the entry following from
+    void start_reading_ledger(consensus::Index from = 0)
     {
-      RINGBUFFER_WRITE_MESSAGE(consensus::ledger_get, to_host, idx);
+      ledger_idx = from;
+      ledger_requested_idx = from;
+      recovery_progress = {};
+      read_ledger_ahead();
+    }
+
+    void read_ledger_ahead()
+    {
+      while (ledger_requested_idx - ledger_idx <= recovery_batch_entries)
+      {
+        auto from = ledger_requested_idx + 1;
+        ledger_requested_idx += recovery_batch_entries;
+        RINGBUFFER_WRITE_MESSAGE(
+          consensus::ledger_get_range, to_host, from, ledger_requested_idx);
+      }
+    }
+
+    void log_recovery_progress(const char* what)
+    {
+      auto ms = std::max<size_t>(recovery_progress.elapsed.count(), 1);
+      LOG_INFO_FMT(
+        "{}: read {} entries ({} bytes) up to {} in {}ms: {} entries/s, {} "
+        "bytes/s",
+        what,
+        recovery_progress.entries,
+        recovery_progress.bytes,
+        ledger_idx,
+        recovery_progress.elapsed.count(),
+        recovery_progress.entries * 1000 / ms,
+        recovery_progress.bytes * 1000 / ms);
     }
 
     void ledger_truncate(consensus::Index idx)
@@ -1395,6 +1764,64 @@ namespace ccf
       RINGBUFFER_WRITE_MESSAGE(consensus::ledger_truncate, to_host, idx);
     }
 
+    // Restores the snapshot provided by the host in a store and its history
+    void restore_snapshot(
+      Store& store,
+      const std::shared_ptr<kv::TxHistory>& tx_history,
+      bool public_only)
+    {
+      for (size_t i = 1; i < snapshot_chunks.size(); ++i)
+      {
+        if (store.deserialise_snapshot(snapshot_chunks[i], public_only) !=
+            snapshot_idx)
+        {
+          throw std::logic_error(
+            fmt::format("Failed to restore snapshot at {}", snapshot_idx));
+        }
+      }
+
+      auto h = dynamic_cast<MerkleTxHistory*>(tx_history.get());
+      if (h)
+        h->set_full_state_tree(snapshot_chunks[0]);
+    }
+
+    // The snapshot the node started from is checked against the evidence
+    // recorded in the ledger by the primary that took it
+    void setup_snapshot_evidence_hook()
+    {
+      network.snapshot_evidence.set_local_hook(
+        [this](
+          kv::Version version,
+          const SnapshotEvidences::State& s,
+          const SnapshotEvidences::Write& w) {
+          for (auto& [id, evidence] : w)
+          {
+            if (evidence.value.version != snapshot_idx)
+              continue;
+
+            std::vector<uint8_t> hash(
+              snapshot_hash.h, snapshot_hash.h + snapshot_hash.SIZE);
+            if (evidence.value.hash != hash)
+            {
+              throw std::logic_error(fmt::format(
+                "Snapshot at {} does not match evidence at {}",
+                snapshot_idx,
+                version));
+            }
+
+            LOG_INFO_FMT(
+              "Snapshot at {} matches evidence at {}", snapshot_idx, version);
+            snapshot_verified = true;
+
+            if (awaiting_snapshot_evidence)
+            {
+              awaiting_snapshot_evidence = false;
+              finish_join();
+            }
+          }
+        });
+    }
+
 #ifdef PBFT
     void setup_pbft()
     {
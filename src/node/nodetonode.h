@@ -4,11 +4,14 @@
 
 #include "channels.h"
 #include "ds/serialized.h"
+#include "ds/spinlock.h"
 #include "enclave/rpchandler.h"
 #include "nodetypes.h"
 
 #include <algorithm>
 #include <fmt/format_header_only.h>
+#include <optional>
+#include <unordered_map>
 
 namespace ccf
 {
@@ -19,6 +22,17 @@ namespace ccf
     std::unique_ptr<ChannelManager> channels;
     ringbuffer::WriterPtr to_host;
 
+    // Consensus messages sent with send_authenticated_coalesced are held per
+    // peer until flush() is called, usually once per tick, and are then
+    // authenticated and sent together in a single frame
+    static constexpr size_t max_coalesced_size = 1 << 16;
+    bool coalesce = false;
+    SpinLock coalesced_lock;
+    std::unordered_map<NodeId, std::vector<uint8_t>> coalesced;
+
+    // Sender of the coalesced frame whose messages are being received
+    std::optional<NodeId> coalesced_from;
+
     void establish_channel(NodeId to)
     {
       // If the channel is not yet established, replace all sent messages with
@@ -39,15 +53,33 @@ namespace ccf
         signed_public.value());
     }
 
+    void send_coalesced(
+      NodeId to, Channel& n2n_channel, std::vector<uint8_t>& frame)
+    {
+      // This should only be called when coalesced_lock is held
+      if (frame.empty())
+        return;
+
+      reinterpret_cast<CoalescedHeader*>(frame.data())->from_node = self;
+
+      GcmHdr hdr;
+      n2n_channel.tag(hdr, frame);
+      to_host->write(
+        node_outbound, to, NodeMsgType::consensus_coalesced_msg, frame, hdr);
+      frame.clear();
+    }
+
   public:
     NodeToNode(ringbuffer::AbstractWriterFactory& writer_factory_) :
       to_host(writer_factory_.create_writer_to_outside())
     {}
 
-    void initialize(NodeId id, const tls::Pem& network_pkey)
+    void initialize(
+      NodeId id, const tls::Pem& network_pkey, bool coalesce_ = false)
     {
       self = id;
       channels = std::make_unique<ChannelManager>(network_pkey);
+      coalesce = coalesce_;
     }
 
     template <class T>
@@ -61,6 +93,16 @@ namespace ccf
         return false;
       }
 
+      // Messages already coalesced for the peer are sent first, so that
+      // messages are received in the order they were sent
+      if (coalesce)
+      {
+        std::lock_guard<SpinLock> guard(coalesced_lock);
+        auto search = coalesced.find(to);
+        if (search != coalesced.end())
+          send_coalesced(to, n2n_channel, search->second);
+      }
+
       // The secure channel between self and to has already been established
       GcmHdr hdr;
       n2n_channel.tag(hdr, asCb(data));
@@ -68,10 +110,72 @@ namespace ccf
       return true;
     }
 
+    template <class T>
+    bool send_authenticated_coalesced(
+      const NodeMsgType& msg_type, NodeId to, const T& data)
+    {
+      // Only consensus messages that the host forwards as they are, without
+      // appending ledger entries to them, should be coalesced
+      if (!coalesce || msg_type != NodeMsgType::consensus_msg)
+        return send_authenticated(msg_type, to, data);
+
+      auto& n2n_channel = channels->get(to);
+      if (n2n_channel.get_status() != ChannelStatus::ESTABLISHED)
+      {
+        establish_channel(to);
+        return false;
+      }
+
+      std::lock_guard<SpinLock> guard(coalesced_lock);
+      auto& frame = coalesced[to];
+      if (frame.empty())
+        frame.resize(sizeof(CoalescedHeader));
+
+      auto size = frame.size();
+      auto space = sizeof(uint32_t) + sizeof(T);
+      frame.resize(size + space);
+      auto p = frame.data() + size;
+      serialized::write(p, space, (uint32_t)sizeof(T));
+      serialized::write(
+        p, space, reinterpret_cast<const uint8_t*>(&data), sizeof(T));
+      reinterpret_cast<CoalescedHeader*>(frame.data())->count++;
+
+      if (frame.size() >= max_coalesced_size)
+        send_coalesced(to, n2n_channel, frame);
+
+      return true;
+    }
+
+    void flush()
+    {
+      if (!coalesce)
+        return;
+
+      std::lock_guard<SpinLock> guard(coalesced_lock);
+      for (auto& [to, frame] : coalesced)
+        send_coalesced(to, channels->get(to), frame);
+    }
+
     template <class T>
     const T& recv_authenticated(const uint8_t*& data, size_t& size)
     {
       const auto& t = serialized::overlay<T>(data, size);
+
+      if (coalesced_from.has_value())
+      {
+        // The frame holding the message has already been authenticated
+        if (t.from_node != coalesced_from.value())
+        {
+          throw std::logic_error(fmt::format(
+            "Coalesced node2node message from node {} claims to be from node "
+            "{}",
+            coalesced_from.value(),
+            t.from_node));
+        }
+
+        return t;
+      }
+
       const auto& hdr = serialized::overlay<GcmHdr>(data, size);
 
       auto& n2n_channel = channels->get(t.from_node);
@@ -87,6 +191,70 @@ namespace ccf
       return t;
     }
 
+    // Authenticates a frame of coalesced consensus messages, and passes each
+    // of them to recv, from which they can be read with recv_authenticated
+    template <typename F>
+    void recv_authenticated_coalesced(
+      const uint8_t* data, size_t size, F&& recv)
+    {
+      if (size < sizeof(CoalescedHeader) + sizeof(GcmHdr))
+        throw std::logic_error("Coalesced node2node message is too short");
+
+      auto frame_size = size - sizeof(GcmHdr);
+      const auto& ch = *reinterpret_cast<const CoalescedHeader*>(data);
+      const auto& hdr =
+        *reinterpret_cast<const GcmHdr*>(data + frame_size);
+
+      auto& n2n_channel = channels->get(ch.from_node);
+      if (!n2n_channel.verify(hdr, {data, frame_size}))
+      {
+        throw std::logic_error(fmt::format(
+          "Invalid authenticated node2node message from node {} (size: {})",
+          ch.from_node,
+          size));
+      }
+
+      auto p = data + sizeof(CoalescedHeader);
+      auto remaining = frame_size - sizeof(CoalescedHeader);
+
+      coalesced_from = ch.from_node;
+      try
+      {
+        for (uint32_t i = 0; i < ch.count; ++i)
+        {
+          auto msg_size = serialized::read<uint32_t>(p, remaining);
+          if (msg_size > remaining)
+          {
+            throw std::logic_error(fmt::format(
+              "Coalesced node2node message wants {} bytes, but only {} remain",
+              msg_size,
+              remaining));
+          }
+
+          recv(p, msg_size);
+          serialized::skip(p, remaining, msg_size);
+        }
+      }
+      catch (...)
+      {
+        coalesced_from.reset();
+        throw;
+      }
+      coalesced_from.reset();
+    }
+
+    // Returns whether messages can be sent to the node. If not, a key
+    // exchange with the node is initiated
+    bool try_establish_channel(NodeId to)
+    {
+      if (channels->get(to).get_status() != ChannelStatus::ESTABLISHED)
+      {
+        establish_channel(to);
+        return false;
+      }
+      return true;
+    }
+
     template <class T>
     bool send_encrypted(
       NodeId to, const std::vector<uint8_t>& data, const T& msg)
@@ -19,7 +19,8 @@ namespace ccf
   {
     channel_msg = 0,
     consensus_msg,
-    forwarded_msg
+    forwarded_msg,
+    consensus_coalesced_msg
   };
 
   // Types of channel messages
@@ -34,7 +35,8 @@ namespace ccf
   enum ForwardedMsg : Node2NodeMsg
   {
     forwarded_cmd = 0,
-    forwarded_response
+    forwarded_response,
+    forwarded_batch
   };
 
 #pragma pack(push, 1)
@@ -58,6 +60,14 @@ namespace ccf
     ForwardedMsg msg;
     NodeId from_node;
   };
+
+  // Header for consensus messages coalesced in a single authenticated frame.
+  // Each message follows, prefixed with its size.
+  struct CoalescedHeader
+  {
+    NodeId from_node;
+    uint32_t count;
+  };
 #pragma pack(pop)
 
   /// Node-to-node related ringbuffer messages
@@ -35,10 +35,22 @@ namespace ccf
       nlohmann::json buckets = {};
     };
 
+    struct RequestCacheResults
+    {
+      size_t hits = {};
+      size_t misses = {};
+      size_t evictions = {};
+      size_t entries = {};
+      size_t bytes = {};
+    };
+
     struct Out
     {
       HistogramResults histogram;
       nlohmann::json tx_rates;
+      // Merkle roots computed per second, over the last tick
+      size_t merkle_root_rate = {};
+      RequestCacheResults request_cache;
     };
   };
 
@@ -123,6 +135,23 @@ namespace ccf
     };
   };
 
+  struct GetReceipts
+  {
+    // Largest number of receipts produced by a single request
+    static constexpr size_t max_receipts = 1000;
+
+    struct In
+    {
+      int64_t from = 0;
+      int64_t to = 0;
+    };
+
+    struct Out
+    {
+      std::vector<std::vector<std::uint8_t>> receipts = {};
+    };
+  };
+
   struct VerifyReceipt
   {
     struct In
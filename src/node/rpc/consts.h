@@ -26,6 +26,7 @@ namespace ccf
     static constexpr auto LIST_METHODS = "listMethods";
     static constexpr auto GET_SCHEMA = "getSchema";
     static constexpr auto GET_RECEIPT = "getReceipt";
+    static constexpr auto GET_RECEIPTS = "getReceipts";
     static constexpr auto VERIFY_RECEIPT = "verifyReceipt";
   };
 
@@ -2,10 +2,14 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "ds/spinlock.h"
 #include "enclave/enclavetypes.h"
 #include "enclave/rpcmap.h"
 #include "node/nodetonode.h"
 
+#include <chrono>
+#include <unordered_map>
+
 namespace ccf
 {
   class ForwardedRpcHandler
@@ -28,14 +32,174 @@ namespace ccf
 
     using IsCallerCertForwarded = bool;
 
+    // If batch_max_delay_ms is not 0, forwarded commands and responses are
+    // written to a batch per destination node. A batch is encrypted and sent
+    // as a single message once it holds batch_max_size bytes, or on the first
+    // tick after batch_max_delay_ms. Each message in a batch is prefixed with
+    // its ForwardedMsg type and its size. A batch that cannot be sent is kept
+    // and sent again on the next tick.
+    size_t batch_max_delay_ms;
+    size_t batch_max_size;
+    size_t ms_since_batches_sent = 0;
+    SpinLock batches_lock;
+    std::unordered_map<NodeId, std::vector<uint8_t>> batches;
+
+    bool send_batch(NodeId to, std::vector<uint8_t>& batch)
+    {
+      // This should only be called when batches_lock is held
+      if (batch.empty())
+        return true;
+
+      ForwardedHeader msg = {ForwardedMsg::forwarded_batch, self};
+      if (!n2n_channels->send_encrypted(to, batch, msg))
+      {
+        LOG_FAIL_FMT(
+          "Could not send batch of forwarded messages to {}, retrying on next "
+          "tick",
+          to);
+        return false;
+      }
+
+      // The batch keeps its capacity, so that it is not reallocated
+      batch.clear();
+      return true;
+    }
+
+    // Sends a message of the given size to a node, or adds it to the node's
+    // batch. write serialises the message in the space reserved for it. This
+    // is called from worker threads as well as from the enclave thread: the
+    // batches are protected by batches_lock, and channels by their own locks.
+    template <typename F>
+    bool send(NodeId to, ForwardedMsg msg_type, size_t size, F&& write)
+    {
+      if (batch_max_delay_ms == 0)
+      {
+        std::vector<uint8_t> plain(size);
+        auto data_ = plain.data();
+        auto size_ = plain.size();
+        write(data_, size_);
+
+        ForwardedHeader msg = {msg_type, self};
+
+        return n2n_channels->send_encrypted(to, plain, msg);
+      }
+
+      // Messages are only batched for nodes that they can be sent to, so that
+      // failing to forward a command is still reported to the caller
+      if (!n2n_channels->try_establish_channel(to))
+        return false;
+
+      std::lock_guard<SpinLock> guard(batches_lock);
+      auto& batch = batches[to];
+
+      // A batch that is still over the maximum size could not be sent. It is
+      // not grown further, and the message is refused so that the caller can
+      // report the failure.
+      if (!batch.empty() && batch.size() >= batch_max_size)
+        return false;
+
+      auto offset = batch.size();
+      batch.resize(offset + sizeof(msg_type) + sizeof(size) + size);
+      auto data_ = batch.data() + offset;
+      auto size_ = batch.size() - offset;
+      serialized::write(data_, size_, msg_type);
+      serialized::write(data_, size_, size);
+      write(data_, size_);
+
+      // The message has been queued, and is sent with the batch either now or
+      // on a later tick
+      if (batch.size() >= batch_max_size)
+        send_batch(to, batch);
+
+      return true;
+    }
+
+    void process_forwarded_command(enclave::RPCContext& ctx, NodeId from_node)
+    {
+      auto handler = rpc_map->find(ctx.actor);
+      if (!handler.has_value())
+      {
+        LOG_FAIL_FMT(
+          "Failed to process forwarded command: no handler for actor {}",
+          ctx.actor);
+        return;
+      }
+
+      auto fwd_handler =
+        dynamic_cast<ForwardedRpcHandler*>(handler.value().get());
+      if (!fwd_handler)
+      {
+        LOG_FAIL_FMT(
+          "Failed to process forwarded command: handler is not a "
+          "ForwardedRpcHandler",
+          ctx.actor);
+        return;
+      }
+
+      if (!send_forwarded_response(
+            ctx.session.fwd->client_session_id,
+            from_node,
+            fwd_handler->process_forwarded(ctx)))
+      {
+        LOG_FAIL_FMT("Could not send forwarded response to {}", from_node);
+      }
+      else
+      {
+        LOG_DEBUG_FMT("Sending forwarded response to {}", from_node);
+      }
+    }
+
+    void process_forwarded_response(
+      size_t client_session_id, const std::vector<uint8_t>& rpc)
+    {
+      LOG_DEBUG_FMT(
+        "Sending forwarded response to RPC endpoint {}", client_session_id);
+
+      rpcresponder->reply_async(client_session_id, rpc);
+    }
+
+    void process_batched_message(
+      ForwardedMsg msg_type, NodeId from_node, const uint8_t* data, size_t size)
+    {
+      switch (msg_type)
+      {
+        case ForwardedMsg::forwarded_cmd:
+        {
+          if (rpc_map)
+          {
+            auto [ctx, from] = parse_forwarded_command(from_node, data, size);
+            process_forwarded_command(ctx, from);
+          }
+          break;
+        }
+
+        case ForwardedMsg::forwarded_response:
+        {
+          auto [client_session_id, rpc] = parse_forwarded_response(data, size);
+          process_forwarded_response(client_session_id, rpc);
+          break;
+        }
+
+        default:
+        {
+          LOG_FAIL_FMT("Unknown batched frontend msg type: {}", msg_type);
+          break;
+        }
+      }
+    }
+
   public:
     Forwarder(
       std::shared_ptr<enclave::AbstractRPCResponder> rpcresponder,
       std::shared_ptr<ChannelProxy> n2n_channels,
-      std::shared_ptr<enclave::RPCMap> rpc_map_) :
+      std::shared_ptr<enclave::RPCMap> rpc_map_,
+      size_t batch_max_delay_ms_ = 0,
+      size_t batch_max_size_ = 0) :
       rpcresponder(rpcresponder),
       n2n_channels(n2n_channels),
-      rpc_map(rpc_map_)
+      rpc_map(rpc_map_),
+      batch_max_delay_ms(batch_max_delay_ms_),
+      batch_max_size(batch_max_size_)
     {}
 
     void initialize(NodeId self_)
@@ -60,24 +224,25 @@ namespace ccf
         include_caller = true;
       }
 
-      std::vector<uint8_t> plain(size);
-      auto data_ = plain.data();
-      auto size_ = plain.size();
-      serialized::write(data_, size_, caller_id);
-      serialized::write(data_, size_, rpc_ctx.session.client_session_id);
-      serialized::write(data_, size_, rpc_ctx.actor);
-      serialized::write(data_, size_, rpc_ctx.method);
-      serialized::write(data_, size_, include_caller);
-      if (include_caller)
-      {
-        serialized::write(data_, size_, caller_cert.size());
-        serialized::write(data_, size_, caller_cert.data(), caller_cert.size());
-      }
-      serialized::write(data_, size_, rpc_ctx.raw.data(), rpc_ctx.raw.size());
-
-      ForwardedHeader msg = {ForwardedMsg::forwarded_cmd, self};
-
-      return n2n_channels->send_encrypted(to, plain, msg);
+      return send(
+        to,
+        ForwardedMsg::forwarded_cmd,
+        size,
+        [&](uint8_t*& data_, size_t& size_) {
+          serialized::write(data_, size_, caller_id);
+          serialized::write(data_, size_, rpc_ctx.session.client_session_id);
+          serialized::write(data_, size_, rpc_ctx.actor);
+          serialized::write(data_, size_, rpc_ctx.method);
+          serialized::write(data_, size_, include_caller);
+          if (include_caller)
+          {
+            serialized::write(data_, size_, caller_cert.size());
+            serialized::write(
+              data_, size_, caller_cert.data(), caller_cert.size());
+          }
+          serialized::write(
+            data_, size_, rpc_ctx.raw.data(), rpc_ctx.raw.size());
+        });
     }
 
     std::optional<std::tuple<enclave::RPCContext, NodeId>>
@@ -94,10 +259,14 @@ namespace ccf
         return {};
       }
 
+      return parse_forwarded_command(
+        r.first.from_node, r.second.data(), r.second.size());
+    }
+
+    std::tuple<enclave::RPCContext, NodeId> parse_forwarded_command(
+      NodeId from_node, const uint8_t* data_, size_t size_)
+    {
       std::vector<uint8_t> caller_cert;
-      const auto& plain_ = r.second;
-      auto data_ = plain_.data();
-      auto size_ = plain_.size();
       auto caller_id = serialized::read<CallerId>(data_, size_);
       auto client_session_id = serialized::read<size_t>(data_, size_);
       auto actor = serialized::read<ActorsType>(data_, size_);
@@ -118,7 +287,7 @@ namespace ccf
       context.actor = actor;
       context.method = method;
 
-      return std::make_tuple(context, r.first.from_node);
+      return std::make_tuple(context, from_node);
     }
 
     bool send_forwarded_response(
@@ -126,15 +295,14 @@ namespace ccf
       NodeId from_node,
       const std::vector<uint8_t>& data)
     {
-      std::vector<uint8_t> plain(sizeof(client_session_id) + data.size());
-      auto data_ = plain.data();
-      auto size_ = plain.size();
-      serialized::write(data_, size_, client_session_id);
-      serialized::write(data_, size_, data.data(), data.size());
-
-      ForwardedHeader msg = {ForwardedMsg::forwarded_response, self};
-
-      return n2n_channels->send_encrypted(from_node, plain, msg);
+      return send(
+        from_node,
+        ForwardedMsg::forwarded_response,
+        sizeof(client_session_id) + data.size(),
+        [&](uint8_t*& data_, size_t& size_) {
+          serialized::write(data_, size_, client_session_id);
+          serialized::write(data_, size_, data.data(), data.size());
+        });
     }
 
     std::optional<std::pair<size_t, std::vector<uint8_t>>>
@@ -151,15 +319,72 @@ namespace ccf
         return {};
       }
 
-      const auto& plain_ = r.second;
-      auto data_ = plain_.data();
-      auto size_ = plain_.size();
+      return parse_forwarded_response(r.second.data(), r.second.size());
+    }
+
+    std::pair<size_t, std::vector<uint8_t>> parse_forwarded_response(
+      const uint8_t* data_, size_t size_)
+    {
       auto client_session_id = serialized::read<size_t>(data_, size_);
       std::vector<uint8_t> rpc = serialized::read(data_, size_, size_);
 
       return std::make_pair(client_session_id, rpc);
     }
 
+    // Decrypts a batch of forwarded messages and passes each of them to recv,
+    // along with its type and the node that sent the batch
+    template <typename F>
+    bool recv_forwarded_batch(const uint8_t* data, size_t size, F&& recv)
+    {
+      try
+      {
+        auto r =
+          n2n_channels->template recv_encrypted<ForwardedHeader>(data, size);
+
+        const auto& plain_ = r.second;
+        auto data_ = plain_.data();
+        auto size_ = plain_.size();
+        while (size_ > 0)
+        {
+          auto msg_type = serialized::read<ForwardedMsg>(data_, size_);
+          auto msg_size = serialized::read<size_t>(data_, size_);
+          if (msg_size > size_)
+          {
+            throw std::logic_error(fmt::format(
+              "Forwarded message wants {} bytes, but only {} remain",
+              msg_size,
+              size_));
+          }
+
+          recv(msg_type, r.first.from_node, data_, msg_size);
+          serialized::skip(data_, size_, msg_size);
+        }
+      }
+      catch (const std::logic_error& err)
+      {
+        LOG_FAIL_FMT("Invalid forwarded batch: {}", err.what());
+        return false;
+      }
+
+      return true;
+    }
+
+    // Sends the batches that have been waiting for batch_max_delay_ms
+    void tick(std::chrono::milliseconds elapsed)
+    {
+      if (batch_max_delay_ms == 0)
+        return;
+
+      std::lock_guard<SpinLock> guard(batches_lock);
+      ms_since_batches_sent += elapsed.count();
+      if (ms_since_batches_sent < batch_max_delay_ms)
+        return;
+
+      ms_since_batches_sent = 0;
+      for (auto& [to, batch] : batches)
+        send_batch(to, batch);
+    }
+
     void recv_message(const uint8_t* data, size_t size)
     {
       serialized::skip(data, size, sizeof(NodeMsgType));
@@ -180,39 +405,7 @@ namespace ccf
             }
 
             auto [ctx, from_node] = r.value();
-
-            auto handler = rpc_map->find(ctx.actor);
-            if (!handler.has_value())
-            {
-              LOG_FAIL_FMT(
-                "Failed to process forwarded command: no handler for actor {}",
-                ctx.actor);
-              return;
-            }
-
-            auto fwd_handler =
-              dynamic_cast<ForwardedRpcHandler*>(handler.value().get());
-            if (!fwd_handler)
-            {
-              LOG_FAIL_FMT(
-                "Failed to process forwarded command: handler is not a "
-                "ForwardedRpcHandler",
-                ctx.actor);
-              return;
-            }
-
-            if (!send_forwarded_response(
-                  ctx.session.fwd->client_session_id,
-                  from_node,
-                  fwd_handler->process_forwarded(ctx)))
-            {
-              LOG_FAIL_FMT(
-                "Could not send forwarded response to {}", from_node);
-            }
-            else
-            {
-              LOG_DEBUG_FMT("Sending forwarded response to {}", from_node);
-            }
+            process_forwarded_command(ctx, from_node);
           }
           break;
         }
@@ -223,14 +416,22 @@ namespace ccf
           if (!rep.has_value())
             return;
 
-          LOG_DEBUG_FMT(
-            "Sending forwarded response to RPC endpoint {}", rep->first);
-
-          if (!rpcresponder->reply_async(rep->first, rep->second))
-          {
-            return;
-          }
+          process_forwarded_response(rep->first, rep->second);
+          break;
+        }
 
+        case ForwardedMsg::forwarded_batch:
+        {
+          recv_forwarded_batch(
+            data,
+            size,
+            [this](
+              ForwardedMsg msg_type,
+              NodeId from_node,
+              const uint8_t* data_,
+              size_t size_) {
+              process_batched_message(msg_type, from_node, data_, size_);
+            });
           break;
         }
 
@@ -242,4 +443,4 @@ namespace ccf
       }
     }
   };
-}
\ No newline at end of file
+}
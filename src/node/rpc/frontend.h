@@ -17,6 +17,7 @@
 #include "rpcexception.h"
 #include "serialization.h"
 
+#include <atomic>
 #include <fmt/format_header_only.h>
 #include <mutex>
 #include <utility>
@@ -219,7 +220,7 @@ namespace ccf
     kv::TxHistory* history;
 
     size_t sig_max_tx = 1000;
-    size_t tx_count = 0;
+    std::atomic<size_t> tx_count{0};
     std::chrono::milliseconds sig_max_ms = std::chrono::milliseconds(1000);
     std::chrono::milliseconds ms_to_sig = std::chrono::milliseconds(1000);
     bool request_storing_disabled = false;
@@ -324,14 +325,22 @@ namespace ccf
         return false;
       }
 
-      auto v = verifiers.find(caller_id);
-      if (v == verifiers.end())
+      // Requests may be processed on several threads, which share verifiers.
+      // Only finding or creating the verifier is done under the lock, so
+      // that signatures are verified concurrently.
+      tls::VerifierPtr verifier;
       {
-        std::vector<uint8_t> caller_cert(caller);
-        verifiers.emplace(
-          std::make_pair(caller_id, tls::make_verifier(caller_cert)));
+        std::lock_guard<SpinLock> mguard(lock);
+        auto& v = verifiers[caller_id];
+        if (v == nullptr)
+        {
+          std::vector<uint8_t> caller_cert(caller);
+          v = tls::make_verifier(caller_cert);
+        }
+        verifier = v;
       }
-      if (!verifiers[caller_id]->verify(
+
+      if (!verifier->verify(
             signed_request.req, signed_request.sig, signed_request.md))
       {
         return false;
@@ -547,6 +556,47 @@ namespace ccf
           "Unable to produce receipt");
       };
 
+      auto get_receipts = [this](Store::Tx& tx, const nlohmann::json& params) {
+        const auto in = params.get<GetReceipts::In>();
+
+        if (
+          in.from > in.to ||
+          static_cast<size_t>(in.to - in.from) >= GetReceipts::max_receipts)
+        {
+          return jsonrpc::error(
+            jsonrpc::StandardErrorCodes::INVALID_PARAMS,
+            fmt::format(
+              "Receipts can be requested for up to {} consecutive commits",
+              GetReceipts::max_receipts));
+        }
+
+        update_history();
+
+        if (history != nullptr)
+        {
+          try
+          {
+            const GetReceipts::Out out{history->get_receipts(in.from, in.to)};
+
+            return jsonrpc::success(out);
+          }
+          catch (const std::exception& e)
+          {
+            return jsonrpc::error(
+              jsonrpc::StandardErrorCodes::INTERNAL_ERROR,
+              fmt::format(
+                "Unable to produce receipts for commits {} to {} : {}",
+                in.from,
+                in.to,
+                e.what()));
+          }
+        }
+
+        return jsonrpc::error(
+          jsonrpc::StandardErrorCodes::INTERNAL_ERROR,
+          "Unable to produce receipts");
+      };
+
       auto verify_receipt =
         [this](Store::Tx& tx, const nlohmann::json& params) {
           const auto in = params.get<VerifyReceipt::In>();
@@ -599,6 +649,8 @@ namespace ccf
         GeneralProcs::GET_SCHEMA, get_schema, Read);
       install_with_auto_schema<GetReceipt>(
         GeneralProcs::GET_RECEIPT, get_receipt, Read);
+      install_with_auto_schema<GetReceipts>(
+        GeneralProcs::GET_RECEIPTS, get_receipts, Read);
       install_with_auto_schema<VerifyReceipt>(
         GeneralProcs::VERIFY_RECEIPT, verify_receipt, Read);
     }
@@ -1090,9 +1142,14 @@ namespace ccf
 
     void tick(std::chrono::milliseconds elapsed) override
     {
-      metrics.track_tx_rates(elapsed, tx_count);
-      // reset tx_counter for next tick interval
-      tx_count = 0;
+      // tx_count is reset for the next tick interval
+      metrics.track_tx_rates(elapsed, tx_count.exchange(0));
+      update_history();
+      if (history != nullptr)
+      {
+        metrics.track_root_rates(elapsed, history->get_roots_computed());
+        metrics.track_request_cache(history->get_request_cache_stats());
+      }
       // TODO(#refactoring): move this to NodeState::tick
       update_consensus();
       if ((consensus != nullptr) && consensus->is_primary())
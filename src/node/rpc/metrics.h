@@ -4,6 +4,7 @@
 
 #include "ds/histogram.h"
 #include "ds/logger.h"
+#include "kv/kvtypes.h"
 #include "serialization.h"
 
 #include <nlohmann/json.hpp>
@@ -27,6 +28,9 @@ namespace metrics
     histogram::Global<Hist> global =
       histogram::Global<Hist>("histogram", __FILE__, __LINE__);
     Hist histogram = Hist(global);
+    size_t roots_computed = 0;
+    size_t root_rate = 0;
+    ccf::GetMetrics::RequestCacheResults request_cache;
 
     ccf::GetMetrics::HistogramResults get_histogram_results()
     {
@@ -69,6 +73,8 @@ namespace metrics
       nlohmann::json result;
       result["histogram"] = get_histogram_results();
       result["tx_rates"] = get_tx_rates();
+      result["merkle_root_rate"] = root_rate;
+      result["request_cache"] = request_cache;
 
       return result;
     }
@@ -93,5 +99,27 @@ namespace metrics
         tick_count++;
       }
     }
+
+    void track_root_rates(
+      const std::chrono::milliseconds& elapsed, size_t total_roots_computed)
+    {
+      // total_roots_computed is reported by the history, which may have been
+      // replaced since the last tick
+      auto roots = total_roots_computed >= roots_computed ?
+        total_roots_computed - roots_computed :
+        total_roots_computed;
+      roots_computed = total_roots_computed;
+      if (elapsed.count() > 0)
+        root_rate = roots / (elapsed.count() / 1000.0);
+    }
+
+    void track_request_cache(const kv::TxHistory::RequestCacheStats& stats)
+    {
+      request_cache.hits = stats.hits;
+      request_cache.misses = stats.misses;
+      request_cache.evictions = stats.evictions;
+      request_cache.entries = stats.entries;
+      request_cache.bytes = stats.bytes;
+    }
   };
 }
\ No newline at end of file
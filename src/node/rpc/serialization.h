@@ -55,8 +55,12 @@ namespace ccf
   DECLARE_JSON_TYPE(GetMetrics::HistogramResults)
   DECLARE_JSON_REQUIRED_FIELDS(
     GetMetrics::HistogramResults, low, high, overflow, underflow, buckets)
+  DECLARE_JSON_TYPE(GetMetrics::RequestCacheResults)
+  DECLARE_JSON_REQUIRED_FIELDS(
+    GetMetrics::RequestCacheResults, hits, misses, evictions, entries, bytes)
   DECLARE_JSON_TYPE(GetMetrics::Out)
-  DECLARE_JSON_REQUIRED_FIELDS(GetMetrics::Out, histogram, tx_rates)
+  DECLARE_JSON_REQUIRED_FIELDS(
+    GetMetrics::Out, histogram, tx_rates, merkle_root_rate, request_cache)
 
   DECLARE_JSON_TYPE(GetPrimaryInfo::Out)
   DECLARE_JSON_REQUIRED_FIELDS(
@@ -86,6 +90,11 @@ namespace ccf
   DECLARE_JSON_TYPE(GetReceipt::Out)
   DECLARE_JSON_REQUIRED_FIELDS(GetReceipt::Out, receipt)
 
+  DECLARE_JSON_TYPE(GetReceipts::In)
+  DECLARE_JSON_REQUIRED_FIELDS(GetReceipts::In, from, to)
+  DECLARE_JSON_TYPE(GetReceipts::Out)
+  DECLARE_JSON_REQUIRED_FIELDS(GetReceipts::Out, receipts)
+
   DECLARE_JSON_TYPE(VerifyReceipt::In)
   DECLARE_JSON_REQUIRED_FIELDS(VerifyReceipt::In, receipt)
   DECLARE_JSON_TYPE(VerifyReceipt::Out)
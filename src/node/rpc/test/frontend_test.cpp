@@ -891,6 +891,160 @@ TEST_CASE("Memberfrontend forwarding" * doctest::test_suite("forwarding"))
   CHECK(member_frontend_primary.last_caller_id == 0);
 }
 
+TEST_CASE("Forwarding batches" * doctest::test_suite("forwarding"))
+{
+  prepare_callers();
+  add_callers_primary_store();
+
+  TestForwardingUserFrontEnd user_frontend_backup(*network.tables);
+  TestForwardingUserFrontEnd user_frontend_primary(*network2.tables);
+  auto channel_stub = std::make_shared<ChannelStubProxy>();
+
+  constexpr size_t max_delay_ms = 10;
+  auto backup_forwarder = std::make_shared<Forwarder<ChannelStubProxy>>(
+    nullptr, channel_stub, nullptr, max_delay_ms, 1 << 16);
+  user_frontend_backup.set_cmd_forwarder(backup_forwarder);
+  auto backup_consensus = std::make_shared<kv::BackupStubConsensus>();
+  network.tables->set_consensus(backup_consensus);
+
+  auto primary_consensus = std::make_shared<kv::PrimaryStubConsensus>();
+  network2.tables->set_consensus(primary_consensus);
+
+  auto write_req = create_simple_json();
+  auto serialized_call = jsonrpc::pack(write_req, default_pack);
+  const auto ctx = enclave::make_rpc_context(user_session, serialized_call);
+
+  {
+    INFO("Forwarded commands are sent in a single batch after the delay");
+    constexpr size_t count = 3;
+    for (size_t i = 0; i < count; ++i)
+    {
+      const auto r = user_frontend_backup.process(ctx);
+      REQUIRE(!r.has_value());
+    }
+    REQUIRE(channel_stub->is_empty());
+
+    backup_forwarder->tick(std::chrono::milliseconds(max_delay_ms - 1));
+    REQUIRE(channel_stub->is_empty());
+
+    backup_forwarder->tick(std::chrono::milliseconds(1));
+    REQUIRE(channel_stub->size() == 1);
+
+    size_t received = 0;
+    auto batch = channel_stub->get_pop_back();
+    REQUIRE(backup_forwarder->recv_forwarded_batch(
+      batch.data(),
+      batch.size(),
+      [&](
+        ForwardedMsg msg_type,
+        NodeId from_node,
+        const uint8_t* data,
+        size_t size) {
+        REQUIRE(msg_type == ForwardedMsg::forwarded_cmd);
+        auto [fwd_ctx, node_id] =
+          backup_forwarder->parse_forwarded_command(from_node, data, size);
+        auto response = jsonrpc::unpack(
+          user_frontend_primary.process_forwarded(fwd_ctx), default_pack);
+        CHECK(response[jsonrpc::RESULT] == true);
+        CHECK(user_frontend_primary.last_caller_cert == user_caller_der);
+        received++;
+      }));
+    CHECK(received == count);
+
+    INFO("Empty batches are not sent");
+    backup_forwarder->tick(std::chrono::milliseconds(max_delay_ms));
+    REQUIRE(channel_stub->is_empty());
+  }
+
+  {
+    INFO("Forwarded responses are batched");
+    const std::vector<uint8_t> response = {1, 2, 3};
+    REQUIRE(backup_forwarder->send_forwarded_response(1, 0, response));
+    REQUIRE(backup_forwarder->send_forwarded_response(2, 0, {}));
+    REQUIRE(channel_stub->is_empty());
+
+    backup_forwarder->tick(std::chrono::milliseconds(max_delay_ms));
+    REQUIRE(channel_stub->size() == 1);
+
+    std::vector<std::pair<size_t, std::vector<uint8_t>>> received;
+    auto batch = channel_stub->get_pop_back();
+    REQUIRE(backup_forwarder->recv_forwarded_batch(
+      batch.data(),
+      batch.size(),
+      [&](
+        ForwardedMsg msg_type,
+        NodeId from_node,
+        const uint8_t* data,
+        size_t size) {
+        REQUIRE(msg_type == ForwardedMsg::forwarded_response);
+        received.push_back(
+          backup_forwarder->parse_forwarded_response(data, size));
+      }));
+    REQUIRE(received.size() == 2);
+    CHECK(received[0].first == 1);
+    CHECK(received[0].second == response);
+    CHECK(received[1].first == 2);
+    CHECK(received[1].second.empty());
+  }
+
+  {
+    INFO("Batches are sent as soon as they exceed the maximum size");
+    auto small_batch_forwarder = std::make_shared<Forwarder<ChannelStubProxy>>(
+      nullptr, channel_stub, nullptr, max_delay_ms, 1);
+    user_frontend_backup.set_cmd_forwarder(small_batch_forwarder);
+
+    const auto r = user_frontend_backup.process(ctx);
+    REQUIRE(!r.has_value());
+    REQUIRE(channel_stub->size() == 1);
+    channel_stub->clear();
+
+    INFO("Batches that cannot be sent are kept and sent on a later tick");
+    channel_stub->fail_sends = true;
+    REQUIRE(!user_frontend_backup.process(ctx).has_value());
+    REQUIRE(channel_stub->is_empty());
+
+    INFO("Further commands are not forwarded while the batch is waiting");
+    const auto failed = user_frontend_backup.process(ctx);
+    REQUIRE(failed.has_value());
+    auto response = jsonrpc::unpack(failed.value(), default_pack);
+    CHECK(
+      response[jsonrpc::ERR][jsonrpc::CODE] ==
+      static_cast<jsonrpc::ErrorBaseType>(
+        jsonrpc::CCFErrorCodes::RPC_NOT_FORWARDED));
+
+    small_batch_forwarder->tick(std::chrono::milliseconds(max_delay_ms));
+    REQUIRE(channel_stub->is_empty());
+
+    channel_stub->fail_sends = false;
+    small_batch_forwarder->tick(std::chrono::milliseconds(max_delay_ms));
+    REQUIRE(channel_stub->size() == 1);
+
+    size_t received = 0;
+    auto batch = channel_stub->get_pop_back();
+    REQUIRE(small_batch_forwarder->recv_forwarded_batch(
+      batch.data(),
+      batch.size(),
+      [&](ForwardedMsg msg_type, NodeId, const uint8_t*, size_t) {
+        CHECK(msg_type == ForwardedMsg::forwarded_cmd);
+        received++;
+      }));
+    CHECK(received == 1);
+  }
+
+  {
+    INFO("Truncated batches are rejected");
+    std::vector<uint8_t> truncated(sizeof(ForwardedMsg) + sizeof(size_t));
+    auto data = truncated.data();
+    auto size = truncated.size();
+    serialized::write(data, size, ForwardedMsg::forwarded_cmd);
+    serialized::write(data, size, (size_t)1);
+    CHECK_FALSE(backup_forwarder->recv_forwarded_batch(
+      truncated.data(),
+      truncated.size(),
+      [](ForwardedMsg, NodeId, const uint8_t*, size_t) {}));
+  }
+}
+
 TEST_CASE("App-defined errors")
 {
   prepare_callers();
@@ -16,6 +16,8 @@ namespace ccf
     ObjectId index;
     ObjectId term;
     ObjectId commit;
+    // Frontier of the Merkle tree at index, from which the tree can be
+    // resumed. Its size does not depend on the length of the ledger.
     std::vector<uint8_t> tree;
 
     MSGPACK_DEFINE(MSGPACK_BASE(RawSignature), node, index, term, commit, tree);
@@ -0,0 +1,31 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/json.h"
+#include "entities.h"
+
+#include <msgpack.hpp>
+#include <vector>
+
+namespace ccf
+{
+  // SnapshotEvidenceId is used as the key of the SNAPSHOT_EVIDENCE table. Only
+  // the latest snapshot is recorded, so this key is always 0.
+  using SnapshotEvidenceId = uint64_t;
+
+  struct SnapshotEvidence
+  {
+    // Version of the store captured by the snapshot
+    kv::Version version;
+
+    // Hash chained over the chunks of the snapshot, in order
+    std::vector<uint8_t> hash;
+
+    MSGPACK_DEFINE(version, hash);
+  };
+  DECLARE_JSON_TYPE(SnapshotEvidence);
+  DECLARE_JSON_REQUIRED_FIELDS(SnapshotEvidence, version, hash);
+
+  using SnapshotEvidences = Store::Map<SnapshotEvidenceId, SnapshotEvidence>;
+}
@@ -0,0 +1,120 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "consensus/ledgerenclavetypes.h"
+#include "crypto/hash.h"
+#include "ds/logger.h"
+#include "ds/ringbuffer_types.h"
+#include "history.h"
+#include "networkstate.h"
+#include "snapshotevidence.h"
+
+#include <vector>
+
+namespace ccf
+{
+  /// Periodically snapshots the store on the primary. Snapshots are written
+  /// by the host next to the ledger, in chunks: the first chunk is the
+  /// frontier of the Merkle tree of the history at the snapshot version, and
+  /// the following ones are the store's chunks, in order. Once a snapshot has
+  /// been written, its hash is recorded in the snapshot evidence table, so
+  /// that a node starting from the snapshot can check it against the ledger.
+  class Snapshotter
+  {
+  public:
+    // Maximum number of key-value entries in each chunk of a snapshot
+    static constexpr size_t max_chunk_entries = 1000;
+
+    /// Hash of a snapshot, chained over its chunks
+    static crypto::Sha256Hash hash_chunk(
+      const crypto::Sha256Hash& h, const std::vector<uint8_t>& chunk)
+    {
+      return crypto::Sha256Hash({{h.h, h.SIZE}, {chunk.data(), chunk.size()}});
+    }
+
+  private:
+    ringbuffer::WriterPtr to_host;
+    NetworkState& network;
+
+    // Number of committed transactions between two snapshots
+    const size_t interval;
+    kv::Version last_snapshot_idx = 0;
+
+    // Snapshot captured once due, along with the frontier of the Merkle tree
+    // at its version, and written once the local ledger is durable up to
+    // that version
+    std::unique_ptr<kv::StoreSnapshot<StoreSerialiser>> pending_snapshot;
+    std::vector<uint8_t> pending_tree;
+
+  public:
+    Snapshotter(
+      ringbuffer::AbstractWriterFactory& writer_factory,
+      NetworkState& network,
+      size_t interval) :
+      to_host(writer_factory.create_writer_to_outside()),
+      network(network),
+      interval(interval)
+    {}
+
+    void set_last_snapshot_idx(kv::Version idx)
+    {
+      last_snapshot_idx = idx;
+    }
+
+    /// Called periodically on the primary. Captures the store at its last
+    /// committed version, if enough transactions have been committed since
+    /// the last snapshot. The snapshot is only written once the local ledger
+    /// is durable up to its version, so that a node restarting from the
+    /// snapshot never finds its ledger behind it. As the captured version
+    /// does not move, the snapshot is taken even if the durable index always
+    /// lags the commit index.
+    void maybe_snapshot(MerkleTxHistory& history, kv::Version durable_idx)
+    {
+      if (interval == 0)
+        return;
+
+      if (pending_snapshot == nullptr)
+      {
+        auto commit_version = network.tables->commit_version();
+        if (commit_version < last_snapshot_idx + interval)
+          return;
+
+        pending_snapshot = network.tables->snapshot();
+        pending_tree =
+          history.get_full_state_tree(pending_snapshot->get_version());
+      }
+
+      auto v = pending_snapshot->get_version();
+      if (v > durable_idx)
+        return;
+
+      auto snapshot = std::move(pending_snapshot);
+      const consensus::Index idx = v;
+
+      crypto::Sha256Hash h;
+      size_t chunks = 0;
+      auto write_chunk = [this, idx, &h, &chunks](
+                           std::vector<uint8_t>&& chunk) {
+        h = hash_chunk(h, chunk);
+        chunks++;
+        RINGBUFFER_WRITE_MESSAGE(
+          consensus::snapshot_put_chunk, to_host, idx, chunk);
+      };
+
+      write_chunk(std::move(pending_tree));
+      pending_tree.clear();
+      snapshot->serialise(max_chunk_entries, write_chunk);
+      RINGBUFFER_WRITE_MESSAGE(consensus::snapshot_commit, to_host, idx);
+
+      last_snapshot_idx = v;
+      LOG_INFO_FMT("Snapshot at {}: {} chunks, hash {}", v, chunks, h);
+
+      Store::Tx tx;
+      auto evidence_view = tx.get_view(network.snapshot_evidence);
+      evidence_view->put(0, {v, {h.h, h.h + h.SIZE}});
+      if (tx.commit() != kv::CommitSuccess::OK)
+        LOG_FAIL_FMT("Could not record evidence of snapshot at {}", v);
+    }
+  };
+}
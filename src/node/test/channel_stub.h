@@ -14,12 +14,23 @@ namespace ccf
   public:
     std::vector<std::vector<uint8_t>> sent_encrypted_messages;
 
+    // If set, messages are not sent, as if the channel could not be used
+    bool fail_sends = false;
+
     ChannelStubProxy() {}
 
+    bool try_establish_channel(NodeId to)
+    {
+      return true;
+    }
+
     template <class T>
     bool send_encrypted(
       NodeId to, const std::vector<uint8_t>& data, const T& msg)
     {
+      if (fail_sends)
+        return false;
+
       sent_encrypted_messages.push_back(data);
       return true;
     }
@@ -3,8 +3,11 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 
 #include "../channels.h"
+#include "../nodetonode.h"
+#include "ds/ringbuffer.h"
 
 #include <doctest/doctest.h>
+#include <thread>
 
 using namespace ccf;
 
@@ -202,3 +205,232 @@ TEST_CASE("Channel manager")
     REQUIRE(plain == decrypted);
   }
 }
+
+#pragma pack(push, 1)
+struct TestMsg : Header
+{
+  uint64_t value;
+};
+#pragma pack(pop)
+
+static std::vector<std::vector<uint8_t>> read_outbound(
+  ringbuffer::Circuit& eio)
+{
+  std::vector<std::vector<uint8_t>> msgs;
+  eio.read_from_inside().read(
+    -1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+      REQUIRE(m == node_outbound);
+      serialized::read<NodeId>(data, size);
+      msgs.emplace_back(data, data + size);
+    });
+  return msgs;
+}
+
+TEST_CASE("Coalesced consensus messages")
+{
+  NodeId id1 = 1;
+  NodeId id2 = 2;
+  auto network_pkey = tls::make_key_pair()->private_key_pem();
+
+  ringbuffer::Circuit eio1(1 << 16);
+  ringbuffer::Circuit eio2(1 << 16);
+  ringbuffer::WriterFactory writer_factory1(eio1);
+  ringbuffer::WriterFactory writer_factory2(eio2);
+
+  NodeToNode n2n1(writer_factory1);
+  NodeToNode n2n2(writer_factory2);
+  n2n1.initialize(id1, network_pkey, true);
+  n2n2.initialize(id2, network_pkey, true);
+
+  auto recv_values = [&](const std::vector<uint8_t>& frame) {
+    const uint8_t* data = frame.data();
+    auto size = frame.size();
+    REQUIRE(
+      serialized::read<NodeMsgType>(data, size) ==
+      NodeMsgType::consensus_coalesced_msg);
+
+    std::vector<uint64_t> values;
+    n2n2.recv_authenticated_coalesced(
+      data, size, [&](const uint8_t* data, size_t size) {
+        uint64_t value = n2n2.recv_authenticated<TestMsg>(data, size).value;
+        values.push_back(value);
+      });
+    return values;
+  };
+
+  INFO("Establish channel");
+  {
+    TestMsg msg = {{0, id1}, 0};
+    REQUIRE_FALSE(n2n1.send_authenticated_coalesced(
+      NodeMsgType::consensus_msg, id2, msg));
+
+    auto ke = read_outbound(eio1);
+    REQUIRE(ke.size() == 1);
+    n2n2.recv_message(
+      ke[0].data() + sizeof(NodeMsgType), ke[0].size() - sizeof(NodeMsgType));
+
+    auto ke_response = read_outbound(eio2);
+    REQUIRE(ke_response.size() == 1);
+    n2n1.recv_message(
+      ke_response[0].data() + sizeof(NodeMsgType),
+      ke_response[0].size() - sizeof(NodeMsgType));
+  }
+
+  INFO("Messages are held until flushed, and sent in a single frame");
+  {
+    for (uint64_t i = 1; i <= 3; ++i)
+    {
+      TestMsg msg = {{0, id1}, i};
+      REQUIRE(n2n1.send_authenticated_coalesced(
+        NodeMsgType::consensus_msg, id2, msg));
+    }
+    REQUIRE(read_outbound(eio1).empty());
+
+    n2n1.flush();
+    auto frames = read_outbound(eio1);
+    REQUIRE(frames.size() == 1);
+    REQUIRE(recv_values(frames[0]) == std::vector<uint64_t>{1, 2, 3});
+
+    n2n1.flush();
+    REQUIRE(read_outbound(eio1).empty());
+  }
+
+  INFO("Coalesced messages are sent before later messages");
+  {
+    TestMsg msg = {{0, id1}, 4};
+    n2n1.send_authenticated_coalesced(NodeMsgType::consensus_msg, id2, msg);
+    msg.value = 5;
+    n2n1.send_authenticated(NodeMsgType::consensus_msg, id2, msg);
+
+    auto frames = read_outbound(eio1);
+    REQUIRE(frames.size() == 2);
+    REQUIRE(recv_values(frames[0]) == std::vector<uint64_t>{4});
+
+    const uint8_t* data = frames[1].data();
+    auto size = frames[1].size();
+    REQUIRE(
+      serialized::read<NodeMsgType>(data, size) == NodeMsgType::consensus_msg);
+    REQUIRE(n2n2.recv_authenticated<TestMsg>(data, size).value == 5);
+  }
+
+  INFO("Tampered frames are rejected");
+  {
+    TestMsg msg = {{0, id1}, 6};
+    n2n1.send_authenticated_coalesced(NodeMsgType::consensus_msg, id2, msg);
+    n2n1.flush();
+
+    auto frames = read_outbound(eio1);
+    REQUIRE(frames.size() == 1);
+    frames[0][frames[0].size() - sizeof(GcmHdr) - 1]++;
+    REQUIRE_THROWS_AS(recv_values(frames[0]), std::logic_error);
+  }
+
+  INFO("Messages from another node than the sender are rejected");
+  {
+    TestMsg msg = {{0, 3}, 7};
+    n2n1.send_authenticated_coalesced(NodeMsgType::consensus_msg, id2, msg);
+    n2n1.flush();
+
+    auto frames = read_outbound(eio1);
+    REQUIRE(frames.size() == 1);
+    REQUIRE_THROWS_AS(recv_values(frames[0]), std::logic_error);
+  }
+}
+
+TEST_CASE("Concurrent use of channels")
+{
+  // Worker threads forward commands over the channels that the consensus
+  // thread uses at the same time. Run under TSan to detect races.
+  NodeId id1 = 1;
+  NodeId id2 = 2;
+  auto network_pkey = tls::make_key_pair()->private_key_pem();
+
+  ringbuffer::Circuit eio1(1 << 20);
+  ringbuffer::Circuit eio2(1 << 16);
+  ringbuffer::WriterFactory writer_factory1(eio1);
+  ringbuffer::WriterFactory writer_factory2(eio2);
+
+  NodeToNode n2n1(writer_factory1);
+  NodeToNode n2n2(writer_factory2);
+  n2n1.initialize(id1, network_pkey);
+  n2n2.initialize(id2, network_pkey);
+
+  constexpr size_t thread_count = 4;
+  constexpr size_t msg_count = 50;
+
+  INFO("Channel is established while workers try to use it");
+  {
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < thread_count; ++t)
+    {
+      workers.emplace_back([&]() {
+        for (size_t i = 0; i < msg_count; ++i)
+          n2n1.try_establish_channel(id2);
+      });
+    }
+
+    TestMsg msg = {{0, id1}, 0};
+    n2n1.send_authenticated(NodeMsgType::consensus_msg, id2, msg);
+    for (auto& w : workers)
+      w.join();
+
+    // All key exchange messages carry the same public key
+    auto ke = read_outbound(eio1);
+    REQUIRE(!ke.empty());
+    n2n2.recv_message(
+      ke[0].data() + sizeof(NodeMsgType), ke[0].size() - sizeof(NodeMsgType));
+
+    auto ke_response = read_outbound(eio2);
+    REQUIRE(ke_response.size() == 1);
+    n2n1.recv_message(
+      ke_response[0].data() + sizeof(NodeMsgType),
+      ke_response[0].size() - sizeof(NodeMsgType));
+  }
+
+  INFO("Messages encrypted and tagged concurrently can all be read");
+  {
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < thread_count; ++t)
+    {
+      workers.emplace_back([&, t]() {
+        std::vector<uint8_t> plain(64, static_cast<uint8_t>(t));
+        ForwardedHeader header = {ForwardedMsg::forwarded_cmd, id1};
+        for (size_t i = 0; i < msg_count; ++i)
+          n2n1.send_encrypted(id2, plain, header);
+      });
+    }
+
+    for (uint64_t i = 0; i < msg_count; ++i)
+    {
+      TestMsg msg = {{0, id1}, i};
+      REQUIRE(n2n1.send_authenticated(NodeMsgType::consensus_msg, id2, msg));
+    }
+    for (auto& w : workers)
+      w.join();
+
+    auto msgs = read_outbound(eio1);
+    REQUIRE(msgs.size() == thread_count * msg_count + msg_count);
+
+    size_t forwarded = 0;
+    for (auto& m : msgs)
+    {
+      const uint8_t* data = m.data();
+      auto size = m.size();
+      auto type = serialized::read<NodeMsgType>(data, size);
+      if (type == NodeMsgType::forwarded_msg)
+      {
+        auto [header, plain] =
+          n2n2.recv_encrypted<ForwardedHeader>(data, size);
+        REQUIRE(header.from_node == id1);
+        REQUIRE(plain.size() == 64);
+        forwarded++;
+      }
+      else
+      {
+        REQUIRE(type == NodeMsgType::consensus_msg);
+        n2n2.recv_authenticated<TestMsg>(data, size);
+      }
+    }
+    REQUIRE(forwarded == thread_count * msg_count);
+  }
+}
@@ -0,0 +1,152 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT
+#include "consensus/raft/rafttypes.h"
+#include "ds/ringbuffer.h"
+#include "node/nodetonode.h"
+
+#include <picobench/picobench.hpp>
+
+extern "C"
+{
+#include <evercrypt/EverCrypt_AutoConfig2.h>
+}
+
+using namespace ccf;
+
+// Two nodes with an established channel, whose outbound messages are read
+// straight from their ringbuffers
+struct Nodes
+{
+  static constexpr NodeId id1 = 1;
+  static constexpr NodeId id2 = 2;
+
+  ringbuffer::Circuit eio1;
+  ringbuffer::Circuit eio2;
+  ringbuffer::WriterFactory writer_factory1;
+  ringbuffer::WriterFactory writer_factory2;
+  NodeToNode n2n1;
+  NodeToNode n2n2;
+
+  Nodes(bool coalesce) :
+    eio1(1 << 20),
+    eio2(1 << 20),
+    writer_factory1(eio1),
+    writer_factory2(eio2),
+    n2n1(writer_factory1),
+    n2n2(writer_factory2)
+  {
+    auto network_pkey = tls::make_key_pair()->private_key_pem();
+    n2n1.initialize(id1, network_pkey, coalesce);
+    n2n2.initialize(id2, network_pkey, coalesce);
+
+    // The first message sent triggers the key exchange
+    n2n1.send_authenticated(NodeMsgType::consensus_msg, id2, response(0));
+    deliver(eio1, [this](const uint8_t* data, size_t size) {
+      n2n2.recv_message(data, size);
+    });
+    deliver(eio2, [this](const uint8_t* data, size_t size) {
+      n2n1.recv_message(data, size);
+    });
+  }
+
+  static raft::AppendEntriesResponse response(raft::Index idx)
+  {
+    return {raft::raft_append_entries_response, id1, 1, idx, true};
+  }
+
+  // Passes each message sent by a node to f, after its message type
+  template <typename F>
+  static void deliver(ringbuffer::Circuit& eio, F&& f)
+  {
+    eio.read_from_inside().read(
+      -1, [&f](ringbuffer::Message m, const uint8_t* data, size_t size) {
+        serialized::read<NodeId>(data, size);
+        serialized::read<NodeMsgType>(data, size);
+        f(data, size);
+      });
+  }
+};
+
+// Append entries responses sent by a follower to the leader, in groups of B
+// per tick, each authenticated on its own
+template <size_t B>
+static void authenticated(picobench::state& s)
+{
+  Nodes nodes(false);
+  size_t received = 0;
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); i += B)
+  {
+    for (size_t j = 0; j < B; ++j)
+      nodes.n2n1.send_authenticated(
+        NodeMsgType::consensus_msg, Nodes::id2, Nodes::response(i + j));
+
+    nodes.deliver(nodes.eio1, [&](const uint8_t* data, size_t size) {
+      nodes.n2n2.recv_authenticated<raft::AppendEntriesResponse>(data, size);
+      received++;
+    });
+  }
+  s.stop_timer();
+
+  s.set_result(received);
+}
+
+// The same responses, coalesced in a single authenticated frame per tick
+template <size_t B>
+static void coalesced(picobench::state& s)
+{
+  Nodes nodes(true);
+  size_t received = 0;
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); i += B)
+  {
+    for (size_t j = 0; j < B; ++j)
+      nodes.n2n1.send_authenticated_coalesced(
+        NodeMsgType::consensus_msg, Nodes::id2, Nodes::response(i + j));
+    nodes.n2n1.flush();
+
+    nodes.deliver(nodes.eio1, [&](const uint8_t* data, size_t size) {
+      nodes.n2n2.recv_authenticated_coalesced(
+        data, size, [&](const uint8_t* data, size_t size) {
+          nodes.n2n2.recv_authenticated<raft::AppendEntriesResponse>(
+            data, size);
+          received++;
+        });
+    });
+  }
+  s.stop_timer();
+
+  s.set_result(received);
+}
+
+const std::vector<int> message_count = {1024, 16384};
+
+PICOBENCH_SUITE("per_tick_1");
+PICOBENCH(authenticated<1>).iterations(message_count).baseline();
+PICOBENCH(coalesced<1>).iterations(message_count);
+
+PICOBENCH_SUITE("per_tick_4");
+PICOBENCH(authenticated<4>).iterations(message_count).baseline();
+PICOBENCH(coalesced<4>).iterations(message_count);
+
+PICOBENCH_SUITE("per_tick_16");
+PICOBENCH(authenticated<16>).iterations(message_count).baseline();
+PICOBENCH(coalesced<16>).iterations(message_count);
+
+PICOBENCH_SUITE("per_tick_64");
+PICOBENCH(authenticated<64>).iterations(message_count).baseline();
+PICOBENCH(coalesced<64>).iterations(message_count);
+
+// We need an explicit main to initialize kremlib and EverCrypt
+int main(int argc, char* argv[])
+{
+  ::EverCrypt_AutoConfig2_init();
+  logger::config::level() = logger::FATAL;
+
+  picobench::runner runner;
+  runner.parse_cmd_line(argc, argv);
+  return runner.run();
+}
@@ -0,0 +1,286 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT
+#include "ds/logger.h"
+#include "node/encryptor.h"
+#include "node/networksecrets.h"
+
+#include <fstream>
+#include <iostream>
+#include <picobench/picobench.hpp>
+
+extern "C"
+{
+#include <evercrypt/EverCrypt_AutoConfig2.h>
+}
+
+using namespace ccf;
+
+inline void clobber_memory()
+{
+  asm volatile("" : : : "memory");
+}
+
+// Entries are encrypted from and to a pool of buffers, reused across
+// iterations, so that large payloads do not need as many buffers
+static constexpr size_t pool_size = 64;
+
+static std::shared_ptr<TxEncryptor> make_encryptor(bool aesni)
+{
+  ::EverCrypt_AutoConfig2_init();
+  if (!aesni)
+    ::EverCrypt_AutoConfig2_disable_aesni();
+
+  Secret secret({}, {}, std::vector<uint8_t>(16, 0x1));
+  NetworkSecrets secrets(0, secret);
+  auto encryptor = std::make_shared<TxEncryptor>(0, secrets);
+
+  ::EverCrypt_AutoConfig2_init();
+  return encryptor;
+}
+
+struct Pool
+{
+  std::vector<std::vector<uint8_t>> plains;
+  std::vector<std::vector<uint8_t>> ciphers;
+  std::vector<std::vector<uint8_t>> headers;
+  std::vector<uint8_t> additional_data;
+
+  Pool(size_t payload_size, size_t header_length) : additional_data(32, 0x2)
+  {
+    ::srand(42);
+    for (size_t i = 0; i < pool_size; i++)
+    {
+      std::vector<uint8_t> plain(payload_size);
+      for (auto& c : plain)
+        c = ::rand() % 256;
+      plains.push_back(plain);
+      ciphers.emplace_back(payload_size);
+      headers.emplace_back(header_length);
+    }
+  }
+
+  std::vector<kv::AbstractTxEncryptor::BatchEntry> entries(bool encrypt)
+  {
+    std::vector<kv::AbstractTxEncryptor::BatchEntry> entries;
+    for (size_t i = 0; i < pool_size; i++)
+    {
+      entries.push_back({encrypt ? plains[i] : ciphers[i],
+                         additional_data,
+                         headers[i].data(),
+                         encrypt ? ciphers[i].data() : plains[i].data(),
+                         0});
+    }
+    return entries;
+  }
+};
+
+// Encrypts entries of P bytes one at a time, through vectors
+template <size_t P, bool AESNI>
+static void encrypt_one(picobench::state& s)
+{
+  auto encryptor = make_encryptor(AESNI);
+  Pool pool(P, encryptor->get_header_length());
+
+  size_t idx = 0;
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    auto i = idx++ % pool_size;
+    encryptor->encrypt(
+      pool.plains[i],
+      pool.additional_data,
+      pool.headers[i],
+      pool.ciphers[i],
+      0);
+    clobber_memory();
+  }
+  s.stop_timer();
+  s.set_result(P);
+}
+
+template <size_t P>
+static void encrypt_mbedtls(picobench::state& s)
+{
+  encrypt_one<P, false>(s);
+}
+
+template <size_t P>
+static void encrypt_evercrypt(picobench::state& s)
+{
+  encrypt_one<P, true>(s);
+}
+
+// Encrypts entries of P bytes pool_size at a time, into the same buffers
+template <size_t P>
+static void encrypt_batch(picobench::state& s)
+{
+  auto encryptor = make_encryptor(true);
+  Pool pool(P, encryptor->get_header_length());
+  auto entries = pool.entries(true);
+
+  const size_t n = s.iterations();
+  s.start_timer();
+  for (size_t i = 0; i < n; i += pool_size)
+  {
+    encryptor->encrypt_batch(entries.data(), std::min(pool_size, n - i));
+    clobber_memory();
+  }
+  s.stop_timer();
+  s.set_result(P);
+}
+
+template <size_t P, bool AESNI>
+static void decrypt_one(picobench::state& s)
+{
+  auto encryptor = make_encryptor(AESNI);
+  Pool pool(P, encryptor->get_header_length());
+  for (size_t i = 0; i < pool_size; i++)
+  {
+    encryptor->encrypt(
+      pool.plains[i],
+      pool.additional_data,
+      pool.headers[i],
+      pool.ciphers[i],
+      0);
+  }
+
+  size_t idx = 0;
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    auto i = idx++ % pool_size;
+    encryptor->decrypt(
+      pool.ciphers[i],
+      pool.additional_data,
+      pool.headers[i],
+      pool.plains[i],
+      0);
+    clobber_memory();
+  }
+  s.stop_timer();
+  s.set_result(P);
+}
+
+template <size_t P>
+static void decrypt_mbedtls(picobench::state& s)
+{
+  decrypt_one<P, false>(s);
+}
+
+template <size_t P>
+static void decrypt_evercrypt(picobench::state& s)
+{
+  decrypt_one<P, true>(s);
+}
+
+template <size_t P>
+static void decrypt_batch(picobench::state& s)
+{
+  auto encryptor = make_encryptor(true);
+  Pool pool(P, encryptor->get_header_length());
+  encryptor->encrypt_batch(pool.entries(true).data(), pool_size);
+  auto entries = pool.entries(false);
+
+  const size_t n = s.iterations();
+  s.start_timer();
+  for (size_t i = 0; i < n; i += pool_size)
+  {
+    encryptor->decrypt_batch(entries.data(), std::min(pool_size, n - i));
+    clobber_memory();
+  }
+  s.stop_timer();
+  s.set_result(P);
+}
+
+const std::vector<int> sizes = {1000};
+
+PICOBENCH_SUITE("encrypt_256B");
+PICOBENCH(encrypt_mbedtls<256>).iterations(sizes).samples(10).baseline();
+PICOBENCH(encrypt_evercrypt<256>).iterations(sizes).samples(10);
+PICOBENCH(encrypt_batch<256>).iterations(sizes).samples(10);
+
+PICOBENCH_SUITE("encrypt_4KB");
+PICOBENCH(encrypt_mbedtls<4096>).iterations(sizes).samples(10).baseline();
+PICOBENCH(encrypt_evercrypt<4096>).iterations(sizes).samples(10);
+PICOBENCH(encrypt_batch<4096>).iterations(sizes).samples(10);
+
+PICOBENCH_SUITE("encrypt_64KB");
+PICOBENCH(encrypt_mbedtls<65536>).iterations(sizes).samples(10).baseline();
+PICOBENCH(encrypt_evercrypt<65536>).iterations(sizes).samples(10);
+PICOBENCH(encrypt_batch<65536>).iterations(sizes).samples(10);
+
+PICOBENCH_SUITE("decrypt_256B");
+PICOBENCH(decrypt_mbedtls<256>).iterations(sizes).samples(10).baseline();
+PICOBENCH(decrypt_evercrypt<256>).iterations(sizes).samples(10);
+PICOBENCH(decrypt_batch<256>).iterations(sizes).samples(10);
+
+PICOBENCH_SUITE("decrypt_4KB");
+PICOBENCH(decrypt_mbedtls<4096>).iterations(sizes).samples(10).baseline();
+PICOBENCH(decrypt_evercrypt<4096>).iterations(sizes).samples(10);
+PICOBENCH(decrypt_batch<4096>).iterations(sizes).samples(10);
+
+PICOBENCH_SUITE("decrypt_64KB");
+PICOBENCH(decrypt_mbedtls<65536>).iterations(sizes).samples(10).baseline();
+PICOBENCH(decrypt_evercrypt<65536>).iterations(sizes).samples(10);
+PICOBENCH(decrypt_batch<65536>).iterations(sizes).samples(10);
+
+// Each benchmark returns the size of its payloads, from which its throughput
+// is reported, along with the usual report
+static void print_throughput(const picobench::report& report)
+{
+  std::cout << "Throughput (GB/s)" << std::endl;
+  for (const auto& suite : report.suites)
+  {
+    for (const auto& bm : suite.benchmarks)
+    {
+      for (const auto& d : bm.data)
+      {
+        const double bytes = double(d.dimension) * double(d.result);
+        std::cout << suite.name << "," << bm.name << ","
+                  << bytes / double(d.total_time_ns) << std::endl;
+      }
+    }
+  }
+}
+
+// We need an explicit main to initialize EverCrypt, and to report throughput
+int main(int argc, char* argv[])
+{
+  ::EverCrypt_AutoConfig2_init();
+  logger::config::level() = logger::FATAL;
+
+  picobench::runner runner;
+  runner.parse_cmd_line(argc, argv);
+  if (!runner.should_run())
+    return runner.error();
+
+  runner.run_benchmarks();
+  auto report = runner.generate_report();
+
+  std::ostream* out = &std::cout;
+  std::ofstream fout;
+  if (runner.preferred_output_filename())
+  {
+    fout.open(runner.preferred_output_filename());
+    out = &fout;
+  }
+
+  switch (runner.preferred_output_format())
+  {
+    case picobench::report_output_format::text:
+      report.to_text(*out);
+      break;
+    case picobench::report_output_format::concise_text:
+      report.to_text_concise(*out);
+      break;
+    case picobench::report_output_format::csv:
+      report.to_csv(*out);
+      break;
+  }
+
+  print_throughput(report);
+  return runner.error();
+}
@@ -11,7 +11,9 @@
 #include "node/nodes.h"
 #include "node/signatures.h"
 
+#include <atomic>
 #include <doctest/doctest.h>
+#include <thread>
 
 extern "C"
 {
@@ -498,6 +500,277 @@ TEST_CASE(
   }
 }
 
+static crypto::Sha256Hash random_hash()
+{
+  crypto::Sha256Hash h;
+  for (size_t i = 0; i < h.SIZE; ++i)
+    h.h[i] = rand();
+  return h;
+}
+
+TEST_CASE("Merkle tree can be resumed from its frontier")
+{
+  for (size_t n : {1, 2, 3, 8, 100, 1023, 1024, 5000})
+  {
+    INFO("With " << n << " entries");
+    ccf::MerkleTreeHistory tree;
+    for (size_t i = 0; i < n; ++i)
+      tree.append(random_hash());
+    if (n > 10)
+      tree.flush(n - 10);
+
+    auto frontier = tree.serialise_frontier();
+    REQUIRE(frontier.size() < 4096);
+
+    ccf::MerkleTreeHistory resumed(frontier);
+    REQUIRE(resumed.get_root() == tree.get_root());
+
+    // mt_insert overwrites the hash it is given
+    for (size_t i = 0; i < 100; ++i)
+    {
+      auto h = random_hash();
+      auto h_ = h;
+      tree.append(h);
+      resumed.append(h_);
+      REQUIRE(resumed.get_root() == tree.get_root());
+    }
+
+    resumed.flush(resumed.end_index() - 10);
+    tree.retract(tree.end_index() - 5);
+    resumed.retract(resumed.end_index() - 5);
+    REQUIRE(resumed.get_root() == tree.get_root());
+
+    INFO("Frontier at an earlier index");
+    {
+      auto index = tree.end_index() - 3;
+      ccf::MerkleTreeHistory full(tree.serialise(index));
+      ccf::MerkleTreeHistory partial(tree.serialise_frontier(index));
+      REQUIRE(partial.get_root() == full.get_root());
+    }
+  }
+}
+
+TEST_CASE("Receipts can be produced for ranges of entries")
+{
+  for (size_t n : {1, 2, 3, 8, 100, 1023, 1024, 5000})
+  {
+    INFO("With " << n << " entries");
+    ccf::MerkleTreeHistory tree;
+    for (size_t i = 0; i < n; ++i)
+      tree.append(random_hash());
+
+    auto receipts = tree.get_receipts(0, tree.end_index());
+    REQUIRE(receipts.size() == tree.end_index() + 1);
+    for (size_t i = 0; i < receipts.size(); ++i)
+    {
+      REQUIRE(receipts[i] == tree.get_receipt(i).to_v());
+      REQUIRE(tree.verify(ccf::Receipt::from_v(receipts[i])));
+    }
+
+    INFO("Receipts for flushed entries are still produced");
+    {
+      tree.flush(tree.end_index());
+      auto flushed = tree.get_receipts(0, tree.end_index());
+      REQUIRE(flushed == receipts);
+
+      tree.append(random_hash());
+      for (auto& r : tree.get_receipts(0, tree.end_index()))
+        REQUIRE(tree.verify(ccf::Receipt::from_v(r)));
+    }
+  }
+
+  INFO("The oldest flushed entries are forgotten");
+  {
+    ccf::MerkleTreeHistory tree;
+    for (size_t i = 0; i < MAX_FLUSHED_HISTORY_LEN + 10; ++i)
+      tree.append(random_hash());
+    tree.flush(tree.end_index());
+    REQUIRE_THROWS_AS(tree.get_receipts(0, 1), std::logic_error);
+    auto from = tree.end_index() - MAX_FLUSHED_HISTORY_LEN;
+    REQUIRE(tree.get_receipts(from, from + 1).size() == 2);
+  }
+}
+
+TEST_CASE("Merkle roots are only computed on demand")
+{
+  INFO("Roots are cached until the tree changes");
+  {
+    ccf::MerkleTreeHistory tree;
+    tree.append(random_hash());
+    auto root = tree.get_root();
+    REQUIRE(tree.get_roots_computed() == 1);
+    REQUIRE(tree.get_root() == root);
+    REQUIRE(tree.get_roots_computed() == 1);
+
+    tree.append(random_hash());
+    REQUIRE(tree.get_root() != root);
+    REQUIRE(tree.get_roots_computed() == 2);
+
+    tree.retract(tree.end_index() - 1);
+    REQUIRE(tree.get_root() == root);
+    REQUIRE(tree.get_roots_computed() == 3);
+  }
+
+#ifndef PBFT
+  INFO("Committing transactions does not compute roots");
+  {
+    Store store;
+    auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+    store.set_encryptor(encryptor);
+    auto& nodes = store.create<ccf::Nodes>(
+      ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+    auto& signatures = store.create<ccf::Signatures>(
+      ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+    auto& table = store.create<size_t, size_t>("table");
+
+    auto kp = tls::make_key_pair();
+    std::shared_ptr<kv::Consensus> consensus =
+      std::make_shared<DummyConsensus>(nullptr);
+    store.set_consensus(consensus);
+    std::shared_ptr<kv::TxHistory> history =
+      std::make_shared<ccf::MerkleTxHistory>(
+        store, 0, *kp, signatures, nodes);
+    store.set_history(history);
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+      Store::Tx tx;
+      auto view = tx.get_view(table);
+      view->put(i, i);
+      REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    }
+    REQUIRE(history->get_roots_computed() == 0);
+
+    auto root = history->get_full_state_root();
+    REQUIRE(history->get_roots_computed() == 1);
+    REQUIRE(history->get_full_state_root() == root);
+    REQUIRE(history->get_roots_computed() == 1);
+  }
+#endif
+}
+
+TEST_CASE("Requests are kept until their version is compacted")
+{
+  Store store;
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  store.set_encryptor(encryptor);
+  auto& nodes =
+    store.create<ccf::Nodes>(ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+  auto& signatures = store.create<ccf::Signatures>(
+    ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+  auto& table = store.create<size_t, size_t>("table");
+
+  auto kp = tls::make_key_pair();
+  std::shared_ptr<kv::Consensus> consensus =
+    std::make_shared<DummyConsensus>(nullptr);
+  store.set_consensus(consensus);
+  auto history = std::make_shared<ccf::MerkleTxHistory>(
+    store, 0, *kp, signatures, nodes);
+  store.set_history(history);
+
+  const std::vector<uint8_t> request(100, 1);
+  std::vector<kv::TxHistory::RequestID> ids;
+  for (size_t i = 0; i < 3; ++i)
+  {
+    kv::TxHistory::RequestID id = {0, 0, i};
+    REQUIRE(history->add_request(id, 0, 0, {}, request));
+    ids.push_back(id);
+
+    Store::Tx tx;
+    tx.set_req_id(id);
+    auto view = tx.get_view(table);
+    view->put(i, i);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  REQUIRE(history->get_request_cache_stats().entries == 3);
+  REQUIRE(history->get_request_cache_stats().bytes == 3 * request.size());
+  REQUIRE(history->get_request(ids[0]) == request);
+
+  history->compact(store.current_version() - 1);
+  REQUIRE_FALSE(history->get_request(ids[0]).has_value());
+  REQUIRE_FALSE(history->get_request(ids[1]).has_value());
+  REQUIRE(history->get_request(ids[2]) == request);
+
+  auto stats = history->get_request_cache_stats();
+  REQUIRE(stats.entries == 1);
+  REQUIRE(stats.bytes == request.size());
+  REQUIRE(stats.hits == 2);
+  REQUIRE(stats.misses == 2);
+}
+
+TEST_CASE("History is shared by the committing, worker and enclave threads")
+{
+  Store store;
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  store.set_encryptor(encryptor);
+  auto& nodes =
+    store.create<ccf::Nodes>(ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+  auto& signatures = store.create<ccf::Signatures>(
+    ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+  auto& table = store.create<size_t, size_t>("table");
+
+  auto kp = tls::make_key_pair();
+  std::shared_ptr<kv::Consensus> consensus =
+    std::make_shared<DummyConsensus>(nullptr);
+  store.set_consensus(consensus);
+  auto history = std::make_shared<ccf::MerkleTxHistory>(
+    store, 0, *kp, signatures, nodes);
+  store.set_history(history);
+
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(table);
+    view->put(0, 0);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  // Versions stay below MAX_HISTORY_LEN, so that the first entry is never
+  // flushed from the tree
+  constexpr size_t tx_count = 200;
+  constexpr size_t tick_count = 100;
+  std::atomic<size_t> running(2);
+
+  std::thread committing([&]() {
+    for (size_t i = 0; i < tx_count; ++i)
+    {
+      Store::Tx tx;
+      tx.set_req_id({0, 0, i});
+      auto view = tx.get_view(table);
+      view->put(i, i);
+      REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+      Store::Tx read_only;
+      read_only.set_req_id({1, 0, i});
+      auto read_view = read_only.get_view(table);
+      read_view->get(i);
+      REQUIRE(read_only.commit() == kv::CommitSuccess::OK);
+    }
+    running--;
+  });
+
+  std::thread enclave([&]() {
+    for (size_t i = 0; i < tick_count; ++i)
+    {
+      history->emit_signature();
+      store.compact(store.current_version());
+    }
+    running--;
+  });
+
+  const std::vector<uint8_t> request(10, 1);
+  for (size_t i = 0; running.load() > 0; ++i)
+  {
+    history->add_request({1, 0, i}, 0, 0, {}, request);
+    REQUIRE(history->verify_receipt(history->get_receipt(1)));
+    history->get_request({1, 0, i});
+    history->get_request_cache_stats();
+  }
+
+  committing.join();
+  enclave.join();
+}
+
 // We need an explicit main to initialize kremlib and EverCrypt
 int main(int argc, char** argv)
 {
@@ -62,6 +62,35 @@ static void hash_only(picobench::state& s)
   s.stop_timer();
 }
 
+// Hashes B transactions of S bytes at a time
+template <size_t S, size_t B>
+static void hash_batch(picobench::state& s)
+{
+  ::srand(42);
+
+  std::vector<std::vector<uint8_t>> txs;
+  for (size_t i = 0; i < s.iterations(); i++)
+  {
+    std::vector<uint8_t> tx;
+    for (size_t j = 0; j < S; j++)
+    {
+      tx.push_back(::rand() % 256);
+    }
+    txs.push_back(tx);
+  }
+  std::vector<CBuffer> buffers(txs.begin(), txs.end());
+  std::vector<crypto::Sha256Hash> hashes(txs.size());
+
+  s.start_timer();
+  for (size_t i = 0; i < buffers.size(); i += B)
+  {
+    crypto::Sha256Hash::evercrypt_sha256_batch(
+      &buffers[i], std::min(B, buffers.size() - i), &hashes[i]);
+    clobber_memory();
+  }
+  s.stop_timer();
+}
+
 template <size_t S>
 static void hash_mbedtls_sha256(picobench::state& s)
 {
@@ -162,6 +191,48 @@ static void append(picobench::state& s)
   s.stop_timer();
 }
 
+// Adds the results of B transactions of S bytes, as a replicated batch
+template <size_t S, size_t B>
+static void append_batch(picobench::state& s)
+{
+  ::srand(42);
+
+  Store store;
+  auto& nodes = store.create<ccf::Nodes>(ccf::Tables::NODES);
+  auto& signatures = store.create<ccf::Signatures>(ccf::Tables::SIGNATURES);
+
+  auto kp = tls::make_key_pair();
+
+  std::shared_ptr<kv::Consensus> consensus = std::make_shared<DummyConsensus>();
+  store.set_consensus(consensus);
+
+  std::shared_ptr<kv::TxHistory> history =
+    std::make_shared<ccf::MerkleTxHistory>(store, 0, *kp, signatures, nodes);
+  store.set_history(history);
+
+  std::vector<std::vector<uint8_t>> txs;
+  for (size_t i = 0; i < s.iterations(); i++)
+  {
+    std::vector<uint8_t> tx;
+    for (size_t j = 0; j < S; j++)
+    {
+      tx.push_back(::rand() % 256);
+    }
+    txs.push_back(tx);
+  }
+
+  s.start_timer();
+  for (size_t i = 0; i < txs.size(); i++)
+  {
+    history->add_result({}, i + 1, nullptr, 0, txs[i].data(), txs[i].size());
+    if ((i + 1) % B == 0)
+      history->append_pending();
+    clobber_memory();
+  }
+  history->append_pending();
+  s.stop_timer();
+}
+
 template <size_t S>
 static void append_compact(picobench::state& s)
 {
@@ -211,6 +282,14 @@ PICOBENCH(hash_only<10>).iterations(sizes).samples(10).baseline();
 PICOBENCH(hash_only<100>).iterations(sizes).samples(10);
 PICOBENCH(hash_only<1000>).iterations(sizes).samples(10);
 
+PICOBENCH_SUITE("hash_batch");
+PICOBENCH(hash_batch<100, 1>).iterations(sizes).samples(10).baseline();
+PICOBENCH(hash_batch<100, 16>).iterations(sizes).samples(10);
+PICOBENCH(hash_batch<100, 256>).iterations(sizes).samples(10);
+PICOBENCH(hash_batch<1000, 1>).iterations(sizes).samples(10);
+PICOBENCH(hash_batch<1000, 16>).iterations(sizes).samples(10);
+PICOBENCH(hash_batch<1000, 256>).iterations(sizes).samples(10);
+
 PICOBENCH_SUITE("hash_mbedtls_sha256");
 PICOBENCH(hash_mbedtls_sha256<10>).iterations(sizes).samples(10).baseline();
 PICOBENCH(hash_mbedtls_sha256<100>).iterations(sizes).samples(10);
@@ -226,6 +305,14 @@ PICOBENCH(append<10>).iterations(sizes).samples(10).baseline();
 PICOBENCH(append<100>).iterations(sizes).samples(10);
 PICOBENCH(append<1000>).iterations(sizes).samples(10);
 
+PICOBENCH_SUITE("append_batch");
+PICOBENCH(append_batch<100, 1>).iterations(sizes).samples(10).baseline();
+PICOBENCH(append_batch<100, 16>).iterations(sizes).samples(10);
+PICOBENCH(append_batch<100, 256>).iterations(sizes).samples(10);
+PICOBENCH(append_batch<1000, 1>).iterations(sizes).samples(10);
+PICOBENCH(append_batch<1000, 16>).iterations(sizes).samples(10);
+PICOBENCH(append_batch<1000, 256>).iterations(sizes).samples(10);
+
 PICOBENCH_SUITE("append_compact");
 PICOBENCH(append_compact<10>).iterations(sizes).samples(10).baseline();
 PICOBENCH(append_compact<100>).iterations(sizes).samples(10);
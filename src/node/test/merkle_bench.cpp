@@ -155,6 +155,40 @@ static void append_get_receipt_verify_v(picobench::state& s)
   s.stop_timer();
 }
 
+// Produces the receipts of all entries, R at a time, or one by one with
+// get_receipt if R is 0
+template <size_t R>
+static void get_receipts(picobench::state& s)
+{
+  ccf::MerkleTreeHistory t;
+  std::random_device r;
+
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    crypto::Sha256Hash h;
+    for (size_t j = 0; j < crypto::Sha256Hash::SIZE; j++)
+      h.h[j] = r();
+    t.append(h);
+  }
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); i += std::max<size_t>(R, 1))
+  {
+    if (R == 0)
+    {
+      auto v = t.get_receipt(i).to_v();
+      do_not_optimize(v);
+    }
+    else
+    {
+      auto vs = t.get_receipts(i, std::min(i + R, s.iterations()) - 1);
+      do_not_optimize(vs);
+    }
+    clobber_memory();
+  }
+  s.stop_timer();
+}
+
 static void serialise_deserialise(picobench::state& s)
 {
   ccf::MerkleTreeHistory t;
@@ -211,6 +245,11 @@ PICOBENCH_SUITE("append_get_receipt_verify");
 PICOBENCH(append_get_receipt_verify).iterations(sizes).samples(10).baseline();
 PICOBENCH_SUITE("append_get_receipt_verify_v");
 PICOBENCH(append_get_receipt_verify_v).iterations(sizes).samples(10).baseline();
+PICOBENCH_SUITE("get_receipts");
+PICOBENCH(get_receipts<0>).iterations(sizes).samples(10).baseline();
+PICOBENCH(get_receipts<1>).iterations(sizes).samples(10);
+PICOBENCH(get_receipts<100>).iterations(sizes).samples(10);
+PICOBENCH(get_receipts<1000>).iterations(sizes).samples(10);
 PICOBENCH_SUITE("serialise_deserialise");
 PICOBENCH(serialise_deserialise).iterations(sizes).samples(10).baseline();
 // Checks the size of serialised tree, timing results are irrelevant here
@@ -0,0 +1,118 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define DOCTEST_CONFIG_IMPLEMENT
+#include "node/snapshotter.h"
+
+#include "ds/ringbuffer.h"
+#include "kv/test/stub_consensus.h"
+#include "node/encryptor.h"
+
+#include <doctest/doctest.h>
+
+extern "C"
+{
+#include <evercrypt/EverCrypt_AutoConfig2.h>
+}
+
+using namespace ccf;
+
+// Versions of the snapshots committed to the host since the last call
+static std::vector<consensus::Index> read_snapshot_commits(
+  ringbuffer::Circuit& eio)
+{
+  std::vector<consensus::Index> idxs;
+  eio.read_from_inside().read(
+    -1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+      if (m == consensus::snapshot_commit)
+        idxs.push_back(serialized::read<consensus::Index>(data, size));
+    });
+  return idxs;
+}
+
+static void commit_txs(NetworkState& network, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(network.values);
+    view->put(0, i);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+  network.tables->compact(network.tables->current_version());
+}
+
+TEST_CASE("Snapshots are taken when durability lags commit")
+{
+  NetworkState network;
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  network.tables->set_encryptor(encryptor);
+  auto consensus = std::make_shared<kv::StubConsensus>();
+  network.tables->set_consensus(consensus);
+
+  auto kp = tls::make_key_pair();
+  auto history = std::make_shared<ccf::MerkleTxHistory>(
+    *network.tables, 0, *kp, network.signatures, network.nodes);
+  network.tables->set_history(history);
+
+  ringbuffer::Circuit eio(1 << 20);
+  ringbuffer::WriterFactory writer_factory(eio);
+  constexpr size_t interval = 5;
+  Snapshotter snapshotter(writer_factory, network, interval);
+
+  INFO("No snapshot before interval transactions are committed");
+  {
+    commit_txs(network, interval - 1);
+    snapshotter.maybe_snapshot(*history, network.tables->commit_version());
+    REQUIRE(read_snapshot_commits(eio).empty());
+  }
+
+  commit_txs(network, 1);
+  const auto first_snapshot = network.tables->commit_version();
+
+  INFO("Snapshot is not written until the ledger is durable up to it");
+  {
+    snapshotter.maybe_snapshot(*history, first_snapshot - 1);
+    REQUIRE(read_snapshot_commits(eio).empty());
+  }
+
+  INFO("Snapshot is written while commit keeps running ahead of durability");
+  {
+    commit_txs(network, interval);
+    snapshotter.maybe_snapshot(
+      *history, network.tables->commit_version() - 1);
+    auto commits = read_snapshot_commits(eio);
+    REQUIRE(commits.size() == 1);
+    REQUIRE(commits[0] == first_snapshot);
+
+    Store::Tx tx;
+    auto evidence = tx.get_view(network.snapshot_evidence)->get(0);
+    REQUIRE(evidence.has_value());
+    REQUIRE(evidence->version == first_snapshot);
+  }
+
+  INFO("Next snapshot is captured at the next due commit version");
+  {
+    const auto second_snapshot = network.tables->commit_version();
+    snapshotter.maybe_snapshot(*history, second_snapshot - 1);
+    REQUIRE(read_snapshot_commits(eio).empty());
+
+    commit_txs(network, 1);
+    snapshotter.maybe_snapshot(
+      *history, network.tables->commit_version() - 1);
+    auto commits = read_snapshot_commits(eio);
+    REQUIRE(commits.size() == 1);
+    REQUIRE(commits[0] == second_snapshot);
+  }
+}
+
+// We need an explicit main to initialize kremlib and EverCrypt
+int main(int argc, char** argv)
+{
+  doctest::Context context;
+  context.applyCommandLine(argc, argv);
+  ::EverCrypt_AutoConfig2_init();
+  int res = context.run();
+  if (context.shouldExit())
+    return res;
+  return res;
+}
@@ -70,6 +70,23 @@ def cli_args(add=lambda x: None, parser=None, accept_unknown=False):
     parser.add_argument(
         "--sig-max-ms", help="Max milliseconds between signatures", type=int
     )
+    parser.add_argument(
+        "--forwarding-batch-max-delay-ms",
+        help="Max milliseconds for which forwarded requests and responses are batched (0 disables batching)",
+        type=int,
+        default=0,
+    )
+    parser.add_argument(
+        "--forwarding-batch-max-size",
+        help="Max size (bytes) of a batch of forwarded requests and responses",
+        type=int,
+    )
+    parser.add_argument(
+        "--worker-threads",
+        help="Number of additional threads executing client requests in each enclave",
+        type=int,
+        default=0,
+    )
     parser.add_argument(
         "--memory-reserve-startup",
         help="Reserve this many bytes of memory on startup, to simulate memory restrictions",
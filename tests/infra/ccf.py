@@ -46,6 +46,9 @@ class Network:
         "ignore_quote",
         "sig_max_tx",
         "sig_max_ms",
+        "forwarding_batch_max_delay_ms",
+        "forwarding_batch_max_size",
+        "worker_threads",
         "election_timeout",
         "consensus",
         "memory_reserve_startup",
@@ -515,6 +515,9 @@ class CCFRemote(object):
         ignore_quote=False,
         sig_max_tx=1000,
         sig_max_ms=1000,
+        forwarding_batch_max_delay_ms=0,
+        forwarding_batch_max_size=None,
+        worker_threads=0,
         election_timeout=1000,
         consensus="raft",
         memory_reserve_startup=0,
@@ -574,6 +577,15 @@ class CCFRemote(object):
         if sig_max_ms:
             cmd += [f"--sig-max-ms={sig_max_ms}"]
 
+        if forwarding_batch_max_delay_ms:
+            cmd += [f"--forwarding-batch-max-delay-ms={forwarding_batch_max_delay_ms}"]
+
+        if forwarding_batch_max_size:
+            cmd += [f"--forwarding-batch-max-size={forwarding_batch_max_size}"]
+
+        if worker_threads:
+            cmd += [f"--worker-threads={worker_threads}"]
+
         if memory_reserve_startup:
             cmd += [f"--memory-reserve-startup={memory_reserve_startup}"]
 
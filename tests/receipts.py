@@ -17,7 +17,7 @@ import e2e_args
 from loguru import logger as LOG
 
 
-@reqs.supports_methods("getReceipt", "verifyReceipt", "LOG_get")
+@reqs.supports_methods("getReceipt", "getReceipts", "verifyReceipt", "LOG_get")
 @reqs.at_least_n_nodes(2)
 def test(network, args, notifications_queue=None):
     LOG.info("Running transactions against logging app")
@@ -43,6 +43,16 @@ def test(network, args, notifications_queue=None):
             invalid[-3] += 1
             check(c.rpc("verifyReceipt", {"receipt": invalid}), result={"valid": False})
 
+            LOG.info("Get receipts for a range of commits")
+            commit = r.commit
+            rs = c.rpc("getReceipts", {"from": commit - 2, "to": commit})
+            assert len(rs.result["receipts"]) == 3
+            for receipt in rs.result["receipts"]:
+                check(
+                    c.rpc("verifyReceipt", {"receipt": receipt}),
+                    result={"valid": True},
+                )
+
     return network
 
 